@@ -0,0 +1,262 @@
+#!/usr/bin/env python3
+"""
+Throughput benchmark for the Chunked BLE Protocol
+Runs a matrix of payload sizes, MTU caps, flow control and compression settings in both
+directions against the benchmark firmware (pio run -e esp32-c3-devkitm-1-bench -t upload)
+"""
+
+import argparse
+import asyncio
+import csv
+import json
+import os
+import statistics
+import sys
+import time
+from typing import List, Optional
+from bleak import BleakScanner, BleakClient
+from chunked_ble_protocol import ChunkedBLEProtocol
+
+DEFAULT_DEVICE_NAME = "BLE-Chunked-Bench"
+DEFAULT_SIZES = [1, 16, 128, 1024, 8 * 1024, 32 * 1024, ChunkedBLEProtocol.MAX_TOTAL_DATA_SIZE]
+RECEIVE_TIMEOUT = 120.0  # Seconds for the largest payload over the slowest link
+
+RESULT_FIELDS = ['direction', 'size', 'payload', 'flow', 'compression', 'mtu', 'repeat', 'ok',
+                 'goodput', 'chunk_p50_ms', 'chunk_p90_ms', 'chunk_p99_ms', 'device_goodput',
+                 'retransmissions', 'device_cpu_us', 'min_free_heap']
+
+
+class QuietProtocol(ChunkedBLEProtocol):
+    """Protocol without per-chunk console output, which would dominate the timings"""
+
+    def _log(self, message: str) -> None:
+        if message.startswith('[ERROR]'):
+            print(message)
+
+
+def make_payload(size: int, kind: str) -> bytes:
+    """
+    Build a payload like the firmware does
+
+    Args:
+        size: Payload length in bytes
+        kind: 'text' for compressible JSON records, 'random' for incompressible bytes
+    """
+    if kind == 'random':
+        return os.urandom(size)
+    records = []
+    length = 0
+    record_id = 0
+    while length < size:
+        record = f'{{"id":{record_id},"temp":{20 + record_id % 10}.{record_id % 7},"status":"ok"}},'
+        records.append(record)
+        length += len(record)
+        record_id += 1
+    return ''.join(records).encode()[:size]
+
+
+def percentile(values: List[float], fraction: float) -> float:
+    """Nearest-rank percentile, 0 for no values"""
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def device_cpu_us(before: Optional[dict], after: Optional[dict]) -> int:
+    """Device time spent in CRC32, reassembly and callbacks between two diagnostics reads"""
+    if not before or not after:
+        return 0
+    stages = ('crc_time_us', 'reassembly_time_us', 'callback_time_us')
+    return sum((after[stage] - before[stage]) & 0xFFFFFFFF for stage in stages)
+
+
+class Benchmark:
+    """
+    One connection per setting combination, every size and direction measured on it
+
+    Flow control and compression are negotiated in HELLO, so the client's settings select
+    the mode; the MTU cap only shrinks the client's frames (see set_max_mtu()).
+    """
+
+    def __init__(self, address: str, args: argparse.Namespace):
+        self.address = address
+        self.args = args
+        self.results: List[dict] = []
+        self._chunk_times: List[float] = []
+
+    def _on_progress(self, current: int, total: int, is_receiving: bool) -> None:
+        self._chunk_times.append(time.perf_counter())
+
+    def _chunk_latencies_ms(self) -> List[float]:
+        """Time between consecutive chunks of the last transfer"""
+        times = self._chunk_times
+        return [(later - earlier) * 1000.0 for earlier, later in zip(times, times[1:])]
+
+    async def run_combination(self, flow: bool, compression: bool, mtu: Optional[int]) -> None:
+        """Connect with one setting combination and measure every size in both directions"""
+        client = BleakClient(self.address)
+        await client.connect()
+        try:
+            protocol = QuietProtocol(client)
+            protocol.set_flow_control(flow)
+            protocol.set_compression(compression)
+            if mtu:
+                protocol.set_max_mtu(mtu)
+            protocol.set_progress_callback(self._on_progress)
+            if not await protocol.initialize():
+                print("[ERROR] Protocol initialization failed")
+                return
+
+            await protocol.send_data(b"BENCH RESET")
+            label = (f"flow={'credits' if flow else 'none'} compression={'on' if compression else 'off'} "
+                     f"mtu={mtu or protocol.get_negotiated_mtu()}")
+            print(f"[BENCH] {label}")
+
+            for size in self.args.sizes:
+                for direction in self.args.directions:
+                    for repeat in range(self.args.repeat):
+                        result = await self._measure(protocol, direction, size)
+                        result.update(flow='credits' if flow else 'none', compression=compression,
+                                      mtu=mtu or protocol.get_negotiated_mtu(), repeat=repeat)
+                        self.results.append(result)
+                        self._print_result(result)
+
+            # Heap high-water of the whole combination
+            stats = await self._device_stats(protocol)
+            min_free_heap = stats.get('min_free_heap', 0) if stats else 0
+            for result in self.results:
+                if result['min_free_heap'] is None:
+                    result['min_free_heap'] = min_free_heap
+            print(f"[BENCH] Device heap: {stats}")
+        finally:
+            await client.disconnect()
+
+    async def _measure(self, protocol: ChunkedBLEProtocol, direction: str, size: int) -> dict:
+        """Time one transfer and collect the device's view of it"""
+        kind = self.args.payload
+        before = await protocol.read_diagnostics()
+
+        if direction == 'up':
+            payload = make_payload(size, kind)
+            self._chunk_times = []
+            start = time.perf_counter()
+            ok = await protocol.send_data(payload)
+            elapsed = time.perf_counter() - start
+        else:
+            await protocol.send_data(f"BENCH SEND {size} {kind}".encode())
+            self._chunk_times = []
+            start = time.perf_counter()
+            data = await protocol.receive_data(timeout=RECEIVE_TIMEOUT)
+            elapsed = time.perf_counter() - start
+            ok = data is not None and len(data) == size
+
+        after = await protocol.read_diagnostics()
+        record = (after or {}).get('last_received' if direction == 'up' else 'last_sent', {})
+        latencies = self._chunk_latencies_ms()
+        retransmissions = ((after['retransmissions'] - before['retransmissions']) & 0xFFFFFFFF
+                           if before and after else 0)
+        return {
+            'direction': direction,
+            'size': size,
+            'payload': kind,
+            'ok': ok,
+            'goodput': size / elapsed if ok and elapsed > 0 else 0.0,
+            'chunk_p50_ms': percentile(latencies, 0.50),
+            'chunk_p90_ms': percentile(latencies, 0.90),
+            'chunk_p99_ms': percentile(latencies, 0.99),
+            'device_goodput': record.get('bytes_per_second', 0),
+            'retransmissions': retransmissions,
+            'device_cpu_us': device_cpu_us(before, after),
+            'min_free_heap': None
+        }
+
+    async def _device_stats(self, protocol: ChunkedBLEProtocol) -> Optional[dict]:
+        """Ask the firmware for its heap and counters"""
+        await protocol.send_data(b"BENCH STATS")
+        reply = await protocol.receive_data(timeout=10.0)
+        try:
+            return json.loads(reply.decode('utf-8')) if reply else None
+        except (UnicodeDecodeError, json.JSONDecodeError):
+            return None
+
+    @staticmethod
+    def _print_result(result: dict) -> None:
+        status = "ok" if result['ok'] else "FAILED"
+        print(f"[RESULT] {result['direction']:>4} {result['size']:>6} B: {result['goodput']:9.0f} B/s "
+              f"(device {result['device_goodput']:>7} B/s), chunk p50/p90/p99 "
+              f"{result['chunk_p50_ms']:.1f}/{result['chunk_p90_ms']:.1f}/{result['chunk_p99_ms']:.1f} ms, "
+              f"{result['retransmissions']} retransmitted, device CPU {result['device_cpu_us']} us - {status}")
+
+    def print_summary(self) -> None:
+        """Median goodput per direction and size over all combinations"""
+        print("\n=== Summary (median goodput, B/s) ===")
+        for direction in self.args.directions:
+            for size in self.args.sizes:
+                rates = [r['goodput'] for r in self.results
+                         if r['direction'] == direction and r['size'] == size and r['ok']]
+                if rates:
+                    print(f"{direction:>4} {size:>6} B: {statistics.median(rates):9.0f}  ({len(rates)} runs)")
+
+    def write_csv(self, path: str) -> None:
+        with open(path, 'w', newline='') as f:
+            writer = csv.DictWriter(f, fieldnames=RESULT_FIELDS)
+            writer.writeheader()
+            writer.writerows(self.results)
+        print(f"[BENCH] {len(self.results)} results written to {path}")
+
+
+async def find_device(name: str) -> Optional[str]:
+    """Scan for the benchmark firmware and return its address"""
+    print(f"[SCAN] Scanning for {name}...")
+    device = await BleakScanner.find_device_by_name(name, timeout=10.0)
+    if not device:
+        print(f"[ERROR] Device '{name}' not found")
+        return None
+    print(f"[SCAN] Found {name} at {device.address}")
+    return device.address
+
+
+def parse_list(value: str, convert=str) -> list:
+    return [convert(item) for item in value.split(',') if item]
+
+
+async def main() -> int:
+    parser = argparse.ArgumentParser(description="Chunked BLE Protocol throughput benchmark")
+    parser.add_argument('--device', default=DEFAULT_DEVICE_NAME, help="advertised name of the benchmark firmware")
+    parser.add_argument('--sizes', type=lambda v: parse_list(v, int), default=DEFAULT_SIZES,
+                        help="payload sizes in bytes, comma-separated")
+    parser.add_argument('--directions', type=parse_list, default=['up', 'down'],
+                        help="up (client to device), down (device to client)")
+    parser.add_argument('--flow', type=parse_list, default=['credits', 'none'], help="credits, none")
+    parser.add_argument('--compression', type=parse_list, default=['on', 'off'], help="on, off")
+    parser.add_argument('--mtus', type=lambda v: parse_list(v, int), default=[0],
+                        help="MTU caps for the client's frames, 0 = negotiated")
+    parser.add_argument('--payload', choices=['text', 'random'], default='text',
+                        help="compressible JSON records or random bytes")
+    parser.add_argument('--repeat', type=int, default=3, help="runs per size and direction")
+    parser.add_argument('--csv', help="write every run to this CSV file")
+    args = parser.parse_args()
+
+    address = await find_device(args.device)
+    if not address:
+        return 1
+
+    benchmark = Benchmark(address, args)
+    for flow in args.flow:
+        for compression in args.compression:
+            for mtu in args.mtus:
+                await benchmark.run_combination(flow == 'credits', compression == 'on', mtu or None)
+
+    benchmark.print_summary()
+    if args.csv:
+        benchmark.write_csv(args.csv)
+    return 0 if all(r['ok'] for r in benchmark.results) else 2
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(asyncio.run(main()))
+    except KeyboardInterrupt:
+        print("\n[INTERRUPTED] Benchmark cancelled by user")
+        sys.exit(130)
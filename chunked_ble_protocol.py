@@ -5,9 +5,13 @@ Enhanced with CRC32 validation, security limits, and timeouts
 """
 
 import asyncio
+import base64
+import json
+import math
 import struct
 import time
 import zlib  # For CRC32 calculation
+from collections import deque
 from typing import Callable, Optional, List
 from bleak import BleakClient
 from bleak.backends.characteristic import BleakGATTCharacteristic
@@ -15,6 +19,466 @@ from bleak.backends.characteristic import BleakGATTCharacteristic
 # Default configuration - matching ESP32 UUIDs
 DEFAULT_SERVICE_UUID = "5b18eb9b-747f-47da-b7b0-a4e503f9a00f"
 DEFAULT_CHAR_UUID = "8f8b49a2-9117-4e9f-acfc-fda4d0db7408"
+DEFAULT_DIAGNOSTICS_UUID = "3f4c2d91-6b0e-4a57-9d18-c2e7a5b04f63"
+
+# LZSS stream format shared with the ESP32 (src/LZSS.h):
+# original_length(4), then groups of a flag byte and up to 8 tokens; flag bit i (LSB first)
+# clear = literal byte, set = reference(2) = (distance - 1) << 5 | (length - 3)
+LZSS_WINDOW_SIZE = 2048
+LZSS_MIN_MATCH = 3
+LZSS_MAX_MATCH = 34
+LZSS_MAX_CHAIN = 16
+
+
+def lzss_compress(data: bytes) -> Optional[bytes]:
+    """
+    Compress data in the LZSS format the ESP32 inflates
+    
+    Returns:
+        Compressed stream, or None if it would not be smaller than the data
+    """
+    length = len(data)
+    if length <= 4:
+        return None
+    out = bytearray(struct.pack('<I', length))
+    head = {}                          # 3-byte prefix -> latest position
+    prev = [-1] * LZSS_WINDOW_SIZE     # Older position with the same prefix, per window slot
+    flag_position = 0
+    flag_bit = 8
+    position = 0
+    while position < length:
+        if flag_bit == 8:
+            flag_position = len(out)
+            out.append(0)
+            flag_bit = 0
+        
+        # Longest match in the window, nearest first on ties
+        best_length = 0
+        best_distance = 0
+        max_length = min(LZSS_MAX_MATCH, length - position)
+        if max_length >= LZSS_MIN_MATCH:
+            candidate = head.get(data[position:position + LZSS_MIN_MATCH], -1)
+            chain = 0
+            while candidate >= 0 and position - candidate <= LZSS_WINDOW_SIZE and chain < LZSS_MAX_CHAIN:
+                matched = LZSS_MIN_MATCH
+                while matched < max_length and data[candidate + matched] == data[position + matched]:
+                    matched += 1
+                if matched > best_length:
+                    best_length, best_distance = matched, position - candidate
+                    if matched == max_length:
+                        break
+                candidate = prev[candidate % LZSS_WINDOW_SIZE]
+                chain += 1
+        
+        if best_length >= LZSS_MIN_MATCH:
+            out[flag_position] |= 1 << flag_bit
+            out += struct.pack('<H', ((best_distance - 1) << 5) | (best_length - LZSS_MIN_MATCH))
+            step = best_length
+        else:
+            out.append(data[position])
+            step = 1
+        flag_bit += 1
+        
+        # Incompressible data - stop before spending more time on it
+        if len(out) >= length:
+            return None
+        
+        # Every position passed over becomes a match candidate
+        for passed in range(position, min(position + step, length - LZSS_MIN_MATCH + 1)):
+            key = data[passed:passed + LZSS_MIN_MATCH]
+            prev[passed % LZSS_WINDOW_SIZE] = head.get(key, -1)
+            head[key] = passed
+        position += step
+    return bytes(out)
+
+
+def lzss_decompress(data: bytes, max_length: int) -> Optional[bytes]:
+    """
+    Decompress an LZSS stream
+    
+    Returns:
+        Original data, or None if the stream is corrupt, truncated or longer than max_length
+    """
+    if len(data) < 4:
+        return None
+    expected, = struct.unpack('<I', data[:4])
+    if expected > max_length:
+        return None
+    out = bytearray()
+    position = 4
+    end = len(data)
+    while len(out) < expected:
+        if position >= end:
+            return None
+        flags = data[position]
+        position += 1
+        for bit in range(8):
+            if len(out) == expected:
+                break
+            if not flags & (1 << bit):
+                if position >= end:
+                    return None
+                out.append(data[position])
+                position += 1
+                continue
+            if position + 2 > end:
+                return None
+            token = data[position] | (data[position + 1] << 8)
+            position += 2
+            distance = (token >> 5) + 1
+            match_length = (token & 0x1F) + LZSS_MIN_MATCH
+            if distance > len(out) or match_length > expected - len(out):
+                return None
+            start = len(out) - distance
+            if distance >= match_length:
+                out += out[start:start + match_length]
+            else:
+                for i in range(match_length):
+                    out.append(out[start + i])
+    if position != end:
+        return None  # Nothing may follow the last token
+    return bytes(out)
+
+
+# Delta patch format shared with the ESP32 (src/Delta.h), varints are LEB128:
+# result_length, then instructions: n even = insert the n >> 1 bytes that follow,
+# n odd = copy (n >> 1) + DELTA_MIN_COPY base bytes from cursor + zigzag varint offset,
+# cursor being where the previous copy ended
+DELTA_MIN_COPY = 6
+DELTA_HASH_BYTES = 4
+
+
+def _append_varint(out: bytearray, value: int) -> None:
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
+def _read_varint(data: bytes, position: int) -> tuple:
+    """Returns (value, next position), raises ValueError when truncated"""
+    value = 0
+    for i in range(10):
+        if position >= len(data):
+            break
+        byte = data[position]
+        position += 1
+        value |= (byte & 0x7F) << (7 * i)
+        if not byte & 0x80:
+            return value, position
+    raise ValueError("Delta varint is truncated or too long")
+
+
+def delta_encode(base: bytes, data: bytes) -> Optional[bytes]:
+    """
+    Encode data as a patch against base, in the format the ESP32 applies
+    
+    Returns:
+        Patch, or None if it would not be smaller than the data
+    """
+    length = len(data)
+    if len(base) < DELTA_MIN_COPY or length < DELTA_MIN_COPY:
+        return None
+    out = bytearray()
+    _append_varint(out, length)
+    
+    # Latest base position of every 4-byte prefix
+    index = {}
+    for i in range(len(base) - DELTA_HASH_BYTES + 1):
+        index[base[i:i + DELTA_HASH_BYTES]] = i
+    
+    def insert(start: int, end: int) -> None:
+        if end > start:
+            _append_varint(out, (end - start) << 1)
+            out.extend(data[start:end])
+    
+    cursor = 0          # End of the last copy in the base
+    literal_start = 0   # First data byte not covered by an instruction yet
+    position = 0
+    while position + DELTA_MIN_COPY <= length and len(out) < length:
+        # The stretch after the last copy, then whatever the index holds for these bytes
+        best_length = 0
+        best_offset = 0
+        for candidate in (cursor + position - literal_start, index.get(data[position:position + DELTA_HASH_BYTES])):
+            if candidate is None or candidate + DELTA_MIN_COPY > len(base):
+                continue
+            limit = min(len(base) - candidate, length - position)
+            matched = 0
+            while matched < limit and base[candidate + matched] == data[position + matched]:
+                matched += 1
+            if matched > best_length:
+                best_length, best_offset = matched, candidate
+        if best_length < DELTA_MIN_COPY:
+            position += 1
+            continue
+        
+        # The match may start a little earlier, inside the bytes still to be inserted
+        while position > literal_start and best_offset > 0 and base[best_offset - 1] == data[position - 1]:
+            position -= 1
+            best_offset -= 1
+            best_length += 1
+        insert(literal_start, position)
+        offset = best_offset - cursor
+        _append_varint(out, ((best_length - DELTA_MIN_COPY) << 1) | 1)
+        _append_varint(out, (offset << 1) if offset >= 0 else ((-offset << 1) - 1))
+        cursor = best_offset + best_length
+        position += best_length
+        literal_start = position
+    insert(literal_start, length)
+    return bytes(out) if len(out) < length else None
+
+
+def delta_apply(base: bytes, patch: bytes, max_length: int) -> Optional[bytes]:
+    """
+    Rebuild a payload from its base and a patch
+    
+    Returns:
+        Rebuilt payload, or None if the patch is corrupt, reaches outside the base or is too large
+    """
+    try:
+        result_length, position = _read_varint(patch, 0)
+        if result_length > max_length:
+            return None
+        out = bytearray()
+        cursor = 0
+        while len(out) < result_length:
+            instruction, position = _read_varint(patch, position)
+            count = instruction >> 1
+            room = result_length - len(out)
+            if not instruction & 1:
+                if count == 0 or count > room or position + count > len(patch):
+                    return None
+                out += patch[position:position + count]
+                position += count
+                continue
+            zigzag, position = _read_varint(patch, position)
+            count += DELTA_MIN_COPY
+            start = cursor + ((zigzag >> 1) ^ -(zigzag & 1))
+            if count > room or start < 0 or start + count > len(base):
+                return None
+            out += base[start:start + count]
+            cursor = start + count
+    except ValueError:
+        return None
+    if position != len(patch):
+        return None  # Nothing may follow the last instruction
+    return bytes(out)
+
+
+# CBOR (RFC 8949) as the ESP32 reads and writes it (src/CBOR.h): definite lengths,
+# the shortest integer and float forms, at most CBOR_MAX_DEPTH nested arrays and maps
+CBOR_MAX_DEPTH = 16
+_CBOR_BREAK = object()  # Stop code of an indefinite-length item
+
+
+def _cbor_head(out: bytearray, major: int, value: int) -> None:
+    """Append an initial byte and the shortest argument for value"""
+    if value < 24:
+        out.append(major << 5 | value)
+    elif value <= 0xFF:
+        out += struct.pack('<BB', major << 5 | 24, value)
+    elif value <= 0xFFFF:
+        out += struct.pack('>BH', major << 5 | 25, value)
+    elif value <= 0xFFFFFFFF:
+        out += struct.pack('>BI', major << 5 | 26, value)
+    else:
+        out += struct.pack('>BQ', major << 5 | 27, value)
+
+
+def _cbor_float(out: bytearray, value: float) -> None:
+    """Append a float in the shortest precision that keeps it"""
+    for code, fmt in ((25, '>e'), (26, '>f')):
+        try:
+            packed = struct.pack(fmt, value)
+        except OverflowError:
+            continue
+        if struct.unpack(fmt, packed)[0] == value or math.isnan(value):
+            out.append(0xE0 | code)
+            out += packed
+            return
+    out.append(0xFB)
+    out += struct.pack('>d', value)
+
+
+def _cbor_encode_item(out: bytearray, obj, depth: int) -> None:
+    """Append one item (internal to cbor_encode)"""
+    if obj is None:
+        out.append(0xF6)
+    elif obj is True or obj is False:
+        out.append(0xF5 if obj else 0xF4)
+    elif isinstance(obj, int):
+        if 0 <= obj <= 0xFFFFFFFFFFFFFFFF:
+            _cbor_head(out, 0, obj)
+        elif -0x10000000000000000 <= obj < 0:
+            _cbor_head(out, 1, -1 - obj)
+        else:
+            _cbor_float(out, float(obj))
+    elif isinstance(obj, float):
+        _cbor_float(out, obj)
+    elif isinstance(obj, str):
+        encoded = obj.encode('utf-8')
+        _cbor_head(out, 3, len(encoded))
+        out += encoded
+    elif isinstance(obj, (bytes, bytearray, memoryview)):
+        _cbor_head(out, 2, len(obj))
+        out += obj
+    elif isinstance(obj, (list, tuple, dict)):
+        if depth >= CBOR_MAX_DEPTH:
+            raise ValueError(f"CBOR nests deeper than {CBOR_MAX_DEPTH} levels")
+        if isinstance(obj, dict):
+            _cbor_head(out, 5, len(obj))
+            for key, value in obj.items():
+                _cbor_encode_item(out, key, depth + 1)
+                _cbor_encode_item(out, value, depth + 1)
+        else:
+            _cbor_head(out, 4, len(obj))
+            for value in obj:
+                _cbor_encode_item(out, value, depth + 1)
+    else:
+        raise TypeError(f"Cannot encode {type(obj).__name__} as CBOR")
+
+
+def cbor_encode(obj) -> bytes:
+    """
+    Encode a JSON-like value (dict, list, str, bytes, int, float, bool, None) as CBOR
+    
+    Raises:
+        TypeError, ValueError: The value has other types or nests too deep
+    """
+    out = bytearray()
+    _cbor_encode_item(out, obj, 0)
+    return bytes(out)
+
+
+def _cbor_decode_item(data: bytes, position: int, depth: int):
+    """Decode the item at position, returns (value, next position); _CBOR_BREAK for a break (internal)"""
+    # Tags are dropped - a run of them is skipped in a loop, so it costs no recursion depth
+    while data[position] >> 5 == 6:
+        info = data[position] & 0x1F
+        if info > 27:
+            raise ValueError("CBOR has a reserved argument encoding")
+        position += 1 + (1 << (info - 24) if info >= 24 else 0)
+    
+    initial = data[position]
+    position += 1
+    major, info = initial >> 5, initial & 0x1F
+    if major == 7:
+        if info == 31:
+            return _CBOR_BREAK, position
+        if info in (25, 26, 27):
+            fmt, size = {25: ('>e', 2), 26: ('>f', 4), 27: ('>d', 8)}[info]
+            if position + size > len(data):
+                raise ValueError("CBOR is truncated")
+            return struct.unpack(fmt, data[position:position + size])[0], position + size
+        if info == 24:
+            if position >= len(data):
+                raise ValueError("CBOR is truncated")
+            info = data[position]
+            position += 1
+            if info < 32:
+                raise ValueError("CBOR simple value is not well-formed")
+        elif info > 24:
+            raise ValueError("CBOR has a reserved simple value encoding")
+        return {20: False, 21: True}.get(info), position  # null, undefined and others become None
+    
+    # Argument
+    indefinite = info == 31
+    if info < 24:
+        value = info
+    elif info <= 27:
+        size = 1 << (info - 24)
+        if position + size > len(data):
+            raise ValueError("CBOR is truncated")
+        value = int.from_bytes(data[position:position + size], 'big')
+        position += size
+    elif indefinite and major in (2, 3, 4, 5):
+        value = 0
+    else:
+        raise ValueError("CBOR has a reserved argument encoding")
+    
+    if major == 0:
+        return value, position
+    if major == 1:
+        return -1 - value, position
+    if major in (2, 3):
+        if indefinite:
+            pieces = []
+            while True:
+                if position >= len(data):
+                    raise ValueError("CBOR is truncated")
+                if data[position] == 0xFF:
+                    position += 1
+                    break
+                if data[position] >> 5 != major or data[position] & 0x1F == 31:
+                    raise ValueError("CBOR string chunk has the wrong type")
+                piece, position = _cbor_decode_item(data, position, depth)
+                pieces.append(piece.encode('utf-8') if major == 3 else piece)
+            raw = b''.join(pieces)
+        else:
+            if position + value > len(data):
+                raise ValueError("CBOR is truncated")
+            raw = bytes(data[position:position + value])
+            position += value
+        return (raw.decode('utf-8') if major == 3 else raw), position
+    
+    # Array or map
+    if depth >= CBOR_MAX_DEPTH:
+        raise ValueError(f"CBOR nests deeper than {CBOR_MAX_DEPTH} levels")
+    items = []
+    while indefinite or len(items) < value * (2 if major == 5 else 1):
+        if position >= len(data):
+            raise ValueError("CBOR is truncated")
+        item, position = _cbor_decode_item(data, position, depth + 1)
+        if item is _CBOR_BREAK:
+            if not indefinite or (major == 5 and len(items) % 2):
+                raise ValueError("CBOR has an unexpected break")
+            break
+        items.append(item)
+    if major == 4:
+        return items, position
+    keys = items[0::2]
+    if any(isinstance(key, (bytes, list, dict)) for key in keys):
+        raise ValueError("CBOR map key is no text, number or simple value")
+    return dict(zip(keys, items[1::2])), position
+
+
+def cbor_decode(data: bytes):
+    """
+    Decode one CBOR item; byte strings stay bytes, tags are dropped, undefined becomes None
+    
+    Raises:
+        ValueError: The encoding is malformed, truncated or followed by more data
+    """
+    try:
+        value, position = _cbor_decode_item(data, 0, 0)
+    except (IndexError, UnicodeDecodeError, RecursionError) as e:
+        raise ValueError(f"CBOR is malformed: {e}")
+    if value is _CBOR_BREAK or position != len(data):
+        raise ValueError("CBOR is followed by more data")
+    return value
+
+
+def _json_value(obj):
+    """Map a decoded CBOR value onto JSON types like the ESP32's CBOR::toJSON() (internal)"""
+    if isinstance(obj, bytes):
+        return base64.urlsafe_b64encode(obj).rstrip(b'=').decode('ascii')
+    if isinstance(obj, float) and not math.isfinite(obj):
+        return None
+    if isinstance(obj, list):
+        return [_json_value(item) for item in obj]
+    if isinstance(obj, dict):
+        return {key: _json_value(value) for key, value in obj.items()}
+    return obj
+
+
+def cbor_to_json(data: bytes) -> bytes:
+    """
+    Convert CBOR to compact JSON text (UTF-8); byte strings become base64url text
+    
+    Raises:
+        ValueError: The encoding is malformed
+    """
+    return json.dumps(_json_value(cbor_decode(data)), ensure_ascii=False, separators=(',', ':')).encode('utf-8')
 
 
 class ChunkedBLEProtocol:
@@ -26,8 +490,32 @@ class ChunkedBLEProtocol:
     - Security limits (max 64KB transfers)
     - Transfer timeouts (configurable chunk timeout)
     - Enhanced statistics and diagnostics
+    - Credit-based flow control negotiated with a HELLO handshake
+    - Selective retransmission: receiver reports missing chunks (ACK/NACK bitmap)
+    
+    Header format (14 bytes): chunk_num(2) + total_chunks(2) + data_size(2) + chunk_crc32(4) + global_crc32(4)
+    Chunk size follows the negotiated ATT MTU: MTU - 3 (ATT header) - 14 (chunk header)
+    Control frames start with chunk_num 0: marker(2) + type(1) + payload
+    
+    Large transfers (both sides announce FEATURE_LARGE): an OPEN control frame carries
+    transfer_id(2) + global_crc32(4) + total_length(4) + chunk_size(2) + flags(1), then every chunk
+    has a 10-byte header: transfer_id(2) + chunk_num(4) + chunk_crc32(4), or with FEATURE_COMPACT
+    chunk_num(2) + chunk_crc32(4), or just chunk_num(2) when chunk CRC32s are off
+    
+    Resumable transfers (FEATURE_RESUME): a large transfer cut off by a disconnect is kept
+    for a grace period; RESUME (same layout as OPEN) is answered with RESUME_POINT and the
+    sender continues from there
     
-    Header format (13 bytes): chunk_num(2) + total_chunks(2) + data_size(1) + chunk_crc32(4) + global_crc32(4)
+    Compression (FEATURE_COMPRESSION): payloads are LZSS-compressed ahead of chunking and
+    flagged in OPEN; length and CRC32s then describe the compressed stream
+    
+    Forward error correction (FEATURE_EXT_FEC, in the extended HELLO byte): OPEN_FLAG_FEC adds
+    fec_group(1) to OPEN, and an XOR parity chunk numbered total_chunks + g + 1 follows every
+    group g of fec_group chunks; a receiver that lost one chunk of a group rebuilds it
+    
+    Content types (FEATURE_EXT_CONTENT_TYPE): OPEN_FLAG_CONTENT_TYPE adds content_type(1) to
+    OPEN, after fec_group; send_json() sends CBOR to devices that announce it, and CBOR from the
+    device is handed to the callbacks as JSON text unless set_cbor_decoding(False)
     
     Usage (C++-like API):
         protocol = ChunkedBLEProtocol(ble_client)
@@ -38,16 +526,90 @@ class ChunkedBLEProtocol:
     """
     
     # Enhanced protocol constants
-    CHUNK_SIZE = 172       # Data size per chunk (185 - 13 bytes header)
-    HEADER_SIZE = 13       # Enhanced header: chunk_num(2) + total_chunks(2) + data_size(1) + chunk_crc32(4) + global_crc32(4)
-    MTU_SIZE = 185         # Maximum transmission unit
+    HEADER_SIZE = 14       # Enhanced header: chunk_num(2) + total_chunks(2) + data_size(2) + chunk_crc32(4) + global_crc32(4)
+    ATT_HEADER_SIZE = 3    # ATT opcode(1) + attribute handle(2) in every write/notify
+    DEFAULT_MTU_SIZE = 23  # ATT MTU before (or without) MTU exchange
+    PREFERRED_MTU_SIZE = 517  # Largest ATT MTU the ESP32 offers
+    MAX_CHUNK_SIZE = PREFERRED_MTU_SIZE - ATT_HEADER_SIZE - HEADER_SIZE  # 500 bytes
+    LARGE_HEADER_SIZE = 10  # Large transfers: transfer_id(2) + chunk_num(4) + chunk_crc32(4)
+    COMPACT_HEADER_SIZE = 6  # Compact frames: chunk_num(2) + chunk_crc32(4)
+    COMPACT_HEADER_SIZE_NO_CRC = 2  # Compact frames without chunk CRC32: chunk_num(2)
+    MAX_COMPACT_CHUNKS = 0xFFFF  # Larger transfers fall back to the 10-byte header
     
     # Security and reliability limits
-    MAX_TOTAL_DATA_SIZE = 64 * 1024    # 64KB max transfer
+    MAX_TOTAL_DATA_SIZE = 64 * 1024    # Default receive limit (see set_transfer_limits)
     MAX_CHUNKS_PER_TRANSFER = 365      # ~64KB / 172 bytes
+    MAX_STREAM_CHUNKS = 0xFFFF         # Streaming receivers are limited only by 16-bit chunk numbers
     DEFAULT_CHUNK_TIMEOUT = 60.0        # Default 5 seconds per chunk timeout
+    
+    # Flow control (matches ESP32 FrameType / FeatureFlags)
+    PROTOCOL_VERSION = 2
+    FRAME_HELLO = 0x01     # version(1) + features(1) + window(2) [+ extended_features(1)]
+    FRAME_CREDIT = 0x02    # credits(2)
+    FRAME_ACK = 0x03       # global_crc32(4) + status(1)
+    FRAME_NACK = 0x04      # global_crc32(4) + base(2) + bitmap (bit i = chunk base + i missing)
+    FRAME_OPEN = 0x05      # transfer_id(2) + global_crc32(4) + total_length(4) + chunk_size(2)
+    FRAME_NACK_LARGE = 0x06  # global_crc32(4) + base(4) + bitmap
+    FRAME_RESUME = 0x07    # Same payload as OPEN, asks where an interrupted transfer continues
+    FRAME_RESUME_POINT = 0x08  # transfer_id(2) + global_crc32(4) + next_chunk(4)
+    FRAME_TRANSPORT = 0x09  # transport(1) + psm(2) + mtu(2), offer of an L2CAP CoC
+    FEATURE_CREDITS = 0x01
+    FEATURE_SACK = 0x02
+    FEATURE_STREAMING = 0x04  # Device streams received data instead of buffering it
+    FEATURE_LARGE = 0x08      # OPEN frame + 32-bit chunk numbers
+    FEATURE_RESUME = 0x10     # Interrupted large transfers survive a disconnect
+    FEATURE_COMPACT = 0x20    # Compact data frames after OPEN
+    FEATURE_COMPRESSION = 0x40  # LZSS payloads (OPEN_FLAG_COMPRESSED)
+    FEATURE_EXT_FEC = 0x01    # Extended features: parity chunks are used to rebuild lost ones
+    FEATURE_EXT_CONTENT_TYPE = 0x02  # Extended features: content type of OPEN is read
+    FEATURE_EXT_DELTA = 0x04  # Extended features: the last payload is kept as a delta base
+    
+    # OPEN flags - framing of the data frames that follow
+    OPEN_FLAG_COMPACT = 0x01       # chunk_num(2) [+ chunk_crc32(4)]
+    OPEN_FLAG_NO_CHUNK_CRC = 0x02  # No chunk CRC32, only the global CRC32 is checked
+    OPEN_FLAG_COMPRESSED = 0x04    # Payload is an LZSS stream
+    OPEN_FLAG_FEC = 0x40           # fec_group(1) follows OPEN, parity chunks follow the data chunks
+    OPEN_FLAG_CONTENT_TYPE = 0x80  # content_type(1) follows OPEN (after fec_group)
+    
+    # Content types announced with OPEN_FLAG_CONTENT_TYPE
+    CONTENT_TYPE_NONE = 0  # Application-defined bytes
+    CONTENT_TYPE_JSON = 1  # UTF-8 JSON text
+    CONTENT_TYPE_CBOR = 2  # RFC 8949 CBOR
+    CONTENT_FLAG_DELTA = 0x80  # In content_type: patch payload, base_crc32(4) + result_crc32(4) follow
+    
+    # Compression
+    MIN_COMPRESSION_SIZE = 64  # Smaller payloads are sent as they are
+    
+    # Forward error correction
+    DEFAULT_FEC_GROUP_SIZE = 8  # Data chunks per parity chunk, 12.5% overhead
+    
+    # Delta transfers
+    DEFAULT_MAX_DELTA_BASE_SIZE = 16 * 1024  # Largest payload kept as a base, per direction
+    
+    # Diagnostics characteristic (DiagnosticsValue in ChunkedBLEProtocol.h)
+    DIAGNOSTICS_VERSION = 2
+    DIAGNOSTICS_FORMAT = '<BI19I8I8IHHBB'
+    DIAGNOSTICS_TRANSFER_FORMAT = '<IIIIIIHHBBB'
+    DIAGNOSTICS_COUNTERS = ('total_data_sent', 'total_data_received', 'chunks_sent', 'chunks_received',
+                            'transfers_completed', 'retransmissions', 'crc_errors', 'timeouts',
+                            'size_rejections', 'cancellations', 'send_failures', 'rx_dropped',
+                            'compression_saved', 'crc_time_us', 'reassembly_time_us', 'callback_time_us',
+                            'parity_sent', 'fec_recovered', 'delta_saved')
+    
+    # Resumable transfers
+    DEFAULT_RESUME_GRACE = 30.0  # Seconds an interrupted transfer is kept
+    ACK_STATUS_OK = 0
+    ACK_STATUS_GLOBAL_CRC_FAILED = 1
+    ACK_STATUS_REJECTED = 2
+    ACK_STATUS_DELTA_BASE_MISSING = 3  # Delta against a payload the receiver does not hold
+    DEFAULT_CREDIT_WINDOW = 8
+    DEFAULT_PIPELINE_DEPTH = 8  # Write commands handed to the stack before waiting for the oldest
+    DEFAULT_MAX_RETRANSMIT_ROUNDS = 8
+    MAX_NACK_BITMAP_BYTES = 32
+    HELLO_TIMEOUT = 2.0    # Seconds to wait for the device's HELLO answer
 
-    def __init__(self, client: BleakClient, service_uuid: str = DEFAULT_SERVICE_UUID, char_uuid: str = DEFAULT_CHAR_UUID):
+    def __init__(self, client: BleakClient, service_uuid: str = DEFAULT_SERVICE_UUID, char_uuid: str = DEFAULT_CHAR_UUID,
+                 diagnostics_uuid: str = DEFAULT_DIAGNOSTICS_UUID):
         """
         Initialize the chunked BLE protocol (C++-like API)
         
@@ -55,17 +617,33 @@ class ChunkedBLEProtocol:
             client: Connected BleakClient instance
             service_uuid: Optional custom service UUID
             char_uuid: Optional custom characteristic UUID
+            diagnostics_uuid: Optional custom diagnostics characteristic UUID
         """
         self.client = client
         self.service_uuid = service_uuid
         self.char_uuid = char_uuid
+        self.diagnostics_uuid = diagnostics_uuid
         
         # Internal BLE components (hidden from user)
         self._characteristic: Optional[BleakGATTCharacteristic] = None
         self._notifications_enabled = False
+        self._write_without_response = True   # Data chunks as ATT write commands when possible
+        self._write_nr_supported = False      # Characteristic offers write-without-response
+        self._pipeline_depth = self.DEFAULT_PIPELINE_DEPTH
+        self._pending_writes: deque = deque()  # Write commands not completed yet, oldest first
+        self._log_prefix = ''
         
-        # Receive buffer management
-        self._received_chunks: List[Optional[bytes]] = []
+        # Negotiated link parameters (updated in initialize())
+        self._mtu = self.DEFAULT_MTU_SIZE
+        self._max_mtu = self.PREFERRED_MTU_SIZE  # Cap on the MTU used for our frames
+        self._frame_mtu = self._mtu              # MTU our frames are sized for, min(_mtu, _max_mtu)
+        self._chunk_size = self._mtu - self.ATT_HEADER_SIZE - self.HEADER_SIZE
+        
+        # Receive buffer management - one buffer per transfer, chunks written at their offsets
+        self._receive_buffer = bytearray()
+        self._received_bitmap = bytearray()  # Bit per chunk, set once its data is in the buffer
+        self._chunk_stride = 0               # Device's chunk size, taken from the first non-last chunk
+        self._receive_length = 0             # Payload length, known once the last chunk is stored
         self._expected_chunks = 0
         self._received_chunk_count = 0
         self._complete_data_event = asyncio.Event()
@@ -77,6 +655,59 @@ class ChunkedBLEProtocol:
         self._chunk_timeout = self.DEFAULT_CHUNK_TIMEOUT  # Configurable chunk timeout
         self._last_chunk_time = None  # Initialize to None
         self._expected_global_crc32 = None  # Expected global CRC32 from first chunk
+        self._max_data_size = self.MAX_TOTAL_DATA_SIZE
+        
+        # Large transfer state
+        self._open_transfer_id = 0   # Transfer opened by the device's last OPEN frame
+        self._open_flags = 0         # Framing of that transfer's data frames
+        self._compact_framing = True
+        self._compact_chunk_crc = True
+        self._compression = True
+        self._compressed_transfer = False  # Current receive carries OPEN_FLAG_COMPRESSED
+        self._next_transfer_id = 1   # Id for our next outbound large transfer
+        
+        # Forward error correction state
+        self._fec_group_size = 0     # Data chunks per parity chunk we send, 0 disables FEC
+        self._fec_group = 0          # Group size of the current receive, 0 without parity
+        self._parity_chunks: List[Optional[bytes]] = []  # Parity received per group
+        self._peer_extended_features = 0
+        
+        # Content type state
+        self._cbor_decoding = True
+        self._content_type = self.CONTENT_TYPE_NONE  # Content type of the current (or last) receive
+        
+        # Delta state - the last payload each way, kept while both ends announce FEATURE_EXT_DELTA
+        self._max_delta_base = 0     # 0 disables delta transfers
+        self._delta_base_crc32 = 0   # Base of the current receive, 0 unless it is a delta
+        self._delta_result_crc32 = 0
+        self._rx_base = b''
+        self._rx_base_crc32 = 0
+        self._tx_base = b''
+        self._tx_base_crc32 = 0
+        self._last_ack_status = self.ACK_STATUS_OK
+        
+        # Resumable transfer state
+        self._resume_grace = self.DEFAULT_RESUME_GRACE
+        self._suspended_transfer_id = 0  # Receive state kept across a disconnect, 0 if none
+        self._suspend_time = 0.0
+        self._interrupted_send: Optional[dict] = None  # Failed large send offered for resumption
+        
+        # Flow control state (negotiated in initialize())
+        self._flow_control_enabled = True
+        self._credit_window = self.DEFAULT_CREDIT_WINDOW
+        self._peer_features = 0
+        self._peer_window = 0
+        self._send_credits = asyncio.Semaphore(0)
+        self._credits_owed = 0
+        self._hello_event = asyncio.Event()
+        
+        # Selective retransmission state
+        self._retransmission_enabled = True
+        self._max_retransmit_rounds = self.DEFAULT_MAX_RETRANSMIT_ROUNDS
+        self._report_queue: asyncio.Queue = asyncio.Queue()
+        self._pending_reports: List[bytes] = []
+        self._report_point = 0
+        self._last_completed_crc32 = None
         
         # Security and statistics
         self._stats = {
@@ -85,7 +716,14 @@ class ChunkedBLEProtocol:
             'crc_errors': 0,
             'timeouts': 0,
             'successful_transfers': 0,
-            'last_transfer_time': 0.0
+            'last_transfer_time': 0.0,
+            'retransmissions': 0,
+            'compression_saved': 0,
+            'parity_sent': 0,
+            'fec_recovered': 0,
+            'delta_saved': 0,
+            'last_send_rate': 0.0,
+            'last_send_write_without_response': False
         }
         
         # Callbacks (C++-like delegates)
@@ -94,7 +732,7 @@ class ChunkedBLEProtocol:
         self._progress_callback: Optional[Callable[[int, int, bool], None]] = None
         
         self._log("[PROTOCOL] Enhanced ChunkedBLEProtocol initialized")
-        self._log(f"[PROTOCOL] MTU={self.MTU_SIZE}, Chunk size={self.CHUNK_SIZE} bytes, Header={self.HEADER_SIZE} bytes")
+        self._log(f"[PROTOCOL] Header={self.HEADER_SIZE} bytes, chunk size follows negotiated MTU (max {self.MAX_CHUNK_SIZE} bytes)")
         self._log(f"[SECURITY] Max data: {self.MAX_TOTAL_DATA_SIZE} bytes, Max chunks: {self.MAX_CHUNKS_PER_TRANSFER}")
         self._log(f"[CONFIG] Chunk timeout: {self._chunk_timeout}s (configurable)")
         self._log(f"[PROTOCOL] Service UUID: {self.service_uuid}")
@@ -134,10 +772,19 @@ class ChunkedBLEProtocol:
                 return False
             
             self._log(f"[BLE] Service and characteristic found successfully")
+            self._write_nr_supported = 'write-without-response' in self._characteristic.properties
+            
+            # Negotiate MTU before any chunk is sized
+            await self._negotiate_mtu()
             
             # Enable notifications automatically
             await self.enable_notifications()
             
+            # Agree on flow control once the device can answer via notifications
+            await self._exchange_hello()
+            write_mode = "without response" if self._uses_write_without_response() else "with response"
+            self._log(f"[FLOW] Data chunks written {write_mode}")
+            
             self._log("[PROTOCOL] Initialization complete")
             return True
             
@@ -145,6 +792,190 @@ class ChunkedBLEProtocol:
             self._log(f"[ERROR] Initialization failed: {e}")
             return False
     
+    async def _negotiate_mtu(self) -> int:
+        """
+        Request the largest MTU and derive chunk size from the agreed value (internal)
+        
+        Returns:
+            Negotiated ATT MTU
+        """
+        # BlueZ only reports the real MTU after it has been acquired explicitly;
+        # WinRT and CoreBluetooth exchange MTU automatically on connect
+        acquire_mtu = getattr(getattr(self.client, '_backend', None), '_acquire_mtu', None)
+        if acquire_mtu is not None:
+            try:
+                await acquire_mtu()
+            except Exception as e:
+                self._log(f"[BLE] MTU acquisition failed, using reported value: {e}")
+        
+        mtu = self.client.mtu_size or self.DEFAULT_MTU_SIZE
+        self._mtu = max(self.DEFAULT_MTU_SIZE, min(mtu, self.PREFERRED_MTU_SIZE))
+        self._frame_mtu = min(self._mtu, self._max_mtu)
+        self._chunk_size = self._frame_mtu - self.ATT_HEADER_SIZE - self.HEADER_SIZE
+        self._log(f"[BLE] MTU negotiated: {self._mtu} (chunk size {self._chunk_size} bytes)")
+        return self._mtu
+    
+    def get_negotiated_mtu(self) -> int:
+        """Get ATT MTU negotiated with the device"""
+        return self._mtu
+    
+    async def _exchange_hello(self) -> None:
+        """
+        Announce our features and credit window, wait for the device's answer (internal)
+        """
+        features = 0
+        if self._flow_control_enabled:
+            features |= self.FEATURE_CREDITS
+        if self._retransmission_enabled:
+            features |= self.FEATURE_SACK
+        features |= self.FEATURE_LARGE
+        if self._resume_grace > 0:
+            features |= self.FEATURE_RESUME
+        if self._compact_framing:
+            features |= self.FEATURE_COMPACT
+        if self._compression:
+            features |= self.FEATURE_COMPRESSION
+        self._peer_features = 0
+        self._peer_extended_features = 0
+        
+        # A new connection - keep an interrupted large transfer for resumption
+        self._suspend_receive()
+        self._hello_event.clear()
+        
+        # Transfers from the device are always buffered, so its parity chunks can be used
+        extended = self.FEATURE_EXT_FEC | self.FEATURE_EXT_CONTENT_TYPE
+        if self._max_delta_base:
+            extended |= self.FEATURE_EXT_DELTA
+        await self._write_control_frame(self.FRAME_HELLO,
+                                        struct.pack('<BBHB', self.PROTOCOL_VERSION, features, self._credit_window,
+                                                    extended))
+        try:
+            await asyncio.wait_for(self._hello_event.wait(), timeout=self.HELLO_TIMEOUT)
+        except asyncio.TimeoutError:
+            self._log("[FLOW] No HELLO from device - using legacy pacing")
+            return
+        
+        mode = "credits" if self._uses_credits() else "legacy pacing"
+        self._log(f"[FLOW] Flow control negotiated: {mode}")
+    
+    def _uses_credits(self) -> bool:
+        """Check if both sides agreed on credit-based flow control"""
+        return self._flow_control_enabled and bool(self._peer_features & self.FEATURE_CREDITS)
+    
+    def _uses_sack(self) -> bool:
+        """Check if both sides agreed on ACK/NACK reporting"""
+        return self._retransmission_enabled and bool(self._peer_features & self.FEATURE_SACK)
+    
+    def _uses_write_without_response(self) -> bool:
+        """Check if data chunks may go out as write commands (credits bound what is in flight)"""
+        return self._write_without_response and self._write_nr_supported and self._uses_credits()
+    
+    def _uses_large(self) -> bool:
+        """Check if the device understands OPEN frames and 32-bit chunk numbers"""
+        return bool(self._peer_features & self.FEATURE_LARGE)
+    
+    def _uses_compact(self) -> bool:
+        """Check if our large transfers to the device may use compact data frames"""
+        return self._compact_framing and bool(self._peer_features & self.FEATURE_COMPACT) and self._uses_large()
+    
+    def _uses_compression(self) -> bool:
+        """Check if our transfers to the device may be compressed"""
+        return self._compression and bool(self._peer_features & self.FEATURE_COMPRESSION) and self._uses_large()
+    
+    def _uses_fec(self) -> bool:
+        """Check if our large transfers to the device may carry parity chunks"""
+        return self._fec_group_size > 0 and bool(self._peer_extended_features & self.FEATURE_EXT_FEC) and \
+            not self._peer_features & self.FEATURE_STREAMING and self._uses_large()
+    
+    def _uses_content_types(self) -> bool:
+        """Check if the device reads the content type of our large transfers"""
+        return bool(self._peer_extended_features & self.FEATURE_EXT_CONTENT_TYPE) and self._uses_large()
+    
+    def _uses_delta(self) -> bool:
+        """Check if the device keeps the payloads we send as delta bases (only acknowledged ones count)"""
+        return self._max_delta_base > 0 and bool(self._peer_extended_features & self.FEATURE_EXT_DELTA) and \
+            not self._peer_features & self.FEATURE_STREAMING and self._uses_sack() and self._uses_content_types()
+    
+    def _keeps_delta_bases(self) -> bool:
+        """Check if we keep the payloads the device sends as delta bases"""
+        return self._max_delta_base > 0 and bool(self._peer_extended_features & self.FEATURE_EXT_DELTA)
+    
+    def _large_header_size(self, open_flags: int) -> int:
+        """Data frame header size for the given OPEN flags (internal)"""
+        if not open_flags & self.OPEN_FLAG_COMPACT:
+            return self.LARGE_HEADER_SIZE
+        if open_flags & self.OPEN_FLAG_NO_CHUNK_CRC:
+            return self.COMPACT_HEADER_SIZE_NO_CRC
+        return self.COMPACT_HEADER_SIZE
+    
+    def _uses_resume(self) -> bool:
+        """Check if both sides can resume interrupted large transfers"""
+        return self._resume_grace > 0 and bool(self._peer_features & self.FEATURE_RESUME) and \
+            self._uses_large() and self._uses_sack()
+    
+    async def _write_control_frame(self, frame_type: int, payload: bytes) -> None:
+        """Write a control frame (chunk_num 0 marker + type + payload)"""
+        await self.client.write_gatt_char(self._characteristic, struct.pack('<HB', 0, frame_type) + payload)
+    
+    def _process_control_frame(self, data: bytes) -> None:
+        """
+        Process control frame from the device (internal)
+        
+        Args:
+            data: Raw frame including marker and type
+        """
+        frame_type = data[2]
+        if frame_type == self.FRAME_HELLO and len(data) >= 7:
+            version, features, window = struct.unpack('<BBH', data[3:7])
+            self._peer_features = features
+            self._peer_extended_features = data[7] if len(data) >= 8 else 0
+            self._peer_window = window
+            self._credits_owed = 0
+            self._send_credits = asyncio.Semaphore(window if self._uses_credits() else 0)
+            self._log(f"[FLOW] Device HELLO: version {version}, features 0x{features:02X}/"
+                      f"0x{self._peer_extended_features:02X}, window {window}")
+            self._hello_event.set()
+        elif frame_type == self.FRAME_CREDIT and len(data) >= 5:
+            credits, = struct.unpack('<H', data[3:5])
+            for _ in range(credits):
+                self._send_credits.release()
+        elif frame_type == self.FRAME_ACK and len(data) >= 8:
+            global_crc32, status = struct.unpack('<IB', data[3:8])
+            self._report_queue.put_nowait((global_crc32, (self.FRAME_ACK, status, 0, b'')))
+        elif frame_type == self.FRAME_NACK and len(data) >= 9:
+            global_crc32, base = struct.unpack('<IH', data[3:9])
+            self._report_queue.put_nowait((global_crc32, (self.FRAME_NACK, 0, base, data[9:])))
+        elif frame_type == self.FRAME_NACK_LARGE and len(data) >= 11:
+            global_crc32, base = struct.unpack('<II', data[3:11])
+            self._report_queue.put_nowait((global_crc32, (self.FRAME_NACK, 0, base, data[11:])))
+        elif frame_type == self.FRAME_RESUME_POINT and len(data) >= 13:
+            transfer_id, global_crc32, next_chunk = struct.unpack('<HII', data[3:13])
+            self._report_queue.put_nowait((global_crc32, (self.FRAME_RESUME_POINT, 0, next_chunk, b'')))
+        elif frame_type == self.FRAME_TRANSPORT and len(data) >= 8:
+            transport, psm, mtu = struct.unpack('<BHH', data[3:8])
+            # bleak has no L2CAP channels - frames keep going over the characteristic
+            self._log(f"[TRANSPORT] Device offers transport {transport} on PSM 0x{psm:04X}, "
+                      f"MTU {mtu} - staying on GATT")
+        else:
+            self._log(f"[FLOW] Unknown or short control frame type 0x{frame_type:02X} - ignoring")
+    
+    async def _flush_receive_credits(self) -> None:
+        """Return all credits held back for the device (internal)"""
+        if self._uses_credits() and self._credits_owed > 0:
+            credits, self._credits_owed = self._credits_owed, 0
+            await self._write_control_frame(self.FRAME_CREDIT, struct.pack('<H', credits))
+    
+    async def _release_receive_credit(self) -> None:
+        """Account for one received data frame and return credits in batches (internal)"""
+        if not self._uses_credits():
+            return
+        
+        # Grant in half-window batches; completion and reports flush the rest
+        self._credits_owed += 1
+        if self._credits_owed >= (self._credit_window + 1) // 2:
+            credits, self._credits_owed = self._credits_owed, 0
+            await self._write_control_frame(self.FRAME_CREDIT, struct.pack('<H', credits))
+    
     async def enable_notifications(self) -> bool:
         """
         Enable notifications on characteristic (internal)
@@ -210,6 +1041,30 @@ class ChunkedBLEProtocol:
         """
         self._progress_callback = callback
     
+    def set_flow_control(self, enabled: bool, window: int = DEFAULT_CREDIT_WINDOW) -> None:
+        """
+        Enable or disable credit-based flow control (applied on initialize())
+        
+        Args:
+            enabled: Announce credit support in HELLO
+            window: Credits granted to the device (1..64)
+        """
+        self._flow_control_enabled = enabled
+        self._credit_window = max(1, min(window, 64))
+        self._log(f"[CONFIG] Flow control: {'credits' if enabled else 'none'} (window {self._credit_window})")
+    
+    def set_retransmission(self, enabled: bool, max_rounds: int = DEFAULT_MAX_RETRANSMIT_ROUNDS) -> None:
+        """
+        Enable or disable selective retransmission (applied on initialize())
+        
+        Args:
+            enabled: Announce ACK/NACK support in HELLO
+            max_rounds: Retransmission rounds before a send is abandoned
+        """
+        self._retransmission_enabled = enabled
+        self._max_retransmit_rounds = max_rounds
+        self._log(f"[CONFIG] Selective retransmission {'enabled' if enabled else 'disabled'} (max {max_rounds} rounds)")
+    
     def set_chunk_timeout(self, timeout_seconds: float) -> None:
         """
         Set chunk timeout in seconds (C++-like API)
@@ -220,12 +1075,219 @@ class ChunkedBLEProtocol:
         self._chunk_timeout = timeout_seconds
         self._log(f"[CONFIG] Chunk timeout set to {self._chunk_timeout}s")
     
-    async def send_data(self, data: bytes) -> bool:
+    def set_transfer_limits(self, max_data_size: int) -> None:
+        """
+        Set the largest transfer accepted from the device, and sent to a non-streaming device
+        
+        Devices that announce FEATURE_LARGE use 32-bit chunk numbers, so this is the only
+        limit for them; older devices are also held to the 16-bit chunk count limits.
+        
+        Args:
+            max_data_size: Limit in bytes
+        """
+        self._max_data_size = max_data_size
+        self._log(f"[CONFIG] Transfer limit set to {self._max_data_size} bytes")
+    
+    def set_compact_framing(self, enabled: bool, chunk_crc: bool = True) -> None:
+        """
+        Configure compact framing for large transfers (applied on initialize())
+        
+        Compact data frames carry a 16-bit chunk number and the chunk CRC32, or only the chunk
+        number when chunk_crc is False. Without chunk CRC32s a corrupted chunk is only caught by
+        the global CRC32 and fails the whole transfer - use it only over a trusted link.
+        
+        Args:
+            enabled: Accept compact frames and send them to devices that accept them
+            chunk_crc: Include the chunk CRC32 in the compact frames we send
+        """
+        self._compact_framing = enabled
+        self._compact_chunk_crc = chunk_crc
+        self._log(f"[CONFIG] Compact framing {'enabled' if enabled else 'disabled'}"
+                  f"{'' if chunk_crc or not enabled else ' without chunk CRC32'}")
+    
+    def set_compression(self, enabled: bool) -> None:
+        """
+        Enable or disable payload compression (applied on initialize())
+        
+        Payloads of MIN_COMPRESSION_SIZE bytes or more are LZSS-compressed when the device
+        accepts it and the result is smaller; compressed transfers from the device are
+        inflated before they are delivered. Transfer limits apply to the decompressed size.
+        
+        Args:
+            enabled: Compress for devices that accept it and accept compressed transfers
+        """
+        self._compression = enabled
+        self._log(f"[CONFIG] Compression {'enabled' if enabled else 'disabled'}")
+    
+    def set_forward_error_correction(self, group_size: int) -> None:
+        """
+        Send parity chunks with large transfers so lossy links need fewer retransmissions
+        
+        After every group_size data chunks an XOR parity chunk goes out; a device that lost one
+        chunk of a group rebuilds it without a NACK round trip. Costs one frame per group
+        (DEFAULT_FEC_GROUP_SIZE = 12.5% overhead). Only used for devices that announce
+        FEATURE_EXT_FEC and buffer transfers, never for resumed transfers. Parity chunks from
+        the device are used regardless of this setting.
+        
+        Args:
+            group_size: Data chunks per parity chunk, 1 to 255; 0 disables FEC
+        """
+        self._fec_group_size = max(0, min(group_size, 0xFF))
+        if self._fec_group_size:
+            self._log(f"[CONFIG] FEC enabled, one parity chunk per {self._fec_group_size} data chunks")
+        else:
+            self._log("[CONFIG] FEC disabled")
+    
+    def set_cbor_decoding(self, enabled: bool) -> None:
+        """
+        Convert CBOR transfers from the device to JSON text before they are delivered (on by default)
+        
+        Keeps JSON handlers working when the device sends CBOR; turn it off to get the CBOR
+        itself (see cbor_decode() and get_received_content_type()). A transfer that does not
+        decode is rejected.
+        
+        Args:
+            enabled: Deliver CBOR as compact JSON text, byte strings as base64url text
+        """
+        self._cbor_decoding = enabled
+        self._log(f"[CONFIG] CBOR decoding {'enabled' if enabled else 'disabled'}")
+    
+    def set_delta_transfers(self, max_base_size: int) -> None:
+        """
+        Send repeated payloads as patches against the previous one (applied on initialize())
+        
+        The last payload sent and the last one received are kept, up to max_base_size bytes
+        each. When the device enables this too and acknowledges transfers, a payload goes out
+        as a patch whenever that is smaller; a device without the base answers
+        ACK_STATUS_DELTA_BASE_MISSING and gets the whole payload instead.
+        
+        Args:
+            max_base_size: Largest payload kept as a base, e.g. DEFAULT_MAX_DELTA_BASE_SIZE; 0 disables
+        """
+        self._max_delta_base = max(0, max_base_size)
+        if not self._max_delta_base:
+            self._rx_base, self._rx_base_crc32 = b'', 0
+            self._tx_base, self._tx_base_crc32 = b'', 0
+            self._log("[CONFIG] Delta transfers disabled")
+        else:
+            self._log(f"[CONFIG] Delta transfers enabled, bases up to {self._max_delta_base} bytes")
+    
+    def get_received_content_type(self) -> int:
+        """
+        Get the content type of the last transfer delivered (CONTENT_TYPE_*)
+        
+        A decoded CBOR transfer reports CONTENT_TYPE_JSON; devices without
+        FEATURE_EXT_CONTENT_TYPE always report CONTENT_TYPE_NONE.
+        """
+        return self._content_type
+    
+    def set_write_without_response(self, enabled: bool) -> None:
+        """
+        Enable or disable write-without-response for data chunks (applied on initialize())
+        
+        Write commands are not acknowledged at the ATT layer, so several chunks fit into
+        one connection event. They are only used when the characteristic offers them and
+        the device grants credits; control frames always use acknowledged writes.
+        
+        Args:
+            enabled: Send data chunks without ATT write responses when possible
+        """
+        self._write_without_response = enabled
+        self._log(f"[CONFIG] Write without response {'enabled' if enabled else 'disabled'}")
+    
+    def set_pipeline_depth(self, depth: int) -> None:
+        """
+        Set how many write commands may be in flight at once
+        
+        Data chunks sent as write commands are handed to the BLE stack without waiting
+        for the previous write to complete, so the next chunk is ready when the link has
+        room. Credits still bound what the device has to buffer; the depth only bounds
+        what waits in the host stack.
+        
+        Args:
+            depth: Writes in flight, 1 writes one chunk at a time
+        """
+        self._pipeline_depth = max(1, depth)
+        self._log(f"[CONFIG] Pipeline depth {self._pipeline_depth}")
+    
+    def set_log_prefix(self, prefix: str) -> None:
+        """
+        Prefix every log line, e.g. with the device address when several devices share a process
+        
+        Args:
+            prefix: Text put in front of each message
+        """
+        self._log_prefix = prefix
+    
+    def set_max_mtu(self, mtu: int) -> None:
+        """
+        Size our frames for at most this ATT MTU (applied on initialize())
+        
+        Only frames written by this client shrink; the device keeps sizing its notifications
+        for the MTU the stack exchanged.
+        
+        Args:
+            mtu: Largest ATT MTU to use, DEFAULT_MTU_SIZE to PREFERRED_MTU_SIZE
+        """
+        self._max_mtu = max(self.DEFAULT_MTU_SIZE, min(mtu, self.PREFERRED_MTU_SIZE))
+        self._log(f"[CONFIG] MTU capped at {self._max_mtu}")
+    
+    def set_resume_grace_period(self, seconds: float) -> None:
+        """
+        Set how long an interrupted large transfer can be resumed (applied on initialize())
+        
+        A failed send_data() is continued when the same data is sent again after
+        initialize() on the new connection; a receive cut off by a disconnect keeps
+        its chunks until the device resumes it.
+        
+        Args:
+            seconds: Grace period, 0 disables resumption
+        """
+        self._resume_grace = seconds
+        if seconds <= 0:
+            self._interrupted_send = None
+        self._log(f"[CONFIG] Resume grace period {seconds}s")
+    
+    def handle_disconnect(self) -> None:
+        """
+        Mark the link as lost (e.g. from bleak's disconnected_callback)
+        
+        Call initialize() again once reconnected; an interrupted large receive is kept
+        for the resume grace period.
+        """
+        self._notifications_enabled = False
+        self._suspend_receive()
+        self._log("[PROTOCOL] Device disconnected")
+    
+    async def send_json(self, obj) -> bool:
+        """
+        Send a JSON-like value, as CBOR to devices that read content types
+        
+        Other devices get compact JSON text. bytes values need CBOR; they are sent as
+        base64url text to devices without it.
+        
+        Args:
+            obj: dict, list, str, bytes, int, float, bool or None, nested
+            
+        Returns:
+            True if sent successfully, False otherwise
+        """
+        try:
+            if self._uses_content_types():
+                return await self.send_data(cbor_encode(obj), self.CONTENT_TYPE_CBOR)
+            text = json.dumps(_json_value(obj), ensure_ascii=False, separators=(',', ':'))
+        except (TypeError, ValueError) as e:
+            self._log(f"[ERROR] Cannot encode JSON: {e}")
+            return False
+        return await self.send_data(text.encode('utf-8'), self.CONTENT_TYPE_JSON)
+    
+    async def send_data(self, data: bytes, content_type: int = CONTENT_TYPE_NONE) -> bool:
         """
         Send data using chunked protocol
         
         Args:
             data: Data to send
+            content_type: CONTENT_TYPE_* announced to devices that read content types
             
         Returns:
             True if sent successfully, False otherwise
@@ -234,66 +1296,407 @@ class ChunkedBLEProtocol:
             self._log("[ERROR] Protocol not initialized")
             return False
         
+        transfer = None
         try:
             data_size = len(data)
             
+            # A streaming device does not buffer the payload, so only the chunk count limits it
+            streaming_peer = bool(self._peer_features & self.FEATURE_STREAMING)
+            large = self._uses_large()
+            
             # Validate data size against security limits
-            if not self._validate_data_size(data_size):
+            if not streaming_peer and not self._validate_data_size(data_size):
                 self._log(f"[ERROR] Data rejected by security validation")
                 return False
             
-            total_chunks = (data_size + self.CHUNK_SIZE - 1) // self.CHUNK_SIZE  # Round up
-            if total_chunks > self.MAX_CHUNKS_PER_TRANSFER:
-                self._log(f"[ERROR] Too many chunks ({total_chunks} > {self.MAX_CHUNKS_PER_TRANSFER})")
+            # A device holding the payload it acknowledged last gets only the differences
+            use_delta = self._uses_delta()
+            data_crc32 = self._calculate_crc32(data) if use_delta else 0
+            patch = delta_encode(self._tx_base, data) if use_delta and self._tx_base else None
+            if patch is not None:
+                self._log(f"[DELTA] {data_size} bytes sent as a {len(patch)} byte patch against 0x{self._tx_base_crc32:08X}")
+            delta_payload = data if patch is None else patch
+            
+            # Compress ahead of chunking when the device can inflate it and it actually shrinks
+            payload = delta_payload
+            if self._uses_compression() and len(delta_payload) >= self.MIN_COMPRESSION_SIZE:
+                payload = lzss_compress(delta_payload) or delta_payload
+            
+            # Chunk size follows the framing; compact chunk numbers (parity included) have 16 bits
+            open_flags = 0
+            fec_group = self._fec_group_size if self._uses_fec() else 0
+            if self._uses_compact():
+                open_flags = self.OPEN_FLAG_COMPACT | (0 if self._compact_chunk_crc else self.OPEN_FLAG_NO_CHUNK_CRC)
+                chunk_size = self._frame_mtu - self.ATT_HEADER_SIZE - self._large_header_size(open_flags)
+                chunks = (len(payload) + chunk_size - 1) // chunk_size
+                parity_chunks = (chunks + fec_group - 1) // fec_group if fec_group else 0
+                if chunks + parity_chunks > self.MAX_COMPACT_CHUNKS:
+                    open_flags = 0
+            if payload is not delta_payload:
+                open_flags |= self.OPEN_FLAG_COMPRESSED
+                self._log(f"[COMPRESS] {len(delta_payload)} bytes compressed to {len(payload)}")
+            if large:
+                chunk_size = self._frame_mtu - self.ATT_HEADER_SIZE - self._large_header_size(open_flags)
+            else:
+                chunk_size = self._chunk_size
+            total_chunks = (len(payload) + chunk_size - 1) // chunk_size  # Round up
+            max_chunks = self.MAX_STREAM_CHUNKS if streaming_peer else self.MAX_CHUNKS_PER_TRANSFER
+            if not large and total_chunks > max_chunks:
+                self._log(f"[ERROR] Too many chunks ({total_chunks} > {max_chunks})")
                 return False
             
-            self._log(f"[CHUNK] Sending data in {total_chunks} chunks, total size: {data_size} bytes")
-            self._log(f"[SECURITY] Data passed validation (max {self.MAX_TOTAL_DATA_SIZE} bytes, {self.MAX_CHUNKS_PER_TRANSFER} chunks)")
+            self._log(f"[CHUNK] Sending data in {total_chunks} chunks, total size: {len(payload)} bytes")
+            self._log(f"[CHUNK] Chunk size: {chunk_size} bytes (MTU {self._frame_mtu})")
+            self._log(f"[SECURITY] Data passed validation (max {self._max_data_size} bytes)")
+            
+            transfer = {
+                'data': payload,
+                'view': memoryview(payload),
+                'chunk_size': chunk_size,
+                'total_chunks': total_chunks,
+                'global_crc32': self._calculate_crc32(payload),
+                'use_credits': self._uses_credits(),
+                'write_nr': self._uses_write_without_response(),
+                'transfer_id': 0,
+                'open_flags': open_flags,
+                'fec_group': 0,
+            }
+            
+            # The same data sent again after a failed send continues that transfer
+            interrupted = self._interrupted_send
+            self._interrupted_send = None
+            resuming = self._uses_resume() and interrupted is not None and \
+                interrupted['global_crc32'] == transfer['global_crc32'] and \
+                interrupted['size'] == len(payload) and interrupted['chunk_size'] == chunk_size and \
+                time.time() - interrupted['time'] <= self._resume_grace
+            if resuming:
+                transfer['transfer_id'] = interrupted['transfer_id']
+            elif large:
+                transfer['transfer_id'] = self._next_transfer_id
+                self._next_transfer_id = self._next_transfer_id % 0xFFFF + 1
+            
+            # Parity groups would not line up with the chunks a resumed round starts from
+            if large and fec_group and not resuming:
+                transfer['fec_group'] = fec_group
+                transfer['open_flags'] |= self.OPEN_FLAG_FEC
+                self._log(f"[FEC] One parity chunk per {fec_group} data chunks")
+            transfer['content_type'] = self.CONTENT_TYPE_NONE
+            if large and content_type != self.CONTENT_TYPE_NONE and self._uses_content_types():
+                transfer['content_type'] = content_type
+                transfer['open_flags'] |= self.OPEN_FLAG_CONTENT_TYPE
+            if patch is not None:
+                transfer['content_type'] |= self.CONTENT_FLAG_DELTA
+                transfer['open_flags'] |= self.OPEN_FLAG_CONTENT_TYPE
+                transfer['base_crc32'] = self._tx_base_crc32
+                transfer['result_crc32'] = data_crc32
+            
+            # Drop reports left over from an earlier transfer
+            while not self._report_queue.empty():
+                self._report_queue.get_nowait()
             
             # Start transfer timing
             send_start_time = time.time()
             
-            for chunk_num in range(total_chunks):
-                chunk_start = chunk_num * self.CHUNK_SIZE
-                chunk_end = min(chunk_start + self.CHUNK_SIZE, data_size)
-                chunk_data = data[chunk_start:chunk_end]
-                chunk_data_size = len(chunk_data)
-                
-                # Calculate CRC32 for chunk data
-                crc32 = self._calculate_crc32(chunk_data)
-                
-                # Create enhanced header: chunk_num(2) + total_chunks(2) + data_size(1) + crc32(4) + global_crc32(4)
-                header = struct.pack('<HHB', chunk_num + 1, total_chunks, chunk_data_size) + crc32.to_bytes(4, 'little') + self._calculate_crc32(data).to_bytes(4, 'little')
-                
-                # Combine header and data
-                chunk_packet = header + chunk_data
-                
-                # Send chunk
-                await self.client.write_gatt_char(self._characteristic, chunk_packet)
-                
-                self._log(f"[CHUNK] Sent chunk {chunk_num + 1}/{total_chunks} ({chunk_data_size} bytes data, CRC32: 0x{crc32:08X})")
-                
-                # Update progress
-                if self._progress_callback:
-                    self._progress_callback(chunk_num + 1, total_chunks, False)
-                
-                # Small delay between chunks to prevent overwhelming receiver
-                await asyncio.sleep(0.01)
+            # Large transfers announce length and global CRC32 once, ahead of the chunks;
+            # a resumed one starts wherever the device's resume point says (0 = no answer)
+            first_chunk = await self._request_resume(transfer) if resuming else 0
+            if not first_chunk and large:
+                await self._send_open(transfer)
+            
+            # Keep the data until the device confirms it has everything
+            self._last_ack_status = self.ACK_STATUS_OK
+            delivered = await self._send_chunk_range(transfer, first_chunk or 1) and \
+                (not self._uses_sack() or await self._await_delivery(transfer))
+            if not delivered:
+                self._abort_writes()
+                # Without its base the device cannot use the patch - it gets the payload whole
+                if patch is not None and self._last_ack_status == self.ACK_STATUS_DELTA_BASE_MISSING:
+                    self._log(f"[DELTA] Device lacks base 0x{self._tx_base_crc32:08X} - sending {data_size} bytes whole")
+                    self._tx_base, self._tx_base_crc32 = b'', 0
+                    return await self.send_data(data, content_type)
+                self._remember_interrupted_send(transfer)
+                return False
             
             send_time = time.time() - send_start_time
-            self._log(f"[CHUNK] All chunks sent successfully in {send_time:.3f}s")
+            send_rate = data_size / send_time if send_time > 0 else 0.0
+            mode = "write without response" if transfer['write_nr'] else "write with response"
+            self._log(f"[CHUNK] All chunks sent successfully in {send_time:.3f}s ({send_rate:.0f} B/s, {mode})")
             
             # Update statistics
             self._stats['total_data_sent'] += data_size
+            self._stats['compression_saved'] += len(delta_payload) - len(payload)
+            self._stats['delta_saved'] += data_size - len(delta_payload)
             self._stats['successful_transfers'] += 1
+            self._stats['last_send_rate'] = send_rate
+            self._stats['last_send_write_without_response'] = transfer['write_nr']
             self._stats['last_transfer_time'] = time.time()
             
+            # The device now holds this payload, the next one may be sent against it
+            if use_delta and data_size <= self._max_delta_base:
+                self._tx_base, self._tx_base_crc32 = bytes(data), data_crc32
+            else:
+                self._tx_base, self._tx_base_crc32 = b'', 0
+            
             return True
             
         except Exception as e:
             self._log(f"[ERROR] Send failed: {e}")
+            self._abort_writes()
+            if transfer is not None:
+                self._remember_interrupted_send(transfer)
             return False
     
+    async def _send_chunk_range(self, transfer: dict, first_chunk: int) -> bool:
+        """Send chunks first_chunk..total_chunks, True if _await_delivery() can take over (internal)"""
+        total_chunks = transfer['total_chunks']
+        
+        # A resumed transfer may only miss chunks the next report will list
+        if first_chunk > total_chunks:
+            await self._send_chunk(transfer, total_chunks, probe=True)
+            return True
+        
+        # Parity covers whole groups, so only a round that starts with chunk 1 carries it
+        fec_group = transfer['fec_group'] if first_chunk == 1 else 0
+        parity = 0
+        
+        for chunk_num in range(first_chunk, total_chunks + 1):
+            last_chunk = chunk_num == total_chunks
+            sent = True
+            if fec_group:
+                if (chunk_num - 1) % fec_group == 0:
+                    parity = 0
+                parity ^= int.from_bytes(self._chunk_data(transfer, chunk_num), 'little')
+                # The last group's parity goes ahead of the last chunk, which triggers the device's report
+                # (a last group of just that chunk gets none - the device never rebuilds the last chunk)
+                if last_chunk and (chunk_num - 1) % fec_group != 0:
+                    sent = await self._send_parity(transfer, chunk_num, parity)
+            sent = sent and await self._send_chunk(transfer, chunk_num)
+            if sent and fec_group and not last_chunk and chunk_num % fec_group == 0:
+                sent = await self._send_parity(transfer, chunk_num, parity)
+            
+            if not sent:
+                # A lost frame also loses its credit - the device's report resynchronizes both
+                if not self._uses_sack():
+                    return False
+                self._log(f"[SACK] Round interrupted at chunk {chunk_num}, asking device for a report")
+                await self._send_chunk(transfer, total_chunks, probe=True)
+                break
+            
+            # Update progress
+            if self._progress_callback:
+                self._progress_callback(chunk_num, total_chunks, False)
+        await self._drain_writes()
+        return True
+    
+    def _remember_interrupted_send(self, transfer: dict) -> None:
+        """Offer a failed large transfer for resumption when the same data is sent again (internal)"""
+        if transfer['transfer_id'] and self._resume_grace > 0:
+            self._interrupted_send = {
+                'transfer_id': transfer['transfer_id'],
+                'global_crc32': transfer['global_crc32'],
+                'size': len(transfer['data']),
+                'chunk_size': transfer['chunk_size'],
+                'time': time.time(),
+            }
+    
+    async def _request_resume(self, transfer: dict) -> int:
+        """Ask the device where an interrupted transfer continues, 0 if there is no answer (internal)"""
+        await self._send_open(transfer, self.FRAME_RESUME)
+        report = await self._wait_for_report(transfer['global_crc32'])
+        if report is None or report[0] != self.FRAME_RESUME_POINT:
+            self._log(f"[RESUME] No resume point for transfer {transfer['transfer_id']} - sending it again")
+            return 0
+        
+        next_chunk = max(1, min(report[2], transfer['total_chunks'] + 1))
+        self._log(f"[RESUME] Transfer {transfer['transfer_id']} continues at chunk {next_chunk} of {transfer['total_chunks']}")
+        return next_chunk
+    
+    def _chunk_data(self, transfer: dict, chunk_num: int) -> memoryview:
+        """Data of one chunk of an outbound transfer, sliced without copying (internal)"""
+        chunk_start = (chunk_num - 1) * transfer['chunk_size']
+        return transfer['view'][chunk_start:chunk_start + transfer['chunk_size']]
+    
+    async def _send_parity(self, transfer: dict, chunk_num: int, parity: int) -> bool:
+        """Send the parity chunk of the group chunk_num belongs to, numbered after the data chunks (internal)"""
+        group = (chunk_num - 1) // transfer['fec_group']
+        parity_data = parity.to_bytes(transfer['chunk_size'], 'little')
+        if not await self._send_chunk(transfer, transfer['total_chunks'] + group + 1, chunk_data=parity_data):
+            return False
+        self._stats['parity_sent'] += 1
+        return True
+    
+    async def _send_chunk(self, transfer: dict, chunk_num: int, probe: bool = False,
+                          chunk_data: Optional[bytes] = None) -> bool:
+        """
+        Send (or resend) one chunk of an outbound transfer (internal)
+        
+        Args:
+            transfer: Transfer description built by send_data()
+            chunk_num: 1-based chunk number
+            probe: Send without waiting for a credit (asks the device for a report)
+            chunk_data: Frame data instead of the chunk's own (parity chunks)
+            
+        Returns:
+            True if the chunk was written, False otherwise
+        """
+        total_chunks = transfer['total_chunks']
+        
+        if chunk_data is None:
+            chunk_data = self._chunk_data(transfer, chunk_num)
+        chunk_data_size = len(chunk_data)
+        
+        # Calculate CRC32 for chunk data
+        crc32 = self._calculate_crc32(chunk_data)
+        
+        if transfer['open_flags'] & self.OPEN_FLAG_COMPACT:
+            # Compact header: chunk_num(2) [+ crc32(4)], the device knows the transfer from OPEN
+            header = struct.pack('<H', chunk_num)
+            if not transfer['open_flags'] & self.OPEN_FLAG_NO_CHUNK_CRC:
+                header += struct.pack('<I', crc32)
+        elif transfer['transfer_id']:
+            # Large header: transfer_id(2) + chunk_num(4) + crc32(4), totals went out in OPEN
+            header = struct.pack('<HII', transfer['transfer_id'], chunk_num, crc32)
+        else:
+            # Create enhanced header: chunk_num(2) + total_chunks(2) + data_size(2) + crc32(4) + global_crc32(4)
+            header = struct.pack('<HHHII', chunk_num, total_chunks, chunk_data_size, crc32, transfer['global_crc32'])
+        
+        # Wait until the device has room for another chunk (probes go out regardless)
+        if transfer['use_credits'] and not probe:
+            try:
+                await asyncio.wait_for(self._send_credits.acquire(), timeout=self._chunk_timeout)
+            except asyncio.TimeoutError:
+                self._log(f"[FLOW] No credits from device - aborting send at chunk {chunk_num}/{total_chunks}")
+                return False
+        
+        # Send chunk, as a write command when credits already pace the chunks. Write commands
+        # are pipelined: the next chunk is queued while earlier ones are still in the stack.
+        if transfer['write_nr']:
+            await self._pipeline_write(header + chunk_data)
+        else:
+            await self.client.write_gatt_char(self._characteristic, header + chunk_data, response=True)
+        
+        self._log(f"[CHUNK] Sent chunk {chunk_num}/{total_chunks} ({chunk_data_size} bytes data, CRC32: 0x{crc32:08X})")
+        
+        # Devices without flow control still need a gap between chunks
+        if not transfer['use_credits']:
+            await asyncio.sleep(0.01)
+        return True
+    
+    async def _pipeline_write(self, frame: bytes) -> None:
+        """Queue a write command, waiting only while the pipeline is full (internal)"""
+        while len(self._pending_writes) >= self._pipeline_depth:
+            await self._pending_writes.popleft()
+        self._pending_writes.append(asyncio.ensure_future(
+            self.client.write_gatt_char(self._characteristic, frame, response=False)))
+    
+    async def _drain_writes(self) -> None:
+        """Wait until every queued write command is with the stack, raising the first failure (internal)"""
+        while self._pending_writes:
+            await self._pending_writes.popleft()
+    
+    def _abort_writes(self) -> None:
+        """Cancel queued write commands of a failed send (internal)"""
+        while self._pending_writes:
+            write = self._pending_writes.popleft()
+            if write.done() and not write.cancelled():
+                write.exception()  # Already reported by the failure that ended the send
+            write.cancel()
+    
+    async def _send_open(self, transfer: dict, frame_type: int = FRAME_OPEN) -> None:
+        """Announce a large transfer to the device, RESUME asks to continue it (internal, sent without a credit)"""
+        # Retransmission rounds must not let the OPEN overtake chunks still queued
+        await self._drain_writes()
+        payload = struct.pack('<HIIHB', transfer['transfer_id'], transfer['global_crc32'],
+                              len(transfer['data']), transfer['chunk_size'], transfer['open_flags'])
+        if transfer['open_flags'] & self.OPEN_FLAG_FEC:
+            payload += struct.pack('<B', transfer['fec_group'])
+        if transfer['open_flags'] & self.OPEN_FLAG_CONTENT_TYPE:
+            payload += struct.pack('<B', transfer['content_type'])
+            if transfer['content_type'] & self.CONTENT_FLAG_DELTA:
+                payload += struct.pack('<II', transfer['base_crc32'], transfer['result_crc32'])
+        await self._write_control_frame(frame_type, payload)
+        name = "RESUME" if frame_type == self.FRAME_RESUME else "OPEN"
+        self._log(f"[LARGE] {name} sent: transfer {transfer['transfer_id']}, {len(transfer['data'])} bytes")
+    
+    async def _await_delivery(self, transfer: dict) -> bool:
+        """
+        Wait for the device's ACK, retransmitting whatever it reports missing (internal)
+        
+        Args:
+            transfer: Transfer description built by send_data()
+            
+        Returns:
+            True if the device acknowledged the complete transfer
+        """
+        round_last_chunk = transfer['total_chunks']
+        
+        for round_num in range(self._max_retransmit_rounds + 1):
+            report = await self._wait_for_report(transfer['global_crc32'])
+            if report is None:
+                # Our last chunk or the device's report got lost - resending it asks again
+                self._log(f"[SACK] No report from device, resending chunk {round_last_chunk}")
+                self._stats['retransmissions'] += 1
+                # The device ignores a repeated OPEN, and needs it if the first one was lost
+                if transfer['transfer_id']:
+                    await self._send_open(transfer)
+                await self._send_chunk(transfer, round_last_chunk, probe=True)
+                continue
+            
+            # The device flushed its credits before reporting, so the whole window is ours again
+            if transfer['use_credits']:
+                self._send_credits = asyncio.Semaphore(self._peer_window)
+            
+            frame_type, status, base, bitmap = report
+            if frame_type == self.FRAME_RESUME_POINT:
+                continue  # Late answer to our RESUME, the chunks already went out
+            if frame_type == self.FRAME_ACK:
+                self._last_ack_status = status
+                if status == self.ACK_STATUS_OK:
+                    self._log("[SACK] Device acknowledged complete transfer")
+                    return True
+                self._log(f"[SACK] Device rejected transfer (status {status})")
+                return False
+            
+            # NACK - resend only the chunks marked in the bitmap, in ascending order.
+            # The device reports again once it sees the highest chunk it asked for.
+            missing = [base + bit for bit in range(len(bitmap) * 8) if bitmap[bit // 8] & (1 << (bit % 8))]
+            if missing:
+                round_last_chunk = missing[-1]
+            resent = 0
+            for chunk_num in missing:
+                if chunk_num < 1 or chunk_num > transfer['total_chunks']:
+                    continue
+                if not await self._send_chunk(transfer, chunk_num):
+                    break  # Out of credits - the probe after the report timeout recovers
+                resent += 1
+            self._stats['retransmissions'] += resent
+            self._log(f"[SACK] Round {round_num + 1}: retransmitted {resent} chunks")
+        
+        self._log(f"[SACK] Giving up after {self._max_retransmit_rounds} retransmission rounds")
+        return False
+    
+    async def _wait_for_report(self, global_crc32: int) -> Optional[tuple]:
+        """
+        Wait for an ACK/NACK belonging to the given transfer (internal)
+        
+        Returns:
+            (frame_type, status, base, bitmap) or None on timeout
+        """
+        # The timeout runs from when the last chunk actually went out
+        await self._drain_writes()
+        deadline = time.time() + self._chunk_timeout
+        while True:
+            remaining = deadline - time.time()
+            if remaining <= 0:
+                return None
+            try:
+                report_crc32, report = await asyncio.wait_for(self._report_queue.get(), timeout=remaining)
+            except asyncio.TimeoutError:
+                return None
+            if report_crc32 == global_crc32:
+                return report
+            self._log(f"[SACK] Ignoring report for transfer 0x{report_crc32:08X}")
+    
     async def receive_data(self, timeout: float = 30.0) -> Optional[bytes]:
         """
         Wait for and receive complete data
@@ -327,9 +1730,7 @@ class ChunkedBLEProtocol:
         Cleanup protocol resources
         """
         await self.disable_notifications()
-        self._received_chunks.clear()
-        self._expected_chunks = 0
-        self._received_chunk_count = 0
+        self._clear_receive_buffers()
         self._received_data = None
         self._complete_data_event.clear()
         self._log("[PROTOCOL] Cleanup complete")
@@ -345,36 +1746,58 @@ class ChunkedBLEProtocol:
             data: Received data
         """
         try:
-            if len(data) < self.HEADER_SIZE:
-                self._log("[ERROR] Received data too small for chunk header")
-                return
+            if len(data) >= 3 and data[0] == 0 and data[1] == 0:
+                if data[2] in (self.FRAME_OPEN, self.FRAME_RESUME):
+                    # Not a data frame, but replies to it go out like chunk reports
+                    self._process_open_frame(bytes(data))
+                else:
+                    self._process_control_frame(bytes(data))
+                    return
+            else:
+                # Every data frame consumed one of the device's credits, valid or not.
+                # Counted before processing so that an ACK/NACK flushes the exact balance.
+                await self._release_receive_credit()
+                self._process_received_chunk(memoryview(data))
             
-            self._process_received_chunk(bytes(data))
+            # Return held-back credits before a report so the device can retransmit right away
+            if self._pending_reports or not self._transfer_in_progress:
+                await self._flush_receive_credits()
+            while self._pending_reports:
+                await self.client.write_gatt_char(self._characteristic, self._pending_reports.pop(0))
             
         except Exception as e:
             self._log(f"[ERROR] Notification handler failed: {e}")
     
-    def _process_received_chunk(self, data: bytes) -> None:
+    def _process_received_chunk(self, data: memoryview) -> None:
         """
         Process received chunk data (internal)
         
         Args:
-            data: Raw chunk data with header
+            data: Raw chunk data with header, sliced without copying
         """
         try:
+            # Devices that announce large transfers never send 14-byte chunk headers
+            if self._uses_large():
+                self._process_large_chunk(data)
+                return
+            
             # Check minimum data size for header
             if len(data) < self.HEADER_SIZE:
                 self._log(f"[CHUNK] Received data too small for chunk header ({len(data)} bytes)")
                 return
             
             # Parse enhanced header
-            chunk_num, total_chunks, data_size = struct.unpack('<HHB', data[:5])
-            chunk_crc32 = int.from_bytes(data[5:9], 'little')
-            global_crc32 = int.from_bytes(data[9:13], 'little')
-            chunk_data = data[13:13 + data_size]
+            chunk_num, total_chunks, data_size, chunk_crc32, global_crc32 = struct.unpack('<HHHII', data[:self.HEADER_SIZE])
+            chunk_data = data[14:14 + data_size]
             
             self._log(f"[CHUNK] Received chunk {chunk_num}/{total_chunks} ({data_size} bytes data, CRC32: 0x{chunk_crc32:08X})")
             
+            # Validate chunk numbers
+            if chunk_num == 0 or chunk_num > total_chunks:
+                self._log(f"[CHUNK] Invalid chunk numbers: {chunk_num}/{total_chunks}")
+                self._stats['crc_errors'] += 1
+                return
+            
             # Check if data size matches header
             expected_size = self.HEADER_SIZE + data_size
             if len(data) != expected_size:
@@ -382,35 +1805,37 @@ class ChunkedBLEProtocol:
                 self._stats['crc_errors'] += 1
                 return
             
+            # With selective retransmission a bad chunk is only marked missing, the header is still usable
+            use_sack = self._uses_sack()
+            
             # Validate CRC32
             calculated_crc = self._calculate_crc32(chunk_data)
-            if chunk_crc32 != calculated_crc:
+            chunk_valid = chunk_crc32 == calculated_crc
+            if not chunk_valid:
                 self._log(f"[CRC] CRC32 mismatch: expected 0x{chunk_crc32:08X}, calculated 0x{calculated_crc:08X}")
                 self._stats['crc_errors'] += 1
+                if not use_sack:
+                    return
+            else:
+                self._log(f"[CRC] CRC32 validation passed for chunk {chunk_num}")
+            
+            # The device missed our ACK and is probing a transfer we already delivered
+            if use_sack and not self._transfer_in_progress and chunk_num != 1 and global_crc32 == self._last_completed_crc32:
+                self._log(f"[SACK] Chunk {chunk_num} of delivered transfer 0x{global_crc32:08X} - repeating ACK")
+                self._queue_ack(global_crc32, self.ACK_STATUS_OK)
                 return
             
-            self._log(f"[CRC] CRC32 validation passed for chunk {chunk_num}")
+            # Legacy transfers start with chunk 1; with retransmission any chunk of an unknown transfer does
+            if use_sack:
+                starts_transfer = not self._transfer_in_progress or global_crc32 != self._expected_global_crc32
+            else:
+                starts_transfer = chunk_num == 1
             
-            # Initialize chunks buffer if this is the first chunk
-            if chunk_num == 1:
-                self._received_chunks = [None] * total_chunks
-                self._expected_chunks = total_chunks
-                self._received_chunk_count = 0
-                
-                # Start transfer timer
-                self._start_transfer_timer()
-                
-                self._log(f"[CHUNK] Starting new transfer: expecting {total_chunks} chunks total")
-                
-                # Validate total expected data size
-                estimated_total_size = total_chunks * self.CHUNK_SIZE
-                if not self._validate_data_size(estimated_total_size):
-                    self._cancel_transfer("Total data size exceeds limits")
+            # Set up the reassembly state if this is the first chunk
+            if starts_transfer:
+                # Only the chunk count is known, the length and chunk size follow from the chunks
+                if not self._begin_transfer(total_chunks, global_crc32, 0, 0):
                     return
-                
-                # Store global CRC32 from first chunk
-                self._expected_global_crc32 = global_crc32
-                self._log(f"[CRC] Expected global CRC32: 0x{global_crc32:08X}")
             else:
                 # Validate global CRC32 consistency across chunks
                 if global_crc32 != self._expected_global_crc32:
@@ -418,87 +1843,483 @@ class ChunkedBLEProtocol:
                     self._cancel_transfer("Global CRC32 mismatch between chunks")
                     return
             
-            # Check chunk timeout
-            if self._check_chunk_timeout():
-                self._cancel_transfer("Chunk timeout")
-                return
-            
-            # Update chunk timer
-            self._update_chunk_timer()
-            
             # Validate chunk consistency
             if total_chunks != self._expected_chunks:
                 self._log(f"[CHUNK] Inconsistent total chunks: expected {self._expected_chunks}, got {total_chunks}")
-                self._cancel_transfer("Inconsistent chunk count")
+                self._reject_transfer("Inconsistent chunk count", self.ACK_STATUS_REJECTED)
                 return
             
+            self._accept_chunk(chunk_num, chunk_data, chunk_valid)
+            
+        except Exception as e:
+            self._log(f"[ERROR] Failed to process chunk: {e}")
+            self._stats['crc_errors'] += 1
+    
+    def _process_large_chunk(self, data: memoryview) -> None:
+        """Process a data frame of a large transfer opened by an OPEN frame (internal)"""
+        # Data frames arriving before any OPEN cannot even be parsed
+        header_size = self._large_header_size(self._open_flags)
+        if self._open_transfer_id == 0 or len(data) <= header_size:
+            self._log(f"[LARGE] Chunk without an open transfer or too small ({len(data)} bytes) - ignoring")
+            self._stats['crc_errors'] += 1
+            return
+        
+        chunk_crc32 = 0
+        if self._open_flags & self.OPEN_FLAG_COMPACT:
+            # Compact frames only exist for the open transfer
+            transfer_id = self._open_transfer_id
+            chunk_num, = struct.unpack('<H', data[:2])
+            if not self._open_flags & self.OPEN_FLAG_NO_CHUNK_CRC:
+                chunk_crc32, = struct.unpack('<I', data[2:6])
+        else:
+            transfer_id, chunk_num, chunk_crc32 = struct.unpack('<HII', data[:self.LARGE_HEADER_SIZE])
+        chunk_data = data[header_size:]
+        
+        self._log(f"[CHUNK] Received chunk {chunk_num}/{self._expected_chunks} ({len(chunk_data)} bytes data, CRC32: 0x{chunk_crc32:08X})")
+        
+        # The device's OPEN was lost or belongs to another transfer
+        if transfer_id != self._open_transfer_id:
+            self._log(f"[LARGE] Chunk for unknown transfer {transfer_id} - ignoring")
+            self._stats['crc_errors'] += 1
+            return
+        
+        use_sack = self._uses_sack()
+        
+        # Validate CRC32 - without chunk CRC32s only the global CRC32 can catch corruption
+        calculated_crc = self._calculate_crc32(chunk_data)
+        if self._open_flags & self.OPEN_FLAG_NO_CHUNK_CRC:
+            chunk_crc32 = calculated_crc
+        chunk_valid = chunk_crc32 == calculated_crc
+        if not chunk_valid:
+            self._log(f"[CRC] CRC32 mismatch: expected 0x{chunk_crc32:08X}, calculated 0x{calculated_crc:08X}")
+            self._stats['crc_errors'] += 1
+            if not use_sack:
+                return
+        
+        if not self._transfer_in_progress:
+            # The device missed our ACK and is probing a transfer we already delivered
+            if use_sack and self._last_completed_crc32 is not None and self._expected_global_crc32 == self._last_completed_crc32:
+                self._log(f"[SACK] Chunk {chunk_num} of delivered transfer 0x{self._last_completed_crc32:08X} - repeating ACK")
+                self._queue_ack(self._last_completed_crc32, self.ACK_STATUS_OK)
+            return
+        
+        # Parity chunks are numbered after the data chunks
+        if chunk_num == 0 or chunk_num > self._expected_chunks + len(self._parity_chunks):
+            self._log(f"[CHUNK] Invalid chunk numbers: {chunk_num}/{self._expected_chunks}")
+            self._stats['crc_errors'] += 1
+            return
+        
+        self._accept_chunk(chunk_num, chunk_data, chunk_valid)
+    
+    def _process_open_frame(self, data: bytes) -> None:
+        """Start receiving a large transfer announced by the device (internal)"""
+        if len(data) < 16:
+            self._log(f"[LARGE] Malformed OPEN frame ({len(data)} bytes)")
+            return
+        transfer_id, global_crc32, total_length, chunk_size, flags = struct.unpack('<HIIHB', data[3:16])
+        
+        # Trailing fields in flag order, a missing one reads as 0
+        trailer = bytes(data[16:])
+        fec_group = 0
+        content_type = self.CONTENT_TYPE_NONE
+        if flags & self.OPEN_FLAG_FEC and trailer:
+            fec_group, trailer = trailer[0], trailer[1:]
+        if flags & self.OPEN_FLAG_CONTENT_TYPE and trailer:
+            content_type, trailer = trailer[0], trailer[1:]
+        base_crc32, result_crc32 = 0, 0
+        delta_announced = bool(content_type & self.CONTENT_FLAG_DELTA)
+        if delta_announced and len(trailer) >= 8:
+            base_crc32, result_crc32 = struct.unpack('<II', trailer[:8])
+        content_type &= ~self.CONTENT_FLAG_DELTA
+        resume_request = data[2] == self.FRAME_RESUME
+        framing_accepted = (self._compact_framing or not flags & self.OPEN_FLAG_COMPACT) and \
+            (self._compression or not flags & self.OPEN_FLAG_COMPRESSED)
+        
+        # The device repeats OPEN when a report is overdue - keep what we already have
+        if transfer_id == self._open_transfer_id and global_crc32 == self._expected_global_crc32:
+            self._log(f"[LARGE] Repeated OPEN for transfer {transfer_id}")
+            if resume_request:
+                self._queue_resume_point(transfer_id, global_crc32, self._resume_point())
+            return
+        
+        # Continue a transfer the last disconnect interrupted
+        if self._suspended_transfer_id and framing_accepted and \
+                self._resume_receive(transfer_id, global_crc32, total_length, chunk_size,
+                                     bool(flags & self.OPEN_FLAG_COMPRESSED)):
+            # Framing may differ from the interrupted connection, the chunk size and compression may not
+            self._open_flags = flags
+            self._content_type = content_type
+            self._delta_base_crc32, self._delta_result_crc32 = base_crc32, result_crc32
+            self._begin_parity(fec_group)
+            if resume_request:
+                self._queue_resume_point(transfer_id, global_crc32, self._resume_point())
+            return
+        
+        max_chunk_size = self._mtu - self.ATT_HEADER_SIZE - self._large_header_size(flags)
+        max_chunks = self.MAX_COMPACT_CHUNKS if flags & self.OPEN_FLAG_COMPACT else 0x7FFFFFFF
+        total_chunks = (total_length + chunk_size - 1) // chunk_size if chunk_size else 0
+        parity_chunks = (total_chunks + fec_group - 1) // fec_group if fec_group else 0
+        if transfer_id == 0 or total_length == 0 or chunk_size == 0 or not framing_accepted or \
+                (flags & self.OPEN_FLAG_FEC and not fec_group) or (delta_announced and not base_crc32) or \
+                chunk_size > max_chunk_size or total_chunks + parity_chunks > max_chunks:
+            self._log(f"[LARGE] Invalid OPEN: transfer {transfer_id}, {total_length} bytes, chunk size {chunk_size}")
+            if self._uses_sack():
+                self._queue_ack(global_crc32, self.ACK_STATUS_REJECTED)
+            return
+        
+        self._open_transfer_id = transfer_id
+        self._open_flags = flags
+        self._log(f"[LARGE] Transfer {transfer_id} opened: {total_length} bytes, chunk size {chunk_size}, flags 0x{flags:02X}")
+        if not self._begin_transfer(total_chunks, global_crc32, total_length, chunk_size):
+            return
+        self._compressed_transfer = bool(flags & self.OPEN_FLAG_COMPRESSED)
+        self._content_type = content_type
+        
+        # A delta needs the payload it was made against
+        self._delta_base_crc32, self._delta_result_crc32 = base_crc32, result_crc32
+        if base_crc32 and base_crc32 != self._rx_base_crc32:
+            self._log(f"[DELTA] Transfer {transfer_id} needs base 0x{base_crc32:08X}, holding 0x{self._rx_base_crc32:08X}")
+            self._reject_transfer("Delta base missing", self.ACK_STATUS_DELTA_BASE_MISSING)
+            return
+        self._begin_parity(fec_group)
+        if resume_request:
+            # Nothing to resume - the device starts over without waiting for a timeout
+            self._queue_resume_point(transfer_id, global_crc32, 1)
+    
+    def _suspend_receive(self) -> None:
+        """Keep the current large transfer across a disconnect, or drop it (internal)"""
+        transfer_id, self._open_transfer_id = self._open_transfer_id, 0
+        if self._suspended_transfer_id:
+            return  # Still waiting for a resume from an earlier disconnect
+        if not self._transfer_in_progress or not transfer_id or self._resume_grace <= 0:
+            self._transfer_in_progress = False
+            self._clear_receive_buffers()
+            return
+        
+        # Chunks stay in place; RESUME (or OPEN) of the same transfer picks them up
+        self._transfer_in_progress = False
+        self._suspended_transfer_id = transfer_id
+        self._suspend_time = time.time()
+        self._log(f"[RESUME] Transfer {transfer_id} suspended with {self._received_chunk_count}/{self._expected_chunks} chunks")
+    
+    def _resume_receive(self, transfer_id: int, global_crc32: int, total_length: int, chunk_size: int,
+                        compressed: bool) -> bool:
+        """Pick up the suspended transfer if it is the announced one and still within the grace period (internal)"""
+        if time.time() - self._suspend_time > self._resume_grace:
+            self._log(f"[RESUME] Transfer {self._suspended_transfer_id} expired")
+            self._clear_receive_buffers()
+            return False
+        if transfer_id != self._suspended_transfer_id or global_crc32 != self._expected_global_crc32 or \
+                total_length != self._receive_length or chunk_size != self._chunk_stride or \
+                compressed != self._compressed_transfer:
+            return False
+        
+        self._open_transfer_id, self._suspended_transfer_id = transfer_id, 0
+        self._transfer_in_progress = True
+        self._report_point = self._expected_chunks  # Next report once the device's round reaches the last chunk
+        self._update_chunk_timer()
+        self._log(f"[RESUME] Transfer {transfer_id} resumed with {self._received_chunk_count}/{self._expected_chunks} chunks")
+        return True
+    
+    def _resume_point(self) -> int:
+        """Chunk after the highest one received, missing chunks below it are NACKed later (internal)"""
+        for i in range(self._expected_chunks - 1, -1, -1):
+            if self._is_chunk_received(i):
+                return i + 2
+        return 1
+    
+    def _queue_resume_point(self, transfer_id: int, global_crc32: int, next_chunk: int) -> None:
+        """Queue a RESUME_POINT frame for the notification handler to write (internal)"""
+        self._pending_reports.append(struct.pack('<HBHII', 0, self.FRAME_RESUME_POINT, transfer_id, global_crc32, next_chunk))
+        self._log(f"[RESUME] Transfer {transfer_id} continues at chunk {next_chunk}")
+    
+    def _begin_transfer(self, total_chunks: int, global_crc32: int, total_length: int, chunk_size: int) -> bool:
+        """Start reassembling a new transfer, length and chunk size are 0 when not announced (internal)"""
+        self._clear_receive_buffers()
+        self._content_type = self.CONTENT_TYPE_NONE  # Set by OPEN afterwards
+        self._delta_base_crc32 = 0
+        self._received_bitmap = bytearray((total_chunks + 7) // 8)
+        self._expected_chunks = total_chunks
+        self._received_chunk_count = 0
+        self._report_point = total_chunks  # First report once the last chunk shows up
+        
+        # Start transfer timer
+        self._start_transfer_timer()
+        
+        self._log(f"[CHUNK] Starting new transfer: expecting {total_chunks} chunks total")
+        
+        # Store global CRC32 from first chunk
+        self._expected_global_crc32 = global_crc32
+        self._log(f"[CRC] Expected global CRC32: 0x{global_crc32:08X}")
+        
+        # Without an announced length, estimate it from the chunk count
+        transfer_size = total_length or total_chunks * self._chunk_size
+        if not self._validate_data_size(transfer_size):
+            self._reject_transfer("Total data size exceeds limits", self.ACK_STATUS_REJECTED)
+            return False
+        
+        # An announced chunk size gives every offset up front
+        if chunk_size:
+            self._chunk_stride = chunk_size
+            self._receive_length = total_length
+            self._receive_buffer = bytearray(total_chunks * chunk_size)
+        return True
+    
+    def _begin_parity(self, fec_group: int) -> None:
+        """Expect parity chunks for the open transfer, or none (internal); received parity is kept"""
+        groups = (self._expected_chunks + fec_group - 1) // fec_group if fec_group else 0
+        if fec_group != self._fec_group or groups != len(self._parity_chunks):
+            self._fec_group = fec_group
+            self._parity_chunks = [None] * groups
+    
+    def _accept_chunk(self, chunk_num: int, chunk_data: memoryview, chunk_valid: bool) -> None:
+        """Store a chunk of the current transfer and finish the transfer once it is complete (internal)"""
+        use_sack = self._uses_sack()
+        data_size = len(chunk_data)
+        
+        # Check chunk timeout - buffered chunks survive it when missing ones can be requested again
+        if self._check_chunk_timeout() and not use_sack:
+            self._cancel_transfer("Chunk timeout")
+            return
+        
+        # Update chunk timer
+        self._update_chunk_timer()
+        
+        chunk_index = chunk_num - 1  # Convert to 0-based index
+        parity = chunk_num > self._expected_chunks
+        if chunk_valid and parity:
+            # Parity chunk - may rebuild the one chunk its group is missing
+            group = chunk_num - self._expected_chunks - 1
+            if self._parity_chunks[group] is None and self._store_parity(group, chunk_data):
+                self._rebuild_chunk(group)
+        elif chunk_valid:
             # Check for duplicate chunks
-            chunk_index = chunk_num - 1  # Convert to 0-based index
-            if chunk_index >= 0 and chunk_index < len(self._received_chunks) and self._received_chunks[chunk_index] is not None:
+            if self._is_chunk_received(chunk_index):
                 self._log(f"[CHUNK] Duplicate chunk {chunk_num} - ignoring")
-                return
+                if not use_sack:
+                    return
+            elif self._store_chunk(chunk_num, chunk_data):
+                self._received_chunk_count += 1
+                
+                # Update statistics
+                self._stats['total_data_received'] += data_size
+                
+                # Notify progress
+                if self._progress_callback:
+                    self._progress_callback(self._received_chunk_count, self._expected_chunks, True)
+                
+                self._log(f"[CHUNK] Progress: {self._received_chunk_count}/{self._expected_chunks} chunks received")
+                
+                # Storing a chunk may complete a group that lost one chunk
+                if self._fec_group:
+                    self._rebuild_chunk(chunk_index // self._fec_group)
+        
+        # Check if all chunks received
+        if self._received_chunk_count == self._expected_chunks:
+            self._log("[CHUNK] All chunks received, data already in place")
             
-            # Validate chunk index
-            if chunk_index < 0 or chunk_index >= len(self._received_chunks):
-                self._log(f"[CHUNK] Invalid chunk index {chunk_index} for {len(self._received_chunks)} total chunks")
-                return
+            # Single copy out of the reassembly buffer, trimmed to the real length
+            complete_data = bytes(memoryview(self._receive_buffer)[:self._receive_length])
             
-            # Store chunk data
-            self._received_chunks[chunk_index] = chunk_data
-            self._received_chunk_count += 1
+            self._log(f"[CHUNK] Complete data assembled ({len(complete_data)} bytes)")
             
-            # Update statistics
-            self._stats['total_data_received'] += data_size
+            # Validate global CRC32
+            calculated_global_crc32 = self._calculate_crc32(complete_data)
+            if self._expected_global_crc32 != calculated_global_crc32:
+                self._log(f"[CRC] Global CRC32 mismatch: expected 0x{self._expected_global_crc32:08X}, calculated 0x{calculated_global_crc32:08X}")
+                self._stats['crc_errors'] += 1
+                self._reject_transfer("Global CRC32 mismatch after assembling complete data", self.ACK_STATUS_GLOBAL_CRC_FAILED)
+                return
             
-            # Notify progress
-            if self._progress_callback:
-                self._progress_callback(self._received_chunk_count, self._expected_chunks, True)
+            self._log(f"[CRC] Global CRC32 validation passed")
             
-            self._log(f"[CHUNK] Progress: {self._received_chunk_count}/{self._expected_chunks} chunks received")
+            # Inflate before confirming, so a corrupt stream is reported to the device
+            if self._compressed_transfer:
+                inflated = lzss_decompress(complete_data, self._max_data_size)
+                if inflated is None:
+                    self._reject_transfer("Compressed payload is corrupt or too large", self.ACK_STATUS_REJECTED)
+                    return
+                self._log(f"[COMPRESS] {len(complete_data)} bytes inflated to {len(inflated)}")
+                self._stats['compression_saved'] += len(inflated) - len(complete_data)
+                complete_data = inflated
             
-            # Check if all chunks received
-            if self._received_chunk_count == self._expected_chunks:
-                self._log("[CHUNK] All chunks received, assembling complete data")
-                
-                # Assemble complete data
-                complete_data = b''.join(chunk for chunk in self._received_chunks if chunk is not None)
-                
-                # Mark transfer as complete
-                self._transfer_in_progress = False
-                
-                self._log(f"[CHUNK] Complete data assembled ({len(complete_data)} bytes)")
-                
-                # Update final statistics
-                self._stats['successful_transfers'] += 1
-                self._stats['last_transfer_time'] = time.time()
-                
-                # Validate global CRC32
-                calculated_global_crc32 = self._calculate_crc32(complete_data)
-                if self._expected_global_crc32 != calculated_global_crc32:
-                    self._log(f"[CRC] Global CRC32 mismatch: expected 0x{self._expected_global_crc32:08X}, calculated 0x{calculated_global_crc32:08X}")
-                    self._stats['crc_errors'] += 1
+            # A delta is rebuilt from the last payload and must match its own CRC32;
+            # the complete payload becomes the base of the next delta
+            if self._delta_base_crc32:
+                rebuilt = None
+                if self._delta_base_crc32 == self._rx_base_crc32:
+                    rebuilt = delta_apply(self._rx_base, complete_data, self._max_data_size)
+                if rebuilt is None or self._calculate_crc32(rebuilt) != self._delta_result_crc32:
+                    self._reject_transfer("Delta does not apply to the base", self.ACK_STATUS_DELTA_BASE_MISSING)
                     return
-                
-                self._log(f"[CRC] Global CRC32 validation passed")
-                
-                # Store data BEFORE setting event and calling callback (critical for sync!)
-                self._received_data = complete_data
-                
-                # Set completion event
-                self._complete_data_event.set()
-                
-                # Call user callback if set
-                if self._data_received_callback:
-                    self._data_received_callback(complete_data)
-                
-                # Clear buffers for next reception
-                self._received_chunks.clear()
-                self._expected_chunks = 0
-                self._received_chunk_count = 0
-                
-        except Exception as e:
-            self._log(f"[ERROR] Failed to process chunk: {e}")
+                self._log(f"[DELTA] {len(complete_data)} byte patch rebuilt to {len(rebuilt)} bytes")
+                self._stats['delta_saved'] += len(rebuilt) - len(complete_data)
+                complete_data = rebuilt
+            if self._keeps_delta_bases():
+                if len(complete_data) <= self._max_delta_base:
+                    self._rx_base = bytes(complete_data)
+                    self._rx_base_crc32 = self._delta_result_crc32 if self._delta_base_crc32 else \
+                        self._calculate_crc32(complete_data)
+                else:
+                    self._rx_base, self._rx_base_crc32 = b'', 0
+            
+            # JSON handlers get CBOR as text, a payload that does not decode is refused like a corrupt one
+            if self._content_type == self.CONTENT_TYPE_CBOR and self._cbor_decoding:
+                try:
+                    decoded = cbor_to_json(complete_data)
+                except ValueError as e:
+                    self._reject_transfer(f"CBOR payload is malformed: {e}", self.ACK_STATUS_REJECTED)
+                    return
+                self._log(f"[CBOR] {len(complete_data)} bytes decoded to {len(decoded)} bytes of JSON")
+                complete_data = decoded
+                self._content_type = self.CONTENT_TYPE_JSON
+            
+            # Mark transfer as complete
+            self._transfer_in_progress = False
+            self._last_completed_crc32 = self._expected_global_crc32
+            
+            # Update final statistics
+            self._stats['successful_transfers'] += 1
+            self._stats['last_transfer_time'] = time.time()
+            
+            # Confirm before the application callback so the device is not kept waiting
+            if use_sack:
+                self._queue_ack(self._expected_global_crc32, self.ACK_STATUS_OK)
+            
+            # Store data BEFORE setting event and calling callback (critical for sync!)
+            self._received_data = complete_data
+            
+            # Set completion event
+            self._complete_data_event.set()
+            
+            # Call user callback if set
+            if self._data_received_callback:
+                self._data_received_callback(complete_data)
+            
+            # Clear buffers for next reception
+            self._clear_receive_buffers()
+        elif use_sack and not parity and chunk_num >= self._report_point:
+            # Device has reached the end of its current round - tell it what is still missing
+            self._queue_nack()
+    
+    def _is_chunk_received(self, chunk_index: int) -> bool:
+        """Check the received bitmap for a chunk (0-based index, internal)"""
+        return bool(self._received_bitmap[chunk_index // 8] & (1 << (chunk_index % 8)))
+    
+    def _store_chunk(self, chunk_num: int, chunk_data: memoryview) -> bool:
+        """
+        Copy a validated chunk to its offset in the reassembly buffer (internal)
+        
+        Returns:
+            True if the chunk was stored, False if it has to be retransmitted
+        """
+        last_chunk = chunk_num == self._expected_chunks
+        data_size = len(chunk_data)
+        
+        # Every chunk but the last one has the device's chunk size, which gives the offsets
+        if self._chunk_stride == 0:
+            if last_chunk and self._expected_chunks > 1:
+                self._log(f"[CHUNK] Last chunk arrived first, offsets unknown - chunk {chunk_num} left for retransmission")
+                return False
+            self._chunk_stride = data_size
+            self._receive_buffer = bytearray(self._expected_chunks * self._chunk_stride)
+        
+        if data_size > self._chunk_stride or (not last_chunk and data_size != self._chunk_stride):
+            self._log(f"[CHUNK] Chunk {chunk_num} has {data_size} bytes, expected {self._chunk_stride}")
+            self._stats['crc_errors'] += 1
+            return False
+        
+        chunk_index = chunk_num - 1
+        offset = chunk_index * self._chunk_stride
+        self._receive_buffer[offset:offset + data_size] = chunk_data
+        self._received_bitmap[chunk_index // 8] |= 1 << (chunk_index % 8)
+        if last_chunk:
+            self._receive_length = offset + data_size
+        return True
+    
+    def _store_parity(self, group: int, parity_data: memoryview) -> bool:
+        """Keep the parity chunk of a group, always a full chunk long (internal)"""
+        if len(parity_data) != self._chunk_stride:
+            self._log(f"[FEC] Parity chunk of group {group} has {len(parity_data)} bytes, expected {self._chunk_stride}")
             self._stats['crc_errors'] += 1
+            return False
+        self._parity_chunks[group] = bytes(parity_data)
+        return True
+    
+    def _rebuild_chunk(self, group: int) -> None:
+        """Rebuild the one chunk a group is missing once its parity is there (internal)"""
+        parity_data = self._parity_chunks[group]
+        if parity_data is None:
+            return
+        first = group * self._fec_group
+        end = min(first + self._fec_group, self._expected_chunks)
+        missing = [i for i in range(first, end) if not self._is_chunk_received(i)]
+        # The last chunk is never rebuilt, it is still in flight after the last parity chunk
+        if len(missing) != 1 or missing[0] == self._expected_chunks - 1:
+            return
+        
+        # XOR of the parity and every other chunk of the group, the last one at its real length
+        stride = self._chunk_stride
+        value = int.from_bytes(parity_data, 'little')
+        for i in range(first, end):
+            if i != missing[0]:
+                offset = i * stride
+                length = min(stride, self._receive_length - offset)
+                value ^= int.from_bytes(self._receive_buffer[offset:offset + length], 'little')
+        offset = missing[0] * stride
+        self._receive_buffer[offset:offset + stride] = value.to_bytes(stride, 'little')
+        self._received_bitmap[missing[0] // 8] |= 1 << (missing[0] % 8)
+        self._received_chunk_count += 1
+        self._stats['fec_recovered'] += 1
+        self._log(f"[FEC] Chunk {missing[0] + 1} rebuilt from parity")
+    
+    def _clear_receive_buffers(self) -> None:
+        """Release the reassembly state (internal)"""
+        self._receive_buffer = bytearray()
+        self._received_bitmap = bytearray()
+        self._compressed_transfer = False
+        self._fec_group = 0
+        self._parity_chunks = []
+        self._suspended_transfer_id = 0
+        self._chunk_stride = 0
+        self._receive_length = 0
+        self._expected_chunks = 0
+        self._received_chunk_count = 0
+    
+    def _queue_ack(self, global_crc32: int, status: int) -> None:
+        """Queue an ACK frame for the notification handler to write (internal)"""
+        self._pending_reports.append(struct.pack('<HBIB', 0, self.FRAME_ACK, global_crc32, status))
+        self._log(f"[SACK] ACK queued for transfer 0x{global_crc32:08X} (status {status})")
+    
+    def _queue_nack(self) -> None:
+        """Queue a NACK listing missing chunks of the current transfer (internal)"""
+        missing = [i + 1 for i in range(self._expected_chunks) if not self._is_chunk_received(i)]
+        large = self._uses_large()
+        header_size = 11 if large else 9
+        capacity_bits = min(self._frame_mtu - self.ATT_HEADER_SIZE - header_size, self.MAX_NACK_BITMAP_BYTES) * 8
+        base = missing[0]
+        listed = [chunk_num for chunk_num in missing if chunk_num - base < capacity_bits]
+        
+        bitmap = bytearray((listed[-1] - base) // 8 + 1)
+        for chunk_num in listed:
+            bit = chunk_num - base
+            bitmap[bit // 8] |= 1 << (bit % 8)
+        
+        # The retransmission round ends with the highest chunk we asked for
+        self._report_point = listed[-1]
+        if large:
+            header = struct.pack('<HBII', 0, self.FRAME_NACK_LARGE, self._expected_global_crc32, base)
+        else:
+            header = struct.pack('<HBIH', 0, self.FRAME_NACK, self._expected_global_crc32, base)
+        self._pending_reports.append(header + bytes(bitmap))
+        self._log(f"[SACK] NACK queued: {len(listed)} chunks missing from chunk {base}")
+    
+    def _reject_transfer(self, reason: str, status: int) -> None:
+        """Cancel current transfer and let the device know it will not complete (internal)"""
+        global_crc32 = self._expected_global_crc32 or 0
+        self._cancel_transfer(reason)
+        if self._uses_sack():
+            self._queue_ack(global_crc32, status)
     
     def _log(self, message: str) -> None:
         """
@@ -507,13 +2328,63 @@ class ChunkedBLEProtocol:
         Args:
             message: Message to log
         """
-        print(message)
+        print(self._log_prefix + message)
 
     # Statistics and diagnostics
     def get_statistics(self) -> dict:
         """Get transfer statistics"""
         return self._stats.copy()
     
+    async def read_diagnostics(self) -> Optional[dict]:
+        """
+        Read the device's statistics of this connection from its diagnostics characteristic
+        
+        Returns:
+            Counters, stage timings (µs), frame gap histograms ([0] < 1 ms, [i] < 2^i ms,
+            last >= 64 ms) and the last sent/received transfer, seen from the device;
+            None if the device has no diagnostics or does not share them
+        """
+        try:
+            value = bytes(await self.client.read_gatt_char(self.diagnostics_uuid))
+        except Exception as e:
+            self._log(f"[DIAG] Diagnostics read failed: {e}")
+            return None
+        
+        size = struct.calcsize(self.DIAGNOSTICS_FORMAT)
+        transfer_size = struct.calcsize(self.DIAGNOSTICS_TRANSFER_FORMAT)
+        if len(value) < size + 2 * transfer_size or value[0] != self.DIAGNOSTICS_VERSION:
+            self._log(f"[DIAG] Unexpected diagnostics value ({len(value)} bytes)")
+            return None
+        
+        fields = struct.unpack(self.DIAGNOSTICS_FORMAT, value[:size])
+        counters = len(self.DIAGNOSTICS_COUNTERS)
+        diagnostics = {'uptime_ms': fields[1]}
+        diagnostics.update(zip(self.DIAGNOSTICS_COUNTERS, fields[2:2 + counters]))
+        gaps = 2 + counters
+        diagnostics['rx_gaps'] = list(fields[gaps:gaps + 8])
+        diagnostics['tx_gaps'] = list(fields[gaps + 8:gaps + 16])
+        diagnostics['mtu'], diagnostics['conn_interval'], diagnostics['tx_phy'], diagnostics['rx_phy'] = fields[gaps + 16:]
+        
+        for i, name in enumerate(('last_sent', 'last_received')):
+            offset = size + i * transfer_size
+            (start_us, duration_us, data_bytes, chunks, retransmissions, rate, mtu, interval, phy, channel,
+             flags) = struct.unpack(self.DIAGNOSTICS_TRANSFER_FORMAT, value[offset:offset + transfer_size])
+            diagnostics[name] = {
+                'start_us': start_us,
+                'duration_us': duration_us,
+                'bytes': data_bytes,
+                'chunks': chunks,
+                'retransmissions': retransmissions,
+                'bytes_per_second': rate,
+                'mtu': mtu,
+                'conn_interval': interval,
+                'tx_phy': phy & 0x0F,
+                'rx_phy': phy >> 4,
+                'channel': channel,
+                'success': bool(flags & 2)
+            }
+        return diagnostics
+    
     def reset_statistics(self) -> None:
         """Reset all statistics"""
         self._stats = {
@@ -522,7 +2393,14 @@ class ChunkedBLEProtocol:
             'crc_errors': 0,
             'timeouts': 0,
             'successful_transfers': 0,
-            'last_transfer_time': 0.0
+            'last_transfer_time': 0.0,
+            'retransmissions': 0,
+            'compression_saved': 0,
+            'parity_sent': 0,
+            'fec_recovered': 0,
+            'delta_saved': 0,
+            'last_send_rate': 0.0,
+            'last_send_write_without_response': False
         }
         self._log("[STATS] Statistics reset")
     
@@ -563,18 +2441,16 @@ class ChunkedBLEProtocol:
         self._stats['timeouts'] += 1
         
         # Clear receive buffers
-        self._received_chunks.clear()
-        self._expected_chunks = 0
-        self._received_chunk_count = 0
+        self._clear_receive_buffers()
         self._complete_data_event.clear()
     
     def _validate_data_size(self, size: int) -> bool:
         """Validate data size against security limits"""
-        if size > self.MAX_TOTAL_DATA_SIZE:
-            self._log(f"[SECURITY] Data size {size} exceeds limit {self.MAX_TOTAL_DATA_SIZE}")
+        if size > self._max_data_size:
+            self._log(f"[SECURITY] Data size {size} exceeds limit {self._max_data_size}")
             return False
         return True
     
     def _calculate_crc32(self, data: bytes) -> int:
-        """Calculate CRC32 for data"""
+        """Calculate CRC32 for data (same CRC-32 as the ESP32 CRC32 class, check value 0xCBF43926)"""
         return zlib.crc32(data) & 0xFFFFFFFF
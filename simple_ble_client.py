@@ -7,6 +7,7 @@ Provides easy-to-use high-level API for BLE JSON data exchange
 import asyncio
 import json
 import sys
+from typing import Dict, List, Optional
 from bleak import BleakScanner, BleakClient
 from chunked_ble_protocol import ChunkedBLEProtocol, DEFAULT_SERVICE_UUID, DEFAULT_CHAR_UUID
 
@@ -22,21 +23,29 @@ class SimpleBLEClient:
         await client.connect()
         await client.send_json({"test": "data"})
         response = await client.receive_json()
+    
+    Several clients may run in one event loop, one per device address (see send_to_devices()).
     """
     
-    def __init__(self, device_name: str = "BLE-Chunked"):
+    def __init__(self, device_name: str = "BLE-Chunked", address: Optional[str] = None,
+                 connect_lock: Optional[asyncio.Lock] = None):
         """
         Initialize Simple BLE Client
         
         Args:
             device_name: Name of target BLE device
+            address: Connect to this address instead of scanning for the name
+            connect_lock: Lock shared by clients that must not connect at the same time
+                          (BlueZ refuses a second connection attempt while one is pending)
         """
         self.device_name = device_name
+        self.address = address
+        self.connect_lock = connect_lock
         self.client = None
         self.protocol = None
         self.target_device = None
         
-        print(f"[INIT] Simple BLE client for device: {device_name}")
+        print(f"[INIT] Simple BLE client for device: {address or device_name}")
     
     def set_data_received_callback(self, callback) -> None:
         """Set callback for received data"""
@@ -83,18 +92,25 @@ class SimpleBLEClient:
         """
         try:
             # Scan for device if not already found
-            if not self.target_device:
+            if not self.address and not self.target_device:
                 if not await self.scan_and_find_device():
                     return False
+            address = self.address or self.target_device.address
             
-            # Connect to device
-            print(f"[BLE] Connecting to {self.target_device.address}...")
-            self.client = BleakClient(self.target_device.address)
-            await self.client.connect()
+            # Connect to device, one connection attempt at a time when the lock is shared
+            print(f"[BLE] Connecting to {address}...")
+            self.client = BleakClient(address)
+            if self.connect_lock:
+                async with self.connect_lock:
+                    await self.client.connect()
+            else:
+                await self.client.connect()
             print(f"[BLE] Connected successfully")
             
-            # Initialize protocol (C++-like API)
+            # Initialize protocol (C++-like API), log lines name the device when there may be several
             self.protocol = ChunkedBLEProtocol(self.client)
+            if self.address:
+                self.protocol.set_log_prefix(f"[{address}] ")
             
             # Set callbacks if provided
             if hasattr(self, '_data_callback'):
@@ -137,7 +153,7 @@ class SimpleBLEClient:
         Send JSON data
         
         Args:
-            data: Dictionary to send as JSON
+            data: Dictionary to send as JSON (CBOR on the wire when the device reads it)
             
         Returns:
             True if sent successfully, False otherwise
@@ -147,8 +163,8 @@ class SimpleBLEClient:
             return False
         
         try:
-            json_data = json.dumps(data).encode('utf-8')
-            return await self.protocol.send_data(json_data)
+            # CBOR-encoded for devices that read content types, JSON text otherwise
+            return await self.protocol.send_json(data)
         except Exception as e:
             print(f"[ERROR] Failed to send JSON: {e}")
             return False
@@ -251,6 +267,59 @@ async def simple_json_exchange(device_name: str, request_data: dict, timeout: fl
         await client.disconnect()
 
 
+async def find_devices(device_name: str = "BLE-Chunked", timeout: float = 10.0) -> List[str]:
+    """
+    Scan for every device advertising the given name
+    
+    Args:
+        device_name: Name of the BLE devices
+        timeout: Scan time in seconds
+        
+    Returns:
+        Addresses of the devices found
+    """
+    devices = await BleakScanner.discover(timeout=timeout)
+    addresses = [device.address for device in devices if device.name == device_name]
+    print(f"[SCAN] Found {len(addresses)} device(s) named '{device_name}'")
+    return addresses
+
+
+async def send_to_devices(addresses: List[str], data, max_concurrent: int = 4) -> Dict[str, bool]:
+    """
+    Send the same payload to several devices at once
+    
+    Connections are opened one after another, transfers then run concurrently in this
+    event loop, at most max_concurrent devices at a time.
+    
+    Args:
+        addresses: Device addresses, e.g. from find_devices()
+        data: bytes to send raw, or a dict/list to send as JSON
+        max_concurrent: Devices connected at the same time
+        
+    Returns:
+        Address -> True if that device acknowledged the payload
+    """
+    slots = asyncio.Semaphore(max(1, max_concurrent))
+    connect_lock = asyncio.Lock()
+    
+    async def provision(address: str) -> bool:
+        async with slots:
+            client = SimpleBLEClient(address=address, connect_lock=connect_lock)
+            try:
+                if not await client.connect():
+                    return False
+                if isinstance(data, (bytes, bytearray)):
+                    return await client.send_data(bytes(data))
+                return await client.send_json(data)
+            finally:
+                await client.disconnect()
+    
+    results = await asyncio.gather(*(provision(address) for address in addresses), return_exceptions=True)
+    outcome = {address: result is True for address, result in zip(addresses, results)}
+    print(f"[PROVISION] {sum(outcome.values())}/{len(addresses)} device(s) succeeded")
+    return outcome
+
+
 # Demo usage
 async def demo():
     """Demo usage of Simple BLE Client"""
@@ -337,8 +406,43 @@ async def send_json_file(file_path: str, device_name: str = "BLE-Chunked"):
         return None
 
 
+async def provision_json_file(file_path: str, device_name: str = "BLE-Chunked", max_concurrent: int = 4):
+    """
+    Send a JSON file to every device advertising the given name
+    
+    Args:
+        file_path: Path to JSON file
+        device_name: BLE device name
+        max_concurrent: Devices connected at the same time
+    """
+    try:
+        with open(file_path, 'r', encoding='utf-8') as f:
+            json_data = json.load(f)
+    except (OSError, json.JSONDecodeError) as e:
+        print(f"[ERROR] Cannot load '{file_path}': {e}")
+        return None
+    
+    addresses = await find_devices(device_name)
+    results = await send_to_devices(addresses, json_data, max_concurrent)
+    for address, ok in results.items():
+        print(f"[PROVISION] {address}: {'OK' if ok else 'FAILED'}")
+    return results
+
+
 if __name__ == "__main__":
-    if len(sys.argv) > 1:
+    if len(sys.argv) > 2 and sys.argv[1] == "--all":
+        # Provisioning mode: send JSON file to every device with the name
+        json_file = sys.argv[2]
+        device_name = sys.argv[3] if len(sys.argv) > 3 else "BLE-Chunked"
+        max_concurrent = int(sys.argv[4]) if len(sys.argv) > 4 else 4
+        
+        print(f"=== Sending JSON file: {json_file} to every {device_name} ===")
+        
+        try:
+            asyncio.run(provision_json_file(json_file, device_name, max_concurrent))
+        except KeyboardInterrupt:
+            print("\n[INTERRUPTED] Operation cancelled by user")
+    elif len(sys.argv) > 1:
         # File mode: send JSON file
         json_file = sys.argv[1]
         device_name = sys.argv[2] if len(sys.argv) > 2 else "BLE-Chunked"
@@ -0,0 +1,57 @@
+#ifndef BLE_STACK_H
+#define BLE_STACK_H
+
+/**
+ * BLEStack - Host stack selection for ChunkedBLEProtocol
+ *
+ * Bluedroid through the Arduino BLE library by default. With -DCHUNKED_BLE_NIMBLE=1 in
+ * platformio.ini build_flags (and NimBLE-Arduino in lib_deps) the protocol runs on NimBLE,
+ * which leaves considerably more heap and answers writes with less dispatch overhead.
+ *
+ * The NimBLE classes are aliased to the Arduino names, so applications including only
+ * ChunkedBLEProtocol.h build unchanged on both stacks:
+ *   BLEDevice::init("BLE-Chunked");
+ *   BLEServer* server = BLEDevice::createServer();
+ *   ChunkedBLEProtocol protocol(server);
+ *
+ * CHUNKED_BLE_L2CAP_COC is set when the stack offers LE Credit Based channels, i.e. on
+ * NimBLE with CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0.
+ */
+
+#ifndef CHUNKED_BLE_NIMBLE
+#define CHUNKED_BLE_NIMBLE 0
+#endif
+
+#if CHUNKED_BLE_NIMBLE
+#include <NimBLEDevice.h>
+// Raw host API for per-client notifications, GAP link requests and L2CAP channels
+#if defined(CONFIG_NIMBLE_CPP_IDF)
+#include "host/ble_hs.h"
+#else
+#include "nimble/nimble/host/include/host/ble_hs.h"
+#endif
+
+typedef NimBLEDevice BLEDevice;
+typedef NimBLEServer BLEServer;
+typedef NimBLEService BLEService;
+typedef NimBLECharacteristic BLECharacteristic;
+typedef NimBLEAdvertising BLEAdvertising;
+typedef NimBLEServerCallbacks BLEServerCallbacks;
+typedef NimBLECharacteristicCallbacks BLECharacteristicCallbacks;
+
+#if defined(CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM) && CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0
+#define CHUNKED_BLE_L2CAP_COC 1
+#endif
+#else
+#include <BLEDevice.h>
+#include <BLEServer.h>
+#include <BLEUtils.h>
+#include <BLE2902.h>
+#include <esp_gap_ble_api.h>
+#endif
+
+#ifndef CHUNKED_BLE_L2CAP_COC
+#define CHUNKED_BLE_L2CAP_COC 0
+#endif
+
+#endif // BLE_STACK_H
@@ -0,0 +1,73 @@
+#ifndef BLE_TRANSPORT_H
+#define BLE_TRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <esp_err.h>
+
+/**
+ * BLETransport - Frame transport beneath ChunkedBLEProtocol
+ *
+ * The protocol builds every frame (control or data) itself and only needs a way to
+ * get it to one connected peer and to hear the peer's frames back. The GATT
+ * characteristic is always available; a host stack with LE Credit Based (L2CAP CoC)
+ * channels can add a transport the protocol switches a connection to once the
+ * peer opened such a channel.
+ *
+ * Frames keep their boundaries: one send() arrives as one Receiver::onTransportFrame().
+ *
+ * Usage (transport side):
+ *   receiver->onTransportOpened(this, connId, frameSize);   // channel up, frames may flow
+ *   receiver->onTransportFrame(this, connId, data, length);
+ *   receiver->onTransportClosed(this, connId);
+ */
+class BLETransport {
+public:
+    /**
+     * Receiver - Side of the protocol a transport reports to
+     *
+     * Called from the host stack's task; implementations must not block.
+     */
+    class Receiver {
+    public:
+        virtual ~Receiver() {}
+
+        /**
+         * A frame arrived from a peer
+         *
+         * @param data Frame, only valid during the call
+         */
+        virtual void onTransportFrame(BLETransport* transport, uint16_t connId,
+                                      const uint8_t* data, size_t length) = 0;
+
+        /**
+         * A peer opened the transport, frames of up to frameSize bytes may flow both ways
+         */
+        virtual void onTransportOpened(BLETransport* transport, uint16_t connId, uint16_t frameSize) = 0;
+
+        /**
+         * The transport of a peer closed, the protocol continues on GATT
+         */
+        virtual void onTransportClosed(BLETransport* transport, uint16_t connId) = 0;
+    };
+
+    virtual ~BLETransport() {}
+
+    /**
+     * Get short name for logs
+     */
+    virtual const char* name() const = 0;
+
+    /**
+     * Send one frame to a connected peer
+     *
+     * @param connId Peer's conn_id
+     * @param data Frame
+     * @param length Frame length, at most the frame size the transport reported
+     * @return ESP_OK if queued, ESP_FAIL if the stack is out of buffers for now
+     *         (retry the same frame), other errors if the link is gone
+     */
+    virtual esp_err_t send(uint16_t connId, const uint8_t* data, size_t length) = 0;
+};
+
+#endif // BLE_TRANSPORT_H
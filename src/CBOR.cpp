@@ -0,0 +1,946 @@
+#include "CBOR.h"
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+
+namespace {
+
+const uint8_t MAJOR_UNSIGNED = 0;
+const uint8_t MAJOR_NEGATIVE = 1;
+const uint8_t MAJOR_BYTES = 2;
+const uint8_t MAJOR_TEXT = 3;
+const uint8_t MAJOR_ARRAY = 4;
+const uint8_t MAJOR_MAP = 5;
+const uint8_t MAJOR_TAG = 6;
+const uint8_t MAJOR_SIMPLE = 7;
+const uint8_t INFO_INDEFINITE = 31;
+const uint8_t BREAK = 0xFF;
+const uint8_t SIMPLE_FALSE = 0xF4;
+const uint8_t SIMPLE_TRUE = 0xF5;
+const uint8_t SIMPLE_NULL = 0xF6;
+const uint8_t FLOAT_HALF = 0xF9;
+const uint8_t FLOAT_SINGLE = 0xFA;
+const uint8_t FLOAT_DOUBLE = 0xFB;
+
+// Build an initial byte with the shortest argument encoding, returns its length
+size_t buildHead(uint8_t* head, uint8_t major, uint64_t value) {
+    major <<= 5;
+    if (value < 24) {
+        head[0] = major | (uint8_t)value;
+        return 1;
+    }
+    size_t bytes = value <= 0xFF ? 1 : value <= 0xFFFF ? 2 : value <= 0xFFFFFFFFu ? 4 : 8;
+    head[0] = major | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27);
+    for (size_t i = 0; i < bytes; i++) {
+        head[1 + i] = (uint8_t)(value >> (8 * (bytes - 1 - i)));
+    }
+    return 1 + bytes;
+}
+
+// Append an initial byte with the shortest argument encoding
+void writeHead(std::string& out, uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    out.append((const char*)head, buildHead(head, major, value));
+}
+
+// Append a big-endian value
+void writeBigEndian(std::string& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out.push_back((char)(value >> (8 * (bytes - 1 - i))));
+    }
+}
+
+// Half-precision bits of a float, false if the conversion would lose anything
+bool toHalf(float value, uint16_t& half) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exponent = (bits >> 23) & 0xFF;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if (exponent == 0xFF) {
+        // Infinity, or a NaN whose payload fits
+        if (mantissa & 0x1FFF) {
+            return false;
+        }
+        half = sign | 0x7C00 | (mantissa >> 13);
+        return true;
+    }
+    if (exponent == 0 && mantissa == 0) {
+        half = sign;
+        return true;
+    }
+    int halfExponent = exponent - 127 + 15;
+    if (halfExponent >= 31) {
+        return false;
+    }
+    if (halfExponent >= 1) {
+        if (mantissa & 0x1FFF) {
+            return false;
+        }
+        half = sign | (halfExponent << 10) | (mantissa >> 13);
+        return true;
+    }
+    // Subnormal half: significand * 2^(exponent - 150) = m * 2^-24
+    uint32_t significand = mantissa | 0x800000;
+    int shift = 126 - exponent;
+    if (exponent == 0 || shift > 23 || (significand & ((1u << shift) - 1))) {
+        return false;
+    }
+    half = sign | (significand >> shift);
+    return true;
+}
+
+// Value of half-precision bits
+double fromHalf(uint16_t half) {
+    int exponent = (half >> 10) & 0x1F;
+    int mantissa = half & 0x3FF;
+    double value;
+    if (exponent == 0) {
+        value = ldexp(mantissa, -24);
+    } else if (exponent == 31) {
+        value = mantissa ? NAN : INFINITY;
+    } else {
+        value = ldexp(mantissa + 1024, exponent - 25);
+    }
+    return (half & 0x8000) ? -value : value;
+}
+
+// Append a float in the shortest precision that keeps its value
+void writeFloat(std::string& out, double value) {
+    if (isnan(value) || isinf(value) || (fabs(value) <= FLT_MAX && (double)(float)value == value)) {
+        float single = (float)value;
+        uint16_t half;
+        if (toHalf(single, half)) {
+            out.push_back((char)FLOAT_HALF);
+            writeBigEndian(out, half, 2);
+            return;
+        }
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        out.push_back((char)FLOAT_SINGLE);
+        writeBigEndian(out, bits, 4);
+        return;
+    }
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    out.push_back((char)FLOAT_DOUBLE);
+    writeBigEndian(out, bits, 8);
+}
+
+// Append a code point as UTF-8
+void appendUTF8(std::string& out, uint32_t codePoint) {
+    if (codePoint < 0x80) {
+        out.push_back((char)codePoint);
+    } else if (codePoint < 0x800) {
+        out.push_back((char)(0xC0 | (codePoint >> 6)));
+        out.push_back((char)(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        out.push_back((char)(0xE0 | (codePoint >> 12)));
+        out.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (codePoint & 0x3F)));
+    } else {
+        out.push_back((char)(0xF0 | (codePoint >> 18)));
+        out.push_back((char)(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.push_back((char)(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.push_back((char)(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+// Recursive-descent JSON parser writing CBOR as it goes
+class JSONEncoder {
+public:
+    JSONEncoder(const char* text, size_t length, std::string& out)
+        : text(text), length(length), position(0), out(out) {
+    }
+
+    bool encode() {
+        skipSpace();
+        if (!value(0)) {
+            return false;
+        }
+        skipSpace();
+        return position == length;
+    }
+
+private:
+    const char* text;
+    size_t length;
+    size_t position;
+    std::string& out;
+    std::string scratch;      // Unescaped string, reused
+
+    void skipSpace() {
+        while (position < length && (text[position] == ' ' || text[position] == '\t' ||
+               text[position] == '\n' || text[position] == '\r')) {
+            position++;
+        }
+    }
+
+    bool at(char c) const {
+        return position < length && text[position] == c;
+    }
+
+    bool isDigit() const {
+        return position < length && text[position] >= '0' && text[position] <= '9';
+    }
+
+    bool value(uint8_t depth) {
+        if (position >= length) {
+            return false;
+        }
+        switch (text[position]) {
+            case '{':
+                return container(true, depth);
+            case '[':
+                return container(false, depth);
+            case '"':
+                return string();
+            case 't':
+                return literal("true", SIMPLE_TRUE);
+            case 'f':
+                return literal("false", SIMPLE_FALSE);
+            case 'n':
+                return literal("null", SIMPLE_NULL);
+            default:
+                return number();
+        }
+    }
+
+    // Array or map, its head inserted in front once the element count is known
+    bool container(bool map, uint8_t depth) {
+        if (depth >= CBOR::MAX_DEPTH) {
+            return false;
+        }
+        char close = map ? '}' : ']';
+        position++;
+        size_t start = out.size();
+        uint64_t count = 0;
+        skipSpace();
+        if (at(close)) {
+            position++;
+        } else {
+            for (;;) {
+                skipSpace();
+                if (map) {
+                    if (!at('"') || !string()) {
+                        return false;
+                    }
+                    skipSpace();
+                    if (!at(':')) {
+                        return false;
+                    }
+                    position++;
+                    skipSpace();
+                }
+                if (!value(depth + 1)) {
+                    return false;
+                }
+                count++;
+                skipSpace();
+                if (at(',')) {
+                    position++;
+                } else if (at(close)) {
+                    position++;
+                    break;
+                } else {
+                    return false;
+                }
+            }
+        }
+        uint8_t head[9];
+        out.insert(start, (const char*)head, buildHead(head, map ? MAJOR_MAP : MAJOR_ARRAY, count));
+        return true;
+    }
+
+    // String, copied straight through unless it has escapes
+    bool string() {
+        size_t start = ++position;
+        while (position < length && text[position] != '"' && text[position] != '\\') {
+            if ((uint8_t)text[position] < 0x20) {
+                return false;
+            }
+            position++;
+        }
+        if (at('"')) {
+            writeHead(out, MAJOR_TEXT, position - start);
+            out.append(text + start, position - start);
+            position++;
+            return true;
+        }
+
+        scratch.assign(text + start, position - start);
+        while (position < length && text[position] != '"') {
+            char c = text[position++];
+            if ((uint8_t)c < 0x20) {
+                return false;
+            }
+            if (c != '\\') {
+                scratch.push_back(c);
+                continue;
+            }
+            if (position >= length) {
+                return false;
+            }
+            c = text[position++];
+            switch (c) {
+                case '"': case '\\': case '/':
+                    scratch.push_back(c);
+                    break;
+                case 'b':
+                    scratch.push_back('\b');
+                    break;
+                case 'f':
+                    scratch.push_back('\f');
+                    break;
+                case 'n':
+                    scratch.push_back('\n');
+                    break;
+                case 'r':
+                    scratch.push_back('\r');
+                    break;
+                case 't':
+                    scratch.push_back('\t');
+                    break;
+                case 'u': {
+                    uint32_t codePoint;
+                    if (!hex4(codePoint)) {
+                        return false;
+                    }
+                    // Surrogate pairs make one code point, lone surrogates are no valid UTF-8
+                    if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+                        uint32_t low;
+                        if (position + 2 > length || text[position] != '\\' || text[position + 1] != 'u') {
+                            return false;
+                        }
+                        position += 2;
+                        if (!hex4(low) || low < 0xDC00 || low >= 0xE000) {
+                            return false;
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (codePoint >= 0xDC00 && codePoint < 0xE000) {
+                        return false;
+                    }
+                    appendUTF8(scratch, codePoint);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        if (!at('"')) {
+            return false;
+        }
+        position++;
+        writeHead(out, MAJOR_TEXT, scratch.size());
+        out.append(scratch);
+        return true;
+    }
+
+    bool hex4(uint32_t& value) {
+        if (position + 4 > length) {
+            return false;
+        }
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text[position++];
+            value <<= 4;
+            if (c >= '0' && c <= '9') {
+                value |= c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                value |= c - 'a' + 10;
+            } else if (c >= 'A' && c <= 'F') {
+                value |= c - 'A' + 10;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool literal(const char* word, uint8_t simple) {
+        size_t wordLength = strlen(word);
+        if (length - position < wordLength || memcmp(text + position, word, wordLength) != 0) {
+            return false;
+        }
+        position += wordLength;
+        out.push_back((char)simple);
+        return true;
+    }
+
+    // Integers without fraction or exponent stay integers, everything else is a float
+    bool number() {
+        size_t start = position;
+        bool negative = at('-');
+        if (negative) {
+            position++;
+        }
+        if (at('0')) {
+            position++;
+        } else if (isDigit()) {
+            while (isDigit()) {
+                position++;
+            }
+        } else {
+            return false;
+        }
+        size_t integerEnd = position;
+        bool integer = true;
+        if (at('.')) {
+            position++;
+            if (!isDigit()) {
+                return false;
+            }
+            while (isDigit()) {
+                position++;
+            }
+            integer = false;
+        }
+        if (at('e') || at('E')) {
+            position++;
+            if (at('+') || at('-')) {
+                position++;
+            }
+            if (!isDigit()) {
+                return false;
+            }
+            while (isDigit()) {
+                position++;
+            }
+            integer = false;
+        }
+
+        if (integer) {
+            uint64_t magnitude = 0;
+            bool overflow = false;
+            for (size_t i = start + (negative ? 1 : 0); i < integerEnd; i++) {
+                uint64_t digit = text[i] - '0';
+                if (magnitude > (UINT64_MAX - digit) / 10) {
+                    overflow = true;
+                    break;
+                }
+                magnitude = magnitude * 10 + digit;
+            }
+            if (!overflow) {
+                if (negative && magnitude) {
+                    writeHead(out, MAJOR_NEGATIVE, magnitude - 1);
+                } else {
+                    writeHead(out, MAJOR_UNSIGNED, magnitude);
+                }
+                return true;
+            }
+        }
+
+        // strtod() needs a terminated copy of the token
+        char buffer[64];
+        size_t tokenLength = position - start;
+        double value;
+        if (tokenLength < sizeof(buffer)) {
+            memcpy(buffer, text + start, tokenLength);
+            buffer[tokenLength] = '\0';
+            value = strtod(buffer, nullptr);
+        } else {
+            value = strtod(std::string(text + start, tokenLength).c_str(), nullptr);
+        }
+        writeFloat(out, value);
+        return true;
+    }
+};
+
+// Writes the Reader's items as JSON text
+class JSONDecoder {
+public:
+    explicit JSONDecoder(std::string& out)
+        : out(out), depth(0), stringOpen(false), carried(0), failed(false) {
+    }
+
+    bool hasFailed() const {
+        return failed;
+    }
+
+    void write(const CBOR::Item& item) {
+        if (failed || item.type == CBOR::ITEM_TAG) {
+            return;
+        }
+        if (item.type == CBOR::ITEM_END) {
+            out.push_back(levels[--depth].map ? '}' : ']');
+            completeValue();
+            return;
+        }
+        bool stringItem = item.type == CBOR::ITEM_TEXT || item.type == CBOR::ITEM_BYTES;
+        if (stringItem && stringOpen) {
+            writeString(item);
+            return;
+        }
+
+        // Separator, and whether the item is a map key
+        bool key = false;
+        if (depth) {
+            Level& level = levels[depth - 1];
+            key = level.map && !(level.items & 1);
+            if (level.items) {
+                out.push_back(level.map && !key ? ':' : ',');
+            }
+        }
+        if (stringItem) {
+            stringOpen = true;
+            out.push_back('"');
+            writeString(item);
+            return;
+        }
+        if (key && (item.type == CBOR::ITEM_ARRAY || item.type == CBOR::ITEM_MAP)) {
+            failed = true;
+            return;
+        }
+
+        // JSON keys are strings, so other scalar keys are quoted
+        if (key) {
+            out.push_back('"');
+        }
+        char number[32];
+        switch (item.type) {
+            case CBOR::ITEM_UNSIGNED:
+                snprintf(number, sizeof(number), "%llu", (unsigned long long)item.value);
+                out.append(number);
+                break;
+            case CBOR::ITEM_NEGATIVE:
+                if (item.value == UINT64_MAX) {
+                    out.append("-18446744073709551616");
+                } else {
+                    snprintf(number, sizeof(number), "-%llu", (unsigned long long)item.value + 1);
+                    out.append(number);
+                }
+                break;
+            case CBOR::ITEM_FLOAT:
+                writeFloat(item.number);
+                break;
+            case CBOR::ITEM_FALSE:
+                out.append("false");
+                break;
+            case CBOR::ITEM_TRUE:
+                out.append("true");
+                break;
+            case CBOR::ITEM_ARRAY:
+            case CBOR::ITEM_MAP:
+                if (depth == CBOR::MAX_DEPTH) {
+                    failed = true;
+                    return;
+                }
+                levels[depth].map = item.type == CBOR::ITEM_MAP;
+                levels[depth].items = 0;
+                depth++;
+                out.push_back(item.type == CBOR::ITEM_MAP ? '{' : '[');
+                return;
+            default:
+                out.append("null");
+                break;
+        }
+        if (key) {
+            out.push_back('"');
+        }
+        completeValue();
+    }
+
+private:
+    struct Level {
+        bool map;
+        uint64_t items;          // Keys and values counted separately
+    };
+
+    std::string& out;
+    Level levels[CBOR::MAX_DEPTH];
+    uint8_t depth;
+    bool stringOpen;
+    uint8_t carry[3];            // Bytes waiting for a complete base64 group
+    uint8_t carried;
+    bool failed;
+
+    void completeValue() {
+        if (depth) {
+            levels[depth - 1].items++;
+        }
+    }
+
+    void writeString(const CBOR::Item& item) {
+        if (item.type == CBOR::ITEM_BYTES) {
+            writeBase64(item.data, item.length, item.last);
+        } else {
+            writeEscaped(item.data, item.length);
+        }
+        if (item.last) {
+            stringOpen = false;
+            out.push_back('"');
+            completeValue();
+        }
+    }
+
+    // Text with the characters JSON needs escaped, everything else copied in runs
+    void writeEscaped(const uint8_t* data, size_t length) {
+        size_t run = 0;
+        for (size_t i = 0; i < length; i++) {
+            uint8_t c = data[i];
+            if (c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            out.append((const char*)data + run, i - run);
+            run = i + 1;
+            switch (c) {
+                case '"':
+                    out.append("\\\"");
+                    break;
+                case '\\':
+                    out.append("\\\\");
+                    break;
+                case '\n':
+                    out.append("\\n");
+                    break;
+                case '\r':
+                    out.append("\\r");
+                    break;
+                case '\t':
+                    out.append("\\t");
+                    break;
+                default: {
+                    char escape[8];
+                    snprintf(escape, sizeof(escape), "\\u%04x", c);
+                    out.append(escape);
+                    break;
+                }
+            }
+        }
+        out.append((const char*)data + run, length - run);
+    }
+
+    // base64url without padding, groups may span pieces
+    void writeBase64(const uint8_t* data, size_t length, bool last) {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        for (size_t i = 0; i < length; i++) {
+            carry[carried++] = data[i];
+            if (carried == 3) {
+                out.push_back(alphabet[carry[0] >> 2]);
+                out.push_back(alphabet[((carry[0] & 0x03) << 4) | (carry[1] >> 4)]);
+                out.push_back(alphabet[((carry[1] & 0x0F) << 2) | (carry[2] >> 6)]);
+                out.push_back(alphabet[carry[2] & 0x3F]);
+                carried = 0;
+            }
+        }
+        if (last && carried) {
+            out.push_back(alphabet[carry[0] >> 2]);
+            if (carried == 1) {
+                out.push_back(alphabet[(carry[0] & 0x03) << 4]);
+            } else {
+                out.push_back(alphabet[((carry[0] & 0x03) << 4) | (carry[1] >> 4)]);
+                out.push_back(alphabet[(carry[1] & 0x0F) << 2]);
+            }
+            carried = 0;
+        }
+    }
+
+    // Shortest text that reads back as the same double, always with a fraction or exponent
+    void writeFloat(double value) {
+        if (isnan(value) || isinf(value)) {
+            out.append("null");
+            return;
+        }
+        char text[32];
+        for (int precision = 15; precision <= 17; precision++) {
+            snprintf(text, sizeof(text), "%.*g", precision, value);
+            if (strtod(text, nullptr) == value) {
+                break;
+            }
+        }
+        out.append(text);
+        if (!strpbrk(text, ".e")) {
+            out.append(".0");
+        }
+    }
+};
+
+} // namespace
+
+// Encode JSON text
+bool CBOR::fromJSON(const char* json, size_t length, std::string& out) {
+    out.clear();
+    out.reserve(length);
+    JSONEncoder encoder(json, length, out);
+    return encoder.encode();
+}
+
+// Decode a complete CBOR item to JSON text
+bool CBOR::toJSON(const uint8_t* data, size_t length, std::string& out) {
+    out.clear();
+    out.reserve(length * 2);
+    JSONDecoder decoder(out);
+    Reader reader;
+    bool parsed = reader.feed(data, length, [&decoder](const Item& item) { decoder.write(item); });
+    return parsed && reader.isFinished() && !decoder.hasFailed();
+}
+
+// Constructor
+CBOR::Reader::Reader() {
+    begin();
+}
+
+// Start a new item
+void CBOR::Reader::begin() {
+    depth = 0;
+    headLength = 0;
+    headNeeded = 1;
+    stringRemaining = 0;
+    stringOffset = 0;
+    stringType = ITEM_TEXT;
+    inString = false;
+    chunkedString = 0;
+    finished = false;
+    failed = false;
+}
+
+// Parse the next piece of the encoding
+bool CBOR::Reader::feed(const uint8_t* data, size_t length, const ItemCallback& callback) {
+    size_t position = 0;
+    while (position < length && !failed) {
+        if (finished) {
+            failed = true;   // Data after the top-level item
+            break;
+        }
+
+        // String contents go out as they arrive
+        if (inString) {
+            size_t take = stringRemaining < length - position ? (size_t)stringRemaining : length - position;
+            stringRemaining -= take;
+            Item item = Item();
+            item.type = stringType;
+            item.indefinite = chunkedString != 0;
+            item.last = stringRemaining == 0 && !chunkedString;
+            item.data = data + position;
+            item.length = take;
+            item.offset = stringOffset;
+            emit(item, callback);
+            stringOffset += take;
+            position += take;
+            if (stringRemaining == 0) {
+                inString = false;
+                if (!chunkedString && !completeItem(callback)) {
+                    failed = true;
+                }
+            }
+            continue;
+        }
+
+        head[headLength++] = data[position++];
+        if (headLength == 1) {
+            uint8_t info = head[0] & 0x1F;
+            headNeeded = info >= 24 && info <= 27 ? 1 + (1 << (info - 24)) : 1;
+        }
+        if (headLength == headNeeded) {
+            headLength = 0;
+            if (!processHead(callback)) {
+                failed = true;
+            }
+        }
+    }
+    return !failed;
+}
+
+// Act on a complete initial byte and argument
+bool CBOR::Reader::processHead(const ItemCallback& callback) {
+    uint8_t major = head[0] >> 5;
+    uint8_t info = head[0] & 0x1F;
+    if (info >= 28 && info < INFO_INDEFINITE) {
+        return false;
+    }
+    bool indefinite = info == INFO_INDEFINITE;
+    uint64_t value = info;
+    if (info >= 24 && !indefinite) {
+        value = 0;
+        for (uint8_t i = 1; i < headNeeded; i++) {
+            value = (value << 8) | head[i];
+        }
+    }
+
+    // An indefinite string holds only definite chunks of its own type
+    if (chunkedString && head[0] != BREAK && (major != chunkedString || indefinite)) {
+        return false;
+    }
+
+    Item item = Item();
+    item.value = value;
+    switch (major) {
+        case MAJOR_UNSIGNED:
+        case MAJOR_NEGATIVE:
+            if (indefinite) {
+                return false;
+            }
+            item.type = major == MAJOR_UNSIGNED ? ITEM_UNSIGNED : ITEM_NEGATIVE;
+            emit(item, callback);
+            return completeItem(callback);
+
+        case MAJOR_BYTES:
+        case MAJOR_TEXT:
+            stringType = major == MAJOR_BYTES ? ITEM_BYTES : ITEM_TEXT;
+            if (indefinite) {
+                chunkedString = major;
+                stringOffset = 0;
+                return true;
+            }
+            if (!chunkedString) {
+                stringOffset = 0;
+            }
+            if (value == 0) {
+                if (chunkedString) {
+                    return true;  // Empty chunk
+                }
+                item.type = stringType;
+                item.last = true;
+                emit(item, callback);
+                return completeItem(callback);
+            }
+            stringRemaining = value;
+            inString = true;
+            return true;
+
+        case MAJOR_ARRAY:
+        case MAJOR_MAP:
+            // Refused before the item goes out, so no callback sees more than MAX_DEPTH levels
+            if ((!indefinite && major == MAJOR_MAP && value > UINT64_MAX / 2) || depth == MAX_DEPTH) {
+                return false;
+            }
+            item.type = major == MAJOR_MAP ? ITEM_MAP : ITEM_ARRAY;
+            item.indefinite = indefinite;
+            item.value = indefinite ? 0 : value;
+            emit(item, callback);
+            return openLevel(indefinite ? 0 : (major == MAJOR_MAP ? value * 2 : value), indefinite,
+                             major == MAJOR_MAP, callback);
+
+        case MAJOR_TAG:
+            if (indefinite) {
+                return false;
+            }
+            item.type = ITEM_TAG;
+            emit(item, callback);
+            return true;
+
+        default:
+            break;
+    }
+
+    // Major type 7: break, simple values and floats
+    if (indefinite) {
+        if (chunkedString) {
+            item.type = stringType;
+            item.indefinite = true;
+            item.last = true;
+            item.offset = stringOffset;
+            emit(item, callback);
+            chunkedString = 0;
+            return completeItem(callback);
+        }
+        if (depth == 0 || !levels[depth - 1].indefinite) {
+            return false;
+        }
+        Level& level = levels[depth - 1];
+        if (level.map && (level.remaining & 1)) {
+            return false;  // Key without a value
+        }
+        depth--;
+        Item end = Item();
+        end.type = ITEM_END;
+        end.indefinite = true;
+        emit(end, callback);
+        return completeItem(callback);
+    }
+    switch (info) {
+        case 20:
+            item.type = ITEM_FALSE;
+            break;
+        case 21:
+            item.type = ITEM_TRUE;
+            break;
+        case 22:
+            item.type = ITEM_NULL;
+            break;
+        case 23:
+            item.type = ITEM_UNDEFINED;
+            break;
+        case 25:
+            item.type = ITEM_FLOAT;
+            item.number = fromHalf((uint16_t)value);
+            break;
+        case 26: {
+            uint32_t bits = (uint32_t)value;
+            float single;
+            memcpy(&single, &bits, sizeof(single));
+            item.type = ITEM_FLOAT;
+            item.number = single;
+            break;
+        }
+        case 27:
+            item.type = ITEM_FLOAT;
+            memcpy(&item.number, &value, sizeof(item.number));
+            break;
+        default:
+            item.type = ITEM_SIMPLE;
+            break;
+    }
+    emit(item, callback);
+    return completeItem(callback);
+}
+
+// Enter an array or map, or close it right away if it is empty
+bool CBOR::Reader::openLevel(uint64_t count, bool indefinite, bool map, const ItemCallback& callback) {
+    if (!indefinite && count == 0) {
+        Item end = Item();
+        end.type = ITEM_END;
+        emit(end, callback);
+        return completeItem(callback);
+    }
+    if (depth == MAX_DEPTH) {
+        return false;
+    }
+    levels[depth].remaining = count;
+    levels[depth].indefinite = indefinite;
+    levels[depth].map = map;
+    depth++;
+    return true;
+}
+
+// Count a finished item against its container, closing the containers it completes
+bool CBOR::Reader::completeItem(const ItemCallback& callback) {
+    for (;;) {
+        if (depth == 0) {
+            finished = true;
+            return true;
+        }
+        Level& level = levels[depth - 1];
+        if (level.indefinite) {
+            level.remaining++;
+            return true;
+        }
+        if (--level.remaining) {
+            return true;
+        }
+        depth--;
+        Item end = Item();
+        end.type = ITEM_END;
+        emit(end, callback);
+    }
+}
+
+// Hand an item to the callback
+void CBOR::Reader::emit(Item& item, const ItemCallback& callback) const {
+    item.depth = depth;
+    if (callback) {
+        callback(item);
+    }
+}
+
+// Check if the top-level item is complete
+bool CBOR::Reader::isFinished() const {
+    return finished;
+}
+
+// Check if the encoding was rejected
+bool CBOR::Reader::hasFailed() const {
+    return failed;
+}
@@ -0,0 +1,148 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <functional>
+
+/**
+ * CBOR - RFC 8949 encoding of JSON payloads and an incremental reader
+ *
+ * fromJSON() turns JSON text into CBOR with definite lengths and the shortest
+ * integer and float forms that keep each value, so keys and numbers lose their
+ * quotes, digits and separators (typically 30-50% smaller). toJSON() turns it
+ * back: byte strings become base64url text, tags are dropped, undefined and
+ * other simple values become null, non-finite floats null, non-text map keys text.
+ *
+ * The Reader parses a stream piece by piece, whatever the split, with a few bytes
+ * of state per nesting level. Strings are handed out in the pieces they arrive in,
+ * so nothing is materialized - a streaming receive callback can act on the items
+ * while the transfer is still coming in.
+ *
+ * Usage:
+ *   std::string cbor;
+ *   if (CBOR::fromJSON(json.data(), json.size(), cbor)) { ... }
+ *
+ *   CBOR::Reader reader;
+ *   reader.begin();
+ *   reader.feed(piece, pieceLength, [](const CBOR::Item& item) { ... });
+ *   reader.isFinished();
+ */
+class CBOR {
+public:
+    static const uint8_t MAX_DEPTH = 16;       // Nested arrays and maps
+
+    enum ItemType : uint8_t {
+        ITEM_UNSIGNED,      // value
+        ITEM_NEGATIVE,      // -1 - value
+        ITEM_BYTES,         // Piece of a byte string
+        ITEM_TEXT,          // Piece of a UTF-8 string, possibly split inside a character
+        ITEM_ARRAY,         // Start of an array of value elements (0 if indefinite)
+        ITEM_MAP,           // Start of a map of value pairs (0 if indefinite), keys and values alternate
+        ITEM_END,           // End of the array or map at depth
+        ITEM_TAG,           // Tag value, applies to the next item
+        ITEM_FALSE,
+        ITEM_TRUE,
+        ITEM_NULL,
+        ITEM_UNDEFINED,
+        ITEM_SIMPLE,        // Other simple value
+        ITEM_FLOAT          // number, from half, single or double precision
+    };
+
+    // One event of the Reader, valid only during the call
+    struct Item {
+        ItemType type;
+        uint8_t depth;          // Arrays and maps around the item (ITEM_END: around its container)
+        bool indefinite;        // Indefinite-length array, map or string
+        bool last;              // ITEM_BYTES/TEXT: the string is complete after this piece
+        uint64_t value;
+        double number;
+        const uint8_t* data;    // ITEM_BYTES/TEXT piece
+        size_t length;
+        size_t offset;          // Offset of the piece in its string
+    };
+
+    typedef std::function<void(const Item& item)> ItemCallback;
+
+    /**
+     * Encode JSON text
+     *
+     * @param json JSON text, one value with optional surrounding whitespace
+     * @param length Length of json
+     * @param out CBOR encoding (contents undefined on false)
+     * @return false if the text is not valid JSON or nests deeper than MAX_DEPTH
+     */
+    static bool fromJSON(const char* json, size_t length, std::string& out);
+
+    /**
+     * Decode a complete CBOR item to JSON text
+     *
+     * @param data CBOR encoding of one item
+     * @param length Length of data
+     * @param out JSON text (contents undefined on false)
+     * @return false if the encoding is malformed, truncated, followed by more data or
+     *         has a map key that is no text, number or simple value
+     */
+    static bool toJSON(const uint8_t* data, size_t length, std::string& out);
+
+    /**
+     * Reader - Incremental parser of one CBOR item
+     */
+    class Reader {
+    public:
+        Reader();
+
+        /**
+         * Start a new item
+         */
+        void begin();
+
+        /**
+         * Parse the next piece of the encoding
+         *
+         * @param data CBOR bytes, any split of the encoding
+         * @param length Length of data
+         * @param callback Receives the items in order
+         * @return false once the encoding turned out malformed, too deep or followed by more data
+         */
+        bool feed(const uint8_t* data, size_t length, const ItemCallback& callback);
+
+        /**
+         * Check if the top-level item is complete
+         */
+        bool isFinished() const;
+
+        /**
+         * Check if the encoding was rejected
+         */
+        bool hasFailed() const;
+
+    private:
+        struct Level {
+            uint64_t remaining;       // Items left, counting keys and values separately
+            bool indefinite;          // remaining counts up instead, to check the pairs of maps
+            bool map;
+        };
+
+        Level levels[MAX_DEPTH];
+        uint8_t depth;
+        uint8_t head[9];              // Initial byte and argument of the item being read
+        uint8_t headLength;
+        uint8_t headNeeded;
+        uint64_t stringRemaining;     // Bytes left of the definite string (chunk) being read
+        size_t stringOffset;
+        ItemType stringType;
+        bool inString;
+        uint8_t chunkedString;        // Major type of the indefinite string open, 0 if none
+        bool finished;
+        bool failed;
+
+        bool processHead(const ItemCallback& callback);
+        bool openLevel(uint64_t count, bool indefinite, bool map, const ItemCallback& callback);
+        bool completeItem(const ItemCallback& callback);
+        void emit(Item& item, const ItemCallback& callback) const;
+    };
+};
+
+#endif // CBOR_H
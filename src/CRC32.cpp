@@ -0,0 +1,202 @@
+#include "CRC32.h"
+#include <string.h>
+
+#if defined(ESP_PLATFORM) && !defined(CHUNKED_BLE_CRC32_SOFTWARE)
+#define CRC32_USE_ROM 1
+#include <esp_rom_crc.h>
+#else
+#define CRC32_USE_ROM 0
+#endif
+
+static const uint32_t CRC32_POLYNOMIAL = 0xEDB88320;  // Reflected 0x04C11DB7
+
+// The tables below are constexpr, so they are generated by the compiler into rodata (flash on ESP32)
+// instead of being built in RAM at startup. C++11 constexpr functions are single expressions,
+// hence the recursion; at runtime the tail calls compile to loops.
+namespace {
+
+// 0, 1, ..., N - 1 as a parameter pack
+template <unsigned... I> struct Indices {};
+template <unsigned N, unsigned... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template <unsigned... I> struct MakeIndices<0, I...> {
+    typedef Indices<I...> type;
+};
+
+// CRC register after shifting bits zero bits through it
+constexpr uint32_t shiftBits(uint32_t crc, unsigned bits) {
+    return bits ? shiftBits((crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1, bits - 1) : crc;
+}
+
+// Multiply two polynomials modulo the CRC polynomial (bit-reflected, x^0 in the top bit);
+// m walks the bits of a, the product is complete once no lower bits are left
+constexpr uint32_t multModP(uint32_t a, uint32_t b, uint32_t m = (uint32_t)1 << 31, uint32_t p = 0) {
+    return ((a & m) && !(a & (m - 1))) ? p ^ b :
+        m == 0 ? p : multModP(a, shiftBits(b, 1), m >> 1, (a & m) ? p ^ b : p);
+}
+
+constexpr uint32_t squareModP(uint32_t a) {
+    return multModP(a, a);
+}
+
+// x^(2^k) mod P, squared up from x^1
+constexpr uint32_t combinePower(unsigned k) {
+    return k ? squareModP(combinePower(k - 1)) : (uint32_t)1 << 30;
+}
+
+struct CombinePowers {
+    uint32_t power[32];
+};
+
+template <unsigned... I>
+constexpr CombinePowers makeCombinePowers(Indices<I...>) {
+    return CombinePowers{{combinePower(I)...}};
+}
+
+constexpr CombinePowers COMBINE_POWERS = makeCombinePowers(MakeIndices<32>::type());
+
+} // namespace
+
+#if !CRC32_USE_ROM
+namespace {
+
+// Advance a table entry by one more zero byte
+constexpr uint32_t shiftByte(uint32_t crc) {
+    return (crc >> 8) ^ shiftBits(crc & 0xFF, 8);
+}
+
+// Slicing-by-8 entry: k = 0 is the classic byte table, table[k] advances k more zero bytes
+constexpr uint32_t sliceEntry(unsigned k, uint32_t i) {
+    return k ? shiftByte(sliceEntry(k - 1, i)) : shiftBits(i, 8);
+}
+
+struct SliceTables {
+    uint32_t table[8][256];
+};
+
+template <unsigned... I>
+constexpr SliceTables makeSliceTables(Indices<I...>) {
+    return SliceTables{{{sliceEntry(0, I)...}, {sliceEntry(1, I)...}, {sliceEntry(2, I)...}, {sliceEntry(3, I)...},
+                        {sliceEntry(4, I)...}, {sliceEntry(5, I)...}, {sliceEntry(6, I)...}, {sliceEntry(7, I)...}}};
+}
+
+// Shared by all protocol instances, nothing to build at runtime
+constexpr SliceTables SLICE_TABLES = makeSliceTables(MakeIndices<256>::type());
+
+inline uint32_t load32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+} // namespace
+#endif
+
+// Calculate CRC32 of a buffer
+uint32_t CRC32::calculate(const uint8_t* data, size_t length) {
+    return update(0, data, length);
+}
+
+// Continue a CRC32 over more data
+uint32_t CRC32::update(uint32_t crc, const uint8_t* data, size_t length) {
+#if CRC32_USE_ROM
+    // The ROM routine applies the pre/post inversion itself, like zlib's crc32()
+    return esp_rom_crc32_le(crc, data, length);
+#else
+    const uint32_t (*table)[256] = SLICE_TABLES.table;
+    crc = ~crc;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // Eight bytes per step; the word loads below assume little-endian byte order
+    while (length >= 8) {
+        uint32_t one = load32(data) ^ crc;
+        uint32_t two = load32(data + 4);
+        crc = table[7][one & 0xFF] ^ table[6][(one >> 8) & 0xFF] ^
+              table[5][(one >> 16) & 0xFF] ^ table[4][one >> 24] ^
+              table[3][two & 0xFF] ^ table[2][(two >> 8) & 0xFF] ^
+              table[1][(two >> 16) & 0xFF] ^ table[0][two >> 24];
+        data += 8;
+        length -= 8;
+    }
+#endif
+
+    while (length--) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xFF];
+    }
+    return ~crc;
+#endif
+}
+
+// Precompute the combine step for a fixed block length: x^(8 * length2) mod P
+uint32_t CRC32::combineOperator(size_t length2) {
+    const uint32_t* powers = COMBINE_POWERS.power;
+
+    // Bytes to bits: start at x^(2^3)
+    uint32_t op = (uint32_t)1 << 31;
+    for (unsigned k = 3; length2; length2 >>= 1, k++) {
+        if (length2 & 1) {
+            op = multModP(powers[k & 31], op);
+        }
+    }
+    return op;
+}
+
+// Combine two CRC32s using a precomputed operator
+uint32_t CRC32::combineWithOperator(uint32_t crc1, uint32_t crc2, uint32_t op) {
+    return multModP(op, crc1) ^ crc2;
+}
+
+// Combine the CRC32s of two adjacent blocks
+uint32_t CRC32::combine(uint32_t crc1, uint32_t crc2, size_t length2) {
+    return combineWithOperator(crc1, crc2, combineOperator(length2));
+}
+
+// Bit-at-a-time CRC32, the definition the backends are tested against
+uint32_t CRC32::updateReference(uint32_t crc, const uint8_t* data, size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32_POLYNOMIAL : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+// Check the selected backend against the reference implementation
+bool CRC32::selfTest() {
+    const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    if (calculate(check, sizeof(check)) != CHECK_VALUE) {
+        return false;
+    }
+
+    // Pseudo-random data, every length and start alignment around the 8-byte steps
+    uint8_t buffer[64 + 8];
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 24;
+    }
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length = 0; length <= 64; length++) {
+            if (calculate(buffer + offset, length) != updateReference(0, buffer + offset, length)) {
+                return false;
+            }
+        }
+    }
+
+    // Split updates and combined parts must match a single pass
+    uint32_t whole = calculate(buffer, sizeof(buffer));
+    uint32_t split = update(calculate(buffer, 13), buffer + 13, sizeof(buffer) - 13);
+    uint32_t combined = combine(calculate(buffer, 13), calculate(buffer + 13, sizeof(buffer) - 13),
+                                sizeof(buffer) - 13);
+    return split == whole && combined == whole;
+}
+
+// Get the name of the compiled-in backend
+const char* CRC32::backendName() {
+#if CRC32_USE_ROM
+    return "ROM";
+#else
+    return "slicing-by-8";
+#endif
+}
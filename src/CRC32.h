@@ -0,0 +1,88 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * CRC32 - CRC-32/ISO-HDLC (zlib, Python zlib.crc32) with a compile-time backend
+ *
+ * Backends:
+ *   - ESP32 targets: esp_rom_crc32_le from ROM, no RAM tables
+ *   - Elsewhere, or with -DCHUNKED_BLE_CRC32_SOFTWARE: slicing-by-8 tables (8 KB, shared,
+ *     generated at compile time into flash/rodata)
+ *
+ * Usage:
+ *   uint32_t crc = CRC32::calculate(data, length);
+ *   crc = CRC32::update(crc, moreData, moreLength);  // same as one pass over both
+ *   crc = CRC32::combine(crcA, crcB, lengthB);        // CRC of A+B from the parts, no data needed
+ */
+class CRC32 {
+public:
+    // CRC32 of "123456789", the standard check value
+    static const uint32_t CHECK_VALUE = 0xCBF43926;
+
+    /**
+     * Calculate CRC32 of a buffer
+     *
+     * @param data Data to checksum
+     * @param length Length of data
+     * @return CRC32 value
+     */
+    static uint32_t calculate(const uint8_t* data, size_t length);
+
+    /**
+     * Continue a CRC32 over more data
+     *
+     * @param crc CRC32 of the preceding data (0 to start)
+     * @param data Data to checksum
+     * @param length Length of data
+     * @return CRC32 of the preceding data followed by this data
+     */
+    static uint32_t update(uint32_t crc, const uint8_t* data, size_t length);
+
+    /**
+     * Combine the CRC32s of two adjacent blocks without touching their data
+     *
+     * @param crc1 CRC32 of the first block
+     * @param crc2 CRC32 of the second block
+     * @param length2 Length of the second block
+     * @return CRC32 of the first block followed by the second
+     */
+    static uint32_t combine(uint32_t crc1, uint32_t crc2, size_t length2);
+
+    /**
+     * Precompute the combine step for a fixed block length
+     *
+     * @param length2 Length of the second block
+     * @return Operator for combineWithOperator()
+     */
+    static uint32_t combineOperator(size_t length2);
+
+    /**
+     * Combine two CRC32s using a precomputed operator (32 shift/xor steps)
+     *
+     * @param crc1 CRC32 of the first block
+     * @param crc2 CRC32 of the second block
+     * @param op combineOperator() of the second block's length
+     * @return CRC32 of the first block followed by the second
+     */
+    static uint32_t combineWithOperator(uint32_t crc1, uint32_t crc2, uint32_t op);
+
+    /**
+     * Check the selected backend against a bitwise reference implementation
+     *
+     * @return true if all test vectors match
+     */
+    static bool selfTest();
+
+    /**
+     * Get the name of the compiled-in backend (for logging)
+     */
+    static const char* backendName();
+
+private:
+    static uint32_t updateReference(uint32_t crc, const uint8_t* data, size_t length);
+};
+
+#endif // CRC32_H
@@ -0,0 +1,382 @@
+#include "ChunkAssembler.h"
+#include "CRC32.h"
+#include <string.h>
+#include <algorithm>
+
+// Constructor
+ChunkAssembler::ChunkAssembler()
+    : chunks(0), received(0), window(0), chunkStride(0), strideOperator(0), payloadLength(0),
+      delivered(0), deliveredLength(0), deliveredCRC32(0), groupSize(0), parityStored(0), recovered(0) {
+}
+
+// Start a new transfer
+void ChunkAssembler::begin(int totalChunks, size_t slots, size_t reserveBytes, Sink deliverTo) {
+    buffer.clear();
+    chunks = totalChunks;
+    received = 0;
+    window = slots;
+    chunkStride = 0;
+    strideOperator = 0;
+    payloadLength = 0;
+    delivered = 0;
+    deliveredLength = 0;
+    deliveredCRC32 = 0;
+    sink = deliverTo;
+    bitmap.assign(((window ? window : (size_t)totalChunks) + 7) / 8, 0);
+    crcs.clear();
+    setParity(0);
+    reserve(reserveBytes);
+}
+
+// Fix the sender's chunk size
+void ChunkAssembler::setStride(size_t stride, size_t totalLength) {
+    size_t slots = window ? window : (size_t)chunks;
+    chunkStride = stride;
+    strideOperator = CRC32::combineOperator(chunkStride);
+    payloadLength = totalLength;
+    buffer.resize(slots * chunkStride);
+    crcs.resize(slots);
+}
+
+// Accept parity chunks for the current transfer
+bool ChunkAssembler::setParity(size_t size) {
+    parity.clear();
+    parityHeld.clear();
+    groupSize = 0;
+    parityStored = 0;
+    recovered = 0;
+    if (size == 0) {
+        return true;
+    }
+    // Rebuilding needs every offset and the last chunk's length up front
+    if (window || chunkStride == 0 || payloadLength == 0) {
+        return false;
+    }
+    groupSize = size;
+    parityHeld.assign(parityGroups(), 0);
+    parity.resize(parityHeld.size() * chunkStride);
+    return true;
+}
+
+// Store a parity chunk
+ChunkAssembler::StoreResult ChunkAssembler::storeParity(int group, const uint8_t* data, size_t length) {
+    if (group < 0 || group >= parityGroups()) {
+        return STORE_OUT_OF_RANGE;
+    }
+    if (parityHeld[group]) {
+        return STORE_DUPLICATE;
+    }
+    if (length != chunkStride) {
+        return STORE_BAD_SIZE;
+    }
+    memcpy(&parity[(size_t)group * chunkStride], data, length);
+    parityHeld[group] = 1;
+    parityStored++;
+    rebuild(group);
+    return STORE_OK;
+}
+
+// Rebuild the one chunk a group is missing from its parity
+bool ChunkAssembler::rebuild(int group) {
+    if (!parityHeld[group]) {
+        return false;
+    }
+    int first = group * (int)groupSize;
+    int end = std::min(first + (int)groupSize, chunks);
+    int missing = -1;
+    for (int i = first; i < end; i++) {
+        if (!testBit(i)) {
+            if (missing >= 0) {
+                return false;  // Two gaps - only a retransmission helps
+            }
+            missing = i;
+        }
+    }
+    if (missing < 0 || missing == chunks - 1) {
+        return false;
+    }
+
+    // Parity XOR every other chunk of the group; only the last chunk can be short
+    uint8_t* out = (uint8_t*)&buffer[(size_t)missing * chunkStride];
+    memcpy(out, &parity[(size_t)group * chunkStride], chunkStride);
+    for (int i = first; i < end; i++) {
+        if (i != missing) {
+            size_t offset = (size_t)i * chunkStride;
+            addParity(out, (const uint8_t*)&buffer[offset], std::min(chunkStride, payloadLength - offset));
+        }
+    }
+    crcs[missing] = CRC32::calculate(out, chunkStride);
+    bitmap[missing / 8] |= 1 << (missing % 8);
+    recovered++;
+    if (++received == chunks) {
+        buffer.resize(payloadLength);
+    }
+    return true;
+}
+
+// XOR a data chunk into a parity chunk
+void ChunkAssembler::addParity(uint8_t* parityData, const uint8_t* data, size_t length) {
+    size_t i = 0;
+    for (; i + sizeof(uint32_t) <= length; i += sizeof(uint32_t)) {
+        uint32_t a;
+        uint32_t b;
+        memcpy(&a, parityData + i, sizeof(a));
+        memcpy(&b, data + i, sizeof(b));
+        a ^= b;
+        memcpy(parityData + i, &a, sizeof(a));
+    }
+    for (; i < length; i++) {
+        parityData[i] ^= data[i];
+    }
+}
+
+// Store a verified chunk
+ChunkAssembler::StoreResult ChunkAssembler::store(int chunkNum, const uint8_t* data, size_t length, uint32_t chunkCRC32) {
+    if (chunkNum < 1 || chunkNum > chunks) {
+        return STORE_OUT_OF_RANGE;
+    }
+    int chunkIndex = chunkNum - 1;
+    if (isReceived(chunkIndex)) {
+        return STORE_DUPLICATE;
+    }
+    bool lastChunk = chunkNum == chunks;
+
+    // Every chunk but the last one has the sender's chunk size, which gives the offsets
+    if (chunkStride == 0) {
+        if (lastChunk && chunks > 1) {
+            return STORE_STRIDE_UNKNOWN;
+        }
+        setStride(length);
+    }
+    if (lastChunk ? length > chunkStride : length != chunkStride) {
+        return STORE_BAD_SIZE;
+    }
+
+    if (!window) {
+        size_t offset = (size_t)chunkIndex * chunkStride;
+        memcpy(&buffer[offset], data, length);
+        crcs[chunkIndex] = chunkCRC32;
+        bitmap[chunkIndex / 8] |= 1 << (chunkIndex % 8);
+        if (lastChunk) {
+            payloadLength = offset + length;
+        }
+        // Trim the short last chunk's slack once nothing can land there any more
+        if (++received == chunks) {
+            buffer.resize(payloadLength);
+        } else if (groupSize) {
+            rebuild(chunkIndex / (int)groupSize);
+        }
+        return STORE_OK;
+    }
+
+    if ((size_t)chunkIndex >= delivered + window) {
+        return STORE_BEYOND_WINDOW;
+    }
+    if (lastChunk) {
+        payloadLength = (size_t)chunkIndex * chunkStride + length;
+    }
+    received++;
+
+    if (chunkIndex != delivered) {
+        size_t slot = chunkIndex % window;
+        memcpy(&buffer[slot * chunkStride], data, length);
+        crcs[slot] = chunkCRC32;
+        bitmap[slot / 8] |= 1 << (slot % 8);
+        return STORE_OK;
+    }
+
+    // Next in order - hand it over straight from the caller's buffer, then whatever it made contiguous
+    deliver(data, length, chunkCRC32);
+    while (delivered < chunks) {
+        size_t slot = delivered % window;
+        if (!testBit(slot)) {
+            break;
+        }
+        bitmap[slot / 8] &= ~(1 << (slot % 8));
+        size_t chunkLength = delivered == chunks - 1 ? payloadLength - deliveredLength : chunkStride;
+        deliver((const uint8_t*)&buffer[slot * chunkStride], chunkLength, crcs[slot]);
+    }
+    return STORE_OK;
+}
+
+// Pass the next in-order chunk of a windowed transfer to the sink
+void ChunkAssembler::deliver(const uint8_t* data, size_t length, uint32_t chunkCRC32) {
+    deliveredCRC32 = appendCRC32(deliveredCRC32, chunkCRC32, length);
+    if (sink) {
+        sink(data, length);
+    }
+    deliveredLength += length;
+    delivered++;
+}
+
+// Check if a chunk is stored or delivered
+bool ChunkAssembler::isReceived(int chunkIndex) const {
+    if (chunkIndex < 0 || chunkIndex >= chunks) {
+        return false;
+    }
+    if (window) {
+        // Delivered chunks are gone from the window, chunks beyond it were never kept
+        if (chunkIndex < delivered) {
+            return true;
+        }
+        if ((size_t)chunkIndex >= delivered + window) {
+            return false;
+        }
+        return testBit(chunkIndex % window);
+    }
+    return testBit(chunkIndex);
+}
+
+// Check if every chunk is stored or delivered
+bool ChunkAssembler::isComplete() const {
+    return chunks > 0 && (window ? delivered == chunks : received == chunks);
+}
+
+// Report the missing chunks from the delivery point on
+int ChunkAssembler::missingChunks(uint8_t* missing, size_t capacity, int& base, int& highest, size_t& bitmapLength) const {
+    memset(missing, 0, capacity);
+    base = 0;
+    highest = 0;
+    bitmapLength = 0;
+    int count = 0;
+    // Everything before the delivery point has arrived
+    for (int i = delivered; i < chunks; i++) {
+        if (isReceived(i)) {
+            continue;
+        }
+        int chunkNum = i + 1;
+        if (base == 0) {
+            base = chunkNum;
+        }
+        size_t bit = chunkNum - base;
+        if (bit >= capacity * 8) {
+            break;  // Later gaps go into the next report
+        }
+        missing[bit / 8] |= 1 << (bit % 8);
+        bitmapLength = bit / 8 + 1;
+        highest = chunkNum;
+        count++;
+    }
+    return count;
+}
+
+// One past the highest chunk held
+int ChunkAssembler::nextChunk() const {
+    // A window holds nothing beyond its last slot
+    int last = window ? std::min(chunks, delivered + (int)window) : chunks;
+    for (int i = last - 1; i >= delivered; i--) {
+        if (isReceived(i)) {
+            return i + 2;
+        }
+    }
+    return delivered + 1;
+}
+
+// Get the CRC32 of the assembled data
+uint32_t ChunkAssembler::globalCRC32() const {
+    if (window) {
+        return deliveredCRC32;
+    }
+    uint32_t crc = 0;
+    for (int i = 0; i < chunks; i++) {
+        crc = appendCRC32(crc, crcs[i], i == chunks - 1 ? payloadLength - (size_t)i * chunkStride : chunkStride);
+    }
+    return crc;
+}
+
+// Extend a running CRC32 by the next chunk's CRC32
+uint32_t ChunkAssembler::appendCRC32(uint32_t crc, uint32_t chunkCRC32, size_t length) const {
+    return length == chunkStride
+        ? CRC32::combineWithOperator(crc, chunkCRC32, strideOperator)
+        : CRC32::combine(crc, chunkCRC32, length);
+}
+
+// Get the assembled data
+std::string& ChunkAssembler::data() {
+    return buffer;
+}
+
+// Drop the transfer
+void ChunkAssembler::clear(size_t keepCapacity) {
+    // Give the memory back between transfers rather than keeping the largest one's capacity
+    if (buffer.capacity() > keepCapacity) {
+        std::string().swap(buffer);
+        buffer.reserve(keepCapacity);
+    } else {
+        buffer.clear();
+    }
+    std::vector<uint8_t>().swap(bitmap);
+    std::vector<uint32_t>().swap(crcs);
+    std::string().swap(parity);
+    std::vector<uint8_t>().swap(parityHeld);
+    groupSize = 0;
+    parityStored = 0;
+    recovered = 0;
+    sink = Sink();
+    chunks = 0;
+    received = 0;
+    window = 0;
+    chunkStride = 0;
+    strideOperator = 0;
+    payloadLength = 0;
+    delivered = 0;
+    deliveredLength = 0;
+    deliveredCRC32 = 0;
+}
+
+// Make sure the buffer can hold at least this many bytes (reserve() alone may shrink it)
+void ChunkAssembler::reserve(size_t bytes) {
+    if (buffer.capacity() < bytes) {
+        buffer.reserve(bytes);
+    }
+}
+
+// Test a bit of the received bitmap
+bool ChunkAssembler::testBit(size_t index) const {
+    return (bitmap[index / 8] >> (index % 8)) & 1;
+}
+
+// Getters
+int ChunkAssembler::totalChunks() const {
+    return chunks;
+}
+
+int ChunkAssembler::receivedChunks() const {
+    return received;
+}
+
+size_t ChunkAssembler::stride() const {
+    return chunkStride;
+}
+
+size_t ChunkAssembler::length() const {
+    return payloadLength;
+}
+
+size_t ChunkAssembler::capacity() const {
+    return buffer.capacity();
+}
+
+bool ChunkAssembler::windowed() const {
+    return window != 0;
+}
+
+int ChunkAssembler::deliveredChunks() const {
+    return delivered;
+}
+
+size_t ChunkAssembler::deliveredBytes() const {
+    return deliveredLength;
+}
+
+int ChunkAssembler::parityGroups() const {
+    return groupSize ? (int)((chunks + groupSize - 1) / groupSize) : 0;
+}
+
+int ChunkAssembler::parityChunks() const {
+    return parityStored;
+}
+
+int ChunkAssembler::recoveredChunks() const {
+    return recovered;
+}
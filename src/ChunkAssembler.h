@@ -0,0 +1,201 @@
+#ifndef CHUNK_ASSEMBLER_H
+#define CHUNK_ASSEMBLER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+/**
+ * ChunkAssembler - Reassembly of one chunked transfer, independent of BLE and FreeRTOS
+ *
+ * Chunks are 1-based and every chunk but the last has the sender's chunk size (the
+ * stride), so each verified chunk is copied straight to its offset and only its CRC32
+ * is kept; the global CRC32 is combined from those instead of recomputed over the data.
+ *
+ * Two modes, chosen by begin():
+ *   - Buffered: the whole transfer is assembled in data()
+ *   - Windowed: only chunks that arrive ahead of a missing one are kept, in a window of
+ *     `window` slots; chunks are passed to the sink in order as soon as they are contiguous
+ *
+ * Buffered transfers may also carry XOR parity (setParity()): one parity chunk per group
+ * of data chunks lets a group that lost a single chunk rebuild it without a retransmission.
+ *
+ * Usage:
+ *   ChunkAssembler assembler;
+ *   assembler.begin(totalChunks, 0, totalLength);
+ *   assembler.setStride(chunkSize);                 // or let the first full chunk set it
+ *   assembler.store(chunkNum, data, size, chunkCRC32);
+ *   if (assembler.isComplete() && assembler.globalCRC32() == expected) use(assembler.data());
+ *
+ * Not thread-safe; ChunkedBLEProtocol keeps one per channel.
+ */
+class ChunkAssembler {
+public:
+    // Receives each in-order chunk of a windowed transfer, valid only during the call
+    typedef std::function<void(const uint8_t* data, size_t length)> Sink;
+
+    enum StoreResult {
+        STORE_OK,               // Chunk stored (or passed to the sink)
+        STORE_DUPLICATE,        // Chunk was already stored or delivered
+        STORE_OUT_OF_RANGE,     // Chunk number is 0 or beyond the transfer
+        STORE_STRIDE_UNKNOWN,   // Last chunk arrived before any other, its offset is unknown
+        STORE_BAD_SIZE,         // Chunk is longer than the stride, or a non-last chunk is shorter
+        STORE_BEYOND_WINDOW     // Windowed transfer cannot keep a chunk that far ahead
+    };
+
+    ChunkAssembler();
+
+    /**
+     * Start a new transfer, dropping any previous one
+     *
+     * @param totalChunks Chunk count of the transfer
+     * @param window Slots kept ahead of the delivery point, 0 to buffer the whole transfer
+     * @param reserveBytes Buffer capacity to make sure of up front (estimate, 0 for none)
+     * @param sink Receives the data of a windowed transfer in order
+     */
+    void begin(int totalChunks, size_t window, size_t reserveBytes, Sink sink = Sink());
+
+    /**
+     * Fix the sender's chunk size, which gives every chunk's offset
+     *
+     * @param stride Data bytes of every chunk but the last
+     * @param totalLength Payload length if announced, 0 to learn it from the last chunk
+     */
+    void setStride(size_t stride, size_t totalLength = 0);
+
+    /**
+     * Accept parity chunks for the current transfer
+     *
+     * Parity chunk g is the XOR of data chunks g * groupSize + 1 .. (g + 1) * groupSize, each
+     * zero-padded to the stride (see addParity()). Once a group's parity and all but one of
+     * its chunks are stored, the missing chunk is rebuilt and counts as stored. The last chunk
+     * of the transfer is never rebuilt - the sender puts the last group's parity ahead of it,
+     * so it is still on its way.
+     *
+     * @param groupSize Data chunks per parity chunk, 0 for none
+     * @return false for windowed transfers and when stride or length were not announced
+     */
+    bool setParity(size_t groupSize);
+
+    /**
+     * Store a parity chunk whose CRC32 has been verified
+     *
+     * @param group 0-based group index
+     * @param data Parity data, always stride bytes
+     * @param length Parity data length
+     * @return STORE_OK if the parity was kept
+     */
+    StoreResult storeParity(int group, const uint8_t* data, size_t length);
+
+    /**
+     * XOR a data chunk into a parity chunk (sender side), shorter chunks count as zero-padded
+     */
+    static void addParity(uint8_t* parity, const uint8_t* data, size_t length);
+
+    /**
+     * Store a chunk whose CRC32 has been verified
+     *
+     * @param chunkNum 1-based chunk number
+     * @param data Chunk data
+     * @param length Chunk data length
+     * @param chunkCRC32 CRC32 of the chunk data
+     * @return STORE_OK if the chunk counts towards completion
+     */
+    StoreResult store(int chunkNum, const uint8_t* data, size_t length, uint32_t chunkCRC32);
+
+    /**
+     * Check if a chunk is stored or delivered (0-based index)
+     */
+    bool isReceived(int chunkIndex) const;
+
+    /**
+     * Check if every chunk is stored or delivered
+     */
+    bool isComplete() const;
+
+    /**
+     * Report the missing chunks from the delivery point on
+     *
+     * @param bitmap Receives a bit per chunk from *base on (LSB first), set if missing
+     * @param capacity Bitmap size in bytes, later gaps are left out
+     * @param base Set to the first missing chunk number, 0 if none
+     * @param highest Set to the highest missing chunk number reported
+     * @param bitmapLength Set to the bytes of bitmap in use
+     * @return Number of missing chunks reported
+     */
+    int missingChunks(uint8_t* bitmap, size_t capacity, int& base, int& highest, size_t& bitmapLength) const;
+
+    /**
+     * One past the highest chunk number held, delivery point + 1 if none is held
+     */
+    int nextChunk() const;
+
+    /**
+     * Get the CRC32 of the assembled data, from the stored chunk CRC32s
+     *
+     * Buffered transfers must be complete; for windowed ones this is the running CRC32
+     * of everything delivered so far.
+     */
+    uint32_t globalCRC32() const;
+
+    /**
+     * Get the assembled data of a buffered transfer, trimmed to its length once complete
+     *
+     * The string may be swapped out by the caller; clear() starts over either way.
+     */
+    std::string& data();
+
+    /**
+     * Drop the transfer
+     *
+     * @param keepCapacity Buffer capacity kept for the next transfer, larger buffers are freed
+     */
+    void clear(size_t keepCapacity);
+
+    /**
+     * Make sure the buffer can hold at least this many bytes
+     */
+    void reserve(size_t bytes);
+
+    // Current transfer
+    int totalChunks() const;
+    int receivedChunks() const;        // Stored or delivered, duplicates not counted
+    size_t stride() const;             // 0 until known
+    size_t length() const;             // Payload length, 0 until the last chunk is stored
+    size_t capacity() const;           // Buffer capacity in bytes
+    bool windowed() const;
+    int deliveredChunks() const;       // Windowed transfers only
+    size_t deliveredBytes() const;
+    int parityGroups() const;          // 0 without parity
+    int parityChunks() const;          // Parity chunks stored
+    int recoveredChunks() const;       // Chunks rebuilt from parity, included in receivedChunks()
+
+private:
+    std::string buffer;             // Whole transfer, or `window` slots of a windowed one
+    std::vector<uint8_t> bitmap;    // Bit per chunk or slot, set once its data is in buffer
+    std::vector<uint32_t> crcs;     // Verified CRC32 per chunk or slot
+    Sink sink;
+    int chunks;
+    int received;
+    size_t window;
+    size_t chunkStride;
+    uint32_t strideOperator;        // CRC32::combineOperator(chunkStride)
+    size_t payloadLength;
+    int delivered;
+    size_t deliveredLength;
+    uint32_t deliveredCRC32;        // Running CRC32 of the delivered data
+    std::string parity;             // Parity chunk per group, stride bytes each
+    std::vector<uint8_t> parityHeld;  // 1 per group once its parity is stored
+    size_t groupSize;               // 0 without parity
+    int parityStored;
+    int recovered;
+
+    bool rebuild(int group);
+    void deliver(const uint8_t* data, size_t length, uint32_t chunkCRC32);
+    uint32_t appendCRC32(uint32_t crc, uint32_t chunkCRC32, size_t length) const;
+    bool testBit(size_t index) const;
+};
+
+#endif // CHUNK_ASSEMBLER_H
@@ -1,8 +1,49 @@
 #include "ChunkedBLEProtocol.h"
+#include "CRC32.h"
+#include "CBOR.h"
+#include "Delta.h"
+#include "PacketRing.h"
+#include "GattTransport.h"
+#if CHUNKED_BLE_L2CAP_COC
+#include "L2capTransport.h"
+#endif
+#include <new>
+#include <string.h>
+
+// Log macros - levels above CHUNKED_BLE_LOG_LEVEL compile to nothing; the dead call
+// keeps values that are only logged from triggering "unused variable" warnings
+#if CHUNKED_BLE_LOG_LEVEL >= CHUNKED_BLE_LOG_ERROR
+#define CBLE_LOGE(...) log(ChunkedBLEProtocol::LEVEL_ERROR, __VA_ARGS__)
+#else
+#define CBLE_LOGE(...) do { if (0) log(ChunkedBLEProtocol::LEVEL_ERROR, __VA_ARGS__); } while (0)
+#endif
+#if CHUNKED_BLE_LOG_LEVEL >= CHUNKED_BLE_LOG_WARN
+#define CBLE_LOGW(...) log(ChunkedBLEProtocol::LEVEL_WARN, __VA_ARGS__)
+#else
+#define CBLE_LOGW(...) do { if (0) log(ChunkedBLEProtocol::LEVEL_WARN, __VA_ARGS__); } while (0)
+#endif
+#if CHUNKED_BLE_LOG_LEVEL >= CHUNKED_BLE_LOG_INFO
+#define CBLE_LOGI(...) log(ChunkedBLEProtocol::LEVEL_INFO, __VA_ARGS__)
+#else
+#define CBLE_LOGI(...) do { if (0) log(ChunkedBLEProtocol::LEVEL_INFO, __VA_ARGS__); } while (0)
+#endif
+#if CHUNKED_BLE_LOG_LEVEL >= CHUNKED_BLE_LOG_DEBUG
+#define CBLE_LOGD(...) log(ChunkedBLEProtocol::LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define CBLE_LOGD(...) do { if (0) log(ChunkedBLEProtocol::LEVEL_DEBUG, __VA_ARGS__); } while (0)
+#endif
+#if CHUNKED_BLE_LOG_LEVEL >= CHUNKED_BLE_LOG_TRACE
+#define CBLE_LOGT(...) log(ChunkedBLEProtocol::LEVEL_TRACE, __VA_ARGS__)
+#else
+#define CBLE_LOGT(...) do { if (0) log(ChunkedBLEProtocol::LEVEL_TRACE, __VA_ARGS__); } while (0)
+#endif
 
 // Default UUIDs
 const char* ChunkedBLEProtocol::DEFAULT_SERVICE_UUID = "5b18eb9b-747f-47da-b7b0-a4e503f9a00f";
 const char* ChunkedBLEProtocol::DEFAULT_CHAR_UUID = "8f8b49a2-9117-4e9f-acfc-fda4d0db7408";
+const char* ChunkedBLEProtocol::DEFAULT_DIAGNOSTICS_UUID = "3f4c2d91-6b0e-4a57-9d18-c2e7a5b04f63";
+
+ChunkedBLEProtocol* ChunkedBLEProtocol::instance = nullptr;
 
 // Internal callback class for characteristic events
 class ChunkedBLEProtocol::ProtocolCharacteristicCallbacks : public BLECharacteristicCallbacks {
@@ -12,26 +53,66 @@ private:
 public:
     explicit ProtocolCharacteristicCallbacks(ChunkedBLEProtocol* p) : protocol(p) {}
     
-    void onWrite(BLECharacteristic *pChar) override {
-        std::string value = pChar->getValue();
-        if (value.length() >= protocol->HEADER_SIZE) {
-            protocol->processReceivedChunk(value);
-        } else {
-            protocol->log("[CHUNK] Received data too small for chunk header");
-        }
+    // Target of the CBLE_LOG* macros inside this class
+    void log(LogLevel level, const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        protocol->logv(level, format, args);
+        va_end(args);
     }
     
-    void onRead(BLECharacteristic *pChar) override {
-        protocol->log("[BLE] Characteristic read by client");
+#if CHUNKED_BLE_NIMBLE
+    // Runs in the host task right after the write (long writes already reassembled) was stored;
+    // parsed through a reference to the stored value, not a copy of it
+    void onWrite(NimBLECharacteristic* pChar, ble_gap_conn_desc* desc) override {
+        const NimBLEAttValue& value = pChar->getValue();
+        protocol->handleWrite(desc->conn_handle, value.data(), value.length());
+    }
+    
+    void onRead(NimBLECharacteristic*, ble_gap_conn_desc* desc) override {
+        CBLE_LOGD("[BLE] Characteristic read by client %d", desc->conn_handle);
+    }
+#else
+    // The library calls this for plain writes (ESP_GATTS_WRITE_EVT) and for committed prepared
+    // writes (ESP_GATTS_EXEC_WRITE_EVT); gattsEventHandler() marks the sessions with parts queued.
+    // Every GATTS event starts with conn_id, so either event finds its session the same way.
+    void onWrite(BLECharacteristic *pChar, esp_ble_gatts_cb_param_t* param) override {
+        Session* session = protocol->findSession(param->write.conn_id);
+        if (session && session->preparedWrite) {
+            // The library joined the parts into the characteristic value
+            session->preparedWrite = false;
+            protocol->handleWrite(param->exec_write.conn_id, pChar->getData(), pChar->getLength());
+            return;
+        }
+        
+        // Parse in place from the write event instead of the shared value
+        protocol->handleWrite(param->write.conn_id, param->write.value, param->write.len);
     }
     
-    void onNotify(BLECharacteristic *pChar) override {
-        protocol->log("[BLE] Notification sent to client");
+    void onRead(BLECharacteristic*) override {
+        CBLE_LOGD("[BLE] Characteristic read by client");
     }
+#endif
+};
+
+// Internal callback class for the diagnostics characteristic, refreshes its value per read
+class ChunkedBLEProtocol::ProtocolDiagnosticsCallbacks : public BLECharacteristicCallbacks {
+private:
+    ChunkedBLEProtocol* protocol;
+    
+public:
+    explicit ProtocolDiagnosticsCallbacks(ChunkedBLEProtocol* p) : protocol(p) {}
     
-    void onStatus(BLECharacteristic *pChar, Status s, uint32_t code) override {
-        protocol->log("[BLE] Status callback - Status: %d, Code: %u", s, code);
+#if CHUNKED_BLE_NIMBLE
+    void onRead(NimBLECharacteristic*, ble_gap_conn_desc* desc) override {
+        protocol->updateDiagnostics(desc->conn_handle);
     }
+#else
+    // Called before the first read response, the blobs of a long read keep that value
+    void onRead(BLECharacteristic*, esp_ble_gatts_cb_param_t* param) override {
+        protocol->updateDiagnostics(param->read.conn_id);
+    }
+#endif
 };
 
 // Internal callback class for server events
@@ -42,133 +123,347 @@ private:
 public:
     explicit ProtocolServerCallbacks(ChunkedBLEProtocol* p) : protocol(p) {}
     
-    void onConnect(BLEServer* pServer) override {
-        protocol->log("[BLE] Client connected");
-        protocol->log("[BLE] Connected clients count: %d", pServer->getConnectedCount());
-        protocol->log("[BLE] MTU will be negotiated to 185 or lower");
-        protocol->handleConnectionChange(true);
+    // Target of the CBLE_LOG* macros inside this class
+    void log(LogLevel level, const char* format, ...) {
+        va_list args;
+        va_start(args, format);
+        protocol->logv(level, format, args);
+        va_end(args);
+    }
+    
+#if CHUNKED_BLE_NIMBLE
+    // The connection handle serves as conn_id, the identity address survives address rotation
+    void onConnect(NimBLEServer* pServer, ble_gap_conn_desc* desc) override {
+        CBLE_LOGI("[BLE] Client %d connected", desc->conn_handle);
+        CBLE_LOGD("[BLE] Connected clients count: %d", pServer->getConnectedCount());
+        LinkParameters connected;
+        connected.connInterval = desc->conn_itvl;
+        connected.connLatency = desc->conn_latency;
+        connected.supervisionTimeout = desc->supervision_timeout;
+        protocol->openSession(desc->conn_handle, desc->peer_id_addr.val, connected);
+    }
+    
+    void onMTUChange(uint16_t MTU, ble_gap_conn_desc* desc) override {
+        protocol->handleMTUChange(desc->conn_handle, MTU);
+    }
+    
+    void onDisconnect(NimBLEServer*, ble_gap_conn_desc* desc) override {
+        CBLE_LOGI("[BLE] Client %d disconnected", desc->conn_handle);
+        protocol->closeSession(desc->conn_handle);
+    }
+#else
+    // Called right after onConnect(pServer) with the central's conn_id and address
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+        CBLE_LOGI("[BLE] Client %d connected", param->connect.conn_id);
+        CBLE_LOGD("[BLE] Connected clients count: %d", pServer->getConnectedCount() + 1);
+        LinkParameters connected;
+        connected.connInterval = param->connect.conn_params.interval;
+        connected.connLatency = param->connect.conn_params.latency;
+        connected.supervisionTimeout = param->connect.conn_params.timeout;
+        protocol->openSession(param->connect.conn_id, param->connect.remote_bda, connected);
+    }
+    
+    void onMtuChanged(BLEServer*, esp_ble_gatts_cb_param_t* param) override {
+        protocol->handleMTUChange(param->mtu.conn_id, param->mtu.mtu);
+    }
+    
+    // Called right after onDisconnect(pServer) with the conn_id
+    void onDisconnect(BLEServer*, esp_ble_gatts_cb_param_t* param) override {
+        CBLE_LOGI("[BLE] Client %d disconnected", param->disconnect.conn_id);
+        protocol->closeSession(param->disconnect.conn_id);
+    }
+#endif
+};
+
+// Internal callback class for frames and channels of non-GATT transports
+class ChunkedBLEProtocol::ProtocolTransportCallbacks : public BLETransport::Receiver {
+private:
+    ChunkedBLEProtocol* protocol;
+    
+public:
+    explicit ProtocolTransportCallbacks(ChunkedBLEProtocol* p) : protocol(p) {}
+    
+    void onTransportFrame(BLETransport*, uint16_t connId, const uint8_t* data, size_t length) override {
+        protocol->handleWrite(connId, data, length);
     }
     
-    void onDisconnect(BLEServer* pServer) override {
-        protocol->log("[BLE] Client disconnected");
-        protocol->log("[BLE] Connected clients count: %d", pServer->getConnectedCount());
-        protocol->handleConnectionChange(false);
+    void onTransportOpened(BLETransport* transport, uint16_t connId, uint16_t frameSize) override {
+        protocol->openTransport(transport, connId, frameSize);
+    }
+    
+    void onTransportClosed(BLETransport* transport, uint16_t connId) override {
+        protocol->closeTransport(transport, connId);
     }
 };
 
 // Constructor with default UUIDs
 ChunkedBLEProtocol::ChunkedBLEProtocol(BLEServer* server) 
-    : bleServer(server), bleService(nullptr), bleCharacteristic(nullptr),
-      charCallbacks(nullptr), serverCallbacks(nullptr),
-      isConnected(false), expectedChunks(0), receivedChunkCount(0),
-      lastChunkTime(0), transferInProgress(false), chunkTimeoutMs(DEFAULT_CHUNK_TIMEOUT_MS),
-      expectedGlobalCRC32(0) {
+    : bleServer(server), bleService(nullptr), bleCharacteristic(nullptr), diagnosticsCharacteristic(nullptr),
+      charCallbacks(nullptr), diagnosticsCallbacks(nullptr), serverCallbacks(nullptr), transportCallbacks(nullptr),
+      gattTransport(nullptr), l2capTransport(nullptr), l2capPsm(DEFAULT_L2CAP_PSM), l2capEnabled(false),
+      sessions(), sessionCount(0), retiredStats(),
+      chunkTimeoutMs(DEFAULT_CHUNK_TIMEOUT_MS),
+      flowControlMode(FLOW_CONTROL_CREDITS), creditWindow(DEFAULT_CREDIT_WINDOW),
+      retransmissionEnabled(true), maxRetransmitRounds(DEFAULT_MAX_RETRANSMIT_ROUNDS),
+      streamWindow(DEFAULT_STREAM_WINDOW),
+      maxBufferedSize(MAX_TOTAL_DATA_SIZE), maxStreamedSize(DEFAULT_MAX_STREAM_SIZE),
+      compactFraming(true), compactChunkCRC(true),
+      resumeGraceMs(DEFAULT_RESUME_GRACE_MS), compressionEnabled(CHUNKED_BLE_COMPRESSION), cborDecoding(true), multiplexEnabled(true),
+      fecGroupSize(0), maxDeltaBaseSize(0), diagnosticsEnabled(true), linkProfile(LINK_PROFILE_NONE),
+      txMutex(nullptr), txTurnHolder(nullptr), asyncMutex(nullptr), nextMessageId(1),
+      rxTask(nullptr), dataLengthSession(nullptr), logSink(serialLogSink) {
     
-    log("[PROTOCOL] Initializing ChunkedBLEProtocol with enhanced security");
+    CBLE_LOGI("[PROTOCOL] Initializing ChunkedBLEProtocol with enhanced security");
     
-    // Initialize CRC32 lookup table
-    initCRC32Table();
+    // Check the CRC32 backend before trusting it with transfers
+    initCRC32();
     
-    // Reset statistics
-    resetStatistics();
+    // Create flow control primitives and the first session
+    initFlowControl();
+    setMaxSessions(1);
     
-    setupBLEService(DEFAULT_SERVICE_UUID, DEFAULT_CHAR_UUID);
-    log("[PROTOCOL] ChunkedBLEProtocol initialized with CRC validation and timeouts");
+    setupBLEService(DEFAULT_SERVICE_UUID, DEFAULT_CHAR_UUID, DEFAULT_DIAGNOSTICS_UUID);
+    CBLE_LOGI("[PROTOCOL] ChunkedBLEProtocol initialized with CRC validation and timeouts");
 }
 
 // Main constructor with custom UUIDs
-ChunkedBLEProtocol::ChunkedBLEProtocol(BLEServer* server, const char* serviceUUID, const char* charUUID) 
-    : bleServer(server), bleService(nullptr), bleCharacteristic(nullptr),
-      charCallbacks(nullptr), serverCallbacks(nullptr),
-      isConnected(false), expectedChunks(0), receivedChunkCount(0),
-      lastChunkTime(0), transferInProgress(false), chunkTimeoutMs(DEFAULT_CHUNK_TIMEOUT_MS),
-      expectedGlobalCRC32(0) {
+ChunkedBLEProtocol::ChunkedBLEProtocol(BLEServer* server, const char* serviceUUID, const char* charUUID,
+                                       const char* diagnosticsUUID) 
+    : bleServer(server), bleService(nullptr), bleCharacteristic(nullptr), diagnosticsCharacteristic(nullptr),
+      charCallbacks(nullptr), diagnosticsCallbacks(nullptr), serverCallbacks(nullptr), transportCallbacks(nullptr),
+      gattTransport(nullptr), l2capTransport(nullptr), l2capPsm(DEFAULT_L2CAP_PSM), l2capEnabled(false),
+      sessions(), sessionCount(0), retiredStats(),
+      chunkTimeoutMs(DEFAULT_CHUNK_TIMEOUT_MS),
+      flowControlMode(FLOW_CONTROL_CREDITS), creditWindow(DEFAULT_CREDIT_WINDOW),
+      retransmissionEnabled(true), maxRetransmitRounds(DEFAULT_MAX_RETRANSMIT_ROUNDS),
+      streamWindow(DEFAULT_STREAM_WINDOW),
+      maxBufferedSize(MAX_TOTAL_DATA_SIZE), maxStreamedSize(DEFAULT_MAX_STREAM_SIZE),
+      compactFraming(true), compactChunkCRC(true),
+      resumeGraceMs(DEFAULT_RESUME_GRACE_MS), compressionEnabled(CHUNKED_BLE_COMPRESSION), cborDecoding(true), multiplexEnabled(true),
+      fecGroupSize(0), maxDeltaBaseSize(0), diagnosticsEnabled(true), linkProfile(LINK_PROFILE_NONE),
+      txMutex(nullptr), txTurnHolder(nullptr), asyncMutex(nullptr), nextMessageId(1),
+      rxTask(nullptr), dataLengthSession(nullptr), logSink(serialLogSink) {
     
-    log("[PROTOCOL] Initializing ChunkedBLEProtocol with custom UUIDs and enhanced security");
+    CBLE_LOGI("[PROTOCOL] Initializing ChunkedBLEProtocol with custom UUIDs and enhanced security");
     
-    // Initialize CRC32 lookup table
-    initCRC32Table();
+    // Check the CRC32 backend before trusting it with transfers
+    initCRC32();
     
-    // Reset statistics
-    resetStatistics();
+    // Create flow control primitives and the first session
+    initFlowControl();
+    setMaxSessions(1);
     
-    setupBLEService(serviceUUID, charUUID);
-    log("[PROTOCOL] ChunkedBLEProtocol initialized with CRC validation and timeouts");
+    setupBLEService(serviceUUID, charUUID, diagnosticsUUID ? diagnosticsUUID : DEFAULT_DIAGNOSTICS_UUID);
+    CBLE_LOGI("[PROTOCOL] ChunkedBLEProtocol initialized with CRC validation and timeouts");
 }
 
-// Initialize CRC32 lookup table
-void ChunkedBLEProtocol::initCRC32Table() {
-    const uint32_t polynomial = 0xEDB88320;
+// Session constructor - allocates everything a connection needs up front
+ChunkedBLEProtocol::Session::Session(ChunkedBLEProtocol& protocol, uint8_t index, size_t bufferSize)
+    : protocol(protocol), index(index), channels(),
+      isConnected(false), connId(0), generation(0), peerAddress(),
+      stats(), negotiatedMTU(DEFAULT_MTU_SIZE), transport(nullptr), transportFrameSize(0),
+      peerFeatures(0), peerExtendedFeatures(0), peerCreditWindow(0), creditsOwed(0), txCredits(nullptr),
+      congestionCleared(nullptr), linkCongested(false), preparedWrite(false), txTurn(nullptr), waitingForTurn(false),
+      channelTurnHolder(nullptr), nextTransferId(1), rxRing(nullptr),
+      linkParameters(), linkIdleTimer(nullptr), lastLinkActivity(0),
+      history(), historyNext(0), historyCount(0) {
     
-    for (uint32_t i = 0; i < 256; i++) {
-        uint32_t crc = i;
-        for (uint32_t j = 8; j > 0; j--) {
-            if (crc & 1) {
-                crc = (crc >> 1) ^ polynomial;
-            } else {
-                crc >>= 1;
-            }
-        }
-        crc32_table[i] = crc;
+    txCredits = xSemaphoreCreateCounting(MAX_CREDIT_WINDOW, 0);
+    congestionCleared = xSemaphoreCreateBinary();
+    txTurn = xSemaphoreCreateBinary();
+    linkIdleTimer = xTimerCreate("cble_link", pdMS_TO_TICKS(LINK_IDLE_TIMEOUT_MS), pdFALSE, this, linkIdleTimerEntry);
+    
+    // Only the default channel keeps the reserved buffer, the others allocate per transfer
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        channels[i] = new (std::nothrow) Channel(*this, i, i == DEFAULT_CHANNEL ? bufferSize : 0);
+    }
+}
+
+// Session destructor
+ChunkedBLEProtocol::Session::~Session() {
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        delete channels[i];
+    }
+    delete rxRing;
+    
+    if (linkIdleTimer) {
+        xTimerDelete(linkIdleTimer, portMAX_DELAY);
+    }
+    if (txCredits) {
+        vSemaphoreDelete(txCredits);
+    }
+    if (congestionCleared) {
+        vSemaphoreDelete(congestionCleared);
+    }
+    if (txTurn) {
+        vSemaphoreDelete(txTurn);
     }
-    log("[CRC] CRC32 lookup table initialized");
 }
 
-// Calculate CRC32 for data
-uint32_t ChunkedBLEProtocol::calculateCRC32(const uint8_t* data, size_t length) {
-    uint32_t crc = 0xFFFFFFFF;
+// Channel constructor
+ChunkedBLEProtocol::Channel::Channel(Session& session, uint8_t id, size_t bufferSize)
+    : session(session), protocol(session.protocol), id(id), bufferSize(bufferSize),
+      lastChunkTime(0), transferInProgress(false), expectedGlobalCRC32(0),
+      reportPoint(0), lastCompletedCRC32(0),
+      streamingTransfer(false),
+      openTransferId(0), openFlags(0), fecGroup(0), suspendedTransferId(0), suspendTime(0),
+      compressedTransfer(false), contentType(CONTENT_TYPE_NONE), streamOutputBytes(0),
+      deltaBaseCRC32(0), deltaResultCRC32(0), rxBaseCRC32(0), txBaseCRC32(0), txAckStatus(ACK_STATUS_OK),
+      sendMutex(nullptr), reportQueue(nullptr), activeCRC32(0), activeTransferId(0), sending(false), interruptedSend(),
+      txFrame(nullptr), txParity(nullptr), turn(nullptr), waitingForTurn(false), txQueue(nullptr), txTask(nullptr),
+      rxRecord(), txRecord(), lastRxFrameUs(0), lastTxFrameUs(0) {
     
-    for (size_t i = 0; i < length; i++) {
-        uint8_t tableIndex = (crc ^ data[i]) & 0xFF;
-        crc = (crc >> 8) ^ crc32_table[tableIndex];
+    sendMutex = xSemaphoreCreateMutex();
+    reportQueue = xQueueCreate(REPORT_QUEUE_LENGTH, sizeof(ReceiveReport));
+    turn = xSemaphoreCreateBinary();
+    txQueue = xQueueCreate(TX_QUEUE_LENGTH, sizeof(PendingSend*));
+    assembler.reserve(bufferSize);
+}
+
+// Channel destructor
+ChunkedBLEProtocol::Channel::~Channel() {
+    // Stop the TX task and drop messages it never got to
+    if (txTask) {
+        vTaskDelete(txTask);
+    }
+    PendingSend* pending;
+    while (txQueue && xQueueReceive(txQueue, &pending, 0) == pdTRUE) {
+        delete pending;
     }
     
-    return crc ^ 0xFFFFFFFF;
+    if (txQueue) {
+        vQueueDelete(txQueue);
+    }
+    if (reportQueue) {
+        vQueueDelete(reportQueue);
+    }
+    if (sendMutex) {
+        vSemaphoreDelete(sendMutex);
+    }
+    if (turn) {
+        vSemaphoreDelete(turn);
+    }
+    delete[] txFrame;
+    delete[] txParity;
+}
+
+// Verify the compiled-in CRC32 backend
+void ChunkedBLEProtocol::initCRC32() {
+    if (CRC32::selfTest()) {
+        CBLE_LOGI("[CRC] CRC32 backend: %s, self-test passed", CRC32::backendName());
+    } else {
+        CBLE_LOGE("[CRC] CRC32 backend: %s, SELF-TEST FAILED - transfers will fail CRC validation", CRC32::backendName());
+    }
+}
+
+// Calculate CRC32
+uint32_t ChunkedBLEProtocol::Session::calculateCRC32(const uint8_t* data, size_t length) {
+    uint32_t start = micros();
+    uint32_t crc = CRC32::calculate(data, length);
+    stats.crcTimeUs += micros() - start;
+    return crc;
 }
 
 // Destructor
 ChunkedBLEProtocol::~ChunkedBLEProtocol() {
-    log("[PROTOCOL] Cleaning up ChunkedBLEProtocol...");
+    CBLE_LOGI("[PROTOCOL] Cleaning up ChunkedBLEProtocol...");
     
     // Clean up callback instances
     delete charCallbacks;
+    delete diagnosticsCallbacks;
     delete serverCallbacks;
+    delete l2capTransport;
+    delete gattTransport;
+    delete transportCallbacks;
+    
+    if (instance == this) {
+        instance = nullptr;
+    }
+    
+    // Stop the RX task before freeing the rings it reads
+    if (rxTask) {
+        vTaskDelete(rxTask);
+    }
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        delete sessions[i];
+    }
+    
+    vSemaphoreDelete(asyncMutex);
+    vSemaphoreDelete(txMutex);
     
     // Note: BLE service and characteristic are managed by BLE stack
-    log("[PROTOCOL] ChunkedBLEProtocol cleaned up");
+    CBLE_LOGI("[PROTOCOL] ChunkedBLEProtocol cleaned up");
 }
 
 // Setup complete BLE service and characteristic
-void ChunkedBLEProtocol::setupBLEService(const char* serviceUUID, const char* charUUID) {
+void ChunkedBLEProtocol::setupBLEService(const char* serviceUUID, const char* charUUID, const char* diagnosticsUUID) {
+    // Offer the largest MTU; the client starts the exchange and the agreed value arrives in onMtuChanged
+    BLEDevice::setMTU(PREFERRED_MTU_SIZE);
+    CBLE_LOGD("[BLE] Local MTU set to %d", PREFERRED_MTU_SIZE);
+    
     // Create service
     bleService = bleServer->createService(serviceUUID);
-    log("[BLE] Service created: %s", serviceUUID);
+    CBLE_LOGD("[BLE] Service created: %s", serviceUUID);
     
     // Create characteristic with all necessary properties
+#if CHUNKED_BLE_NIMBLE
+    // NimBLE adds the Client Characteristic Configuration Descriptor for NOTIFY itself
+    bleCharacteristic = bleService->createCharacteristic(
+        charUUID,
+        NIMBLE_PROPERTY::READ |
+        NIMBLE_PROPERTY::WRITE |
+        NIMBLE_PROPERTY::WRITE_NR |
+        NIMBLE_PROPERTY::NOTIFY
+    );
+    CBLE_LOGD("[BLE] Characteristic created: %s", charUUID);
+#else
     bleCharacteristic = bleService->createCharacteristic(
         charUUID,
         BLECharacteristic::PROPERTY_READ |
         BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR |
         BLECharacteristic::PROPERTY_NOTIFY
     );
-    log("[BLE] Characteristic created: %s", charUUID);
+    CBLE_LOGD("[BLE] Characteristic created: %s", charUUID);
     
     // Add Client Characteristic Configuration Descriptor (CCCD) for notifications
     BLE2902* pCCCD = new BLE2902();
     pCCCD->setNotifications(true);
     bleCharacteristic->addDescriptor(pCCCD);
-    log("[BLE] CCCD descriptor added for notifications");
+    CBLE_LOGD("[BLE] CCCD descriptor added for notifications");
+#endif
     
     // Set up callbacks
     charCallbacks = new ProtocolCharacteristicCallbacks(this);
     bleCharacteristic->setCallbacks(charCallbacks);
     
+    // Statistics of the reading client, filled in on each read
+#if CHUNKED_BLE_NIMBLE
+    diagnosticsCharacteristic = bleService->createCharacteristic(diagnosticsUUID, NIMBLE_PROPERTY::READ);
+#else
+    diagnosticsCharacteristic = bleService->createCharacteristic(diagnosticsUUID, BLECharacteristic::PROPERTY_READ);
+#endif
+    diagnosticsCallbacks = new ProtocolDiagnosticsCallbacks(this);
+    diagnosticsCharacteristic->setCallbacks(diagnosticsCallbacks);
+    CBLE_LOGD("[BLE] Diagnostics characteristic created: %s", diagnosticsUUID);
+    
+    // Every client starts on GATT, other transports report through transportCallbacks
+    gattTransport = new GattTransport(bleServer, bleCharacteristic);
+    transportCallbacks = new ProtocolTransportCallbacks(this);
+    
     serverCallbacks = new ProtocolServerCallbacks(this);
     bleServer->setCallbacks(serverCallbacks);
     
+    // Congestion is only reported as a raw GATTS event, link parameter changes as GAP events
+    instance = this;
+#if !CHUNKED_BLE_NIMBLE
+    BLEDevice::setCustomGattsHandler(gattsEventHandler);
+#endif
+    BLEDevice::setCustomGapHandler(gapEventHandler);
+    
     // Start the service
     bleService->start();
-    log("[BLE] Service started successfully");
+    CBLE_LOGI("[BLE] Service started successfully");
     
     // Start advertising
     BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
@@ -176,412 +471,3641 @@ void ChunkedBLEProtocol::setupBLEService(const char* serviceUUID, const char* ch
     pAdvertising->setScanResponse(false);
     pAdvertising->setMinPreferred(0x0);
     BLEDevice::startAdvertising();
-    log("[BLE] Advertising started");
+    CBLE_LOGI("[BLE] Advertising started");
 }
 
 // Set data received callback
 void ChunkedBLEProtocol::setDataReceivedCallback(DataReceivedCallback callback) {
+    if (callback) {
+        setSessionDataReceivedCallback([callback](uint16_t, const std::string& data) { callback(data); });
+    } else {
+        setSessionDataReceivedCallback(nullptr);
+    }
+}
+
+// Set data received callback with the client's conn_id
+void ChunkedBLEProtocol::setSessionDataReceivedCallback(SessionDataReceivedCallback callback) {
+    if (callback) {
+        setChannelDataReceivedCallback([callback](uint16_t connId, uint8_t, const std::string& data) {
+            callback(connId, data);
+        });
+    } else {
+        setChannelDataReceivedCallback(nullptr);
+    }
+}
+
+// Set data received callback with the client's conn_id and channel
+void ChunkedBLEProtocol::setChannelDataReceivedCallback(ChannelDataReceivedCallback callback) {
     dataReceivedCallback = callback;
-    log("[PROTOCOL] Data received callback set");
+    CBLE_LOGD("[PROTOCOL] Data received callback set");
+}
+
+// Set stream callbacks
+void ChunkedBLEProtocol::setStreamCallbacks(StreamDataCallback onData, StreamCompleteCallback onComplete,
+                                            uint16_t window) {
+    SessionStreamDataCallback sessionData;
+    if (onData) {
+        sessionData = [onData](uint16_t, const uint8_t* data, size_t length, size_t offset) {
+            onData(data, length, offset);
+        };
+    }
+    SessionStreamCompleteCallback sessionComplete;
+    if (onComplete) {
+        sessionComplete = [onComplete](uint16_t, bool success, size_t totalLength) {
+            onComplete(success, totalLength);
+        };
+    }
+    setSessionStreamCallbacks(sessionData, sessionComplete, window);
+}
+
+// Set stream callbacks with the client's conn_id
+void ChunkedBLEProtocol::setSessionStreamCallbacks(SessionStreamDataCallback onData,
+                                                   SessionStreamCompleteCallback onComplete, uint16_t window) {
+    ChannelStreamDataCallback channelData;
+    if (onData) {
+        channelData = [onData](uint16_t connId, uint8_t, const uint8_t* data, size_t length, size_t offset) {
+            onData(connId, data, length, offset);
+        };
+    }
+    ChannelStreamCompleteCallback channelComplete;
+    if (onComplete) {
+        channelComplete = [onComplete](uint16_t connId, uint8_t, bool success, size_t totalLength) {
+            onComplete(connId, success, totalLength);
+        };
+    }
+    setChannelStreamCallbacks(channelData, channelComplete, window);
+}
+
+// Set stream callbacks with the client's conn_id and channel
+void ChunkedBLEProtocol::setChannelStreamCallbacks(ChannelStreamDataCallback onData,
+                                                   ChannelStreamCompleteCallback onComplete, uint16_t window) {
+    if (window < 1) {
+        window = 1;
+    } else if (window > MAX_STREAM_WINDOW) {
+        window = MAX_STREAM_WINDOW;
+    }
+    streamDataCallback = onData;
+    streamCompleteCallback = onComplete;
+    streamWindow = window;
+    CBLE_LOGI("[STREAM] Streaming receive %s (window %d chunks)", onData ? "enabled" : "disabled", streamWindow);
 }
 
 // Set connection callback
 void ChunkedBLEProtocol::setConnectionCallback(ConnectionCallback callback) {
+    if (callback) {
+        setSessionConnectionCallback([callback](uint16_t, bool connected) { callback(connected); });
+    } else {
+        setSessionConnectionCallback(nullptr);
+    }
+}
+
+// Set connection callback with the client's conn_id
+void ChunkedBLEProtocol::setSessionConnectionCallback(SessionConnectionCallback callback) {
     connectionCallback = callback;
-    log("[PROTOCOL] Connection callback set");
+    CBLE_LOGD("[PROTOCOL] Connection callback set");
 }
 
 // Set progress callback
 void ChunkedBLEProtocol::setProgressCallback(ProgressCallback callback) {
     progressCallback = callback;
-    log("[PROTOCOL] Progress callback set");
+    CBLE_LOGD("[PROTOCOL] Progress callback set");
 }
 
-// Send data using chunked protocol
-bool ChunkedBLEProtocol::sendData(const std::string& data) {
-    if (!isConnected) {
-        log("[CHUNK] Cannot send data - device not connected");
+// Allocate sessions for up to count clients
+bool ChunkedBLEProtocol::setMaxSessions(uint8_t count, size_t bufferSize) {
+    if (count < 1) {
+        count = 1;
+    } else if (count > MAX_SESSIONS) {
+        count = MAX_SESSIONS;
+    }
+    if (getConnectedCount() || rxTask) {
+        CBLE_LOGW("[SESSION] Sessions can only change before the receive worker starts and clients connect");
         return false;
     }
     
-    size_t dataSize = data.length();
-    
-    // Validate data size against security limits
-    if (!validateDataSize(dataSize)) {
-        log("[CHUNK] Data rejected by security validation");
+    // Build the new set completely before dropping the old one
+    Session* created[MAX_SESSIONS] = {};
+    bool ok = true;
+    for (uint8_t i = 0; i < count && ok; i++) {
+        created[i] = new (std::nothrow) Session(*this, i, bufferSize);
+        Session* session = created[i];
+        ok = session && session->txCredits && session->congestionCleared && session->txTurn &&
+             session->linkIdleTimer;
+        for (uint8_t c = 0; c < MAX_CHANNELS && ok; c++) {
+            Channel* channel = session->channels[c];
+            ok = channel && channel->sendMutex && channel->reportQueue && channel->turn && channel->txQueue &&
+                 channel->assembler.capacity() >= channel->bufferSize;
+        }
+    }
+    if (!ok) {
+        for (uint8_t i = 0; i < count; i++) {
+            delete created[i];
+        }
+        CBLE_LOGE("[SESSION] Out of memory for %d sessions", count);
         return false;
     }
     
-    int totalChunks = (dataSize + CHUNK_SIZE - 1) / CHUNK_SIZE; // Round up division
-    
-    // Calculate global CRC32 for entire file
-    uint32_t globalCRC32 = calculateCRC32((const uint8_t*)data.c_str(), dataSize);
-    
-    log("[CHUNK] Sending data in %d chunks, total size: %d bytes", totalChunks, dataSize);
-    log("[SECURITY] Data passed validation (max %d bytes, %d chunks)", 
-        MAX_TOTAL_DATA_SIZE, MAX_CHUNKS_PER_TRANSFER);
-    log("[CRC] Global CRC32 for entire file: 0x%08X", globalCRC32);
-    
-    // Start transfer timing
-    uint32_t sendStartTime = millis();
-    
-    for (int chunkNum = 0; chunkNum < totalChunks; chunkNum++) {
-        // Calculate chunk data size
-        size_t chunkDataSize = std::min(CHUNK_SIZE, dataSize - (chunkNum * CHUNK_SIZE));
-        
-        // Extract chunk data
-        const uint8_t* chunkData = (const uint8_t*)data.c_str() + (chunkNum * CHUNK_SIZE);
-        
-        // Calculate CRC32 for chunk data
-        uint32_t chunkCRC32 = calculateCRC32(chunkData, chunkDataSize);
-        
-        // Create enhanced chunk header with dual CRC32
-        ChunkHeader header;
-        header.chunk_num = chunkNum + 1;  // 1-based numbering
-        header.total_chunks = totalChunks;
-        header.data_size = chunkDataSize;
-        header.chunk_crc32 = chunkCRC32;
-        header.global_crc32 = globalCRC32;  // Same global CRC32 in all chunks
-        
-        // Create complete chunk: header + data
-        std::string chunk;
-        chunk.append((char*)&header, sizeof(ChunkHeader));
-        chunk.append((char*)chunkData, chunkDataSize);
-        
-        // Send chunk
-        bleCharacteristic->setValue(chunk);
-        bleCharacteristic->notify();
-        
-        log("[CHUNK] Sent chunk %d/%d (%d bytes data, CRC32: 0x%08X)", 
-            chunkNum + 1, totalChunks, chunkDataSize, chunkCRC32);
-        
-        // Update progress
-        notifyProgress(chunkNum + 1, totalChunks, false);
-        
-        // Small delay between chunks to prevent overwhelming receiver
-        delay(100);
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        addStatistics(retiredStats, sessions[i]->stats);
+        delete sessions[i];
+        sessions[i] = nullptr;
     }
+    for (uint8_t i = 0; i < count; i++) {
+        sessions[i] = created[i];
+    }
+    sessionCount = count;
+    dataLengthSession = nullptr;
     
-    uint32_t sendTime = millis() - sendStartTime;
-    log("[CHUNK] All chunks sent successfully in %d ms", sendTime);
-    
-    // Update statistics
-    stats.totalDataSent += dataSize;
-    
+    CBLE_LOGI("[SESSION] %d session(s), %u byte receive buffer each", count, (unsigned)bufferSize);
     return true;
 }
 
-// Check if device is connected
-bool ChunkedBLEProtocol::isDeviceConnected() const {
-    return isConnected;
+// Get number of connected clients
+uint8_t ChunkedBLEProtocol::getConnectedCount() const {
+    uint8_t connected = 0;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isConnected) {
+            connected++;
+        }
+    }
+    return connected;
 }
 
-// Process received chunk
-void ChunkedBLEProtocol::processReceivedChunk(const std::string& data) {
-    // Check minimum data size for header
-    if (data.length() < sizeof(ChunkHeader)) {
-        log("[CHUNK] Received data too small for chunk header (%d bytes)", data.length());
-        return;
+// Find the connected session of a client
+ChunkedBLEProtocol::Session* ChunkedBLEProtocol::findSession(uint16_t connId) const {
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isConnected && sessions[i]->connId == connId) {
+            return sessions[i];
+        }
     }
-    
-    // Parse enhanced chunk header
-    ChunkHeader header;
-    memcpy(&header, data.c_str(), sizeof(ChunkHeader));
-    
-    log("[CHUNK] Received chunk %d/%d (%d bytes data, CRC32: 0x%08X)", 
-        header.chunk_num, header.total_chunks, header.data_size, header.chunk_crc32);
-    
-    // Validate chunk header
-    if (!validateChunkHeader(header)) {
-        log("[CHUNK] Invalid chunk header - ignoring");
-        stats.crcErrors++;
-        return;
+    return nullptr;
+}
+
+// Find the connected session of a peer address
+ChunkedBLEProtocol::Session* ChunkedBLEProtocol::findSession(const uint8_t* address) const {
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isConnected && memcmp(sessions[i]->peerAddress, address, BLE_ADDRESS_LENGTH) == 0) {
+            return sessions[i];
+        }
     }
-    
-    // Check if data size matches header
-    size_t expectedSize = sizeof(ChunkHeader) + header.data_size;
-    if (data.length() != expectedSize) {
-        log("[CHUNK] Data size mismatch: expected %d, got %d", expectedSize, data.length());
-        stats.crcErrors++;
-        return;
+    return nullptr;
+}
+
+// Find the first connected session
+ChunkedBLEProtocol::Session* ChunkedBLEProtocol::firstConnectedSession() const {
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isConnected) {
+            return sessions[i];
+        }
     }
-    
-    // Extract chunk data
-    const uint8_t* chunkData = (const uint8_t*)data.c_str() + sizeof(ChunkHeader);
-    
-    // Validate CRC32
-    uint32_t calculatedCRC = calculateCRC32(chunkData, header.data_size);
-    if (calculatedCRC != header.chunk_crc32) {
-        log("[CRC] CRC32 mismatch: expected 0x%08X, calculated 0x%08X", 
-            header.chunk_crc32, calculatedCRC);
-        stats.crcErrors++;
-        return;
+    return nullptr;
+}
+
+// Give a connecting client a session, refusing it when all are taken
+void ChunkedBLEProtocol::openSession(uint16_t connId, const uint8_t* address, const LinkParameters& connected) {
+    // A returning peer gets the session holding its interrupted transfers, a new one
+    // a free session, preferring those without resumable state
+    Session* chosen = nullptr;
+    Session* fallback = nullptr;
+    for (uint8_t i = 0; i < sessionCount && !chosen; i++) {
+        Session* session = sessions[i];
+        if (session->isConnected) {
+            continue;
+        }
+        if (session->generation &&
+            memcmp(session->peerAddress, address, BLE_ADDRESS_LENGTH) == 0) {
+            chosen = session;
+        } else if (!fallback || (fallback->hasResumableState() && !session->hasResumableState())) {
+            fallback = session;
+        }
     }
-    
-    log("[CRC] CRC32 validation passed for chunk %d", header.chunk_num);
-    
-    // Initialize chunks vector if this is the first chunk
-    if (header.chunk_num == 1) {
-        clearReceiveBuffers();
-        receivedChunks.resize(header.total_chunks);
-        expectedChunks = header.total_chunks;
-        receivedChunkCount = 0;
-        expectedGlobalCRC32 = header.global_crc32;  // Store expected global CRC32
-        
-        // Start chunk timer (no transfer timer needed)
-        updateChunkTimer();
-        transferInProgress = true;
+    if (!chosen) {
+        chosen = fallback;
         
-        log("[CHUNK] Starting new transfer: expecting %d chunks total", header.total_chunks);
-        log("[CRC] Expected global CRC32: 0x%08X", expectedGlobalCRC32);
-        
-        // Validate total expected data size
-        size_t estimatedTotalSize = header.total_chunks * CHUNK_SIZE;
-        if (!validateDataSize(estimatedTotalSize)) {
-            cancelTransfer("Total data size exceeds limits");
-            return;
-        }
-    } else {
-        // Validate global CRC32 consistency across chunks
-        if (header.global_crc32 != expectedGlobalCRC32) {
-            log("[CRC] Global CRC32 inconsistency: expected 0x%08X, got 0x%08X", 
-                expectedGlobalCRC32, header.global_crc32);
-            cancelTransfer("Global CRC32 mismatch between chunks");
-            return;
+        // Delta bases belong to the peer that left them
+        if (chosen) {
+            for (uint8_t c = 0; c < MAX_CHANNELS; c++) {
+                chosen->channels[c]->clearDeltaBases();
+            }
         }
     }
-    
-    // Check chunk timeout (only timeout check needed)
-    if (checkChunkTimeout()) {
-        cancelTransfer("Chunk timeout");
+    if (!chosen) {
+        CBLE_LOGW("[SESSION] All %d sessions in use - disconnecting client %d", sessionCount, connId);
+        bleServer->disconnect(connId);
         return;
     }
     
-    // Update chunk timer
-    updateChunkTimer();
+    // Statistics describe the current connection, earlier ones count towards the totals
+    addStatistics(retiredStats, chosen->stats);
+    chosen->stats = TransferStats();
+    chosen->clearHistory();
+    chosen->connId = connId;
+    memcpy(chosen->peerAddress, address, BLE_ADDRESS_LENGTH);
+    chosen->handleConnectionChange(true);
+    chosen->applyLinkProfile(connected);
     
-    // Validate chunk consistency
-    if (header.total_chunks != expectedChunks) {
-        log("[CHUNK] Inconsistent total chunks: expected %d, got %d", 
-            expectedChunks, header.total_chunks);
-        cancelTransfer("Inconsistent chunk count");
-        return;
+    if (getConnectedCount() < sessionCount) {
+        restartAdvertising();
     }
-    
-    // Check for duplicate chunks
-    int chunkIndex = header.chunk_num - 1; // Convert to 0-based index
-    if (chunkIndex >= 0 && chunkIndex < receivedChunks.size() && 
-        !receivedChunks[chunkIndex].empty()) {
-        log("[CHUNK] Duplicate chunk %d - ignoring", header.chunk_num);
-        return;
+}
+
+// End the session of a disconnected client
+void ChunkedBLEProtocol::closeSession(uint16_t connId) {
+    Session* session = findSession(connId);
+    if (!session) {
+        return;  // Refused by openSession()
     }
+    session->handleConnectionChange(false);
     
-    // Store chunk data
-    std::string chunkDataStr((char*)chunkData, header.data_size);
-    receivedChunks[chunkIndex] = chunkDataStr;
-    receivedChunkCount++;
-    
-    // Update statistics
-    updateStatistics(true, header.data_size);
-    
-    // Notify progress
-    notifyProgress(receivedChunkCount, expectedChunks, true);
-    
-    log("[CHUNK] Progress: %d/%d chunks received", receivedChunkCount, expectedChunks);
-    
-    // Check if all chunks received
-    if (receivedChunkCount == expectedChunks) {
-        log("[CHUNK] All chunks received, assembling complete data");
-        
-        // Assemble complete data
-        receiveBuffer.clear();
-        for (int i = 0; i < expectedChunks; i++) {
-            receiveBuffer += receivedChunks[i];
-        }
-        
-        // Validate global CRC32 after assembling complete data
-        uint32_t calculatedGlobalCRC32 = calculateCRC32((const uint8_t*)receiveBuffer.c_str(), receiveBuffer.length());
-        if (calculatedGlobalCRC32 != expectedGlobalCRC32) {
-            log("[CRC] Global CRC32 mismatch: expected 0x%08X, calculated 0x%08X", 
-                expectedGlobalCRC32, calculatedGlobalCRC32);
-            cancelTransfer("Global CRC32 mismatch after assembling complete data");
-            return;
-        }
-        
-        log("[CRC] Global CRC32 validation passed for complete data");
-        
-        // Mark transfer as complete
-        transferInProgress = false;
-        
-        log("[CHUNK] Complete data assembled (%d bytes)", receiveBuffer.length());
-        
-        // Update final statistics
-        updateStatistics(true, 0); // Final update
-        
-        // Notify callback
-        if (dataReceivedCallback) {
-            dataReceivedCallback(receiveBuffer);
-        }
-        
-        // Clear buffers
-        clearReceiveBuffers();
+    // With a single session the application decides when to advertise again
+    if (sessionCount > 1) {
+        restartAdvertising();
     }
 }
 
-// Handle connection changes
-void ChunkedBLEProtocol::handleConnectionChange(bool connected) {
-    isConnected = connected;
+// Accept further clients
+void ChunkedBLEProtocol::restartAdvertising() {
+    BLEDevice::startAdvertising();
+    CBLE_LOGD("[SESSION] Advertising for more clients (%d of %d connected)", getConnectedCount(), sessionCount);
+}
+
+// Route a frame written by a client to its session
+void ChunkedBLEProtocol::handleWrite(uint16_t connId, const uint8_t* data, size_t length) {
+    Session* session = findSession(connId);
+    if (!session) {
+        CBLE_LOGW("[BLE] Write from unknown client %d dropped", connId);
+        return;
+    }
+    session->noteLinkActivity();
+    // FRAME_OPEN/FRAME_RESUME take the data path so they stay ordered with the chunks behind them
+    if (isControlFrame(data, length) && data[2] != FRAME_OPEN && data[2] != FRAME_RESUME) {
+        session->processControlFrame(data, length);
+        return;
+    }
     
-    if (connected) {
-        log("[PROTOCOL] Device connected, ready for chunked data");
+    if (session->rxRing) {
+        session->queueDataFrame(data, length);
     } else {
-        log("[PROTOCOL] Device disconnected, buffers cleared");
-        clearReceiveBuffers();
+        session->handleDataFrame(data, length);
     }
-    
-    // Call user callback
-    if (connectionCallback) {
-        connectionCallback(connected);
+}
+
+// Check if the session keeps state a reconnecting peer could pick up
+bool ChunkedBLEProtocol::Session::hasResumableState() const {
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        if (channels[i]->hasResumableState()) {
+            return true;
+        }
     }
+    return false;
 }
 
-// Clear receive buffers
-void ChunkedBLEProtocol::clearReceiveBuffers() {
-    receivedChunks.clear();
-    receiveBuffer.clear();
-    expectedChunks = 0;
-    receivedChunkCount = 0;
+// Check if the channel keeps state a reconnecting peer could pick up
+bool ChunkedBLEProtocol::Channel::hasResumableState() const {
+    uint32_t now = millis();
+    return (suspendedTransferId && now - suspendTime <= protocol.resumeGraceMs) ||
+           (interruptedSend.transferId && now - interruptedSend.time <= protocol.resumeGraceMs);
 }
 
-// Notify progress
-void ChunkedBLEProtocol::notifyProgress(int current, int total, bool isReceiving) {
-    if (progressCallback) {
-        progressCallback(current, total, isReceiving);
+// Add one set of counters to another
+void ChunkedBLEProtocol::addStatistics(TransferStats& total, const TransferStats& stats) {
+    total.totalDataSent += stats.totalDataSent;
+    total.totalDataReceived += stats.totalDataReceived;
+    total.chunksReceived += stats.chunksReceived;
+    total.crcErrors += stats.crcErrors;
+    total.timeouts += stats.timeouts;
+    total.transfersCompleted += stats.transfersCompleted;
+    total.retransmissions += stats.retransmissions;
+    total.rxDropped += stats.rxDropped;
+    total.compressionSaved += stats.compressionSaved;
+    total.chunksSent += stats.chunksSent;
+    total.sendAllocations += stats.sendAllocations;
+    total.paritySent += stats.paritySent;
+    total.fecRecovered += stats.fecRecovered;
+    total.deltaSaved += stats.deltaSaved;
+    total.sizeRejections += stats.sizeRejections;
+    total.cancellations += stats.cancellations;
+    total.sendFailures += stats.sendFailures;
+    total.crcTimeUs += stats.crcTimeUs;
+    total.reassemblyTimeUs += stats.reassemblyTimeUs;
+    total.callbackTimeUs += stats.callbackTimeUs;
+    for (uint8_t i = 0; i < GAP_HISTOGRAM_BUCKETS; i++) {
+        total.rxGapHistogram[i] += stats.rxGapHistogram[i];
+        total.txGapHistogram[i] += stats.txGapHistogram[i];
+    }
+    // The latest records win, micros() wraps after about 71 minutes
+    if (stats.lastSent.endUs && (!total.lastSent.endUs || (int32_t)(stats.lastSent.endUs - total.lastSent.endUs) > 0)) {
+        total.lastSent = stats.lastSent;
+    }
+    if (stats.lastReceived.endUs &&
+        (!total.lastReceived.endUs || (int32_t)(stats.lastReceived.endUs - total.lastReceived.endUs) > 0)) {
+        total.lastReceived = stats.lastReceived;
+        total.lastTransferTime = stats.lastTransferTime;
     }
 }
 
-// Logging utility
-void ChunkedBLEProtocol::log(const char* format, ...) {
-    char buffer[256];
-    va_list args;
-    va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    va_end(args);
-    Serial.println(buffer);
+// Send data to every connected client
+bool ChunkedBLEProtocol::sendData(const std::string& data, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[MUX] Cannot send data - invalid channel %d", channel);
+        return false;
+    }
+    bool sent = false;
+    bool failed = false;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isConnected) {
+            if (sessions[i]->sendData(channel, (const uint8_t*)data.data(), data.size())) {
+                sent = true;
+            } else {
+                failed = true;
+            }
+        }
+    }
+    if (!sent && !failed) {
+        CBLE_LOGW("[CHUNK] Cannot send data - device not connected");
+    }
+    return sent && !failed;
 }
 
-// Validate total data size against limits
-bool ChunkedBLEProtocol::validateDataSize(size_t totalSize) {
-    if (totalSize == 0) {
-        log("[SECURITY] Rejected: Empty data");
+// Send data to one client
+bool ChunkedBLEProtocol::sendData(uint16_t connId, const std::string& data, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[MUX] Cannot send data - invalid channel %d", channel);
         return false;
     }
-    
-    if (totalSize > MAX_TOTAL_DATA_SIZE) {
-        log("[SECURITY] Rejected: Data too large (%d bytes, max %d)", 
-            totalSize, MAX_TOTAL_DATA_SIZE);
-        stats.timeouts++; // Count as security violation
+    Session* session = findSession(connId);
+    if (!session) {
+        CBLE_LOGW("[CHUNK] Cannot send data - client %d not connected", connId);
         return false;
     }
-    
-    size_t requiredChunks = (totalSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
-    if (requiredChunks > MAX_CHUNKS_PER_TRANSFER) {
-        log("[SECURITY] Rejected: Too many chunks required (%d, max %d)", 
-            requiredChunks, MAX_CHUNKS_PER_TRANSFER);
-        stats.timeouts++; // Count as security violation  
-        return false;
+    return session->sendData(channel, (const uint8_t*)data.data(), data.size());
+}
+
+// Send JSON text to every connected client, encoded once for the peers that take CBOR
+bool ChunkedBLEProtocol::sendJSON(const std::string& json, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[MUX] Cannot send data - invalid channel %d", channel);
+        return false;
+    }
+    std::string cbor;
+    bool sent = false;
+    bool failed = false;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isConnected) {
+            if (sessions[i]->sendJSON(channel, json, cbor)) {
+                sent = true;
+            } else {
+                failed = true;
+            }
+        }
+    }
+    if (!sent && !failed) {
+        CBLE_LOGW("[CHUNK] Cannot send data - device not connected");
+    }
+    return sent && !failed;
+}
+
+// Send JSON text to one client
+bool ChunkedBLEProtocol::sendJSON(uint16_t connId, const std::string& json, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[MUX] Cannot send data - invalid channel %d", channel);
+        return false;
+    }
+    Session* session = findSession(connId);
+    if (!session) {
+        CBLE_LOGW("[CHUNK] Cannot send data - client %d not connected", connId);
+        return false;
+    }
+    std::string cbor;
+    return session->sendJSON(channel, json, cbor);
+}
+
+// Send a source's payload to every connected client
+bool ChunkedBLEProtocol::sendStream(SendSource& source, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[MUX] Cannot send stream - invalid channel %d", channel);
+        return false;
+    }
+    bool sent = false;
+    bool failed = false;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isConnected) {
+            if (sessions[i]->sendData(channel, nullptr, source.size(), &source)) {
+                sent = true;
+            } else {
+                failed = true;
+            }
+        }
+    }
+    if (!sent && !failed) {
+        CBLE_LOGW("[STREAM] Cannot send stream - device not connected");
+    }
+    return sent && !failed;
+}
+
+// Send a source's payload to one client
+bool ChunkedBLEProtocol::sendStream(uint16_t connId, SendSource& source, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[MUX] Cannot send stream - invalid channel %d", channel);
+        return false;
+    }
+    Session* session = findSession(connId);
+    if (!session) {
+        CBLE_LOGW("[STREAM] Cannot send stream - client %d not connected", connId);
+        return false;
+    }
+    return session->sendData(channel, nullptr, source.size(), &source);
+}
+
+// Send a file to every connected client
+bool ChunkedBLEProtocol::sendFile(fs::FS& fs, const char* path, uint8_t channel) {
+    File file = fs.open(path, "r");
+    if (!file || file.isDirectory()) {
+        CBLE_LOGW("[STREAM] Cannot open %s", path);
+        return false;
+    }
+    FileSource source(file);
+    CBLE_LOGD("[STREAM] Sending %s (%u bytes)", path, (unsigned)source.size());
+    bool sent = sendStream(source, channel);
+    file.close();
+    return sent;
+}
+
+// Send a file to one client
+bool ChunkedBLEProtocol::sendFile(uint16_t connId, fs::FS& fs, const char* path, uint8_t channel) {
+    File file = fs.open(path, "r");
+    if (!file || file.isDirectory()) {
+        CBLE_LOGW("[STREAM] Cannot open %s", path);
+        return false;
+    }
+    FileSource source(file);
+    CBLE_LOGD("[STREAM] Sending %s (%u bytes) to client %d", path, (unsigned)source.size(), connId);
+    bool sent = sendStream(connId, source, channel);
+    file.close();
+    return sent;
+}
+
+// Send data (or a source's payload) to this client on one channel
+bool ChunkedBLEProtocol::Session::sendData(uint8_t channelId, const uint8_t* data, size_t size, SendSource* source,
+                                           uint8_t contentType) {
+    // Without multiplexing every send shares the default channel
+    Channel& channel = *channels[peerUsesMultiplex() ? channelId : DEFAULT_CHANNEL];
+    
+    // One transfer per channel at a time, whether started here or by the TX task
+    xSemaphoreTake(channel.sendMutex, portMAX_DELAY);
+    channel.txRecord = TransferRecord();
+    channel.txRecord.startUs = micros();
+    channel.txRecord.bytes = source ? source->size() : size;
+    channel.txRecord.channel = channel.id;
+    channel.txRecord.sent = true;
+    bool sent = transmitData(channel, data, size, source, contentType);
+    channel.sending = false;
+    if (!sent) {
+        stats.sendFailures++;
+    }
+    recordTransfer(channel.txRecord, sent);
+    // The CRC32 table of an unusually large transfer is not kept for the next one
+    if (channel.txChunkCRCs.capacity() > MAX_CHUNKS_PER_TRANSFER) {
+        std::vector<uint32_t>().swap(channel.txChunkCRCs);
+    }
+    xSemaphoreGive(channel.sendMutex);
+    return sent;
+}
+
+// Send JSON text to this client, as CBOR if it takes content types (cbor caches the encoding)
+bool ChunkedBLEProtocol::Session::sendJSON(uint8_t channelId, const std::string& json, std::string& cbor) {
+#if CHUNKED_BLE_CBOR
+    if (!peerUsesContentTypes()) {
+        return sendData(channelId, (const uint8_t*)json.data(), json.size());
+    }
+    if (cbor.empty() && !json.empty()) {
+        uint32_t encodeStart = micros();
+        if (!CBOR::fromJSON(json.data(), json.size(), cbor)) {
+            cbor.clear();
+            CBLE_LOGW("[CBOR] Text is not valid JSON - sending it unencoded");
+        } else {
+            CBLE_LOGD("[CBOR] %d bytes of JSON encoded to %d in %u us", json.size(), cbor.size(),
+                (unsigned)(micros() - encodeStart));
+        }
+    }
+    if (cbor.empty()) {
+        return sendData(channelId, (const uint8_t*)json.data(), json.size());
+    }
+    return sendData(channelId, (const uint8_t*)cbor.data(), cbor.size(), nullptr, CONTENT_TYPE_CBOR);
+#else
+    (void)cbor;
+    return sendData(channelId, (const uint8_t*)json.data(), json.size());
+#endif
+}
+
+// Run one outbound transfer (caller holds the channel's sendMutex)
+bool ChunkedBLEProtocol::Session::transmitData(Channel& channel, const uint8_t* data, size_t dataSize,
+                                               SendSource* source, uint8_t contentType) {
+    if (!isConnected) {
+        CBLE_LOGW("[CHUNK] Cannot send data - device not connected");
+        return false;
+    }
+    
+    // Validate data size against security limits - a streaming receiver does not buffer the payload
+    if (!validateDataSize(dataSize, peerFeatures & FEATURE_STREAMING)) {
+        CBLE_LOGW("[CHUNK] Data rejected by security validation");
+        return false;
+    }
+    
+    // Every chunk is built in the channel's frame buffer, allocated once
+    if (!channel.txFrame) {
+        channel.txFrame = new (std::nothrow) uint8_t[MAX_FRAME_SIZE];
+        if (!channel.txFrame) {
+            CBLE_LOGE("[CHUNK] Cannot send data - no memory for the frame buffer");
+            return false;
+        }
+        stats.sendAllocations++;
+    }
+    
+    // A receiver holding the payload acknowledged last on this channel gets only the differences
+    // (sources are never held in RAM as a whole, so they go out as they are)
+    bool useDelta = !source && peerUsesDelta();
+    uint32_t dataCRC32 = useDelta ? CRC32::calculate(data, dataSize) : 0;
+    std::string patch;
+    bool delta = false;
+#if CHUNKED_BLE_DELTA
+    if (useDelta && !channel.txBase.empty()) {
+        stats.sendAllocations++;  // Patch and base index, once per transfer
+        delta = Delta::encode((const uint8_t*)channel.txBase.data(), channel.txBase.size(), data, dataSize, patch);
+        if (delta) {
+            CBLE_LOGD("[DELTA] %d bytes sent as a %d byte patch against 0x%08X", dataSize, patch.size(),
+                channel.txBaseCRC32);
+        }
+    }
+#endif
+    const uint8_t* payload = delta ? (const uint8_t*)patch.data() : data;
+    size_t payloadSize = delta ? patch.size() : dataSize;
+    
+    // Compress ahead of chunking when the receiver can inflate it and it actually shrinks
+    std::string compressed;
+    bool compress = false;
+#if CHUNKED_BLE_COMPRESSION
+    if (!source && peerUsesCompression() && payloadSize >= MIN_COMPRESSION_SIZE) {
+        stats.sendAllocations++;  // Output and match tables, once per transfer
+        compress = LZSS::compress(payload, payloadSize, compressed);
+    }
+#endif
+    
+    // Chunk size follows the MTU negotiated for this connection and the framing
+    bool largeFraming = peerUsesLargeTransfers();
+    bool multiplexed = peerUsesMultiplex();
+    OutboundTransfer transfer;
+    transfer.data = compress ? (const uint8_t*)compressed.c_str() : payload;
+    transfer.source = source;
+    transfer.size = compress ? compressed.size() : payloadSize;
+    transfer.channel = channel.id;
+    transfer.openFlags = 0;
+    uint8_t fecGroup = peerUsesFec() ? protocol.fecGroupSize : 0;
+    if (peerUsesCompactFraming()) {
+        // Frames of concurrent channels are told apart by their transfer_id
+        transfer.openFlags = OPEN_FLAG_COMPACT | (protocol.compactChunkCRC ? 0 : OPEN_FLAG_NO_CHUNK_CRC) |
+            (multiplexed ? OPEN_FLAG_TAGGED : 0);
+        transfer.chunkSize = getChunkDataSize(largeHeaderSize(transfer.openFlags));
+        size_t chunks = (transfer.size + transfer.chunkSize - 1) / transfer.chunkSize;
+        if (chunks + (fecGroup ? (chunks + fecGroup - 1) / fecGroup : 0) > MAX_COMPACT_CHUNKS) {
+            transfer.openFlags = 0;  // Chunk numbers (parity chunks included) need more than 16 bits
+        }
+    }
+    if (compress) {
+        transfer.openFlags |= OPEN_FLAG_COMPRESSED;
+        CBLE_LOGD("[COMPRESS] %d bytes compressed to %d", payloadSize, transfer.size);
+    }
+    if (multiplexed) {
+        transfer.openFlags |= channel.id << OPEN_CHANNEL_SHIFT;
+    }
+    transfer.contentType = CONTENT_TYPE_NONE;
+    if (contentType != CONTENT_TYPE_NONE && largeFraming && peerUsesContentTypes()) {
+        transfer.contentType = contentType;
+        transfer.openFlags |= OPEN_FLAG_CONTENT_TYPE;
+    }
+    transfer.baseCRC32 = 0;
+    transfer.resultCRC32 = 0;
+    if (delta) {
+        transfer.contentType |= CONTENT_FLAG_DELTA;
+        transfer.openFlags |= OPEN_FLAG_CONTENT_TYPE;
+        transfer.baseCRC32 = channel.txBaseCRC32;
+        transfer.resultCRC32 = dataCRC32;
+    }
+    transfer.headerSize = largeFraming ? largeHeaderSize(transfer.openFlags) : HEADER_SIZE;
+    transfer.chunkSize = getChunkDataSize(transfer.headerSize);
+    transfer.frame = channel.txFrame;
+    transfer.totalChunks = (transfer.size + transfer.chunkSize - 1) / transfer.chunkSize; // Round up division
+    
+    // Per-chunk CRC32s in a single pass, the global CRC32 is combined from them
+    if (!prepareTransferCRCs(transfer)) {
+        CBLE_LOGE("[STREAM] Failed to read the payload from its source");
+        return false;
+    }
+    transfer.useCredits = peerUsesCredits();
+    bool useSack = peerUsesSack();
+    
+    // The same data sent again on the same channel after a failed send continues that transfer
+    InterruptedSend& interruptedSend = channel.interruptedSend;
+    bool resuming = peerUsesResume() && interruptedSend.transferId &&
+        interruptedSend.globalCRC32 == transfer.globalCRC32 && interruptedSend.size == transfer.size &&
+        interruptedSend.chunkSize == transfer.chunkSize && millis() - interruptedSend.time <= protocol.resumeGraceMs;
+    transfer.transferId = 0;
+    if (resuming) {
+        transfer.transferId = interruptedSend.transferId;
+    } else if (largeFraming) {
+        // Channels pick ids from the same counter, so their frames never share a transfer_id
+        xSemaphoreTake(protocol.txMutex, portMAX_DELAY);
+        transfer.transferId = nextTransferId++;
+        if (nextTransferId == 0) {
+            nextTransferId = 1;
+        }
+        xSemaphoreGive(protocol.txMutex);
+    }
+    interruptedSend.transferId = 0;
+    
+    // Parity groups would not line up with the chunks a resumed round starts from
+    transfer.fecGroup = 0;
+    transfer.parity = nullptr;
+    if (fecGroup && !resuming) {
+        if (!channel.txParity) {
+            channel.txParity = new (std::nothrow) uint8_t[MAX_FRAME_SIZE];
+            stats.sendAllocations++;
+        }
+        if (channel.txParity) {
+            transfer.fecGroup = fecGroup;
+            transfer.parity = channel.txParity;
+            transfer.openFlags |= OPEN_FLAG_FEC;
+            CBLE_LOGD("[FEC] One parity chunk per %d data chunks", fecGroup);
+        } else {
+            CBLE_LOGW("[FEC] No memory for the parity buffer - sending without parity");
+        }
+    }
+    
+    if (multiplexed) {
+        CBLE_LOGD("[MUX] Transfer %d on channel %d", transfer.transferId, channel.id);
+    }
+    CBLE_LOGD("[CHUNK] Sending data in %d chunks, total size: %d bytes", transfer.totalChunks, transfer.size);
+    CBLE_LOGD("[CHUNK] Chunk size: %d bytes (MTU %d)", transfer.chunkSize, negotiatedMTU);
+    CBLE_LOGD("[SECURITY] Data passed validation (max %d bytes buffered, %d bytes streamed)", 
+        protocol.maxBufferedSize, protocol.maxStreamedSize);
+    CBLE_LOGD("[CRC] Global CRC32 for entire file: 0x%08X", transfer.globalCRC32);
+    
+    if (transfer.useCredits) {
+        CBLE_LOGD("[FLOW] Using credit-based flow control");
+    } else {
+        CBLE_LOGD("[FLOW] Peer without flow control, pacing chunks every %d ms", LEGACY_CHUNK_DELAY_MS);
+    }
+    
+    // Drop reports left over from an earlier transfer, then let queueReport() route this one's here
+    xQueueReset(channel.reportQueue);
+    channel.activeCRC32 = transfer.globalCRC32;
+    channel.activeTransferId = transfer.transferId;
+    channel.txAckStatus = ACK_STATUS_OK;
+    channel.sending = true;
+    
+    // Start transfer timing
+    uint32_t sendStartTime = millis();
+    
+    // Large transfers announce length and global CRC32 once, ahead of the chunks;
+    // a resumed one starts wherever the receiver's resume point says (0 = no answer)
+    uint32_t firstChunk = resuming ? requestResume(transfer) : 0;
+    bool opened = firstChunk || !largeFraming || sendOpenFrame(transfer);
+    
+    // Keep the data until the receiver confirms it has everything
+    bool delivered = opened && sendChunkRange(transfer, firstChunk ? firstChunk : 1, useSack) &&
+        (!useSack || awaitDelivery(transfer));
+    if (!delivered) {
+        // Without its base the receiver cannot use the patch - it gets the payload whole
+        if (delta && channel.txAckStatus == ACK_STATUS_DELTA_BASE_MISSING && isConnected) {
+            CBLE_LOGW("[DELTA] Receiver lacks base 0x%08X - sending %d bytes whole", channel.txBaseCRC32, dataSize);
+            channel.txBase.clear();
+            channel.txBaseCRC32 = 0;
+            // The record describes the whole payload going out; its time still counts from the first try
+            channel.txRecord.chunks = 0;
+            channel.txRecord.retransmissions = 0;
+            return transmitData(channel, data, dataSize, source, contentType);
+        }
+        
+        // Offer the transfer for resumption when the same data is sent again
+        if (transfer.transferId && protocol.resumeGraceMs) {
+            interruptedSend.transferId = transfer.transferId;
+            interruptedSend.globalCRC32 = transfer.globalCRC32;
+            interruptedSend.size = transfer.size;
+            interruptedSend.chunkSize = transfer.chunkSize;
+            interruptedSend.time = millis();
+        }
+        return false;
+    }
+    
+    uint32_t sendTime = millis() - sendStartTime;
+    CBLE_LOGI("[CHUNK] All chunks sent successfully in %d ms", sendTime);
+    
+    // Update statistics
+    stats.totalDataSent += dataSize;
+    stats.compressionSaved += payloadSize - transfer.size;
+    stats.deltaSaved += dataSize - payloadSize;
+    
+    // The receiver now holds this payload, the next one may be sent against it
+    if (useDelta && dataSize <= protocol.maxDeltaBaseSize) {
+        channel.txBase.assign((const char*)data, dataSize);
+        channel.txBaseCRC32 = dataCRC32;
+    } else if (!channel.txBase.empty()) {
+        std::string().swap(channel.txBase);
+        channel.txBaseCRC32 = 0;
     }
     
     return true;
 }
 
-// Check if chunk reception has timed out
-bool ChunkedBLEProtocol::checkChunkTimeout() {
-    if (!transferInProgress) return false;
+// Queue data for every connected client's TX task
+uint32_t ChunkedBLEProtocol::sendDataAsync(std::string data, SendCompleteCallback onComplete, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[TX] Invalid channel %d - message not queued", channel);
+        return 0;
+    }
+    uint32_t id = takeMessageId();
+    uint8_t connected = getConnectedCount();
     
-    uint32_t currentTime = millis();
-    if (currentTime - lastChunkTime > chunkTimeoutMs) {
-        log("[TIMEOUT] Chunk timeout: %d ms since last chunk", currentTime - lastChunkTime);
-        stats.timeouts++;
-        return true;
+    // Without a client the message still goes through the queue and fails there
+    if (connected == 0) {
+        return queueSend(*sessions[0]->channels[channel], id, std::move(data), onComplete) ? id : 0;
     }
-    return false;
+    
+    bool queued = false;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        Session& session = *sessions[i];
+        if (!session.isConnected) {
+            continue;
+        }
+        // The last copy takes the data itself
+        if (--connected == 0) {
+            queued |= queueSend(*session.channels[channel], id, std::move(data), onComplete);
+        } else {
+            queued |= queueSend(*session.channels[channel], id, data, onComplete);
+        }
+    }
+    return queued ? id : 0;
 }
 
-// Update chunk timer
-void ChunkedBLEProtocol::updateChunkTimer() {
-    lastChunkTime = millis();
+// Queue data for one client's TX task
+uint32_t ChunkedBLEProtocol::sendDataAsync(uint16_t connId, std::string data, SendCompleteCallback onComplete,
+                                           uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[TX] Invalid channel %d - message not queued", channel);
+        return 0;
+    }
+    Session* session = findSession(connId);
+    if (!session) {
+        CBLE_LOGW("[TX] Client %d not connected - message not queued", connId);
+        return 0;
+    }
+    uint32_t id = takeMessageId();
+    return queueSend(*session->channels[channel], id, std::move(data), onComplete) ? id : 0;
 }
 
-// Cancel current transfer
-void ChunkedBLEProtocol::cancelTransfer(const char* reason) {
-    if (transferInProgress) {
-        log("[CANCEL] Transfer cancelled: %s", reason);
-        transferInProgress = false;
-        clearReceiveBuffers();
-        stats.timeouts++;
+// Queue JSON text for every connected client's TX task
+uint32_t ChunkedBLEProtocol::sendJSONAsync(std::string json, SendCompleteCallback onComplete, uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[TX] Invalid channel %d - message not queued", channel);
+        return 0;
+    }
+    uint32_t id = takeMessageId();
+    uint8_t connected = getConnectedCount();
+    
+    // Without a client the message still goes through the queue and fails there
+    if (connected == 0) {
+        return queueSend(*sessions[0]->channels[channel], id, std::move(json), onComplete, true) ? id : 0;
+    }
+    
+    bool queued = false;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        Session& session = *sessions[i];
+        if (!session.isConnected) {
+            continue;
+        }
+        // The last copy takes the text itself
+        if (--connected == 0) {
+            queued |= queueSend(*session.channels[channel], id, std::move(json), onComplete, true);
+        } else {
+            queued |= queueSend(*session.channels[channel], id, json, onComplete, true);
+        }
     }
+    return queued ? id : 0;
 }
 
-// Validate chunk header
-bool ChunkedBLEProtocol::validateChunkHeader(const ChunkHeader& header) {
-    // Check chunk numbers
-    if (header.chunk_num == 0 || header.total_chunks == 0) {
-        log("[VALIDATE] Invalid chunk numbers: %d/%d", header.chunk_num, header.total_chunks);
+// Queue JSON text for one client's TX task
+uint32_t ChunkedBLEProtocol::sendJSONAsync(uint16_t connId, std::string json, SendCompleteCallback onComplete,
+                                           uint8_t channel) {
+    if (channel >= MAX_CHANNELS) {
+        CBLE_LOGW("[TX] Invalid channel %d - message not queued", channel);
+        return 0;
+    }
+    Session* session = findSession(connId);
+    if (!session) {
+        CBLE_LOGW("[TX] Client %d not connected - message not queued", connId);
+        return 0;
+    }
+    uint32_t id = takeMessageId();
+    return queueSend(*session->channels[channel], id, std::move(json), onComplete, true) ? id : 0;
+}
+
+// Hand out the next message id
+uint32_t ChunkedBLEProtocol::takeMessageId() {
+    xSemaphoreTake(asyncMutex, portMAX_DELAY);
+    uint32_t id = nextMessageId++;
+    if (nextMessageId == 0) {
+        nextMessageId = 1;  // 0 is reserved for "not queued"
+    }
+    xSemaphoreGive(asyncMutex);
+    return id;
+}
+
+// Queue one message for a channel's TX task, starting the task on first use
+bool ChunkedBLEProtocol::queueSend(Channel& channel, uint32_t id, std::string data, SendCompleteCallback onComplete,
+                                   bool json) {
+    Session& session = channel.session;
+    xSemaphoreTake(asyncMutex, portMAX_DELAY);
+    
+    if (!channel.txTask && !channel.startTxTask()) {
+        xSemaphoreGive(asyncMutex);
         return false;
     }
     
-    if (header.chunk_num > header.total_chunks) {
-        log("[VALIDATE] Chunk number exceeds total: %d > %d", header.chunk_num, header.total_chunks);
+    PendingSend* pending = new PendingSend();
+    session.stats.sendAllocations++;
+    pending->id = id;
+    pending->generation = session.generation;
+    pending->data = std::move(data);
+    pending->json = json;
+    pending->onComplete = onComplete;
+    
+    if (xQueueSend(channel.txQueue, &pending, 0) != pdTRUE) {
+        xSemaphoreGive(asyncMutex);
+        CBLE_LOGW("[TX] Queue of session %d channel %d full (%d messages) - message not queued",
+            session.index, channel.id, TX_QUEUE_LENGTH);
+        delete pending;
+        return false;
+    }
+    xSemaphoreGive(asyncMutex);
+    
+    CBLE_LOGD("[TX] Message %u queued for session %d channel %d", id, session.index, channel.id);
+    return true;
+}
+
+// Get number of messages waiting for the TX tasks
+size_t ChunkedBLEProtocol::getPendingSendCount() const {
+    size_t pending = 0;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        for (uint8_t c = 0; c < MAX_CHANNELS; c++) {
+            pending += uxQueueMessagesWaiting(sessions[i]->channels[c]->txQueue);
+        }
+    }
+    return pending;
+}
+
+// Start the channel's TX task (caller holds asyncMutex)
+bool ChunkedBLEProtocol::Channel::startTxTask() {
+    char name[16];
+    snprintf(name, sizeof(name), "chunked_tx%d_%d", session.index, id);
+    if (xTaskCreate(txTaskEntry, name, TX_TASK_STACK_SIZE, this,
+                    TX_TASK_PRIORITY, &txTask) != pdPASS) {
+        txTask = nullptr;
+        CBLE_LOGE("[TX] Failed to start TX task");
+        return false;
+    }
+    CBLE_LOGI("[TX] TX task started");
+    return true;
+}
+
+// FreeRTOS entry point of a TX task
+void ChunkedBLEProtocol::Channel::txTaskEntry(void* param) {
+    static_cast<Channel*>(param)->txTaskLoop();
+}
+
+// Send queued messages one by one and report each result
+void ChunkedBLEProtocol::Channel::txTaskLoop() {
+    for (;;) {
+        PendingSend* pending;
+        if (xQueueReceive(txQueue, &pending, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        
+        // Messages queued for an earlier connection are not sent to whoever holds the session now
+        bool sent = false;
+        if (pending->generation == session.generation) {
+            std::string cbor;
+            sent = pending->json ? session.sendJSON(id, pending->data, cbor) :
+                session.sendData(id, (const uint8_t*)pending->data.data(), pending->data.size());
+        }
+        CBLE_LOGI("[TX] Message %u %s", pending->id, sent ? "sent" : "failed");
+        if (pending->onComplete) {
+            pending->onComplete(pending->id, sent);
+        }
+        delete pending;
+    }
+}
+
+// Start the RX task and route data frames through per-session rings
+bool ChunkedBLEProtocol::enableReceiveWorker(size_t ringSize) {
+    if (rxTask) {
+        return true;
+    }
+    
+    // Records never wrap, so the ring must hold two of the largest frames
+    size_t minSize = 2 * (PREFERRED_MTU_SIZE - ATT_HEADER_SIZE + 2) + 1;
+    if (ringSize < minSize) {
+        CBLE_LOGE("[RX] Ring size %u too small, need at least %u bytes", (unsigned)ringSize, (unsigned)minSize);
         return false;
     }
     
-    if (header.total_chunks > MAX_CHUNKS_PER_TRANSFER) {
-        log("[VALIDATE] Too many chunks: %d > %d", header.total_chunks, MAX_CHUNKS_PER_TRANSFER);
+    PacketRing* rings[MAX_SESSIONS] = {};
+    bool allocated = true;
+    for (uint8_t i = 0; i < sessionCount && allocated; i++) {
+        rings[i] = new PacketRing(ringSize);
+        allocated = rings[i]->isValid();
+    }
+    if (!allocated) {
+        for (uint8_t i = 0; i < sessionCount; i++) {
+            delete rings[i];
+        }
+        CBLE_LOGE("[RX] Failed to allocate %u byte receive rings", (unsigned)ringSize);
         return false;
     }
     
-    // Check data size
-    if (header.data_size == 0 || header.data_size > CHUNK_SIZE) {
-        log("[VALIDATE] Invalid data size: %d (max %d)", header.data_size, CHUNK_SIZE);
+    if (xTaskCreate(rxTaskEntry, "chunked_ble_rx", RX_TASK_STACK_SIZE, this,
+                    RX_TASK_PRIORITY, &rxTask) != pdPASS) {
+        rxTask = nullptr;
+        for (uint8_t i = 0; i < sessionCount; i++) {
+            delete rings[i];
+        }
+        CBLE_LOGE("[RX] Failed to start RX task");
         return false;
     }
     
+    // Published last: onWrite switches to a session's ring once it is set
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        sessions[i]->rxRing = rings[i];
+    }
+    CBLE_LOGI("[RX] Receive worker started, %u byte ring per session", (unsigned)ringSize);
     return true;
 }
 
-// Update transfer statistics
-void ChunkedBLEProtocol::updateStatistics(bool success, size_t dataSize) {
-    if (success) {
-        stats.totalDataReceived += dataSize;
-        stats.chunksReceived++;
-        if (!transferInProgress) {
-            stats.transfersCompleted++;
-            stats.lastTransferTime = millis(); // Simply use current time instead of transfer duration
+// Process one data frame: credit accounting, chunk handling, credit flush
+void ChunkedBLEProtocol::Session::handleDataFrame(const uint8_t* data, size_t length) {
+    // FRAME_OPEN and FRAME_RESUME are sent without a credit
+    if (isControlFrame(data, length)) {
+        processOpenFrame(data, length);
+        return;
+    }
+    
+    // Every data frame consumed one of the peer's credits, valid or not.
+    // Counted before processing so that an ACK/NACK flushes the exact balance.
+    releaseReceiveCredit();
+    
+    processReceivedChunk(data, length);
+    
+    if (!isReceiving()) {
+        flushReceiveCredits();
+    }
+}
+
+// Hand a data frame to the RX task (BLE task only - the ring has a single producer)
+void ChunkedBLEProtocol::Session::queueDataFrame(const uint8_t* data, size_t length) {
+    if (!rxRing->push(data, length)) {
+        // Credits bound ring usage, so this only happens with legacy peers or a
+        // stalled callback. The credit is not returned here; the next NACK resyncs it.
+        stats.rxDropped++;
+        CBLE_LOGW("[RX] Receive ring full, frame dropped");
+        return;
+    }
+    xTaskNotifyGive(protocol.rxTask);
+}
+
+// FreeRTOS entry point of the RX task
+void ChunkedBLEProtocol::rxTaskEntry(void* param) {
+    static_cast<ChunkedBLEProtocol*>(param)->rxTaskLoop();
+}
+
+// Drain the receive rings one frame per session at a time, processing each frame in place
+void ChunkedBLEProtocol::rxTaskLoop() {
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        
+        bool pending = true;
+        while (pending) {
+            pending = false;
+            for (uint8_t i = 0; i < sessionCount; i++) {
+                Session& session = *sessions[i];
+                const uint8_t* data;
+                size_t length;
+                if (!session.rxRing || !session.rxRing->peek(data, length)) {
+                    continue;
+                }
+                if (length == 0) {
+                    // Disconnect marker, ordered after the frames of the old connection
+                    session.suspendReceive();
+                } else {
+                    session.handleDataFrame(data, length);
+                }
+                session.rxRing->pop();
+                pending = true;
+            }
         }
     }
 }
 
-// Public methods for statistics and transfer management
-ChunkedBLEProtocol::TransferStats ChunkedBLEProtocol::getStatistics() const {
-    return stats;
+// Calculate chunk CRC32s and derive the global CRC32 without a second pass over the data
+bool ChunkedBLEProtocol::Session::prepareTransferCRCs(OutboundTransfer& transfer) {
+    uint32_t strideOperator = CRC32::combineOperator(transfer.chunkSize);
+    
+    // A source keeps no per-chunk CRC32s, they are recomputed from each chunk as it is sent
+    transfer.chunkCRCs = nullptr;
+    if (!transfer.source) {
+        std::vector<uint32_t>& table = channels[transfer.channel]->txChunkCRCs;
+        if (table.capacity() < transfer.totalChunks) {
+            stats.sendAllocations++;
+        }
+        table.resize(transfer.totalChunks);
+        transfer.chunkCRCs = table.data();
+    }
+    transfer.globalCRC32 = 0;
+    for (uint32_t i = 0; i < transfer.totalChunks; i++) {
+        size_t offset = (size_t)i * transfer.chunkSize;
+        size_t length = std::min(transfer.chunkSize, transfer.size - offset);
+        const uint8_t* chunkData = readChunk(transfer, offset, length);
+        if (!chunkData) {
+            return false;
+        }
+        uint32_t chunkCRC32 = calculateCRC32(chunkData, length);
+        if (!transfer.source) {
+            transfer.chunkCRCs[i] = chunkCRC32;
+        }
+        transfer.globalCRC32 = length == transfer.chunkSize
+            ? CRC32::combineWithOperator(transfer.globalCRC32, chunkCRC32, strideOperator)
+            : CRC32::combine(transfer.globalCRC32, chunkCRC32, length);
+    }
+    return true;
 }
 
-void ChunkedBLEProtocol::resetStatistics() {
-    memset(&stats, 0, sizeof(stats));
-    log("[STATS] Statistics reset");
+// Get the bytes of one chunk, read straight behind the frame's header for sources
+const uint8_t* ChunkedBLEProtocol::Session::readChunk(const OutboundTransfer& transfer, size_t offset, size_t length) {
+    if (!transfer.source) {
+        return transfer.data + offset;
+    }
+    uint8_t* payload = transfer.frame + transfer.headerSize;
+    if (!transfer.source->read(offset, payload, length)) {
+        CBLE_LOGE("[STREAM] Source read of %u bytes at offset %u failed", (unsigned)length, (unsigned)offset);
+        return nullptr;
+    }
+    return payload;
 }
 
-bool ChunkedBLEProtocol::isTransferInProgress() const {
-    return transferInProgress;
+// Send (or resend) one chunk of an outbound transfer
+bool ChunkedBLEProtocol::Session::sendChunk(const OutboundTransfer& transfer, uint32_t chunkNum, bool probe) {
+    // Calculate chunk data size
+    size_t offset = (size_t)(chunkNum - 1) * transfer.chunkSize;
+    size_t chunkDataSize = std::min(transfer.chunkSize, transfer.size - offset);
+    
+    // Extract chunk data
+    const uint8_t* chunkData = readChunk(transfer, offset, chunkDataSize);
+    if (!chunkData) {
+        return false;
+    }
+    
+    // CRC32 computed once by prepareTransferCRCs(), reused for retransmissions;
+    // for sources from the bytes just read, unless no frame carries it
+    uint32_t chunkCRC32 = 0;
+    if (!transfer.source) {
+        chunkCRC32 = transfer.chunkCRCs[chunkNum - 1];
+    } else if ((transfer.openFlags & (OPEN_FLAG_COMPACT | OPEN_FLAG_NO_CHUNK_CRC)) !=
+               (OPEN_FLAG_COMPACT | OPEN_FLAG_NO_CHUNK_CRC)) {
+        chunkCRC32 = calculateCRC32(chunkData, chunkDataSize);
+    }
+    return sendDataFrame(transfer, chunkNum, chunkData, chunkDataSize, chunkCRC32, probe);
 }
 
-void ChunkedBLEProtocol::cancelCurrentTransfer(const char* reason) {
-    cancelTransfer(reason);
+// Build one data or parity frame in the channel's frame buffer and send it
+bool ChunkedBLEProtocol::Session::sendDataFrame(const OutboundTransfer& transfer, uint32_t chunkNum,
+                                                const uint8_t* chunkData, size_t chunkDataSize,
+                                                uint32_t chunkCRC32, bool probe) {
+    // Create complete chunk in the channel's frame buffer: header + data
+    uint8_t* frame = transfer.frame;
+    if (transfer.openFlags & OPEN_FLAG_COMPACT) {
+        // Compact framing - the receiver knows the transfer from FRAME_OPEN, or from the tag
+        uint8_t* field = frame;
+        if (transfer.openFlags & OPEN_FLAG_TAGGED) {
+            memcpy(field, &transfer.transferId, sizeof(transfer.transferId));
+            field += sizeof(transfer.transferId);
+        }
+        uint16_t chunkNum16 = chunkNum;
+        memcpy(field, &chunkNum16, sizeof(chunkNum16));
+        field += sizeof(chunkNum16);
+        if (!(transfer.openFlags & OPEN_FLAG_NO_CHUNK_CRC)) {
+            memcpy(field, &chunkCRC32, sizeof(chunkCRC32));
+        }
+    } else if (transfer.transferId) {
+        // Large framing - totals and global CRC32 went out once in FRAME_OPEN
+        LargeChunkHeader header;
+        header.transfer_id = transfer.transferId;
+        header.chunk_num = chunkNum;
+        header.chunk_crc32 = chunkCRC32;
+        memcpy(frame, &header, sizeof(LargeChunkHeader));
+    } else {
+        // Create enhanced chunk header with dual CRC32
+        ChunkHeader header;
+        header.chunk_num = chunkNum;  // 1-based numbering
+        header.total_chunks = transfer.totalChunks;
+        header.data_size = chunkDataSize;
+        header.chunk_crc32 = chunkCRC32;
+        header.global_crc32 = transfer.globalCRC32;  // Same global CRC32 in all chunks
+        memcpy(frame, &header, sizeof(ChunkHeader));
+    }
+    // Source data was already read into place
+    if (chunkData != frame + transfer.headerSize) {
+        memcpy(frame + transfer.headerSize, chunkData, chunkDataSize);
+    }
+    size_t frameLength = transfer.headerSize + chunkDataSize;
+    
+    // Concurrent channels take turns per frame, the highest priority waiting channel first
+    Channel& channel = *channels[transfer.channel];
+    bool scheduled = peerUsesMultiplex();
+    if (scheduled) {
+        acquireChannelTurn(channel);
+    }
+    
+    // Wait until the receiver has room for another chunk (probes for a report go out regardless)
+    bool sent = false;
+    if (transfer.useCredits && !probe && !waitForCredit()) {
+        CBLE_LOGE("[FLOW] No credits from receiver - aborting send at chunk %d/%d", chunkNum, transfer.totalChunks);
+    } else if (!sendFrame(frame, frameLength)) {
+        CBLE_LOGE("[CHUNK] Failed to send chunk %d/%d", chunkNum, transfer.totalChunks);
+    } else {
+        sent = true;
+    }
+    if (scheduled) {
+        releaseChannelTurn(channel);
+    }
+    if (!sent) {
+        return false;
+    }
+    stats.chunksSent++;
+    uint32_t now = micros();
+    if (channel.txRecord.chunks) {
+        recordGap(stats.txGapHistogram, now - channel.lastTxFrameUs);
+    }
+    channel.lastTxFrameUs = now;
+    channel.txRecord.chunks++;
+    
+    CBLE_LOGT("[CHUNK] Sent chunk %d/%d (%d bytes data, CRC32: 0x%08X)", 
+        chunkNum, transfer.totalChunks, chunkDataSize, chunkCRC32);
+    
+    // Peers without flow control still need a gap between chunks
+    if (!transfer.useCredits) {
+        delay(LEGACY_CHUNK_DELAY_MS);
+    }
+    return true;
 }
 
-// Set chunk timeout
-void ChunkedBLEProtocol::setChunkTimeout(uint32_t timeoutMs) {
-    chunkTimeoutMs = timeoutMs;
-    log("[CONFIG] Chunk timeout set to %d ms", chunkTimeoutMs);
+// Check if any client is connected
+bool ChunkedBLEProtocol::isDeviceConnected() const {
+    return firstConnectedSession() != nullptr;
+}
+
+// Check if a client is connected
+bool ChunkedBLEProtocol::isDeviceConnected(uint16_t connId) const {
+    return findSession(connId) != nullptr;
+}
+
+// Process received chunk straight from the BLE stack's buffer
+void ChunkedBLEProtocol::Session::processReceivedChunk(const uint8_t* data, size_t length) {
+    // Peers that announce large transfers never send ChunkHeader frames
+    if (peerUsesLargeTransfers()) {
+        processLargeChunk(data, length);
+        return;
+    }
+    channels[DEFAULT_CHANNEL]->processReceivedChunk(data, length);
+}
+
+// Process a ChunkHeader frame of a legacy transfer
+void ChunkedBLEProtocol::Channel::processReceivedChunk(const uint8_t* data, size_t length) {
+    // Check minimum data size for header
+    if (length < sizeof(ChunkHeader)) {
+        CBLE_LOGW("[CHUNK] Received data too small for chunk header (%d bytes)", length);
+        return;
+    }
+    
+    // Parse enhanced chunk header
+    ChunkHeader header;
+    memcpy(&header, data, sizeof(ChunkHeader));
+    
+    CBLE_LOGT("[CHUNK] Received chunk %d/%d (%d bytes data, CRC32: 0x%08X)", 
+        header.chunk_num, header.total_chunks, header.data_size, header.chunk_crc32);
+    
+    // Validate chunk header
+    if (!session.validateChunkHeader(header)) {
+        CBLE_LOGW("[CHUNK] Invalid chunk header - ignoring");
+        session.stats.crcErrors++;
+        return;
+    }
+    
+    // Check if data size matches header
+    size_t expectedSize = sizeof(ChunkHeader) + header.data_size;
+    if (length != expectedSize) {
+        CBLE_LOGW("[CHUNK] Data size mismatch: expected %d, got %d", expectedSize, length);
+        session.stats.crcErrors++;
+        return;
+    }
+    
+    // Extract chunk data
+    const uint8_t* chunkData = data + sizeof(ChunkHeader);
+    
+    // With selective retransmission a bad chunk is only marked missing, the header is still usable
+    bool useSack = session.peerUsesSack();
+    
+    // Validate CRC32
+    uint32_t calculatedCRC = session.calculateCRC32(chunkData, header.data_size);
+    bool chunkValid = calculatedCRC == header.chunk_crc32;
+    if (!chunkValid) {
+        CBLE_LOGW("[CRC] CRC32 mismatch: expected 0x%08X, calculated 0x%08X", 
+            header.chunk_crc32, calculatedCRC);
+        session.stats.crcErrors++;
+        if (!useSack) {
+            return;
+        }
+    } else {
+        CBLE_LOGT("[CRC] CRC32 validation passed for chunk %d", header.chunk_num);
+    }
+    
+    // The sender missed our ACK and is probing a transfer we already delivered
+    if (useSack && !transferInProgress && header.chunk_num != 1 &&
+        header.global_crc32 == lastCompletedCRC32) {
+        CBLE_LOGD("[SACK] Chunk %d of delivered transfer 0x%08X - repeating ACK", 
+            header.chunk_num, header.global_crc32);
+        session.sendAck(lastCompletedCRC32, ACK_STATUS_OK, 0);
+        return;
+    }
+    
+    // Legacy transfers start with chunk 1; with retransmission any chunk of an unknown transfer does
+    bool startsTransfer;
+    if (useSack) {
+        startsTransfer = !transferInProgress || header.global_crc32 != expectedGlobalCRC32;
+    } else {
+        startsTransfer = header.chunk_num == 1;
+    }
+    
+    // Set up the reassembly state if this is the first chunk
+    if (startsTransfer) {
+        // Only the chunk count is known, the length and chunk size follow from the chunks
+        if (!beginTransfer(header.total_chunks, header.global_crc32, 0, 0)) {
+            return;
+        }
+    } else {
+        // Validate global CRC32 consistency across chunks
+        if (header.global_crc32 != expectedGlobalCRC32) {
+            CBLE_LOGW("[CRC] Global CRC32 inconsistency: expected 0x%08X, got 0x%08X", 
+                expectedGlobalCRC32, header.global_crc32);
+            cancelTransfer("Global CRC32 mismatch between chunks");
+            return;
+        }
+    }
+    
+    // Validate chunk consistency
+    if (header.total_chunks != assembler.totalChunks()) {
+        CBLE_LOGW("[CHUNK] Inconsistent total chunks: expected %d, got %d", 
+            assembler.totalChunks(), header.total_chunks);
+        rejectTransfer("Inconsistent chunk count", ACK_STATUS_REJECTED);
+        return;
+    }
+    
+    ChunkInfo chunk;
+    chunk.chunkNum = header.chunk_num;
+    chunk.dataSize = header.data_size;
+    chunk.chunkCRC32 = header.chunk_crc32;
+    acceptChunk(chunk, chunkData, chunkValid);
+}
+
+// Route a data frame of a large transfer to the channel that opened it
+void ChunkedBLEProtocol::Session::processLargeChunk(const uint8_t* data, size_t length) {
+    Channel* channel = channels[DEFAULT_CHANNEL];
+    if (peerUsesMultiplex()) {
+        // Every frame of a multiplexing peer starts with its transfer_id
+        uint16_t transferId = 0;
+        if (length >= sizeof(transferId)) {
+            memcpy(&transferId, data, sizeof(transferId));
+        }
+        channel = nullptr;
+        for (uint8_t i = 0; i < MAX_CHANNELS && !channel; i++) {
+            if (transferId && channels[i]->openTransferId == transferId) {
+                channel = channels[i];
+            }
+        }
+        if (!channel) {
+            CBLE_LOGW("[MUX] Chunk for unknown transfer %d - ignoring", transferId);
+            stats.crcErrors++;
+            return;
+        }
+    }
+    channel->processLargeChunk(data, length);
+}
+
+// Process a data frame of a large transfer opened by FRAME_OPEN
+void ChunkedBLEProtocol::Channel::processLargeChunk(const uint8_t* data, size_t length) {
+    // Data frames arriving before any FRAME_OPEN cannot even be parsed
+    size_t headerSize = largeHeaderSize(openFlags);
+    if (openTransferId == 0 || length <= headerSize) {
+        CBLE_LOGW("[LARGE] Chunk without an open transfer or too small (%d bytes) - ignoring", length);
+        session.stats.crcErrors++;
+        return;
+    }
+    
+    LargeChunkHeader header;
+    if (openFlags & OPEN_FLAG_COMPACT) {
+        // Compact frames only exist for the open transfer, tagged ones repeat its id
+        header.transfer_id = openTransferId;
+        size_t tagSize = 0;
+        if (openFlags & OPEN_FLAG_TAGGED) {
+            memcpy(&header.transfer_id, data, sizeof(header.transfer_id));
+            tagSize = sizeof(header.transfer_id);
+        }
+        uint16_t chunkNum16;
+        memcpy(&chunkNum16, data + tagSize, sizeof(chunkNum16));
+        header.chunk_num = chunkNum16;
+        header.chunk_crc32 = 0;
+        if (!(openFlags & OPEN_FLAG_NO_CHUNK_CRC)) {
+            memcpy(&header.chunk_crc32, data + tagSize + sizeof(chunkNum16), sizeof(header.chunk_crc32));
+        }
+    } else {
+        memcpy(&header, data, sizeof(LargeChunkHeader));
+    }
+    size_t dataSize = length - headerSize;
+    const uint8_t* chunkData = data + headerSize;
+    
+    CBLE_LOGT("[CHUNK] Received chunk %u/%d (%d bytes data, CRC32: 0x%08X)", 
+        header.chunk_num, assembler.totalChunks(), dataSize, header.chunk_crc32);
+    
+    // Our FRAME_OPEN was lost or belongs to another transfer
+    if (header.transfer_id != openTransferId) {
+        CBLE_LOGW("[LARGE] Chunk for unknown transfer %d - ignoring", header.transfer_id);
+        session.stats.crcErrors++;
+        return;
+    }
+    
+    bool useSack = session.peerUsesSack();
+    
+    // Validate CRC32 - without chunk CRC32s only the global CRC32 can catch corruption
+    uint32_t calculatedCRC = session.calculateCRC32(chunkData, dataSize);
+    if (openFlags & OPEN_FLAG_NO_CHUNK_CRC) {
+        header.chunk_crc32 = calculatedCRC;
+    }
+    bool chunkValid = calculatedCRC == header.chunk_crc32;
+    if (!chunkValid) {
+        CBLE_LOGW("[CRC] CRC32 mismatch: expected 0x%08X, calculated 0x%08X", 
+            header.chunk_crc32, calculatedCRC);
+        session.stats.crcErrors++;
+        if (!useSack) {
+            return;
+        }
+    } else {
+        CBLE_LOGT("[CRC] CRC32 validation passed for chunk %u", header.chunk_num);
+    }
+    
+    if (!transferInProgress) {
+        // The sender missed our ACK and is probing a transfer we already delivered
+        if (useSack && expectedGlobalCRC32 == lastCompletedCRC32) {
+            CBLE_LOGD("[SACK] Chunk %u of delivered transfer 0x%08X - repeating ACK", 
+                header.chunk_num, lastCompletedCRC32);
+            session.sendAck(lastCompletedCRC32, ACK_STATUS_OK, openTransferId);
+        }
+        return;
+    }
+    
+    // Parity chunks are numbered after the data chunks
+    uint32_t totalChunks = assembler.totalChunks();
+    uint32_t parityChunks = fecGroup ? (totalChunks + fecGroup - 1) / fecGroup : 0;
+    if (header.chunk_num == 0 || header.chunk_num > totalChunks + parityChunks) {
+        CBLE_LOGW("[VALIDATE] Invalid chunk numbers: %u/%d", header.chunk_num, assembler.totalChunks());
+        session.stats.crcErrors++;
+        return;
+    }
+    
+    ChunkInfo chunk;
+    chunk.chunkNum = header.chunk_num;
+    chunk.dataSize = dataSize;
+    chunk.chunkCRC32 = header.chunk_crc32;
+    acceptChunk(chunk, chunkData, chunkValid);
+}
+
+// Start reassembling a new transfer (totalLength and chunkSize are 0 when not announced)
+bool ChunkedBLEProtocol::Channel::beginTransfer(int totalChunks, uint32_t globalCRC32, size_t totalLength, size_t chunkSize) {
+    if (transferInProgress) {
+        CBLE_LOGW("[CHUNK] New transfer 0x%08X replaces unfinished transfer 0x%08X", 
+            globalCRC32, expectedGlobalCRC32);
+    }
+    clearReceiveBuffers();
+    streamingTransfer = (bool)protocol.streamDataCallback;
+    contentType = CONTENT_TYPE_NONE;    // Set by OPEN afterwards
+    expectedGlobalCRC32 = globalCRC32;  // Store expected global CRC32
+    reportPoint = totalChunks;          // First report once the last chunk shows up
+    
+    // Start chunk timer (no transfer timer needed)
+    updateChunkTimer();
+    transferInProgress = true;
+    rxRecord = TransferRecord();
+    rxRecord.startUs = micros();
+    rxRecord.channel = id;
+    
+    CBLE_LOGI("[CHUNK] Starting new transfer: expecting %d chunks total", totalChunks);
+    CBLE_LOGD("[CRC] Expected global CRC32: 0x%08X", expectedGlobalCRC32);
+    
+    // Without an announced length, estimate it from the chunk count
+    size_t transferSize = totalLength ? totalLength : (size_t)totalChunks * session.getChunkDataSize();
+    if (!session.validateDataSize(transferSize, streamingTransfer)) {
+        rejectTransfer("Total data size exceeds limits", ACK_STATUS_REJECTED);
+        return false;
+    }
+    
+    // Only chunks that arrive ahead of a missing one are buffered when streaming, otherwise
+    // one contiguous buffer takes the whole transfer and each chunk is copied straight to its offset.
+    // A preallocated buffer that is large enough is kept.
+    if (streamingTransfer) {
+        size_t windowBytes = (size_t)protocol.streamWindow * (chunkSize ? chunkSize : session.getChunkDataSize());
+        assembler.begin(totalChunks, protocol.streamWindow, windowBytes,
+            [this](const uint8_t* data, size_t length) { deliverStreamChunk(data, length); });
+        CBLE_LOGD("[STREAM] Streaming transfer, window %d chunks", protocol.streamWindow);
+    } else {
+        assembler.begin(totalChunks, 0, transferSize);
+    }
+    
+    // An announced chunk size gives every offset up front
+    if (chunkSize) {
+        assembler.setStride(chunkSize, totalLength);
+    }
+    return true;
+}
+
+// Store a chunk of the current transfer and finish the transfer once it is complete
+void ChunkedBLEProtocol::Channel::acceptChunk(const ChunkInfo& chunk, const uint8_t* chunkData, bool chunkValid) {
+    bool useSack = session.peerUsesSack();
+    
+    // Check chunk timeout - buffered chunks survive it when missing ones can be requested again
+    if (checkChunkTimeout() && !useSack) {
+        cancelTransfer("Chunk timeout");
+        return;
+    }
+    
+    // Update chunk timer
+    updateChunkTimer();
+    uint32_t now = micros();
+    if (rxRecord.chunks) {
+        Session::recordGap(session.stats.rxGapHistogram, now - lastRxFrameUs);
+    }
+    lastRxFrameUs = now;
+    rxRecord.chunks++;
+    
+    bool parity = chunk.chunkNum > assembler.totalChunks();
+    if (chunkValid) {
+        // Storing may deliver stream chunks, the callbacks count separately
+        uint32_t storeStart = micros();
+        uint32_t callbackTimeBefore = session.stats.callbackTimeUs;
+        int recoveredBefore = assembler.recoveredChunks();
+        ChunkAssembler::StoreResult result = storeChunk(chunk, chunkData);
+        session.stats.reassemblyTimeUs += micros() - storeStart - (session.stats.callbackTimeUs - callbackTimeBefore);
+        
+        // Storing a chunk or parity may complete a group that lost one chunk
+        int recovered = assembler.recoveredChunks() - recoveredBefore;
+        if (recovered) {
+            session.stats.fecRecovered += recovered;
+            CBLE_LOGD("[FEC] Chunk rebuilt from parity, %d so far", assembler.recoveredChunks());
+        }
+        
+        if (result == ChunkAssembler::STORE_DUPLICATE) {
+            CBLE_LOGD("[CHUNK] Duplicate chunk %d - ignoring", chunk.chunkNum);
+            if (!useSack) {
+                return;
+            }
+        } else if (result == ChunkAssembler::STORE_OK) {
+            // Parity counts as a received frame, not as payload
+            size_t payloadSize = parity ? 0 : chunk.dataSize;
+            rxRecord.bytes += payloadSize;
+            
+            // Update statistics
+            updateStatistics(true, payloadSize);
+            
+            // Notify progress
+            protocol.notifyProgress(assembler.receivedChunks(), assembler.totalChunks(), true);
+            
+            CBLE_LOGT("[CHUNK] Progress: %d/%d chunks received", assembler.receivedChunks(), assembler.totalChunks());
+        }
+    }
+    
+#if CHUNKED_BLE_COMPRESSION
+    // A corrupt compressed stream cannot recover, whatever arrives next
+    if (streamingTransfer && compressedTransfer && streamDecoder.hasFailed()) {
+        rejectTransfer("Compressed stream is corrupt or too large", ACK_STATUS_REJECTED);
+        return;
+    }
+#endif
+    
+    // Check if all chunks received
+    if (assembler.isComplete()) {
+        if (streamingTransfer) {
+            CBLE_LOGD("[CHUNK] All chunks received and delivered");
+        } else {
+            CBLE_LOGD("[CHUNK] All chunks received, data already in place");
+        }
+        
+        // The global CRC32 is combined from the verified chunk CRC32s, not recomputed over the data;
+        // the assembled buffer itself is handed to the callback
+        uint32_t calculatedGlobalCRC32 = assembler.globalCRC32();
+        std::string& receiveBuffer = assembler.data();
+        
+        // Validate global CRC32 of the complete data
+        if (calculatedGlobalCRC32 != expectedGlobalCRC32) {
+            CBLE_LOGE("[CRC] Global CRC32 mismatch: expected 0x%08X, calculated 0x%08X", 
+                expectedGlobalCRC32, calculatedGlobalCRC32);
+            rejectTransfer("Global CRC32 mismatch after assembling complete data", ACK_STATUS_GLOBAL_CRC_FAILED);
+            return;
+        }
+        
+        CBLE_LOGD("[CRC] Global CRC32 validation passed for complete data");
+        
+#if CHUNKED_BLE_COMPRESSION
+        // Inflate before confirming, so a corrupt or truncated stream is reported to the sender
+        if (compressedTransfer) {
+            size_t receiveLength = assembler.length();
+            bool inflated;
+            if (streamingTransfer) {
+                inflated = streamDecoder.isFinished();
+            } else {
+                std::string decompressed;
+                uint32_t inflateStart = micros();
+                inflated = LZSS::decompress((const uint8_t*)receiveBuffer.data(), receiveLength,
+                                            decompressed, protocol.maxBufferedSize);
+                session.stats.reassemblyTimeUs += micros() - inflateStart;
+                receiveBuffer.swap(decompressed);
+            }
+            if (!inflated) {
+                rejectTransfer("Compressed payload is corrupt or too large", ACK_STATUS_REJECTED);
+                return;
+            }
+            size_t inflatedLength = streamingTransfer ? streamOutputBytes : receiveBuffer.size();
+            CBLE_LOGD("[COMPRESS] %d bytes inflated to %d", receiveLength, inflatedLength);
+            // A peer may send a stream that does not shrink the payload, nothing was saved then
+            if (inflatedLength > receiveLength) {
+                session.stats.compressionSaved += inflatedLength - receiveLength;
+            }
+        }
+#endif
+        
+        // A delta is rebuilt from the last payload and must match its own CRC32;
+        // the complete payload becomes the base of the next delta
+        if (!streamingTransfer && deltaBaseCRC32 && !applyDelta(receiveBuffer)) {
+            return;
+        }
+        if (!streamingTransfer && session.keepsDeltaBases()) {
+            keepDeltaBase(receiveBuffer);
+        }
+        
+#if CHUNKED_BLE_CBOR
+        // JSON handlers get CBOR as text, a payload that does not decode is refused like a corrupt one
+        if (!streamingTransfer && contentType == CONTENT_TYPE_CBOR && protocol.cborDecoding) {
+            std::string json;
+            uint32_t decodeStart = micros();
+            bool decoded = CBOR::toJSON((const uint8_t*)receiveBuffer.data(), receiveBuffer.size(), json);
+            session.stats.reassemblyTimeUs += micros() - decodeStart;
+            if (!decoded) {
+                rejectTransfer("CBOR payload is malformed", ACK_STATUS_REJECTED);
+                return;
+            }
+            CBLE_LOGD("[CBOR] %d bytes decoded to %d bytes of JSON", receiveBuffer.size(), json.size());
+            receiveBuffer.swap(json);
+            contentType = CONTENT_TYPE_JSON;
+        }
+#endif
+        
+        // Mark transfer as complete
+        transferInProgress = false;
+        lastCompletedCRC32 = expectedGlobalCRC32;
+        
+        CBLE_LOGI("[CHUNK] Complete data assembled (%d bytes)", streamingTransfer ? streamOutputBytes : receiveBuffer.size());
+        
+        // Update final statistics
+        updateStatistics(true, 0); // Final update
+        rxRecord.bytes = streamingTransfer ? streamOutputBytes : receiveBuffer.size();
+        // Parity chunks and the chunks they stood in for are not retransmissions
+        uint32_t expectedFrames = assembler.totalChunks() - assembler.recoveredChunks() + assembler.parityChunks();
+        rxRecord.retransmissions = rxRecord.chunks > expectedFrames ? rxRecord.chunks - expectedFrames : 0;
+        session.recordTransfer(rxRecord, true);
+        
+        // Confirm before the application callback so the sender is not kept waiting
+        if (useSack) {
+            session.sendAck(expectedGlobalCRC32, ACK_STATUS_OK, openTransferId);
+        }
+        
+        // Notify callback
+        if (streamingTransfer) {
+            finishStream(true);
+        } else if (protocol.dataReceivedCallback) {
+            uint32_t callbackStart = micros();
+            protocol.dataReceivedCallback(session.connId, id, receiveBuffer);
+            session.stats.callbackTimeUs += micros() - callbackStart;
+        }
+        
+        // Clear buffers
+        clearReceiveBuffers();
+    } else if (useSack && !parity && chunk.chunkNum >= reportPoint) {
+        // Sender has reached the end of its current round - tell it what is still missing
+        sendNack();
+    }
+}
+
+// Handle connection changes
+void ChunkedBLEProtocol::Session::handleConnectionChange(bool connected) {
+    isConnected = connected;
+    if (connected) {
+        generation++;
+    }
+    
+    // Every connection starts on GATT at the default MTU until the peer exchanges MTU
+    negotiatedMTU = DEFAULT_MTU_SIZE;
+    transport = protocol.gattTransport;
+    transportFrameSize = 0;
+    
+    // Flow control is renegotiated by the next peer's HELLO, link parameters are reported again
+    peerFeatures = 0;
+    peerExtendedFeatures = 0;
+    linkParameters = LinkParameters();
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        channels[i]->lastCompletedCRC32 = 0;
+    }
+    creditsOwed = 0;
+    linkCongested = false;
+    preparedWrite = false;
+    resetSendCredits(0);
+    xSemaphoreGive(congestionCleared);
+    
+    if (connected) {
+        CBLE_LOGI("[PROTOCOL] Device connected, ready for chunked data");
+    } else {
+        CBLE_LOGI("[PROTOCOL] Device disconnected");
+        xTimerStop(linkIdleTimer, 0);
+        if (rxRing) {
+            // The RX task may be mid-frame; let it suspend once the ring is drained
+            if (rxRing->push(nullptr, 0)) {
+                xTaskNotifyGive(protocol.rxTask);
+            }
+        } else {
+            suspendReceive();
+        }
+    }
+    
+    // Call user callback
+    if (protocol.connectionCallback) {
+        protocol.connectionCallback(connId, connected);
+    }
+}
+
+// Handle MTU exchange
+void ChunkedBLEProtocol::Session::handleMTUChange(uint16_t mtu) {
+    if (mtu < DEFAULT_MTU_SIZE) {
+        mtu = DEFAULT_MTU_SIZE;
+    } else if (mtu > PREFERRED_MTU_SIZE) {
+        mtu = PREFERRED_MTU_SIZE;
+    }
+    negotiatedMTU = mtu;
+    CBLE_LOGI("[BLE] MTU negotiated: %d (chunk size %d bytes)", negotiatedMTU, getChunkDataSize());
+}
+
+// Get data bytes that fit into one chunk on the current transport
+size_t ChunkedBLEProtocol::Session::getChunkDataSize(size_t headerSize) const {
+    return getMaxFrameSize() - headerSize;
+}
+
+// Get the largest frame the current transport carries (ATT MTU minus ATT header on GATT)
+size_t ChunkedBLEProtocol::Session::getMaxFrameSize() const {
+    if (transportFrameSize) {
+        return transportFrameSize;
+    }
+    size_t mtu = negotiatedMTU < PREFERRED_MTU_SIZE ? negotiatedMTU : PREFERRED_MTU_SIZE;
+    return mtu - ATT_HEADER_SIZE;
+}
+
+// Get negotiated MTU of the first connected client
+uint16_t ChunkedBLEProtocol::getNegotiatedMTU() const {
+    Session* session = firstConnectedSession();
+    return session ? session->negotiatedMTU : (uint16_t)DEFAULT_MTU_SIZE;
+}
+
+// Get negotiated MTU of one client
+uint16_t ChunkedBLEProtocol::getNegotiatedMTU(uint16_t connId) const {
+    Session* session = findSession(connId);
+    return session ? session->negotiatedMTU : (uint16_t)DEFAULT_MTU_SIZE;
+}
+
+// Route an MTU exchange to the client's session
+void ChunkedBLEProtocol::handleMTUChange(uint16_t connId, uint16_t mtu) {
+    Session* session = findSession(connId);
+    if (session) {
+        session->handleMTUChange(mtu);
+    }
+}
+
+// Clear receive buffers
+void ChunkedBLEProtocol::Channel::clearReceiveBuffers() {
+    // A stream that ends here did not complete
+    if (streamingTransfer) {
+        finishStream(false);
+    }
+    
+    // Only the buffer preallocated by setMaxSessions() is kept between transfers
+    assembler.clear(bufferSize);
+#if CHUNKED_BLE_COMPRESSION
+    streamDecoder.end();
+#endif
+    compressedTransfer = false;
+    suspendedTransferId = 0;
+    streamOutputBytes = 0;
+}
+
+// Hand a validated chunk to the assembler, which copies it to its offset or delivers it in order
+ChunkAssembler::StoreResult ChunkedBLEProtocol::Channel::storeChunk(const ChunkInfo& chunk, const uint8_t* chunkData) {
+    if (chunk.chunkNum > assembler.totalChunks()) {
+        // Parity chunk - out of range while streaming, where the assembler takes none
+        ChunkAssembler::StoreResult result =
+            assembler.storeParity(chunk.chunkNum - assembler.totalChunks() - 1, chunkData, chunk.dataSize);
+        if (result == ChunkAssembler::STORE_BAD_SIZE) {
+            CBLE_LOGW("[FEC] Parity chunk %d has %d bytes, expected %d", chunk.chunkNum, chunk.dataSize,
+                assembler.stride());
+            session.stats.crcErrors++;
+        }
+        return result;
+    }
+    ChunkAssembler::StoreResult result = assembler.store(chunk.chunkNum, chunkData, chunk.dataSize, chunk.chunkCRC32);
+    switch (result) {
+        case ChunkAssembler::STORE_STRIDE_UNKNOWN:
+            CBLE_LOGW("[CHUNK] Last chunk arrived first, offsets unknown - chunk %d left for retransmission",
+                chunk.chunkNum);
+            break;
+        case ChunkAssembler::STORE_BAD_SIZE:
+            CBLE_LOGW("[CHUNK] Chunk %d has %d bytes, expected %s%d", chunk.chunkNum, chunk.dataSize,
+                chunk.chunkNum == assembler.totalChunks() ? "at most " : "", assembler.stride());
+            session.stats.crcErrors++;
+            break;
+        case ChunkAssembler::STORE_BEYOND_WINDOW:
+            CBLE_LOGW("[STREAM] Chunk %d is beyond the window - left for retransmission", chunk.chunkNum);
+            break;
+        case ChunkAssembler::STORE_OUT_OF_RANGE:
+            CBLE_LOGW("[VALIDATE] Invalid chunk numbers: %d/%d", chunk.chunkNum, assembler.totalChunks());
+            session.stats.crcErrors++;
+            break;
+        default:
+            break;
+    }
+    return result;
+}
+
+// Pass the next in-order piece of a streaming transfer to the application
+void ChunkedBLEProtocol::Channel::deliverStreamChunk(const uint8_t* data, size_t length) {
+#if CHUNKED_BLE_COMPRESSION
+    if (compressedTransfer) {
+        // Offsets count decompressed bytes; the output arrives in pieces of up to LZSS::WINDOW_SIZE
+        streamDecoder.feed(data, length, [this](const uint8_t* output, size_t outputLength) {
+            if (protocol.streamDataCallback) {
+                uint32_t callbackStart = micros();
+                protocol.streamDataCallback(session.connId, id, output, outputLength, streamOutputBytes);
+                session.stats.callbackTimeUs += micros() - callbackStart;
+            }
+            streamOutputBytes += outputLength;
+        });
+        return;
+    }
+#endif
+    if (protocol.streamDataCallback) {
+        uint32_t callbackStart = micros();
+        protocol.streamDataCallback(session.connId, id, data, length, streamOutputBytes);
+        session.stats.callbackTimeUs += micros() - callbackStart;
+    }
+    streamOutputBytes += length;
+}
+
+// Report the end of a streaming transfer
+void ChunkedBLEProtocol::Channel::finishStream(bool success) {
+    streamingTransfer = false;
+    CBLE_LOGI("[STREAM] Stream %s after %d bytes", success ? "complete" : "aborted", streamOutputBytes);
+    if (protocol.streamCompleteCallback) {
+        uint32_t callbackStart = micros();
+        protocol.streamCompleteCallback(session.connId, id, success, streamOutputBytes);
+        session.stats.callbackTimeUs += micros() - callbackStart;
+    }
+}
+
+// Notify progress
+void ChunkedBLEProtocol::notifyProgress(int current, int total, bool isReceiving) {
+    if (progressCallback) {
+        progressCallback(current, total, isReceiving);
+    }
+}
+
+// Logging utility
+void ChunkedBLEProtocol::log(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    logv(level, format, args);
+    va_end(args);
+}
+
+// Format a message and hand it to the sink
+void ChunkedBLEProtocol::logv(LogLevel level, const char* format, va_list args, const Session* session,
+                              const Channel* channel) {
+    // No sink, no formatting
+    if (!logSink) {
+        return;
+    }
+    char buffer[256];
+    size_t prefix = 0;
+    if (session && sessionCount > 1) {
+        // Tell the clients apart once there can be more than one
+        prefix = snprintf(buffer, sizeof(buffer), "[C%d] ", session->connId);
+    }
+    if (channel && session->peerUsesMultiplex()) {
+        prefix += snprintf(buffer + prefix, sizeof(buffer) - prefix, "[CH%d] ", channel->id);
+    }
+    vsnprintf(buffer + prefix, sizeof(buffer) - prefix, format, args);
+    logSink(level, buffer);
+}
+
+// Session messages go through the protocol's sink
+void ChunkedBLEProtocol::Session::log(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    protocol.logv(level, format, args, this);
+    va_end(args);
+}
+
+// Channel messages go through the protocol's sink
+void ChunkedBLEProtocol::Channel::log(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    protocol.logv(level, format, args, &session, this);
+    va_end(args);
+}
+
+// Default log sink
+void ChunkedBLEProtocol::serialLogSink(LogLevel level, const char* message) {
+    (void)level;  // The message already names its level
+    Serial.println(message);
+}
+
+// Set where log messages go
+void ChunkedBLEProtocol::setLogSink(LogSink sink) {
+    logSink = sink;
+}
+
+// Validate total data size against limits
+bool ChunkedBLEProtocol::Session::validateDataSize(size_t totalSize, bool streamed) {
+    if (totalSize == 0) {
+        CBLE_LOGW("[SECURITY] Rejected: Empty data");
+        return false;
+    }
+    
+    size_t maxSize = streamed ? protocol.maxStreamedSize : protocol.maxBufferedSize;
+    if (totalSize > maxSize) {
+        CBLE_LOGW("[SECURITY] Rejected: Data too large (%d bytes, max %d)", 
+            totalSize, maxSize);
+        stats.sizeRejections++;
+        return false;
+    }
+    
+    // 16-bit chunk numbers also cap the chunk count
+    if (peerUsesLargeTransfers()) {
+        return true;
+    }
+    size_t chunkSize = getChunkDataSize();
+    size_t requiredChunks = (totalSize + chunkSize - 1) / chunkSize;
+    size_t maxChunks = streamed ? MAX_STREAM_CHUNKS : MAX_CHUNKS_PER_TRANSFER;
+    if (requiredChunks > maxChunks) {
+        CBLE_LOGW("[SECURITY] Rejected: Too many chunks required (%d, max %d)", 
+            requiredChunks, maxChunks);
+        stats.sizeRejections++;
+        return false;
+    }
+    
+    return true;
+}
+
+// Check if chunk reception has timed out
+bool ChunkedBLEProtocol::Channel::checkChunkTimeout() {
+    if (!transferInProgress) return false;
+    
+    uint32_t currentTime = millis();
+    if (currentTime - lastChunkTime > protocol.chunkTimeoutMs) {
+        CBLE_LOGW("[TIMEOUT] Chunk timeout: %d ms since last chunk", currentTime - lastChunkTime);
+        session.stats.timeouts++;
+        return true;
+    }
+    return false;
+}
+
+// Update chunk timer
+void ChunkedBLEProtocol::Channel::updateChunkTimer() {
+    lastChunkTime = millis();
+}
+
+// Cancel current transfer
+void ChunkedBLEProtocol::Channel::cancelTransfer(const char* reason) {
+    if (transferInProgress) {
+        CBLE_LOGW("[CANCEL] Transfer cancelled: %s", reason);
+        transferInProgress = false;
+        rxRecord.retransmissions = rxRecord.chunks - assembler.receivedChunks();
+        clearReceiveBuffers();
+        session.stats.cancellations++;
+        session.recordTransfer(rxRecord, false);
+    }
+}
+
+// Validate chunk header
+bool ChunkedBLEProtocol::Session::validateChunkHeader(const ChunkHeader& header) {
+    // Check chunk numbers
+    if (header.chunk_num == 0 || header.total_chunks == 0) {
+        CBLE_LOGW("[VALIDATE] Invalid chunk numbers: %d/%d", header.chunk_num, header.total_chunks);
+        return false;
+    }
+    
+    if (header.chunk_num > header.total_chunks) {
+        CBLE_LOGW("[VALIDATE] Chunk number exceeds total: %d > %d", header.chunk_num, header.total_chunks);
+        return false;
+    }
+    
+    size_t maxChunks = protocol.streamDataCallback ? MAX_STREAM_CHUNKS : MAX_CHUNKS_PER_TRANSFER;
+    if (header.total_chunks > maxChunks) {
+        CBLE_LOGW("[VALIDATE] Too many chunks: %d > %d", header.total_chunks, maxChunks);
+        return false;
+    }
+    
+    // Check data size against what fits into the negotiated MTU
+    size_t maxDataSize = getChunkDataSize();
+    if (header.data_size == 0 || header.data_size > maxDataSize) {
+        CBLE_LOGW("[VALIDATE] Invalid data size: %d (max %d)", header.data_size, maxDataSize);
+        return false;
+    }
+    
+    return true;
+}
+
+// Update transfer statistics
+void ChunkedBLEProtocol::Channel::updateStatistics(bool success, size_t dataSize) {
+    if (success) {
+        session.stats.totalDataReceived += dataSize;
+        session.stats.chunksReceived++;
+        if (!transferInProgress) {
+            session.stats.transfersCompleted++;
+        }
+    }
+}
+
+// Public methods for statistics and transfer management
+ChunkedBLEProtocol::TransferStats ChunkedBLEProtocol::getStatistics() const {
+    TransferStats total = retiredStats;
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        addStatistics(total, sessions[i]->stats);
+    }
+    Session* session = firstConnectedSession();
+    if (session) {
+        total.link = session->linkParameters;
+    }
+    return total;
+}
+
+ChunkedBLEProtocol::TransferStats ChunkedBLEProtocol::getStatistics(uint16_t connId) const {
+    Session* session = findSession(connId);
+    if (!session) {
+        return TransferStats();
+    }
+    TransferStats current = session->stats;
+    current.link = session->linkParameters;
+    return current;
+}
+
+void ChunkedBLEProtocol::resetStatistics() {
+    retiredStats = TransferStats();
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        sessions[i]->stats = TransferStats();
+        sessions[i]->clearHistory();
+    }
+    CBLE_LOGD("[STATS] Statistics reset");
+}
+
+size_t ChunkedBLEProtocol::getTransferHistory(uint16_t connId, TransferRecord* records, size_t maxRecords) const {
+    Session* session = findSession(connId);
+    if (!session) {
+        return 0;
+    }
+    size_t count = std::min(maxRecords, (size_t)session->historyCount);
+    for (size_t i = 0; i < count; i++) {
+        records[i] = session->history[(session->historyNext + TRANSFER_HISTORY_LENGTH - 1 - i) % TRANSFER_HISTORY_LENGTH];
+    }
+    return count;
+}
+
+// Finish a transfer record, keeping it as the latest of its direction and in the history
+void ChunkedBLEProtocol::Session::recordTransfer(TransferRecord& record, bool success) {
+    record.endUs = micros();
+    record.success = success;
+    uint32_t elapsedUs = record.endUs - record.startUs;
+    record.bytesPerSecond = elapsedUs ? (uint32_t)((uint64_t)record.bytes * 1000000 / elapsedUs) : 0;
+    record.mtu = negotiatedMTU;
+    record.connInterval = linkParameters.connInterval;
+    record.txPhy = linkParameters.txPhy;
+    record.rxPhy = linkParameters.rxPhy;
+    
+    if (record.sent) {
+        stats.lastSent = record;
+    } else {
+        stats.lastReceived = record;
+        if (success) {
+            stats.lastTransferTime = elapsedUs / 1000;
+        }
+    }
+    history[historyNext] = record;
+    historyNext = (historyNext + 1) % TRANSFER_HISTORY_LENGTH;
+    if (historyCount < TRANSFER_HISTORY_LENGTH) {
+        historyCount++;
+    }
+    
+    CBLE_LOGD("[STATS] %s %u bytes on channel %d in %u us (%u B/s, %u chunks, %u retransmitted)%s",
+        record.sent ? "Sent" : "Received", record.bytes, record.channel, elapsedUs, record.bytesPerSecond,
+        record.chunks, record.retransmissions, success ? "" : " - failed");
+}
+
+// Forget the finished transfers
+void ChunkedBLEProtocol::Session::clearHistory() {
+    historyNext = 0;
+    historyCount = 0;
+}
+
+// Count one gap between data frames in its power-of-two millisecond bucket
+void ChunkedBLEProtocol::Session::recordGap(uint32_t* histogram, uint32_t gapUs) {
+    uint32_t gapMs = gapUs / 1000;
+    uint8_t bucket = 0;
+    while (gapMs && bucket < GAP_HISTOGRAM_BUCKETS - 1) {
+        gapMs >>= 1;
+        bucket++;
+    }
+    histogram[bucket]++;
+}
+
+// Answer reads of the diagnostics characteristic
+void ChunkedBLEProtocol::setDiagnosticsEnabled(bool enabled) {
+    diagnosticsEnabled = enabled;
+    CBLE_LOGI("[CONFIG] Diagnostics characteristic %s", enabled ? "enabled" : "disabled");
+}
+
+// Fill the diagnostics characteristic with the statistics of the client about to read it (BLE task)
+void ChunkedBLEProtocol::updateDiagnostics(uint16_t connId) {
+    Session* session = diagnosticsEnabled ? findSession(connId) : nullptr;
+    if (!session) {
+        uint8_t empty = 0;
+        diagnosticsCharacteristic->setValue(&empty, 0);
+        return;
+    }
+    const TransferStats& stats = session->stats;
+    DiagnosticsValue value;
+    value.version = DIAGNOSTICS_VERSION;
+    value.uptime_ms = millis();
+    value.total_data_sent = stats.totalDataSent;
+    value.total_data_received = stats.totalDataReceived;
+    value.chunks_sent = stats.chunksSent;
+    value.chunks_received = stats.chunksReceived;
+    value.transfers_completed = stats.transfersCompleted;
+    value.retransmissions = stats.retransmissions;
+    value.crc_errors = stats.crcErrors;
+    value.timeouts = stats.timeouts;
+    value.size_rejections = stats.sizeRejections;
+    value.cancellations = stats.cancellations;
+    value.send_failures = stats.sendFailures;
+    value.rx_dropped = stats.rxDropped;
+    value.compression_saved = stats.compressionSaved;
+    value.crc_time_us = stats.crcTimeUs;
+    value.reassembly_time_us = stats.reassemblyTimeUs;
+    value.callback_time_us = stats.callbackTimeUs;
+    value.parity_sent = stats.paritySent;
+    value.fec_recovered = stats.fecRecovered;
+    value.delta_saved = stats.deltaSaved;
+    memcpy(value.rx_gaps, stats.rxGapHistogram, sizeof(value.rx_gaps));
+    memcpy(value.tx_gaps, stats.txGapHistogram, sizeof(value.tx_gaps));
+    value.mtu = session->negotiatedMTU;
+    value.conn_interval = session->linkParameters.connInterval;
+    value.tx_phy = session->linkParameters.txPhy;
+    value.rx_phy = session->linkParameters.rxPhy;
+    encodeTransferRecord(value.last_sent, stats.lastSent);
+    encodeTransferRecord(value.last_received, stats.lastReceived);
+    diagnosticsCharacteristic->setValue((uint8_t*)&value, sizeof(value));
+}
+
+// Pack a transfer record for the diagnostics characteristic
+void ChunkedBLEProtocol::encodeTransferRecord(DiagnosticsTransfer& out, const TransferRecord& record) {
+    out.start_us = record.startUs;
+    out.duration_us = record.endUs - record.startUs;
+    out.bytes = record.bytes;
+    out.chunks = record.chunks;
+    out.retransmissions = record.retransmissions;
+    out.bytes_per_second = record.bytesPerSecond;
+    out.mtu = record.mtu;
+    out.conn_interval = record.connInterval;
+    out.phy = record.txPhy | record.rxPhy << 4;
+    out.channel = record.channel;
+    out.flags = (record.sent ? 1 : 0) | (record.success ? 2 : 0);
+}
+
+bool ChunkedBLEProtocol::isTransferInProgress() const {
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        if (sessions[i]->isReceiving()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Check if any channel of the session is receiving
+bool ChunkedBLEProtocol::Session::isReceiving() const {
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        if (channels[i]->transferInProgress) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChunkedBLEProtocol::cancelCurrentTransfer(const char* reason) {
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        for (uint8_t c = 0; c < MAX_CHANNELS; c++) {
+            Channel* channel = sessions[i]->channels[c];
+            if (channel->transferInProgress) {
+                channel->cancelTransfer(reason);
+            }
+        }
+    }
+}
+
+// Set chunk timeout
+void ChunkedBLEProtocol::setChunkTimeout(uint32_t timeoutMs) {
+    chunkTimeoutMs = timeoutMs;
+    CBLE_LOGI("[CONFIG] Chunk timeout set to %d ms", chunkTimeoutMs);
+}
+
+// Set flow control mode
+void ChunkedBLEProtocol::setFlowControl(FlowControlMode mode, uint16_t window) {
+    if (window == 0) {
+        window = 1;
+    } else if (window > MAX_CREDIT_WINDOW) {
+        window = MAX_CREDIT_WINDOW;
+    }
+    flowControlMode = mode;
+    creditWindow = window;
+    CBLE_LOGI("[CONFIG] Flow control: %s (window %d), applied on next HELLO",
+        mode == FLOW_CONTROL_CREDITS ? "credits" : "none", creditWindow);
+}
+
+// Create flow control primitives shared by the sessions (each session creates its own)
+void ChunkedBLEProtocol::initFlowControl() {
+    txMutex = xSemaphoreCreateMutex();
+    asyncMutex = xSemaphoreCreateMutex();
+}
+
+// Check if data is a control frame rather than a data chunk
+bool ChunkedBLEProtocol::isControlFrame(const uint8_t* data, size_t length) {
+    return length >= sizeof(ControlHeader) && data[0] == 0 && data[1] == 0;
+}
+
+// Process control frame
+void ChunkedBLEProtocol::Session::processControlFrame(const uint8_t* data, size_t length) {
+    ControlHeader header;
+    memcpy(&header, data, sizeof(ControlHeader));
+    
+    switch (header.type) {
+        case FRAME_HELLO: {
+            if (length < sizeof(HelloFrame)) {
+                CBLE_LOGW("[FLOW] HELLO frame too small (%d bytes)", length);
+                return;
+            }
+            HelloFrame hello;
+            memcpy(&hello, data, sizeof(HelloFrame));
+            peerFeatures = hello.features;
+            peerExtendedFeatures = length >= sizeof(ExtendedHelloFrame) ? data[sizeof(HelloFrame)] : 0;
+            peerCreditWindow = hello.window;
+            creditsOwed = 0;
+            CBLE_LOGI("[FLOW] Peer HELLO: version %d, features 0x%02X/0x%02X, window %d",
+                hello.version, hello.features, peerExtendedFeatures, hello.window);
+            
+            // The client starts the handshake, we always answer with our own capabilities
+            resetSendCredits(peerUsesCredits() ? hello.window : 0);
+            sendHello();
+            break;
+        }
+        case FRAME_CREDIT: {
+            if (length < sizeof(CreditFrame)) {
+                CBLE_LOGW("[FLOW] CREDIT frame too small (%d bytes)", length);
+                return;
+            }
+            CreditFrame credit;
+            memcpy(&credit, data, sizeof(CreditFrame));
+            for (uint16_t i = 0; i < credit.credits; i++) {
+                xSemaphoreGive(txCredits);
+            }
+            break;
+        }
+        case FRAME_ACK:
+        case FRAME_NACK:
+        case FRAME_NACK_LARGE:
+        case FRAME_RESUME_POINT:
+            queueReport(data, length);
+            break;
+        default:
+            CBLE_LOGW("[FLOW] Unknown control frame type 0x%02X - ignoring", header.type);
+            break;
+    }
+}
+
+// Check if both sides agreed on credit-based flow control
+bool ChunkedBLEProtocol::Session::peerUsesCredits() const {
+    return protocol.flowControlMode == FLOW_CONTROL_CREDITS && (peerFeatures & FEATURE_CREDITS);
+}
+
+// Notify one frame, pacing on congestion and stack buffer exhaustion
+bool ChunkedBLEProtocol::Session::sendFrame(const uint8_t* data, size_t length) {
+    noteLinkActivity();
+    // Sessions sending at the same time take turns frame by frame
+    bool shared = protocol.sessionCount > 1;
+    for (int attempt = 0; attempt < NOTIFY_MAX_RETRIES; attempt++) {
+        if (!isConnected || !waitForLinkReady()) {
+            return false;
+        }
+        
+        if (shared) {
+            protocol.acquireTxTurn(*this);
+        }
+        esp_err_t err = transport->send(connId, data, length);
+        if (shared) {
+            protocol.releaseTxTurn(*this);
+        }
+        
+        if (err == ESP_OK) {
+            return true;
+        }
+        if (err != ESP_FAIL) {
+            return false;  // Stack not running or connection gone
+        }
+        
+        // Link congested or stack queue full - give it a tick to drain and retry the same frame
+        vTaskDelay(1);
+    }
+    CBLE_LOGE("[FLOW] Notify still failing after %d attempts", NOTIFY_MAX_RETRIES);
+    return false;
+}
+
+// Notify one control frame without blocking (safe from BLE callbacks)
+bool ChunkedBLEProtocol::Session::sendControlFrame(const uint8_t* data, size_t length) {
+    if (!isConnected || !transport) {
+        return false;
+    }
+    return transport->send(connId, data, length) == ESP_OK;
+}
+
+// Wait until no other session is notifying a data frame
+void ChunkedBLEProtocol::acquireTxTurn(Session& session) {
+    xSemaphoreTake(txMutex, portMAX_DELAY);
+    if (!txTurnHolder) {
+        txTurnHolder = &session;
+        xSemaphoreGive(txMutex);
+        return;
+    }
+    session.waitingForTurn = true;
+    xSemaphoreGive(txMutex);
+    
+    // releaseTxTurn() hands the turn over directly
+    xSemaphoreTake(session.txTurn, portMAX_DELAY);
+}
+
+// Hand the turn to the next waiting session after this one, round robin
+void ChunkedBLEProtocol::releaseTxTurn(Session& session) {
+    xSemaphoreTake(txMutex, portMAX_DELAY);
+    txTurnHolder = nullptr;
+    for (uint8_t step = 1; step <= sessionCount; step++) {
+        Session* next = sessions[(session.index + step) % sessionCount];
+        if (next->waitingForTurn) {
+            next->waitingForTurn = false;
+            txTurnHolder = next;
+            xSemaphoreGive(next->txTurn);
+            break;
+        }
+    }
+    xSemaphoreGive(txMutex);
+}
+
+// Announce our capabilities and initial credit window
+void ChunkedBLEProtocol::Session::sendHello() {
+    ExtendedHelloFrame frame;
+    HelloFrame& hello = frame.hello;
+    hello.header.marker = 0;
+    hello.header.type = FRAME_HELLO;
+    hello.version = PROTOCOL_VERSION;
+    hello.features = 0;
+    if (protocol.flowControlMode == FLOW_CONTROL_CREDITS) {
+        hello.features |= FEATURE_CREDITS;
+    }
+    if (protocol.retransmissionEnabled) {
+        hello.features |= FEATURE_SACK;
+    }
+    if (protocol.streamDataCallback) {
+        hello.features |= FEATURE_STREAMING;
+    }
+    hello.features |= FEATURE_LARGE;
+    if (protocol.resumeGraceMs) {
+        hello.features |= FEATURE_RESUME;
+    }
+    if (protocol.compactFraming) {
+        hello.features |= FEATURE_COMPACT;
+    }
+    if (protocol.compressionEnabled) {
+        hello.features |= FEATURE_COMPRESSION;
+    }
+    if (protocol.multiplexEnabled) {
+        hello.features |= FEATURE_MULTIPLEX;
+    }
+    hello.window = protocol.creditWindow;
+    
+    // Parity only helps a receiver that holds the whole transfer
+    frame.extended_features = 0;
+    if (!protocol.streamDataCallback) {
+        frame.extended_features |= FEATURE_EXT_FEC;
+    }
+#if CHUNKED_BLE_CBOR
+    frame.extended_features |= FEATURE_EXT_CONTENT_TYPE;
+#endif
+    if (protocol.maxDeltaBaseSize && !protocol.streamDataCallback) {
+        frame.extended_features |= FEATURE_EXT_DELTA;
+    }
+    
+    if (!sendControlFrame((const uint8_t*)&frame, sizeof(frame))) {
+        CBLE_LOGE("[FLOW] Failed to send HELLO");
+        return;
+    }
+    CBLE_LOGD("[FLOW] HELLO sent: features 0x%02X/0x%02X, window %d", hello.features, frame.extended_features,
+        hello.window);
+    
+    sendTransportOffer();
+}
+
+// Offer the L2CAP channel to a client still on GATT
+void ChunkedBLEProtocol::Session::sendTransportOffer() {
+    if (!protocol.l2capEnabled || !protocol.l2capTransport || transport != protocol.gattTransport) {
+        return;
+    }
+    TransportFrame offer;
+    offer.header.marker = 0;
+    offer.header.type = FRAME_TRANSPORT;
+    offer.transport = TRANSPORT_L2CAP_COC;
+    offer.psm = protocol.l2capPsm;
+    offer.mtu = MAX_FRAME_SIZE;
+    
+    if (!sendControlFrame((const uint8_t*)&offer, sizeof(offer))) {
+        CBLE_LOGW("[TRANSPORT] Failed to offer L2CAP channel");
+        return;
+    }
+    CBLE_LOGD("[TRANSPORT] L2CAP channel offered on PSM 0x%04X", offer.psm);
+}
+
+// Grant additional credits to the peer
+void ChunkedBLEProtocol::Session::grantCredits(uint16_t credits) {
+    CreditFrame frame;
+    frame.header.marker = 0;
+    frame.header.type = FRAME_CREDIT;
+    frame.credits = credits;
+    
+    if (!sendControlFrame((const uint8_t*)&frame, sizeof(frame))) {
+        CBLE_LOGE("[FLOW] Failed to grant %d credits", credits);
+    }
+}
+
+// Replace send credits with a fresh grant
+void ChunkedBLEProtocol::Session::resetSendCredits(uint16_t credits) {
+    while (xSemaphoreTake(txCredits, 0) == pdTRUE) {
+    }
+    for (uint16_t i = 0; i < credits; i++) {
+        xSemaphoreGive(txCredits);
+    }
+}
+
+// Refill the credit window after a report, unless another channel has frames in flight
+void ChunkedBLEProtocol::Session::resyncSendCredits(Channel& channel) {
+    // Their credits are still out; the CREDIT grants that return them keep the count right
+    if (otherChannelSending(channel)) {
+        return;
+    }
+    
+    // Holding the frame turn keeps a channel that starts now from taking credits mid-refill
+    bool scheduled = peerUsesMultiplex();
+    if (scheduled) {
+        acquireChannelTurn(channel);
+    }
+    if (!otherChannelSending(channel)) {
+        resetSendCredits(peerCreditWindow);
+    }
+    if (scheduled) {
+        releaseChannelTurn(channel);
+    }
+}
+
+// Check if a channel other than the given one has an outbound transfer running
+bool ChunkedBLEProtocol::Session::otherChannelSending(const Channel& channel) const {
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        if (channels[i] != &channel && channels[i]->sending) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return all credits held back for the peer
+void ChunkedBLEProtocol::Session::flushReceiveCredits() {
+    if (peerUsesCredits() && creditsOwed > 0) {
+        grantCredits(creditsOwed);
+        creditsOwed = 0;
+    }
+}
+
+// Account for one received data frame and return credits in batches
+void ChunkedBLEProtocol::Session::releaseReceiveCredit() {
+    if (!peerUsesCredits()) {
+        return;
+    }
+    
+    creditsOwed++;
+    
+    // Grant in half-window batches; completion and reports flush the rest
+    if (creditsOwed >= (protocol.creditWindow + 1) / 2) {
+        grantCredits(creditsOwed);
+        creditsOwed = 0;
+    }
+}
+
+// Wait for one send credit
+bool ChunkedBLEProtocol::Session::waitForCredit() {
+    uint32_t waitStart = millis();
+    while (xSemaphoreTake(txCredits, pdMS_TO_TICKS(FLOW_POLL_INTERVAL_MS)) != pdTRUE) {
+        if (!isConnected) {
+            return false;
+        }
+        if (millis() - waitStart > protocol.chunkTimeoutMs) {
+            CBLE_LOGW("[TIMEOUT] No credit received for %d ms", protocol.chunkTimeoutMs);
+            stats.timeouts++;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Wait until the link is no longer congested
+bool ChunkedBLEProtocol::Session::waitForLinkReady() {
+    uint32_t waitStart = millis();
+    while (linkCongested) {
+        if (!isConnected || millis() - waitStart > protocol.chunkTimeoutMs) {
+            CBLE_LOGW("[FLOW] Link still congested after %d ms", millis() - waitStart);
+            return false;
+        }
+        xSemaphoreTake(congestionCleared, pdMS_TO_TICKS(FLOW_POLL_INTERVAL_MS));
+    }
+    return true;
+}
+
+// Handle congestion state reported by the stack
+void ChunkedBLEProtocol::Session::handleCongestion(bool congested) {
+    linkCongested = congested;
+    if (!congested) {
+        xSemaphoreGive(congestionCleared);
+    }
+}
+
+#if !CHUNKED_BLE_NIMBLE
+// Static GATTS event hook (the Arduino wrapper does not forward congestion or the write event type)
+void ChunkedBLEProtocol::gattsEventHandler(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                                           esp_ble_gatts_cb_param_t* param) {
+    (void)gattsIf;
+    if (!instance) {
+        return;
+    }
+    if (event == ESP_GATTS_CONGEST_EVT) {
+        Session* session = instance->findSession(param->congest.conn_id);
+        if (session) {
+            session->handleCongestion(param->congest.congested);
+        }
+    } else if (event == ESP_GATTS_WRITE_EVT && param->write.is_prep &&
+               param->write.handle == instance->bleCharacteristic->getHandle()) {
+        // Parts of a long write; the onWrite() that follows the EXEC_WRITE event commits them
+        Session* session = instance->findSession(param->write.conn_id);
+        if (session) {
+            session->preparedWrite = true;
+        }
+    } else if (event == ESP_GATTS_EXEC_WRITE_EVT && param->exec_write.exec_write_flag != ESP_GATT_PREP_WRITE_EXEC) {
+        // Cancelled, the library drops the parts without calling onWrite()
+        Session* session = instance->findSession(param->exec_write.conn_id);
+        if (session) {
+            session->preparedWrite = false;
+        }
+    }
+}
+#endif
+
+// Set selective retransmission
+void ChunkedBLEProtocol::setRetransmission(bool enabled, uint8_t maxRounds) {
+    retransmissionEnabled = enabled;
+    maxRetransmitRounds = maxRounds;
+    CBLE_LOGI("[CONFIG] Selective retransmission %s (max %d rounds), applied on next HELLO",
+        enabled ? "enabled" : "disabled", maxRetransmitRounds);
+}
+
+// Check if both sides agreed on ACK/NACK reporting
+bool ChunkedBLEProtocol::Session::peerUsesSack() const {
+    return protocol.retransmissionEnabled && (peerFeatures & FEATURE_SACK);
+}
+
+// Wait for the receiver's ACK, retransmitting whatever it reports missing
+bool ChunkedBLEProtocol::Session::awaitDelivery(const OutboundTransfer& transfer) {
+    uint32_t roundLastChunk = transfer.totalChunks;
+    
+    for (int round = 0; round <= protocol.maxRetransmitRounds; round++) {
+        ReceiveReport report;
+        if (!waitForReport(transfer, report)) {
+            if (!isConnected) {
+                return false;
+            }
+            // Our last chunk or the receiver's report got lost - resending it asks again
+            CBLE_LOGW("[SACK] No report from receiver, resending chunk %d", roundLastChunk);
+            stats.retransmissions++;
+            channels[transfer.channel]->txRecord.retransmissions++;
+            
+            // The receiver ignores a repeated FRAME_OPEN, and needs it if the first one was lost
+            if (transfer.transferId && !sendOpenFrame(transfer) && !isConnected) {
+                return false;
+            }
+            if (!sendChunk(transfer, roundLastChunk, true) && !isConnected) {
+                return false;
+            }
+            continue;
+        }
+        
+        // The receiver flushed its credits before reporting, so the whole window is ours again
+        if (transfer.useCredits) {
+            resyncSendCredits(*channels[transfer.channel]);
+        }
+        
+        if (report.type == FRAME_RESUME_POINT) {
+            continue;  // Late answer to our FRAME_RESUME, the chunks already went out
+        }
+        
+        if (report.type == FRAME_ACK) {
+            channels[transfer.channel]->txAckStatus = report.status;
+            if (report.status == ACK_STATUS_OK) {
+                CBLE_LOGD("[SACK] Receiver acknowledged complete transfer");
+                return true;
+            }
+            CBLE_LOGW("[SACK] Receiver rejected transfer (status %d)", report.status);
+            return false;
+        }
+        
+        // NACK - resend only the chunks marked in the bitmap, in ascending order.
+        // The receiver reports again once it sees the highest chunk it asked for.
+        int resent = 0;
+        for (int bit = report.bitmapLength * 8 - 1; bit >= 0; bit--) {
+            if (report.bitmap[bit / 8] & (1 << (bit % 8))) {
+                roundLastChunk = report.base + bit;
+                break;
+            }
+        }
+        for (int bit = 0; bit < report.bitmapLength * 8; bit++) {
+            if (!(report.bitmap[bit / 8] & (1 << (bit % 8)))) {
+                continue;
+            }
+            uint32_t chunkNum = report.base + bit;
+            if (chunkNum < 1 || chunkNum > transfer.totalChunks) {
+                continue;
+            }
+            if (!sendChunk(transfer, chunkNum)) {
+                if (!isConnected) {
+                    return false;
+                }
+                break;  // Out of credits - the probe after the report timeout recovers
+            }
+            resent++;
+        }
+        stats.retransmissions += resent;
+        channels[transfer.channel]->txRecord.retransmissions += resent;
+        CBLE_LOGI("[SACK] Round %d: retransmitted %d chunks", round + 1, resent);
+    }
+    
+    CBLE_LOGE("[SACK] Giving up after %d retransmission rounds", protocol.maxRetransmitRounds);
+    return false;
+}
+
+// Wait for an ACK/NACK belonging to the given transfer
+bool ChunkedBLEProtocol::Session::waitForReport(const OutboundTransfer& transfer, ReceiveReport& report) {
+    QueueHandle_t reportQueue = channels[transfer.channel]->reportQueue;
+    uint32_t waitStart = millis();
+    while (millis() - waitStart <= protocol.chunkTimeoutMs) {
+        if (xQueueReceive(reportQueue, &report, pdMS_TO_TICKS(FLOW_POLL_INTERVAL_MS)) == pdTRUE) {
+            if (report.globalCRC32 == transfer.globalCRC32 &&
+                (!report.transferId || report.transferId == transfer.transferId)) {
+                return true;
+            }
+            CBLE_LOGW("[SACK] Ignoring report for transfer 0x%08X", report.globalCRC32);
+        } else if (!isConnected) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Parse an ACK/NACK frame and hand it to the sending task
+void ChunkedBLEProtocol::Session::queueReport(const uint8_t* data, size_t length) {
+    ReceiveReport report;
+    memset(&report, 0, sizeof(report));
+    
+    if (data[2] == FRAME_ACK) {
+        if (length < sizeof(AckFrame)) {
+            CBLE_LOGW("[SACK] ACK frame too small (%d bytes)", length);
+            return;
+        }
+        AckFrame ack;
+        memcpy(&ack, data, sizeof(AckFrame));
+        report.type = FRAME_ACK;
+        report.status = ack.status;
+        report.globalCRC32 = ack.global_crc32;
+        if (peerUsesMultiplex() && length >= sizeof(AckFrame) + sizeof(report.transferId)) {
+            memcpy(&report.transferId, data + sizeof(AckFrame), sizeof(report.transferId));
+        }
+    } else if (data[2] == FRAME_RESUME_POINT) {
+        if (length < sizeof(ResumePointFrame)) {
+            CBLE_LOGW("[RESUME] Resume point frame too small (%d bytes)", length);
+            return;
+        }
+        ResumePointFrame point;
+        memcpy(&point, data, sizeof(ResumePointFrame));
+        report.type = FRAME_RESUME_POINT;
+        report.globalCRC32 = point.global_crc32;
+        report.transferId = point.transfer_id;
+        report.base = point.next_chunk;
+    } else if (data[2] == FRAME_NACK_LARGE) {
+        size_t headerSize = sizeof(LargeNackFrame) + (peerUsesMultiplex() ? sizeof(report.transferId) : 0);
+        if (length < headerSize) {
+            CBLE_LOGW("[SACK] NACK frame too small (%d bytes)", length);
+            return;
+        }
+        LargeNackFrame nack;
+        memcpy(&nack, data, sizeof(LargeNackFrame));
+        report.type = FRAME_NACK;
+        report.globalCRC32 = nack.global_crc32;
+        if (headerSize > sizeof(LargeNackFrame)) {
+            memcpy(&report.transferId, data + sizeof(LargeNackFrame), sizeof(report.transferId));
+        }
+        report.base = nack.base;
+        report.bitmapLength = std::min(length - headerSize, (size_t)MAX_NACK_BITMAP_BYTES);
+        memcpy(report.bitmap, data + headerSize, report.bitmapLength);
+    } else {
+        if (length < sizeof(NackFrame)) {
+            CBLE_LOGW("[SACK] NACK frame too small (%d bytes)", length);
+            return;
+        }
+        NackFrame nack;
+        memcpy(&nack, data, sizeof(NackFrame));
+        report.type = FRAME_NACK;
+        report.globalCRC32 = nack.global_crc32;
+        report.base = nack.base;
+        report.bitmapLength = std::min(length - sizeof(NackFrame), (size_t)MAX_NACK_BITMAP_BYTES);
+        memcpy(report.bitmap, data + sizeof(NackFrame), report.bitmapLength);
+    }
+    
+    // Reports name the transfer by its global CRC32, and by transfer_id when the peer multiplexes
+    Channel* channel = nullptr;
+    for (uint8_t i = 0; i < MAX_CHANNELS && !channel; i++) {
+        if (channels[i]->sending && channels[i]->activeCRC32 == report.globalCRC32 &&
+            (!report.transferId || channels[i]->activeTransferId == report.transferId)) {
+            channel = channels[i];
+        }
+    }
+    if (!channel) {
+        CBLE_LOGW("[SACK] Ignoring report for transfer 0x%08X", report.globalCRC32);
+        return;
+    }
+    if (xQueueSend(channel->reportQueue, &report, 0) != pdTRUE) {
+        CBLE_LOGW("[SACK] Report queue full - dropping report");
+    }
+}
+
+// Tell the sender how the transfer ended
+void ChunkedBLEProtocol::Session::sendAck(uint32_t globalCRC32, AckStatus status, uint16_t transferId) {
+    flushReceiveCredits();
+    
+    AckFrame ack;
+    ack.header.marker = 0;
+    ack.header.type = FRAME_ACK;
+    ack.global_crc32 = globalCRC32;
+    ack.status = status;
+    
+    // Channels of a multiplexing sender may run transfers of equal payloads at once
+    uint8_t frame[sizeof(AckFrame) + sizeof(transferId)];
+    size_t frameSize = sizeof(AckFrame);
+    memcpy(frame, &ack, sizeof(AckFrame));
+    if (peerUsesMultiplex()) {
+        memcpy(frame + frameSize, &transferId, sizeof(transferId));
+        frameSize += sizeof(transferId);
+    }
+    
+    if (!sendControlFrame(frame, frameSize)) {
+        CBLE_LOGE("[SACK] Failed to send ACK");
+        return;
+    }
+    CBLE_LOGD("[SACK] ACK sent for transfer 0x%08X (status %d)", globalCRC32, status);
+}
+
+// Report missing chunks of the current transfer
+void ChunkedBLEProtocol::Channel::sendNack() {
+    // Return held-back credits first so the sender can retransmit right away
+    session.flushReceiveCredits();
+    
+    // Large transfers need a 32-bit base chunk number
+    bool large = session.peerUsesLargeTransfers();
+    size_t headerSize = large ? sizeof(LargeNackFrame) : sizeof(NackFrame);
+    
+    // A multiplexing sender finds the channel by the transfer_id between frame and bitmap
+    bool multiplexed = session.peerUsesMultiplex();
+    if (multiplexed) {
+        headerSize += sizeof(openTransferId);
+    }
+    
+    uint8_t frame[sizeof(LargeNackFrame) + sizeof(openTransferId) + MAX_NACK_BITMAP_BYTES];
+    size_t bitmapCapacity = std::min(session.getMaxFrameSize() - headerSize, (size_t)MAX_NACK_BITMAP_BYTES);
+    int base;
+    int highestMissing;
+    size_t bitmapLength;
+    int missingCount = assembler.missingChunks(frame + headerSize, bitmapCapacity, base, highestMissing, bitmapLength);
+    
+    if (large) {
+        LargeNackFrame nack;
+        nack.header.marker = 0;
+        nack.header.type = FRAME_NACK_LARGE;
+        nack.global_crc32 = expectedGlobalCRC32;
+        nack.base = base;
+        memcpy(frame, &nack, sizeof(LargeNackFrame));
+        if (multiplexed) {
+            memcpy(frame + sizeof(LargeNackFrame), &openTransferId, sizeof(openTransferId));
+        }
+    } else {
+        NackFrame nack;
+        nack.header.marker = 0;
+        nack.header.type = FRAME_NACK;
+        nack.global_crc32 = expectedGlobalCRC32;
+        nack.base = base;
+        memcpy(frame, &nack, sizeof(NackFrame));
+    }
+    
+    // The retransmission round ends with the highest chunk we asked for
+    reportPoint = highestMissing;
+    
+    if (!session.sendControlFrame(frame, headerSize + bitmapLength)) {
+        CBLE_LOGE("[SACK] Failed to send NACK");
+        return;
+    }
+    CBLE_LOGD("[SACK] NACK sent: %d chunks missing from chunk %d", missingCount, base);
+}
+
+// Cancel current transfer and let the sender know it will not complete
+void ChunkedBLEProtocol::Channel::rejectTransfer(const char* reason, AckStatus status) {
+    uint32_t globalCRC32 = expectedGlobalCRC32;
+    uint16_t transferId = openTransferId;
+    cancelTransfer(reason);
+    if (session.peerUsesSack()) {
+        session.sendAck(globalCRC32, status, transferId);
+    }
+}
+
+// Set the largest transfer accepted in each receive mode
+void ChunkedBLEProtocol::setTransferLimits(size_t maxBufferedSize, size_t maxStreamedSize) {
+    this->maxBufferedSize = maxBufferedSize;
+    this->maxStreamedSize = maxStreamedSize;
+    CBLE_LOGI("[CONFIG] Transfer limits: %d bytes buffered, %d bytes streamed", maxBufferedSize, maxStreamedSize);
+}
+
+// Check if the peer understands FRAME_OPEN and 32-bit chunk numbers
+bool ChunkedBLEProtocol::Session::peerUsesLargeTransfers() const {
+    return peerFeatures & FEATURE_LARGE;
+}
+
+// Announce a large transfer to the receiver (FRAME_RESUME asks to continue it)
+bool ChunkedBLEProtocol::Session::sendOpenFrame(const OutboundTransfer& transfer, uint8_t type) {
+    OpenFrame open;
+    open.header.marker = 0;
+    open.header.type = type;
+    open.transfer_id = transfer.transferId;
+    open.global_crc32 = transfer.globalCRC32;
+    open.total_length = transfer.size;
+    open.chunk_size = transfer.chunkSize;
+    open.flags = transfer.openFlags;
+    
+    // The parity group size (OPEN_FLAG_FEC), the content type (OPEN_FLAG_CONTENT_TYPE)
+    // and the CRC32s of a delta (CONTENT_FLAG_DELTA) follow the frame
+    uint8_t frame[sizeof(OpenFrame) + 2 + 2 * sizeof(uint32_t)];
+    memcpy(frame, &open, sizeof(open));
+    size_t length = sizeof(open);
+    if (transfer.openFlags & OPEN_FLAG_FEC) {
+        frame[length++] = transfer.fecGroup;
+    }
+    if (transfer.openFlags & OPEN_FLAG_CONTENT_TYPE) {
+        frame[length++] = transfer.contentType;
+        if (transfer.contentType & CONTENT_FLAG_DELTA) {
+            memcpy(frame + length, &transfer.baseCRC32, sizeof(uint32_t));
+            memcpy(frame + length + sizeof(uint32_t), &transfer.resultCRC32, sizeof(uint32_t));
+            length += 2 * sizeof(uint32_t);
+        }
+    }
+    if (!sendFrame(frame, length)) {
+        CBLE_LOGE("[LARGE] Failed to send OPEN for transfer %d", transfer.transferId);
+        return false;
+    }
+    CBLE_LOGD("[LARGE] %s sent: transfer %d, %d bytes in %u chunks", type == FRAME_RESUME ? "RESUME" : "OPEN",
+        transfer.transferId, transfer.size, transfer.totalChunks);
+    return true;
+}
+
+// Route FRAME_OPEN or FRAME_RESUME to the channel it names
+void ChunkedBLEProtocol::Session::processOpenFrame(const uint8_t* data, size_t length) {
+    if (length < sizeof(OpenFrame) || (data[2] != FRAME_OPEN && data[2] != FRAME_RESUME)) {
+        CBLE_LOGW("[LARGE] Malformed OPEN frame (%d bytes)", length);
+        return;
+    }
+    OpenFrame open;
+    memcpy(&open, data, sizeof(OpenFrame));
+    
+    // Trailing fields in flag order, a missing one reads as 0
+    size_t offset = sizeof(OpenFrame);
+    OpenTrailer trailer = {};
+    if ((open.flags & OPEN_FLAG_FEC) && offset < length) {
+        trailer.fecGroup = data[offset++];
+    }
+    if ((open.flags & OPEN_FLAG_CONTENT_TYPE) && offset < length) {
+        trailer.contentType = data[offset++];
+    }
+    if ((trailer.contentType & CONTENT_FLAG_DELTA) && offset + 2 * sizeof(uint32_t) <= length) {
+        memcpy(&trailer.baseCRC32, data + offset, sizeof(uint32_t));
+        memcpy(&trailer.resultCRC32, data + offset + sizeof(uint32_t), sizeof(uint32_t));
+    }
+    
+    uint8_t channel = DEFAULT_CHANNEL;
+    if (peerUsesMultiplex()) {
+        channel = (open.flags & OPEN_FLAG_CHANNEL_MASK) >> OPEN_CHANNEL_SHIFT;
+    }
+    channels[channel]->processOpenFrame(open, trailer);
+}
+
+// Start receiving a large transfer announced by FRAME_OPEN or FRAME_RESUME
+void ChunkedBLEProtocol::Channel::processOpenFrame(const OpenFrame& open, const OpenTrailer& trailer) {
+    bool resumeRequest = open.header.type == FRAME_RESUME;
+    uint8_t fecGroupSize = trailer.fecGroup;
+    bool deltaAnnounced = trailer.contentType & CONTENT_FLAG_DELTA;
+    
+    // The sender repeats OPEN when a report is overdue - keep what we already have
+    if (open.transfer_id == openTransferId && open.global_crc32 == expectedGlobalCRC32) {
+        CBLE_LOGD("[LARGE] Repeated OPEN for transfer %d", open.transfer_id);
+        if (resumeRequest) {
+            session.sendResumePoint(open.transfer_id, open.global_crc32, resumePoint());
+        }
+        return;
+    }
+    
+    // Continue a transfer the last disconnect interrupted
+    // Compact frames of a multiplexing peer must be tagged to find their channel
+    bool tagged = open.flags & OPEN_FLAG_TAGGED;
+    bool framingAccepted = (protocol.compactFraming || !(open.flags & OPEN_FLAG_COMPACT)) &&
+        (protocol.compressionEnabled || !(open.flags & OPEN_FLAG_COMPRESSED)) &&
+        (session.peerUsesMultiplex() ? tagged || !(open.flags & OPEN_FLAG_COMPACT) : !tagged);
+    if (suspendedTransferId && framingAccepted && resumeReceive(open)) {
+        fecGroup = fecGroupSize;
+        contentType = trailer.contentType & ~CONTENT_FLAG_DELTA;
+        deltaBaseCRC32 = deltaAnnounced ? trailer.baseCRC32 : 0;
+        deltaResultCRC32 = trailer.resultCRC32;
+        if (resumeRequest) {
+            session.sendResumePoint(open.transfer_id, open.global_crc32, resumePoint());
+        }
+        return;
+    }
+    
+    size_t maxChunkSize = session.getChunkDataSize(largeHeaderSize(open.flags));
+    uint32_t totalChunks = open.chunk_size ? (open.total_length + open.chunk_size - 1) / open.chunk_size : 0;
+    uint32_t maxChunks = (open.flags & OPEN_FLAG_COMPACT) ? MAX_COMPACT_CHUNKS : MAX_LARGE_CHUNKS;
+    uint32_t parityChunks = fecGroupSize ? (totalChunks + fecGroupSize - 1) / fecGroupSize : 0;
+    bool fecValid = fecGroupSize || !(open.flags & OPEN_FLAG_FEC);
+    bool deltaValid = !deltaAnnounced || trailer.baseCRC32;
+    if (open.transfer_id == 0 || open.total_length == 0 || open.chunk_size == 0 || !framingAccepted ||
+        !fecValid || !deltaValid || open.chunk_size > maxChunkSize || (uint64_t)totalChunks + parityChunks > maxChunks) {
+        CBLE_LOGW("[LARGE] Invalid OPEN: transfer %d, %u bytes, chunk size %d (max %d)", 
+            open.transfer_id, open.total_length, open.chunk_size, maxChunkSize);
+        if (session.peerUsesSack()) {
+            session.sendAck(open.global_crc32, ACK_STATUS_REJECTED, open.transfer_id);
+        }
+        return;
+    }
+    
+    openTransferId = open.transfer_id;
+    openFlags = open.flags;
+    CBLE_LOGI("[LARGE] Transfer %d opened: %u bytes, chunk size %d, flags 0x%02X", 
+        open.transfer_id, open.total_length, open.chunk_size, open.flags);
+    if (!beginTransfer(totalChunks, open.global_crc32, open.total_length, open.chunk_size)) {
+        return;
+    }
+    
+    contentType = trailer.contentType & ~CONTENT_FLAG_DELTA;
+    
+    // A delta needs the payload it was made against, and a whole payload to rebuild it in
+    deltaBaseCRC32 = deltaAnnounced ? trailer.baseCRC32 : 0;
+    deltaResultCRC32 = trailer.resultCRC32;
+    if (deltaBaseCRC32 && (streamingTransfer || deltaBaseCRC32 != rxBaseCRC32)) {
+        CBLE_LOGW("[DELTA] Transfer %d needs base 0x%08X, holding 0x%08X", open.transfer_id, deltaBaseCRC32,
+            streamingTransfer ? 0 : rxBaseCRC32);
+        rejectTransfer("Delta base missing", ACK_STATUS_DELTA_BASE_MISSING);
+        return;
+    }
+    
+    // A streamed transfer keeps no data to rebuild from - its parity chunks are dropped on arrival
+    fecGroup = fecGroupSize;
+    if (fecGroup && !assembler.setParity(fecGroup)) {
+        CBLE_LOGD("[FEC] Parity chunks of transfer %d ignored while streaming", open.transfer_id);
+    }
+    
+    // A compressed stream is inflated as it is delivered, the decompressed size limits it
+    compressedTransfer = open.flags & OPEN_FLAG_COMPRESSED;
+#if CHUNKED_BLE_COMPRESSION
+    if (compressedTransfer && streamingTransfer && !streamDecoder.begin(protocol.maxStreamedSize)) {
+        rejectTransfer("No memory for the decompression window", ACK_STATUS_REJECTED);
+        return;
+    }
+#endif
+    if (resumeRequest) {
+        // Nothing to resume - the sender starts over without waiting for a timeout
+        session.sendResumePoint(open.transfer_id, open.global_crc32, 1);
+    }
+}
+
+// Set how long an interrupted large transfer can be resumed
+void ChunkedBLEProtocol::setResumeGracePeriod(uint32_t graceMs) {
+    resumeGraceMs = graceMs;
+    if (graceMs == 0) {
+        for (uint8_t i = 0; i < sessionCount; i++) {
+            for (uint8_t c = 0; c < MAX_CHANNELS; c++) {
+                sessions[i]->channels[c]->interruptedSend.transferId = 0;
+            }
+        }
+    }
+    CBLE_LOGI("[CONFIG] Resume grace period %u ms, applied on next HELLO", graceMs);
+}
+
+// Enable or disable multiplexed channels
+void ChunkedBLEProtocol::setMultiplexing(bool enabled) {
+    multiplexEnabled = enabled;
+    CBLE_LOGI("[CONFIG] Multiplexed channels %s, applied on next HELLO", enabled ? "enabled" : "disabled");
+}
+
+// Check if both sides run one transfer per channel
+bool ChunkedBLEProtocol::Session::peerUsesMultiplex() const {
+    return protocol.multiplexEnabled && (peerFeatures & FEATURE_MULTIPLEX) && peerUsesLargeTransfers();
+}
+
+// Take the session's next data frame slot, waiting behind the channel holding it
+void ChunkedBLEProtocol::Session::acquireChannelTurn(Channel& channel) {
+    xSemaphoreTake(protocol.txMutex, portMAX_DELAY);
+    if (!channelTurnHolder) {
+        channelTurnHolder = &channel;
+        xSemaphoreGive(protocol.txMutex);
+        return;
+    }
+    channel.waitingForTurn = true;
+    xSemaphoreGive(protocol.txMutex);
+    
+    // releaseChannelTurn() hands the turn over directly
+    xSemaphoreTake(channel.turn, portMAX_DELAY);
+}
+
+// Hand the turn to the waiting channel with the lowest number
+void ChunkedBLEProtocol::Session::releaseChannelTurn(Channel& channel) {
+    (void)channel;  // Only one channel holds the turn
+    xSemaphoreTake(protocol.txMutex, portMAX_DELAY);
+    channelTurnHolder = nullptr;
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        Channel* next = channels[i];
+        if (next->waitingForTurn) {
+            next->waitingForTurn = false;
+            channelTurnHolder = next;
+            xSemaphoreGive(next->turn);
+            break;
+        }
+    }
+    xSemaphoreGive(protocol.txMutex);
+}
+
+// Check if both sides can resume interrupted large transfers
+bool ChunkedBLEProtocol::Session::peerUsesResume() const {
+    return protocol.resumeGraceMs && (peerFeatures & FEATURE_RESUME) && peerUsesLargeTransfers() && peerUsesSack();
+}
+
+// Keep the large transfers of every channel across a disconnect, or drop them
+void ChunkedBLEProtocol::Session::suspendReceive() {
+    for (uint8_t i = 0; i < MAX_CHANNELS; i++) {
+        channels[i]->suspendReceive();
+    }
+}
+
+// Keep the current large transfer across a disconnect, or drop it
+void ChunkedBLEProtocol::Channel::suspendReceive() {
+    uint16_t transferId = openTransferId;
+    openTransferId = 0;
+    if (suspendedTransferId) {
+        return;  // Still waiting for a resume from an earlier disconnect
+    }
+    
+    if (!transferInProgress || !transferId || !protocol.resumeGraceMs) {
+        transferInProgress = false;
+        clearReceiveBuffers();
+        return;
+    }
+    
+    // Chunks stay in place; FRAME_RESUME (or FRAME_OPEN) of the same transfer picks them up
+    transferInProgress = false;
+    suspendedTransferId = transferId;
+    suspendTime = millis();
+    CBLE_LOGI("[RESUME] Transfer %d suspended with %d/%d chunks, resumable for %u ms", 
+        transferId, assembler.receivedChunks(), assembler.totalChunks(), protocol.resumeGraceMs);
+}
+
+// Pick up the suspended transfer if the announced one is the same and still within the grace period
+bool ChunkedBLEProtocol::Channel::resumeReceive(const OpenFrame& open) {
+    if (millis() - suspendTime > protocol.resumeGraceMs) {
+        CBLE_LOGI("[RESUME] Transfer %d expired after %u ms", suspendedTransferId, protocol.resumeGraceMs);
+        clearReceiveBuffers();
+        return false;
+    }
+    if (open.transfer_id != suspendedTransferId || open.global_crc32 != expectedGlobalCRC32 ||
+        open.total_length != assembler.length() || open.chunk_size != assembler.stride() ||
+        (bool)(open.flags & OPEN_FLAG_COMPRESSED) != compressedTransfer) {
+        return false;
+    }
+    
+    // Framing may differ from the interrupted connection, the chunk size and compression may not
+    openTransferId = suspendedTransferId;
+    openFlags = open.flags;
+    suspendedTransferId = 0;
+    transferInProgress = true;
+    reportPoint = assembler.totalChunks();   // Next report once the sender's round reaches the last chunk
+    updateChunkTimer();
+    
+    CBLE_LOGI("[RESUME] Transfer %d resumed with %d/%d chunks", 
+        openTransferId, assembler.receivedChunks(), assembler.totalChunks());
+    return true;
+}
+
+// Chunk after the highest one received (missing chunks below it are NACKed later)
+uint32_t ChunkedBLEProtocol::Channel::resumePoint() const {
+    return assembler.nextChunk();
+}
+
+// Tell the sender where to continue an interrupted transfer
+void ChunkedBLEProtocol::Session::sendResumePoint(uint16_t transferId, uint32_t globalCRC32, uint32_t nextChunk) {
+    ResumePointFrame point;
+    point.header.marker = 0;
+    point.header.type = FRAME_RESUME_POINT;
+    point.transfer_id = transferId;
+    point.global_crc32 = globalCRC32;
+    point.next_chunk = nextChunk;
+    
+    if (!sendControlFrame((const uint8_t*)&point, sizeof(point))) {
+        CBLE_LOGE("[RESUME] Failed to send resume point");
+        return;
+    }
+    CBLE_LOGD("[RESUME] Transfer %d continues at chunk %u", transferId, nextChunk);
+}
+
+// Ask the receiver where an interrupted transfer continues (0 if there is no answer)
+uint32_t ChunkedBLEProtocol::Session::requestResume(const OutboundTransfer& transfer) {
+    if (!sendOpenFrame(transfer, FRAME_RESUME)) {
+        return 0;
+    }
+    
+    ReceiveReport report;
+    if (!waitForReport(transfer, report) || report.type != FRAME_RESUME_POINT) {
+        CBLE_LOGW("[RESUME] No resume point for transfer %d - sending it again", transfer.transferId);
+        return 0;
+    }
+    
+    uint32_t nextChunk = std::max((uint32_t)1, std::min(report.base, transfer.totalChunks + 1));
+    CBLE_LOGI("[RESUME] Transfer %d continues at chunk %u of %u", 
+        transfer.transferId, nextChunk, transfer.totalChunks);
+    return nextChunk;
+}
+
+// Send chunks firstChunk..totalChunks; true if awaitDelivery() can take over
+bool ChunkedBLEProtocol::Session::sendChunkRange(const OutboundTransfer& transfer, uint32_t firstChunk, bool useSack) {
+    // A resumed transfer may only miss chunks the next report will list
+    if (firstChunk > transfer.totalChunks) {
+        sendChunk(transfer, transfer.totalChunks, true);
+        return true;
+    }
+    
+    // Parity covers whole groups, so only a round that starts with chunk 1 carries it
+    uint32_t fecGroup = firstChunk == 1 ? transfer.fecGroup : 0;
+    for (uint32_t chunkNum = firstChunk; chunkNum <= transfer.totalChunks; chunkNum++) {
+        bool lastChunk = chunkNum == transfer.totalChunks;
+        bool sent = true;
+        if (fecGroup) {
+            if ((chunkNum - 1) % fecGroup == 0) {
+                memset(transfer.parity, 0, transfer.chunkSize);
+            }
+            // The last group's parity goes ahead of the last chunk, which triggers the receiver's report
+            // (a last group of just that chunk gets none - the receiver never rebuilds the last chunk)
+            if (lastChunk && (chunkNum - 1) % fecGroup != 0) {
+                sent = addChunkParity(transfer, chunkNum, nullptr) && sendParity(transfer, (chunkNum - 1) / fecGroup);
+            }
+        }
+        sent = sent && sendChunk(transfer, chunkNum);
+        
+        // The chunk is still in the frame buffer behind its header
+        if (sent && fecGroup && !lastChunk) {
+            addChunkParity(transfer, chunkNum, transfer.frame + transfer.headerSize);
+            if (chunkNum % fecGroup == 0) {
+                sent = sendParity(transfer, (chunkNum - 1) / fecGroup);
+            }
+        }
+        
+        if (!sent) {
+            // A lost frame also loses its credit - the receiver's report resynchronizes both
+            if (!useSack || !isConnected) {
+                return false;
+            }
+            CBLE_LOGW("[SACK] Round interrupted at chunk %d, asking receiver for a report", chunkNum);
+            sendChunk(transfer, transfer.totalChunks, true);
+            break;
+        }
+        
+        // Update progress
+        protocol.notifyProgress(chunkNum, transfer.totalChunks, false);
+    }
+    return true;
+}
+
+// Configure compact framing for large transfers
+void ChunkedBLEProtocol::setCompactFraming(bool enabled, bool chunkCRC) {
+    compactFraming = enabled;
+    compactChunkCRC = chunkCRC;
+    CBLE_LOGI("[CONFIG] Compact framing %s%s, applied on next HELLO", enabled ? "enabled" : "disabled",
+        enabled && !chunkCRC ? " without chunk CRC32" : "");
+}
+
+// Check if our large transfers to the peer may use compact data frames
+bool ChunkedBLEProtocol::Session::peerUsesCompactFraming() const {
+    return protocol.compactFraming && (peerFeatures & FEATURE_COMPACT) && peerUsesLargeTransfers();
+}
+
+// Data frame header size for the given FRAME_OPEN flags
+size_t ChunkedBLEProtocol::largeHeaderSize(uint8_t openFlags) {
+    if (!(openFlags & OPEN_FLAG_COMPACT)) {
+        return LARGE_HEADER_SIZE;
+    }
+    size_t tagSize = (openFlags & OPEN_FLAG_TAGGED) ? sizeof(uint16_t) : 0;
+    return tagSize + ((openFlags & OPEN_FLAG_NO_CHUNK_CRC) ? COMPACT_HEADER_SIZE_NO_CRC : COMPACT_HEADER_SIZE);
+}
+
+// Enable or disable payload compression for large transfers
+void ChunkedBLEProtocol::setCompression(bool enabled) {
+#if !CHUNKED_BLE_COMPRESSION
+    if (enabled) {
+        CBLE_LOGW("[CONFIG] Compression not built in (CHUNKED_BLE_COMPRESSION=0)");
+        return;
+    }
+#endif
+    compressionEnabled = enabled;
+    CBLE_LOGI("[CONFIG] Compression %s, applied on next HELLO", enabled ? "enabled" : "disabled");
+}
+
+// Check if our transfers to the peer may be compressed
+bool ChunkedBLEProtocol::Session::peerUsesCompression() const {
+    return protocol.compressionEnabled && (peerFeatures & FEATURE_COMPRESSION) && peerUsesLargeTransfers();
+}
+
+// Configure parity chunks for the large transfers we send
+void ChunkedBLEProtocol::setForwardErrorCorrection(uint8_t groupSize) {
+    fecGroupSize = groupSize;
+    if (groupSize) {
+        CBLE_LOGI("[CONFIG] FEC enabled, one parity chunk per %d data chunks", groupSize);
+    } else {
+        CBLE_LOGI("[CONFIG] FEC disabled");
+    }
+}
+
+// Enable or disable handing buffered CBOR transfers to the callbacks as JSON text
+void ChunkedBLEProtocol::setCBORDecoding(bool enabled) {
+    cborDecoding = enabled;
+    CBLE_LOGI("[CONFIG] CBOR decoding %s", enabled ? "enabled" : "disabled");
+}
+
+// Check if the peer reads the content type of our transfers
+bool ChunkedBLEProtocol::Session::peerUsesContentTypes() const {
+    return (peerExtendedFeatures & FEATURE_EXT_CONTENT_TYPE) && peerUsesLargeTransfers();
+}
+
+// Get the content type of the transfer being delivered on a client's channel
+ChunkedBLEProtocol::ContentType ChunkedBLEProtocol::getReceivedContentType(uint16_t connId, uint8_t channel) const {
+    Session* session = findSession(connId);
+    if (!session || channel >= MAX_CHANNELS) {
+        return CONTENT_TYPE_NONE;
+    }
+    return (ContentType)session->channels[channel]->contentType;
+}
+
+// Configure delta transfers and the largest payload kept as their base
+void ChunkedBLEProtocol::setDeltaTransfers(size_t maxBaseSize) {
+#if !CHUNKED_BLE_DELTA
+    if (maxBaseSize) {
+        CBLE_LOGW("[CONFIG] Delta transfers not built in (CHUNKED_BLE_DELTA=0)");
+        return;
+    }
+#endif
+    maxDeltaBaseSize = maxBaseSize;
+    if (maxBaseSize) {
+        CBLE_LOGI("[CONFIG] Delta transfers enabled, bases up to %d bytes, applied on next HELLO", maxBaseSize);
+        return;
+    }
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        for (uint8_t c = 0; c < MAX_CHANNELS; c++) {
+            sessions[i]->channels[c]->clearDeltaBases();
+        }
+    }
+    CBLE_LOGI("[CONFIG] Delta transfers disabled");
+}
+
+// Check if the peer keeps the payloads we send as delta bases
+bool ChunkedBLEProtocol::Session::peerUsesDelta() const {
+    // Only an acknowledged transfer is known to have become the base
+    return protocol.maxDeltaBaseSize && (peerExtendedFeatures & FEATURE_EXT_DELTA) &&
+        !(peerFeatures & FEATURE_STREAMING) && peerUsesSack() && peerUsesContentTypes();
+}
+
+// Check if we keep the payloads the peer sends as delta bases
+bool ChunkedBLEProtocol::Session::keepsDeltaBases() const {
+    return protocol.maxDeltaBaseSize && (peerExtendedFeatures & FEATURE_EXT_DELTA);
+}
+
+// Rebuild a delta transfer in place from the channel's base, rejecting it when that fails
+bool ChunkedBLEProtocol::Channel::applyDelta(std::string& receiveBuffer) {
+    std::string result;
+    uint32_t applyStart = micros();
+#if CHUNKED_BLE_DELTA
+    bool applied = deltaBaseCRC32 == rxBaseCRC32 &&
+        Delta::apply((const uint8_t*)rxBase.data(), rxBase.size(), (const uint8_t*)receiveBuffer.data(),
+                     receiveBuffer.size(), result, protocol.maxBufferedSize) &&
+        CRC32::calculate((const uint8_t*)result.data(), result.size()) == deltaResultCRC32;
+#else
+    bool applied = false;  // No base is ever kept, OPEN already refused the transfer
+#endif
+    session.stats.reassemblyTimeUs += micros() - applyStart;
+    if (!applied) {
+        // The sender answers with the whole payload
+        rejectTransfer("Delta does not apply to the base", ACK_STATUS_DELTA_BASE_MISSING);
+        return false;
+    }
+    CBLE_LOGD("[DELTA] %d byte patch rebuilt to %d bytes", receiveBuffer.size(), result.size());
+    // A peer's patch may be longer than the payload it rebuilds, nothing was saved then
+    if (result.size() > receiveBuffer.size()) {
+        session.stats.deltaSaved += result.size() - receiveBuffer.size();
+    }
+    receiveBuffer.swap(result);
+    return true;
+}
+
+// Keep a received payload as the base of the next delta, or drop the base if it is too large
+void ChunkedBLEProtocol::Channel::keepDeltaBase(const std::string& payload) {
+    if (payload.size() > protocol.maxDeltaBaseSize) {
+        std::string().swap(rxBase);
+        rxBaseCRC32 = 0;
+        return;
+    }
+    rxBase.assign(payload);
+    if (deltaBaseCRC32) {
+        rxBaseCRC32 = deltaResultCRC32;
+    } else if (compressedTransfer) {
+        rxBaseCRC32 = CRC32::calculate((const uint8_t*)payload.data(), payload.size());
+    } else {
+        rxBaseCRC32 = expectedGlobalCRC32;  // The global CRC32 already describes the payload
+    }
+}
+
+// Forget the payloads kept for delta transfers in both directions
+void ChunkedBLEProtocol::Channel::clearDeltaBases() {
+    std::string().swap(rxBase);
+    std::string().swap(txBase);
+    rxBaseCRC32 = 0;
+    txBaseCRC32 = 0;
+}
+
+// Check if our transfers to the peer may carry parity chunks
+bool ChunkedBLEProtocol::Session::peerUsesFec() const {
+    return protocol.fecGroupSize && (peerExtendedFeatures & FEATURE_EXT_FEC) &&
+        !(peerFeatures & FEATURE_STREAMING) && peerUsesLargeTransfers();
+}
+
+// XOR one chunk into the parity of its group (chunkData nullptr reads it first)
+bool ChunkedBLEProtocol::Session::addChunkParity(const OutboundTransfer& transfer, uint32_t chunkNum,
+                                                 const uint8_t* chunkData) {
+    size_t offset = (size_t)(chunkNum - 1) * transfer.chunkSize;
+    size_t length = std::min(transfer.chunkSize, transfer.size - offset);
+    if (!chunkData) {
+        chunkData = readChunk(transfer, offset, length);
+        if (!chunkData) {
+            return false;
+        }
+    }
+    ChunkAssembler::addParity(transfer.parity, chunkData, length);
+    return true;
+}
+
+// Send the parity chunk of a group, numbered after the data chunks
+bool ChunkedBLEProtocol::Session::sendParity(const OutboundTransfer& transfer, uint32_t group) {
+    uint32_t chunkNum = transfer.totalChunks + group + 1;
+    uint32_t parityCRC32 = 0;
+    if ((transfer.openFlags & (OPEN_FLAG_COMPACT | OPEN_FLAG_NO_CHUNK_CRC)) !=
+        (OPEN_FLAG_COMPACT | OPEN_FLAG_NO_CHUNK_CRC)) {
+        parityCRC32 = calculateCRC32(transfer.parity, transfer.chunkSize);
+    }
+    if (!sendDataFrame(transfer, chunkNum, transfer.parity, transfer.chunkSize, parityCRC32, false)) {
+        return false;
+    }
+    stats.paritySent++;
+    return true;
+}
+
+// Offer an L2CAP CoC to clients
+bool ChunkedBLEProtocol::setL2capChannel(bool enabled, uint16_t psm) {
+    if (enabled && (psm < 0x0080 || psm > 0x00FF)) {
+        CBLE_LOGW("[TRANSPORT] PSM 0x%04X outside the dynamic LE range", psm);
+        return false;
+    }
+    if (enabled && l2capTransport && psm != l2capPsm) {
+        CBLE_LOGW("[TRANSPORT] L2CAP channel already listens on PSM 0x%04X", l2capPsm);
+        return false;
+    }
+#if CHUNKED_BLE_L2CAP_COC
+    if (enabled && !l2capTransport && transportCallbacks) {
+        L2capTransport* coc = new (std::nothrow) L2capTransport(transportCallbacks, MAX_FRAME_SIZE);
+        if (!coc || !coc->begin(psm)) {
+            CBLE_LOGE("[TRANSPORT] Failed to listen for L2CAP channels on PSM 0x%04X", psm);
+            delete coc;
+            return false;
+        }
+        l2capTransport = coc;
+    }
+#endif
+    if (enabled && !l2capTransport) {
+        CBLE_LOGW("[TRANSPORT] L2CAP CoC not supported by this host stack - clients stay on GATT");
+        return false;
+    }
+    l2capEnabled = enabled;
+    l2capPsm = psm;
+    CBLE_LOGI("[TRANSPORT] L2CAP channel %s", enabled ? "offered" : "not offered");
+    return true;
+}
+
+// Get the transport of a client
+ChunkedBLEProtocol::TransportKind ChunkedBLEProtocol::getTransport(uint16_t connId) const {
+    Session* session = findSession(connId);
+    if (session && session->transport && session->transport != gattTransport) {
+        return TRANSPORT_L2CAP_COC;
+    }
+    return TRANSPORT_GATT;
+}
+
+// Move a client's frames to a transport channel it opened
+void ChunkedBLEProtocol::openTransport(BLETransport* transport, uint16_t connId, uint16_t frameSize) {
+    Session* session = findSession(connId);
+    if (!session) {
+        CBLE_LOGW("[TRANSPORT] %s channel from unknown client %d ignored", transport->name(), connId);
+        return;
+    }
+    // Frames of every transport fit the same buffers and receive rings
+    if (frameSize < DEFAULT_MTU_SIZE - ATT_HEADER_SIZE) {
+        CBLE_LOGW("[TRANSPORT] %s channel of client %d too small (%d bytes) - staying on %s",
+            transport->name(), connId, frameSize, session->transport->name());
+        return;
+    }
+    session->transportFrameSize = std::min((size_t)frameSize, MAX_FRAME_SIZE);
+    session->transport = transport;
+    CBLE_LOGI("[TRANSPORT] Client %d switched to %s, %d byte frames",
+        connId, transport->name(), session->transportFrameSize);
+}
+
+// Fall back to GATT when a client's channel closes
+void ChunkedBLEProtocol::closeTransport(BLETransport* transport, uint16_t connId) {
+    Session* session = findSession(connId);
+    if (!session || session->transport != transport) {
+        return;
+    }
+    session->transport = gattTransport;
+    session->transportFrameSize = 0;
+    CBLE_LOGI("[TRANSPORT] %s channel of client %d closed - back to GATT", transport->name(), connId);
+}
+
+// Select the link parameters requested from the central
+void ChunkedBLEProtocol::setLinkProfile(LinkProfile profile) {
+    linkProfile = profile;
+    CBLE_LOGI("[LINK] Link profile %d, applied on next connection", profile);
+}
+
+// Requests per profile (intervals in 1.25 ms units, timeouts in 10 ms units)
+const ChunkedBLEProtocol::LinkProfileSettings& ChunkedBLEProtocol::profileSettings(LinkProfile profile) {
+    static const LinkProfileSettings settings[] = {
+        { {   0,   0, 0,   0 }, {   0,   0, 0,   0 }, false, 0 },                       // NONE
+        { {   6,  12, 0, 400 }, {  80, 160, 4, 600 }, true, PREFERRED_DATA_LENGTH },   // THROUGHPUT
+        { {  12,  24, 0, 400 }, {  80, 160, 4, 600 }, true, PREFERRED_DATA_LENGTH },   // BALANCED
+        { {  40,  80, 0, 600 }, { 160, 320, 4, 600 }, false, 0 },                      // LOW_POWER
+    };
+    return settings[profile <= LINK_PROFILE_LOW_POWER ? profile : LINK_PROFILE_NONE];
+}
+
+// Request the profile's fast link from the central that just connected
+void ChunkedBLEProtocol::Session::applyLinkProfile(const LinkParameters& connected) {
+    linkParameters = connected;
+    CBLE_LOGD("[LINK] Connected at interval %d x 1.25 ms, latency %d, timeout %d x 10 ms",
+        linkParameters.connInterval, linkParameters.connLatency, linkParameters.supervisionTimeout);
+    if (protocol.linkProfile == LINK_PROFILE_NONE) {
+        return;
+    }
+    
+    const LinkProfileSettings& settings = profileSettings(protocol.linkProfile);
+    requestConnectionParams(settings.active);
+#if CHUNKED_BLE_NIMBLE
+    // NimBLE reports no data length change, the link keeps the requested values unconfirmed
+    if (settings.dataLength && ble_gap_set_data_len(connId, settings.dataLength,
+            (settings.dataLength + LL_PACKET_OVERHEAD) * 8) != 0) {
+        CBLE_LOGW("[LINK] Data length request failed");
+    }
+    if (settings.phy2M && ble_gap_set_prefered_le_phy(connId, BLE_GAP_LE_PHY_2M_MASK,
+            BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY) != 0) {
+        CBLE_LOGW("[LINK] 2M PHY request failed");
+    }
+#else
+    if (settings.dataLength) {
+        // Its completion event does not name the peer
+        protocol.dataLengthSession = this;
+        if (esp_ble_gap_set_pkt_data_len(peerAddress, settings.dataLength) != ESP_OK) {
+            CBLE_LOGW("[LINK] Data length request failed");
+        }
+    }
+#if defined(CONFIG_BT_BLE_50_FEATURES_SUPPORTED)
+    if (settings.phy2M && esp_ble_gap_set_preferred_phy(peerAddress, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK,
+            ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF) != ESP_OK) {
+        CBLE_LOGW("[LINK] 2M PHY request failed");
+    }
+#endif
+#endif
+    
+    lastLinkActivity = millis();
+    xTimerChangePeriod(linkIdleTimer, pdMS_TO_TICKS(LINK_IDLE_TIMEOUT_MS), 0);
+}
+
+// Ask the central for new connection parameters
+void ChunkedBLEProtocol::Session::requestConnectionParams(const ConnectionParams& params) {
+#if CHUNKED_BLE_NIMBLE
+    protocol.bleServer->updateConnParams(connId, params.minInterval, params.maxInterval, params.latency, params.timeout);
+#else
+    protocol.bleServer->updateConnParams(peerAddress, params.minInterval, params.maxInterval, params.latency, params.timeout);
+#endif
+    CBLE_LOGD("[LINK] Requested interval %d-%d x 1.25 ms, latency %d", 
+        params.minInterval, params.maxInterval, params.latency);
+}
+
+// Record a frame in either direction and wake an idle link
+void ChunkedBLEProtocol::Session::noteLinkActivity() {
+    lastLinkActivity = millis();
+    if (linkParameters.idle) {
+        linkParameters.idle = false;
+        requestConnectionParams(profileSettings(protocol.linkProfile).active);
+        xTimerChangePeriod(linkIdleTimer, pdMS_TO_TICKS(LINK_IDLE_TIMEOUT_MS), 0);
+    }
+}
+
+// Static timer callback, runs in the FreeRTOS timer task
+void ChunkedBLEProtocol::Session::linkIdleTimerEntry(TimerHandle_t timer) {
+    static_cast<Session*>(pvTimerGetTimerID(timer))->handleLinkIdleTimer();
+}
+
+// Relax the link once no frame went either way for LINK_IDLE_TIMEOUT_MS
+void ChunkedBLEProtocol::Session::handleLinkIdleTimer() {
+    if (!isConnected || protocol.linkProfile == LINK_PROFILE_NONE) {
+        return;
+    }
+    uint32_t quiet = millis() - lastLinkActivity;
+    if (quiet < LINK_IDLE_TIMEOUT_MS) {
+        // Frames kept flowing - check again when the latest one has been quiet long enough
+        xTimerChangePeriod(linkIdleTimer, pdMS_TO_TICKS(LINK_IDLE_TIMEOUT_MS - quiet + 1), 0);
+        return;
+    }
+    linkParameters.idle = true;
+    requestConnectionParams(profileSettings(protocol.linkProfile).idle);
+    CBLE_LOGD("[LINK] Idle for %u ms, relaxing the link", quiet);
+}
+
+#if CHUNKED_BLE_NIMBLE
+// Static GAP event listener for the link parameters the central agreed to
+int ChunkedBLEProtocol::gapEventHandler(struct ble_gap_event* event, void* arg) {
+    (void)arg;
+    if (instance) {
+        instance->handleGapEvent(event);
+    }
+    return 0;
+}
+
+// Record link parameter updates in the session of the connection they belong to
+void ChunkedBLEProtocol::handleGapEvent(struct ble_gap_event* event) {
+    Session* session;
+    struct ble_gap_conn_desc desc;
+    switch (event->type) {
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            session = findSession(event->conn_update.conn_handle);
+            if (session && event->conn_update.status == 0 &&
+                ble_gap_conn_find(event->conn_update.conn_handle, &desc) == 0) {
+                LinkParameters& link = session->linkParameters;
+                link.connInterval = desc.conn_itvl;
+                link.connLatency = desc.conn_latency;
+                link.supervisionTimeout = desc.supervision_timeout;
+                CBLE_LOGI("[LINK] Client %d: connection interval %d x 1.25 ms, latency %d, timeout %d x 10 ms",
+                    session->connId, link.connInterval, link.connLatency, link.supervisionTimeout);
+            }
+            break;
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            session = findSession(event->phy_updated.conn_handle);
+            if (session && event->phy_updated.status == 0) {
+                LinkParameters& link = session->linkParameters;
+                link.txPhy = event->phy_updated.tx_phy;
+                link.rxPhy = event->phy_updated.rx_phy;
+                CBLE_LOGI("[LINK] Client %d: PHY %d TX, %d RX (1 = 1M, 2 = 2M, 3 = Coded)", 
+                    session->connId, link.txPhy, link.rxPhy);
+            }
+            break;
+        default:
+            break;
+    }
+}
+#else
+// Static GAP event hook for the link parameters the central agreed to
+void ChunkedBLEProtocol::gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    if (instance) {
+        instance->handleGapEvent(event, param);
+    }
+}
+
+// Record link parameter updates in the session of the peer they belong to
+void ChunkedBLEProtocol::handleGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param) {
+    Session* session;
+    switch (event) {
+        case ESP_GAP_BLE_UPDATE_CONN_PARAMS_EVT:
+            session = findSession(param->update_conn_params.bda);
+            if (session && param->update_conn_params.status == 0) {
+                LinkParameters& link = session->linkParameters;
+                link.connInterval = param->update_conn_params.conn_int;
+                link.connLatency = param->update_conn_params.latency;
+                link.supervisionTimeout = param->update_conn_params.timeout;
+                CBLE_LOGI("[LINK] Client %d: connection interval %d x 1.25 ms, latency %d, timeout %d x 10 ms",
+                    session->connId, link.connInterval, link.connLatency, link.supervisionTimeout);
+            }
+            break;
+        case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
+            session = dataLengthSession;
+            if (session && session->isConnected && param->pkt_data_lenth_cmpl.status == 0) {
+                LinkParameters& link = session->linkParameters;
+                link.txDataLength = param->pkt_data_lenth_cmpl.params.tx_len;
+                link.rxDataLength = param->pkt_data_lenth_cmpl.params.rx_len;
+                CBLE_LOGI("[LINK] Client %d: data length %d bytes TX, %d bytes RX", 
+                    session->connId, link.txDataLength, link.rxDataLength);
+            }
+            break;
+#if defined(CONFIG_BT_BLE_50_FEATURES_SUPPORTED)
+        case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+            session = findSession(param->phy_update.bda);
+            if (session && param->phy_update.status == 0) {
+                LinkParameters& link = session->linkParameters;
+                link.txPhy = param->phy_update.tx_phy;
+                link.rxPhy = param->phy_update.rx_phy;
+                CBLE_LOGI("[LINK] Client %d: PHY %d TX, %d RX (1 = 1M, 2 = 2M, 3 = Coded)", 
+                    session->connId, link.txPhy, link.rxPhy);
+            }
+            break;
+#endif
+        default:
+            break;
+    }
 }
+#endif
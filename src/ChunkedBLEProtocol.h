@@ -2,13 +2,51 @@
 #define CHUNKED_BLE_PROTOCOL_H
 
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include <BLEUtils.h>
-#include <BLE2902.h>
+#include "BLEStack.h"
+#include <freertos/semphr.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
 #include <vector>
 #include <string>
 #include <functional>
+#include <stdarg.h>
+#include "LZSS.h"
+#include "ChunkAssembler.h"
+#include "SendSource.h"
+
+class PacketRing;
+class BLETransport;
+class GattTransport;
+
+// Log levels for -DCHUNKED_BLE_LOG_LEVEL=... in platformio.ini build_flags
+#define CHUNKED_BLE_LOG_NONE  0
+#define CHUNKED_BLE_LOG_ERROR 1
+#define CHUNKED_BLE_LOG_WARN  2
+#define CHUNKED_BLE_LOG_INFO  3   // Connection and transfer lifecycle
+#define CHUNKED_BLE_LOG_DEBUG 4   // Per transfer and per round details
+#define CHUNKED_BLE_LOG_TRACE 5   // Per chunk and per notify - slows transfers at 115200 baud
+
+#ifndef CHUNKED_BLE_LOG_LEVEL
+#define CHUNKED_BLE_LOG_LEVEL CHUNKED_BLE_LOG_INFO
+#endif
+
+// Optional codecs, -DCHUNKED_BLE_<NAME>=0 builds one out. It is then never announced in HELLO,
+// so peers do not use it, and nothing calls its code (--gc-sections leaves it out of the binary).
+#ifndef CHUNKED_BLE_COMPRESSION
+#define CHUNKED_BLE_COMPRESSION 1   // LZSS, FEATURE_COMPRESSION
+#endif
+#ifndef CHUNKED_BLE_CBOR
+#define CHUNKED_BLE_CBOR 1          // JSON as CBOR, FEATURE_EXT_CONTENT_TYPE (which delta receives need)
+#endif
+#ifndef CHUNKED_BLE_DELTA
+#define CHUNKED_BLE_DELTA 1         // Patches against the last payload, FEATURE_EXT_DELTA
+#endif
+
+// Default limit for buffered transfers, setTransferLimits() changes it at runtime
+#ifndef CHUNKED_BLE_MAX_TOTAL_DATA_SIZE
+#define CHUNKED_BLE_MAX_TOTAL_DATA_SIZE (64 * 1024)
+#endif
 
 /**
  * ChunkedBLEProtocol - Simplified BLE Chunked Data Transfer Protocol
@@ -24,93 +62,914 @@
  */
 class ChunkedBLEProtocol {
 public:
+    enum LogLevel {
+        LEVEL_ERROR = CHUNKED_BLE_LOG_ERROR,
+        LEVEL_WARN = CHUNKED_BLE_LOG_WARN,
+        LEVEL_INFO = CHUNKED_BLE_LOG_INFO,
+        LEVEL_DEBUG = CHUNKED_BLE_LOG_DEBUG,
+        LEVEL_TRACE = CHUNKED_BLE_LOG_TRACE
+    };
+    
     // Callback types
     typedef std::function<void(const std::string& data)> DataReceivedCallback;
     typedef std::function<void(bool connected)> ConnectionCallback;
     typedef std::function<void(int currentChunk, int totalChunks, bool isReceiving)> ProgressCallback;
+    typedef std::function<void(const uint8_t* data, size_t length, size_t offset)> StreamDataCallback;
+    typedef std::function<void(bool success, size_t totalLength)> StreamCompleteCallback;
+    typedef std::function<void(uint32_t messageId, bool success)> SendCompleteCallback;
+    typedef std::function<void(LogLevel level, const char* message)> LogSink;
+    
+    // Callback types naming the client (conn_id) in multi-client mode
+    typedef std::function<void(uint16_t connId, const std::string& data)> SessionDataReceivedCallback;
+    typedef std::function<void(uint16_t connId, bool connected)> SessionConnectionCallback;
+    typedef std::function<void(uint16_t connId, const uint8_t* data, size_t length, size_t offset)> SessionStreamDataCallback;
+    typedef std::function<void(uint16_t connId, bool success, size_t totalLength)> SessionStreamCompleteCallback;
+    
+    // Callback types naming the client and the logical channel a transfer arrived on
+    typedef std::function<void(uint16_t connId, uint8_t channel, const std::string& data)> ChannelDataReceivedCallback;
+    typedef std::function<void(uint16_t connId, uint8_t channel, const uint8_t* data, size_t length,
+                               size_t offset)> ChannelStreamDataCallback;
+    typedef std::function<void(uint16_t connId, uint8_t channel, bool success,
+                               size_t totalLength)> ChannelStreamCompleteCallback;
     
     // Constants - Enhanced with dual CRC32 validation  
-    static const size_t HEADER_SIZE = 13;  // chunk_num(2) + total_chunks(2) + data_size(1) + chunk_crc32(4) + global_crc32(4)
-    static const size_t CHUNK_SIZE = 172;  // MTU(185) - HEADER_SIZE(13)
-    static const size_t MTU_SIZE = 185;
+    static const size_t HEADER_SIZE = 14;  // chunk_num(2) + total_chunks(2) + data_size(2) + chunk_crc32(4) + global_crc32(4)
+    static const size_t ATT_HEADER_SIZE = 3;       // ATT opcode(1) + attribute handle(2) in every notify/write
+    static const uint16_t DEFAULT_MTU_SIZE = 23;   // ATT MTU before (or without) MTU exchange
+    static const uint16_t PREFERRED_MTU_SIZE = 517; // Largest ATT MTU we offer to the peer
+    static const size_t MAX_CHUNK_SIZE = PREFERRED_MTU_SIZE - ATT_HEADER_SIZE - HEADER_SIZE;  // 500 bytes
+    static const size_t MAX_FRAME_SIZE = PREFERRED_MTU_SIZE - ATT_HEADER_SIZE;  // 514, frames of every transport
+    static const size_t LARGE_HEADER_SIZE = 10;    // transfer_id(2) + chunk_num(4) + chunk_crc32(4)
+    static const size_t COMPACT_HEADER_SIZE = 6;   // chunk_num(2) + chunk_crc32(4)
+    static const size_t COMPACT_HEADER_SIZE_NO_CRC = 2;  // chunk_num(2), global CRC32 only
     
     // Security and reliability limits
-    static const size_t MAX_TOTAL_DATA_SIZE = 64 * 1024;    // 64KB max transfer
-    static const size_t MAX_CHUNKS_PER_TRANSFER = 372;      // ~64KB / 172 bytes
+    static const size_t MAX_TOTAL_DATA_SIZE = CHUNKED_BLE_MAX_TOTAL_DATA_SIZE;  // Default limit for buffered transfers
+    static const size_t MAX_CHUNKS_PER_TRANSFER = 372;      // ~64KB / 172 bytes (16-bit framing)
+    static const size_t DEFAULT_MAX_STREAM_SIZE = 16 * 1024 * 1024;  // Default limit for streamed transfers
+    static const uint32_t MAX_LARGE_CHUNKS = 0x7FFFFFFF;    // Chunk counters are int
+    static const uint32_t MAX_COMPACT_CHUNKS = 0xFFFF;      // Larger transfers fall back to LargeChunkHeader
     static const uint32_t DEFAULT_CHUNK_TIMEOUT_MS = 5000;  // Default 5 seconds per chunk timeout
     
+    // Flow control
+    static const uint8_t PROTOCOL_VERSION = 2;
+    static const uint16_t DEFAULT_CREDIT_WINDOW = 8;    // Chunks the peer may send before waiting for credits
+    static const uint16_t MAX_CREDIT_WINDOW = 64;
+    static const uint32_t LEGACY_CHUNK_DELAY_MS = 100;  // Pacing for peers without flow control
+    static const uint32_t FLOW_POLL_INTERVAL_MS = 50;   // Re-check connection while waiting for credits
+    static const int NOTIFY_MAX_RETRIES = 50;           // Retries while the stack is out of buffers
+    
+    // Selective retransmission
+    static const uint8_t DEFAULT_MAX_RETRANSMIT_ROUNDS = 8;
+    static const size_t MAX_NACK_BITMAP_BYTES = 32;     // Up to 256 missing chunks per NACK
+    static const UBaseType_t REPORT_QUEUE_LENGTH = 4;
+    
+    // Streaming receive
+    static const uint16_t DEFAULT_STREAM_WINDOW = 16;   // Out-of-order chunks buffered ahead of delivery
+    static const uint16_t MAX_STREAM_WINDOW = 64;
+    static const size_t MAX_STREAM_CHUNKS = 0xFFFF;     // Limited only by the 16-bit chunk numbers
+    
+    // Asynchronous send
+    static const UBaseType_t TX_QUEUE_LENGTH = 4;       // Messages waiting for the TX task
+    static const uint32_t TX_TASK_STACK_SIZE = 4096;
+    static const UBaseType_t TX_TASK_PRIORITY = 1;
+    
+    // Receive worker
+    static const size_t DEFAULT_RX_RING_SIZE = 8 * 1024;  // Room for a full credit window of 512-byte frames
+    static const uint32_t RX_TASK_STACK_SIZE = 4096;
+    static const UBaseType_t RX_TASK_PRIORITY = 2;       // Above the TX task so credits keep flowing
+    
+    // Resumable transfers
+    static const uint32_t DEFAULT_RESUME_GRACE_MS = 30000;  // Interrupted transfers kept this long
+    
+    // Compression
+    static const size_t MIN_COMPRESSION_SIZE = 64;  // Smaller payloads are sent as they are
+    
+    // Forward error correction
+    static const uint8_t DEFAULT_FEC_GROUP_SIZE = 8;  // Data chunks per parity chunk, 12.5% overhead
+    
+    // Delta transfers
+    static const size_t DEFAULT_MAX_DELTA_BASE_SIZE = 16 * 1024;  // Largest payload kept per channel and direction
+    
+    // Link tuning
+    static const uint16_t PREFERRED_DATA_LENGTH = 251;  // Largest LE Data Length Extension payload
+    static const uint16_t LL_PACKET_OVERHEAD = 14;      // Preamble, access address, header, MIC and CRC bytes
+    static const size_t BLE_ADDRESS_LENGTH = 6;
+    static const uint32_t LINK_IDLE_TIMEOUT_MS = 2000;  // Without frames this long the link relaxes
+    
+    // Multiple clients
+    static const uint8_t MAX_SESSIONS = 9;              // Bluedroid's limit for CONFIG_BT_ACL_CONNECTIONS
+    
+    // Logical channels multiplexed over the characteristic, channel 0 has the highest priority
+    static const uint8_t MAX_CHANNELS = 4;
+    static const uint8_t DEFAULT_CHANNEL = 1;           // Used by sends that name no channel and by older peers
+    
+    // Transports
+    static const uint16_t DEFAULT_L2CAP_PSM = 0x0080;   // First dynamic LE PSM
+    
+    // Diagnostics
+    static const uint8_t GAP_HISTOGRAM_BUCKETS = 8;     // [0] < 1 ms, [i] < 2^i ms, [7] >= 64 ms
+    static const uint8_t TRANSFER_HISTORY_LENGTH = 8;   // Finished transfers kept per session
+    static const uint8_t DIAGNOSTICS_VERSION = 2;       // Layout of DiagnosticsValue
+    
     // Default UUIDs (can be customized via constructor)
     static const char* DEFAULT_SERVICE_UUID;
     static const char* DEFAULT_CHAR_UUID;
+    static const char* DEFAULT_DIAGNOSTICS_UUID;         // Read-only, in the same service
     
     // Enhanced chunk header structure with dual CRC32 validation
     struct ChunkHeader {
         uint16_t chunk_num;      // Current chunk number (1-based)
         uint16_t total_chunks;   // Total number of chunks
-        uint8_t data_size;       // Size of data in this chunk
+        uint16_t data_size;      // Size of data in this chunk
         uint32_t chunk_crc32;    // CRC32 of chunk data
         uint32_t global_crc32;   // CRC32 of entire file (same in all chunks)
     } __attribute__((packed));
     
+    // Control frames share the characteristic with data chunks.
+    // Data chunks are numbered from 1, so a leading chunk_num of 0 marks a control frame.
+    enum FrameType : uint8_t {
+        FRAME_HELLO = 0x01,   // Capability exchange, carries the initial credit window
+        FRAME_CREDIT = 0x02,  // Additional send credits granted by the receiver
+        FRAME_ACK = 0x03,     // Receiver finished the transfer (see AckStatus)
+        FRAME_NACK = 0x04,    // Bitmap of chunks the receiver is still missing
+        FRAME_OPEN = 0x05,    // Starts a large transfer (FEATURE_LARGE)
+        FRAME_NACK_LARGE = 0x06, // FRAME_NACK with a 32-bit base chunk number
+        FRAME_RESUME = 0x07,  // FRAME_OPEN of an interrupted transfer, answered by FRAME_RESUME_POINT
+        FRAME_RESUME_POINT = 0x08, // Chunk the sender continues from
+        FRAME_TRANSPORT = 0x09  // Device offers a faster transport, peers that cannot use it ignore it
+    };
+    
+    // Transports a connection's frames can travel over
+    enum TransportKind : uint8_t {
+        TRANSPORT_GATT = 0,       // Notifications and writes of the protocol characteristic
+        TRANSPORT_L2CAP_COC = 1   // LE Credit Based channel, one frame per SDU
+    };
+    
+    // Feature bits announced in FRAME_HELLO
+    enum FeatureFlags : uint8_t {
+        FEATURE_CREDITS = 0x01,
+        FEATURE_SACK = 0x02,      // Receiver reports ACK/NACK, sender retransmits missing chunks
+        FEATURE_STREAMING = 0x04, // Receiver does not buffer whole transfers, MAX_TOTAL_DATA_SIZE does not apply
+        FEATURE_LARGE = 0x08,     // FRAME_OPEN + LargeChunkHeader framing with 32-bit chunk numbers
+        FEATURE_RESUME = 0x10,    // Interrupted large transfers survive a disconnect (FRAME_RESUME)
+        FEATURE_COMPACT = 0x20,   // Receiver accepts compact data frames (OPEN_FLAG_COMPACT)
+        FEATURE_COMPRESSION = 0x40, // Receiver inflates LZSS payloads (OPEN_FLAG_COMPRESSED)
+        FEATURE_MULTIPLEX = 0x80    // One transfer per channel in flight at once (needs FEATURE_LARGE)
+    };
+    
+    // Second feature byte, appended to FRAME_HELLO; older peers neither send nor read it
+    enum ExtendedFeatureFlags : uint8_t {
+        FEATURE_EXT_FEC = 0x01,     // Receiver rebuilds lost chunks from parity chunks (OPEN_FLAG_FEC)
+        FEATURE_EXT_CONTENT_TYPE = 0x02, // Receiver reads the content type of OPEN (OPEN_FLAG_CONTENT_TYPE)
+        FEATURE_EXT_DELTA = 0x04    // Receiver keeps each channel's last payload as a delta base (CONTENT_FLAG_DELTA)
+    };
+    
+    // Framing of the data frames that follow a FRAME_OPEN
+    enum OpenFlags : uint8_t {
+        OPEN_FLAG_COMPACT = 0x01,       // chunk_num(2) [+ chunk_crc32(4)] instead of LargeChunkHeader
+        OPEN_FLAG_NO_CHUNK_CRC = 0x02,  // Compact frames without chunk_crc32, only the global CRC32 is checked
+        OPEN_FLAG_COMPRESSED = 0x04,    // Payload is an LZSS stream; length and CRC32s describe the stream
+        OPEN_FLAG_TAGGED = 0x08,        // Compact frames start with transfer_id(2) (FEATURE_MULTIPLEX)
+        OPEN_FLAG_CHANNEL_MASK = 0x30,  // Channel of the transfer (FEATURE_MULTIPLEX), see OPEN_CHANNEL_SHIFT
+        OPEN_FLAG_FEC = 0x40,           // Parity chunks follow the data chunks, see OpenFrame (FEATURE_EXT_FEC)
+        OPEN_FLAG_CONTENT_TYPE = 0x80   // content_type(1) follows OpenFrame (FEATURE_EXT_CONTENT_TYPE)
+    };
+    static const uint8_t OPEN_CHANNEL_SHIFT = 4;
+    
+    // What a transfer's payload is, announced with OPEN_FLAG_CONTENT_TYPE
+    enum ContentType : uint8_t {
+        CONTENT_TYPE_NONE = 0,     // Not announced - application-defined bytes
+        CONTENT_TYPE_JSON = 1,     // UTF-8 JSON text
+        CONTENT_TYPE_CBOR = 2      // RFC 8949 CBOR, see CBOR.h
+    };
+    static const uint8_t CONTENT_FLAG_DELTA = 0x80;  // In content_type: the payload is a Delta patch, see OpenFrame
+    
+    enum AckStatus : uint8_t {
+        ACK_STATUS_OK = 0,                 // Complete data delivered
+        ACK_STATUS_GLOBAL_CRC_FAILED = 1,  // All chunks arrived but the assembled data is corrupt
+        ACK_STATUS_REJECTED = 2,           // Transfer violates receiver limits
+        ACK_STATUS_DELTA_BASE_MISSING = 3  // Delta against a payload the receiver does not hold, send it whole
+    };
+    
+    enum FlowControlMode {
+        FLOW_CONTROL_NONE,     // Fixed LEGACY_CHUNK_DELAY_MS between chunks
+        FLOW_CONTROL_CREDITS   // Receiver-granted credit window, falls back to NONE for old peers
+    };
+    
+    struct ControlHeader {
+        uint16_t marker;         // Always 0
+        uint8_t type;            // FrameType
+    } __attribute__((packed));
+    
+    // Sent by the client after subscribing; the device answers with its own HELLO
+    struct HelloFrame {
+        ControlHeader header;
+        uint8_t version;         // PROTOCOL_VERSION
+        uint8_t features;        // FeatureFlags supported and enabled by the sender
+        uint16_t window;         // Initial credits granted to the other side
+    } __attribute__((packed));
+    
+    // HELLO as we send it; peers read the extension only when the frame is long enough
+    struct ExtendedHelloFrame {
+        HelloFrame hello;
+        uint8_t extended_features;  // ExtendedFeatureFlags
+    } __attribute__((packed));
+    
+    struct CreditFrame {
+        ControlHeader header;
+        uint16_t credits;        // Number of additional chunks the other side may send
+    } __attribute__((packed));
+    
+    // With FEATURE_MULTIPLEX followed by the transfer_id(2) of the transfer, and NACK frames
+    // carry it between the frame and the bitmap, so equal payloads on two channels are told apart
+    struct AckFrame {
+        ControlHeader header;
+        uint32_t global_crc32;   // Identifies the transfer
+        uint8_t status;          // AckStatus
+    } __attribute__((packed));
+    
+    // Followed by a bitmap: bit i (LSB first) set means chunk base + i is missing
+    struct NackFrame {
+        ControlHeader header;
+        uint32_t global_crc32;   // Identifies the transfer
+        uint16_t base;           // First missing chunk number
+    } __attribute__((packed));
+    
+    // NACK of a large transfer, followed by the same bitmap as NackFrame
+    struct LargeNackFrame {
+        ControlHeader header;
+        uint32_t global_crc32;
+        uint32_t base;
+    } __attribute__((packed));
+    
+    // Sent before the first chunk of every transfer when both sides announce FEATURE_LARGE.
+    // Total length, chunk count and global CRC32 travel once here instead of in every chunk.
+    // With OPEN_FLAG_FEC it is followed by fec_group(1): parity chunk g (chunk number
+    // total_chunks + g + 1) is the XOR of data chunks g * fec_group + 1 .. (g + 1) * fec_group.
+    // With OPEN_FLAG_CONTENT_TYPE content_type(1) comes next, a ContentType. With CONTENT_FLAG_DELTA
+    // set in it base_crc32(4) + result_crc32(4) follow: the payload (after inflating) is a Delta patch
+    // against the channel's last payload, base_crc32 names that payload, result_crc32 the rebuilt one.
+    struct OpenFrame {
+        ControlHeader header;
+        uint16_t transfer_id;    // Non-zero, repeated in every data frame of the transfer
+        uint32_t global_crc32;   // CRC32 of the complete data
+        uint32_t total_length;   // Payload length in bytes
+        uint16_t chunk_size;     // Data bytes per chunk, only the last chunk may be shorter
+        uint8_t flags;           // OpenFlags, with the channel in OPEN_FLAG_CHANNEL_MASK
+    } __attribute__((packed));
+    
+    // Fields after OpenFrame, present as its flags say
+    struct OpenTrailer {
+        uint8_t fecGroup;        // OPEN_FLAG_FEC, else 0
+        uint8_t contentType;     // OPEN_FLAG_CONTENT_TYPE, else CONTENT_TYPE_NONE
+        uint32_t baseCRC32;      // CONTENT_FLAG_DELTA, else 0
+        uint32_t resultCRC32;
+    };
+    
+    // Sent by the device after its HELLO. A client that opens the channel gets all further
+    // frames over it; frames already sent over GATT are still accepted.
+    struct TransportFrame {
+        ControlHeader header;
+        uint8_t transport;       // TransportKind
+        uint16_t psm;            // L2CAP PSM to connect to
+        uint16_t mtu;            // Largest SDU the device accepts
+    } __attribute__((packed));
+    
+    // Answer to FRAME_RESUME: every chunk before next_chunk that the receiver still misses
+    // is reported by the usual NACK at the end of the round
+    struct ResumePointFrame {
+        ControlHeader header;
+        uint16_t transfer_id;
+        uint32_t global_crc32;
+        uint32_t next_chunk;     // One past the highest chunk held, 1 if the transfer starts over
+    } __attribute__((packed));
+    
+    // Data frame header of a large transfer; the data size follows from the frame length
+    struct LargeChunkHeader {
+        uint16_t transfer_id;    // OpenFrame::transfer_id, never 0 so it cannot look like a control frame
+        uint32_t chunk_num;      // 1-based
+        uint32_t chunk_crc32;
+    } __attribute__((packed));
+    
+    // Connection parameter, PHY and data length requests applied on connect
+    enum LinkProfile {
+        LINK_PROFILE_NONE,         // Leave everything to the central
+        LINK_PROFILE_THROUGHPUT,   // 7.5-15 ms while busy, 2M PHY, 251-byte DLE
+        LINK_PROFILE_BALANCED,     // 15-30 ms while busy, 2M PHY, 251-byte DLE
+        LINK_PROFILE_LOW_POWER     // 50-100 ms while busy, PHY and data length left alone
+    };
+    
+    // Link parameters reported by the stack for the current connection, 0 until known
+    struct LinkParameters {
+        uint16_t connInterval = 0;       // 1.25 ms units
+        uint16_t connLatency = 0;        // Connection events the peripheral may skip
+        uint16_t supervisionTimeout = 0; // 10 ms units
+        uint8_t txPhy = 0;               // 1 = 1M, 2 = 2M, 3 = Coded
+        uint8_t rxPhy = 0;
+        uint16_t txDataLength = 0;       // Link-layer payload bytes, 27 without DLE
+        uint16_t rxDataLength = 0;
+        bool idle = false;               // Relaxed to the profile's idle interval
+    };
+    
+    // One finished transfer, either direction; timestamps are micros()
+    struct TransferRecord {
+        uint32_t startUs = 0;            // Transfer started (first chunk, or FRAME_OPEN)
+        uint32_t endUs = 0;              // Acknowledged, delivered or given up
+        uint32_t bytes = 0;              // Payload bytes, uncompressed; on failure received so far
+        uint32_t chunks = 0;             // Data frames, retransmissions included
+        uint32_t retransmissions = 0;    // Frames sent again, or received again or corrupt
+        uint32_t bytesPerSecond = 0;     // bytes over endUs - startUs
+        uint16_t mtu = 0;                // ATT MTU at the end of the transfer
+        uint16_t connInterval = 0;       // 1.25 ms units, 0 if never reported
+        uint8_t txPhy = 0;               // 1 = 1M, 2 = 2M, 3 = Coded, 0 if never reported
+        uint8_t rxPhy = 0;
+        uint8_t channel = 0;
+        bool sent = false;               // false for received transfers
+        bool success = false;
+    };
+    
     // Transfer statistics and diagnostics
     struct TransferStats {
         uint32_t totalDataSent = 0;
         uint32_t totalDataReceived = 0;
         uint32_t chunksReceived = 0;
         uint32_t crcErrors = 0;
-        uint32_t timeouts = 0;
+        uint32_t timeouts = 0;           // Chunk and credit waits that ran out
         uint32_t transfersCompleted = 0;
-        uint32_t lastTransferTime = 0;
+        uint32_t lastTransferTime = 0;   // Duration in ms of the last received transfer that completed
+        uint32_t retransmissions = 0;
+        uint32_t rxDropped = 0;          // Data frames lost to a full receive ring
+        uint32_t compressionSaved = 0;   // Payload bytes compression kept off the air, both directions
+        uint32_t chunksSent = 0;         // Data frames sent, retransmissions included
+        uint32_t sendAllocations = 0;    // Heap allocations of the send path - none per chunk once warmed up
+        uint32_t paritySent = 0;         // FEC parity chunks sent, also counted in chunksSent
+        uint32_t fecRecovered = 0;       // Received chunks rebuilt from parity instead of retransmitted
+        uint32_t deltaSaved = 0;         // Payload bytes delta transfers kept off the air, both directions
+        
+        // Error causes
+        uint32_t sizeRejections = 0;     // Received transfers over the size or chunk count limits
+        uint32_t cancellations = 0;      // Received transfers abandoned before delivery, any cause
+        uint32_t sendFailures = 0;       // Sent transfers that were not acknowledged
+        
+        // Time per stage in microseconds
+        uint32_t crcTimeUs = 0;          // CRC32 of chunks, both directions
+        uint32_t reassemblyTimeUs = 0;   // Storing received chunks and inflating them
+        uint32_t callbackTimeUs = 0;     // Data and stream callbacks of the application
+        
+        // Time between consecutive data frames of one transfer, see GAP_HISTOGRAM_BUCKETS
+        uint32_t rxGapHistogram[GAP_HISTOGRAM_BUCKETS] = {};
+        uint32_t txGapHistogram[GAP_HISTOGRAM_BUCKETS] = {};
+        
+        TransferRecord lastSent;
+        TransferRecord lastReceived;
+        LinkParameters link;             // Filled in by getStatistics(), not cleared by resetStatistics()
     };
+    
+    // Diagnostics characteristic, one transfer record
+    struct DiagnosticsTransfer {
+        uint32_t start_us;
+        uint32_t duration_us;
+        uint32_t bytes;
+        uint32_t chunks;
+        uint32_t retransmissions;
+        uint32_t bytes_per_second;
+        uint16_t mtu;
+        uint16_t conn_interval;  // 1.25 ms units
+        uint8_t phy;             // tx_phy | rx_phy << 4
+        uint8_t channel;
+        uint8_t flags;           // 1 = sent, 2 = success
+    } __attribute__((packed));
+    
+    // Value of the diagnostics characteristic: the reading client's statistics, little-endian
+    struct DiagnosticsValue {
+        uint8_t version;         // DIAGNOSTICS_VERSION
+        uint32_t uptime_ms;
+        uint32_t total_data_sent;
+        uint32_t total_data_received;
+        uint32_t chunks_sent;
+        uint32_t chunks_received;
+        uint32_t transfers_completed;
+        uint32_t retransmissions;
+        uint32_t crc_errors;
+        uint32_t timeouts;
+        uint32_t size_rejections;
+        uint32_t cancellations;
+        uint32_t send_failures;
+        uint32_t rx_dropped;
+        uint32_t compression_saved;
+        uint32_t crc_time_us;
+        uint32_t reassembly_time_us;
+        uint32_t callback_time_us;
+        uint32_t parity_sent;    // Since version 2
+        uint32_t fec_recovered;
+        uint32_t delta_saved;
+        uint32_t rx_gaps[GAP_HISTOGRAM_BUCKETS];
+        uint32_t tx_gaps[GAP_HISTOGRAM_BUCKETS];
+        uint16_t mtu;
+        uint16_t conn_interval;
+        uint8_t tx_phy;
+        uint8_t rx_phy;
+        DiagnosticsTransfer last_sent;
+        DiagnosticsTransfer last_received;
+    } __attribute__((packed));
 
 private:
+    class Session;
+    class Channel;
+    
+    // Outgoing data for one transfer, kept until the receiver acknowledges it
+    struct OutboundTransfer {
+        const uint8_t* data;             // Whole payload, nullptr when read from source
+        SendSource* source;
+        size_t size;
+        size_t chunkSize;
+        size_t headerSize;               // Chunk header of the framing in use, data follows it in frame
+        uint32_t totalChunks;
+        uint32_t globalCRC32;
+        uint16_t transferId;             // Non-zero when sent with large framing
+        uint8_t openFlags;               // OpenFlags announced in FRAME_OPEN
+        uint8_t channel;
+        uint32_t* chunkCRCs;             // In the channel's table, computed once (nullptr for sources)
+        uint8_t* frame;                  // Channel's TX frame buffer, each chunk is built in place
+        uint8_t fecGroup;                // Data chunks per parity chunk, 0 without OPEN_FLAG_FEC
+        uint8_t* parity;                 // Channel's parity buffer, chunkSize bytes (nullptr without FEC)
+        uint8_t contentType;             // ContentType announced with OPEN_FLAG_CONTENT_TYPE, CONTENT_FLAG_DELTA included
+        uint32_t baseCRC32;              // Delta base and result, with CONTENT_FLAG_DELTA
+        uint32_t resultCRC32;
+        bool useCredits;
+    };
+    
+    // ACK, NACK or resume point received from the peer, queued for the sending task
+    struct ReceiveReport {
+        uint8_t type;            // FRAME_ACK, FRAME_NACK (also for FRAME_NACK_LARGE) or FRAME_RESUME_POINT
+        uint8_t status;          // AckStatus (ACK only)
+        uint32_t globalCRC32;
+        uint16_t transferId;     // 0 unless the peer multiplexes (always set for resume points)
+        uint32_t base;           // First missing chunk (NACK), next chunk to send (resume point)
+        uint8_t bitmapLength;
+        uint8_t bitmap[MAX_NACK_BITMAP_BYTES];
+    };
+    
+    // Chunk header fields in host form, parsed from ChunkHeader or LargeChunkHeader
+    struct ChunkInfo {
+        int chunkNum;            // 1-based
+        size_t dataSize;
+        uint32_t chunkCRC32;
+    };
+    
+    // Large transfer that failed before the receiver confirmed it, offered for resumption
+    struct InterruptedSend {
+        uint16_t transferId;     // 0 if none
+        uint32_t globalCRC32;
+        size_t size;
+        size_t chunkSize;
+        uint32_t time;           // millis() when the send failed
+    };
+    
+    // Connection parameter request, intervals in 1.25 ms units, timeout in 10 ms units
+    struct ConnectionParams {
+        uint16_t minInterval;
+        uint16_t maxInterval;
+        uint16_t latency;
+        uint16_t timeout;
+    };
+    
+    // What a LinkProfile requests
+    struct LinkProfileSettings {
+        ConnectionParams active;         // While frames are flowing
+        ConnectionParams idle;           // After LINK_IDLE_TIMEOUT_MS without frames
+        bool phy2M;                      // Prefer LE 2M PHY in both directions
+        uint16_t dataLength;             // Requested DLE payload, 0 to leave it alone
+    };
+    
+    // Message queued by sendDataAsync(), owned by the channel's TX task once queued
+    struct PendingSend {
+        uint32_t id;
+        uint32_t generation;             // Session::generation it was queued for
+        std::string data;
+        bool json;                       // Queued by sendJSONAsync(), encoded per peer when sent
+        SendCompleteCallback onComplete;
+    };
+    
     // Forward declarations for internal callback classes
     class ProtocolCharacteristicCallbacks;
+    class ProtocolDiagnosticsCallbacks;
+    class ProtocolTransportCallbacks;
     class ProtocolServerCallbacks;
     
+    /**
+     * Channel - One logical channel of a session
+     * 
+     * Each channel reassembles its own inbound transfer and runs its own outbound one,
+     * so a transfer on one channel never waits for another channel's to finish. Data
+     * frames of concurrent outbound transfers are scheduled by channel priority.
+     */
+    class Channel {
+    public:
+        Session& session;
+        ChunkedBLEProtocol& protocol;
+        const uint8_t id;                    // Channel number, 0 has the highest priority
+        const size_t bufferSize;             // Receive buffer capacity kept between transfers
+        
+        // Receive state
+        ChunkAssembler assembler;        // Chunks of the inbound transfer, windowed when streaming
+        uint32_t lastChunkTime;
+        bool transferInProgress;
+        uint32_t expectedGlobalCRC32;  // Expected global CRC32 from first chunk
+        
+        // Selective retransmission state
+        int reportPoint;                 // Chunk number that triggers the next ACK/NACK
+        uint32_t lastCompletedCRC32;     // Recognizes retransmissions of an already delivered transfer
+        
+        // Streaming receive state - the assembler keeps a window of streamWindow chunks
+        bool streamingTransfer;          // Current transfer is delivered through the stream callbacks
+        
+        // Large transfer state
+        uint16_t openTransferId;         // Transfer opened by the peer's last FRAME_OPEN, 0 if none
+        uint8_t openFlags;               // Framing of that transfer's data frames
+        uint8_t fecGroup;                // Data chunks per parity chunk of that transfer, 0 without FEC
+        
+        // Resumable transfer state
+        uint16_t suspendedTransferId;    // Receive state kept across a disconnect, 0 if none
+        uint32_t suspendTime;
+        
+        // Compression state
+        bool compressedTransfer;         // Current receive carries OPEN_FLAG_COMPRESSED
+        uint8_t contentType;             // ContentType of the current (or last) receive
+#if CHUNKED_BLE_COMPRESSION
+        LZSS::Decoder streamDecoder;     // Inflates a compressed stream as it is delivered
+#endif
+        size_t streamOutputBytes;        // Bytes handed to the stream callback (after decompression)
+        
+        // Delta state - the last payload each way, kept while both ends announce FEATURE_EXT_DELTA
+        uint32_t deltaBaseCRC32;         // Base of the current receive, 0 unless it is a delta
+        uint32_t deltaResultCRC32;
+        std::string rxBase;              // Last payload received
+        uint32_t rxBaseCRC32;
+        std::string txBase;              // Last payload the receiver acknowledged
+        uint32_t txBaseCRC32;
+        uint8_t txAckStatus;             // AckStatus of the receiver's final ACK of the current send
+        
+        // Send state
+        SemaphoreHandle_t sendMutex;     // One outbound transfer per channel, sync or async
+        QueueHandle_t reportQueue;       // ReceiveReport items for the sending task
+        volatile uint32_t activeCRC32;   // Global CRC32 of the outbound transfer, routes its reports
+        volatile uint16_t activeTransferId;  // Its transfer_id, tells channels sending equal payloads apart
+        volatile bool sending;
+        InterruptedSend interruptedSend;
+        uint8_t* txFrame;                // MAX_FRAME_SIZE bytes, allocated by the first send
+        uint8_t* txParity;               // MAX_FRAME_SIZE bytes, allocated by the first send with FEC
+        std::vector<uint32_t> txChunkCRCs;  // Chunk CRC32s of the outbound transfer, capacity kept
+        SemaphoreHandle_t turn;          // Given by Session::releaseChannelTurn() when this channel may send
+        bool waitingForTurn;             // Guarded by txMutex
+        
+        // Asynchronous send state
+        QueueHandle_t txQueue;           // PendingSend* items
+        TaskHandle_t txTask;             // Started by the first sendDataAsync() to this channel
+        
+        // Instrumentation of the transfers in progress
+        TransferRecord rxRecord;
+        TransferRecord txRecord;
+        uint32_t lastRxFrameUs;
+        uint32_t lastTxFrameUs;
+        
+        Channel(Session& session, uint8_t id, size_t bufferSize);
+        ~Channel();
+        
+        // Receive path
+        void clearReceiveBuffers();
+        bool beginTransfer(int totalChunks, uint32_t globalCRC32, size_t totalLength, size_t chunkSize);
+        void acceptChunk(const ChunkInfo& chunk, const uint8_t* chunkData, bool chunkValid);
+        ChunkAssembler::StoreResult storeChunk(const ChunkInfo& chunk, const uint8_t* chunkData);
+        void deliverStreamChunk(const uint8_t* data, size_t length);
+        void finishStream(bool success);
+        void processReceivedChunk(const uint8_t* data, size_t length);
+        void processLargeChunk(const uint8_t* data, size_t length);
+        void processOpenFrame(const OpenFrame& open, const OpenTrailer& trailer);
+        bool applyDelta(std::string& receiveBuffer);
+        void keepDeltaBase(const std::string& payload);
+        void clearDeltaBases();
+        bool checkChunkTimeout();
+        void updateChunkTimer();
+        void cancelTransfer(const char* reason);
+        void updateStatistics(bool success, size_t dataSize);
+        void sendNack();
+        void rejectTransfer(const char* reason, AckStatus status);
+        
+        // Resumable transfers
+        void suspendReceive();
+        bool resumeReceive(const OpenFrame& open);
+        uint32_t resumePoint() const;
+        bool hasResumableState() const;
+        
+        // Asynchronous send
+        bool startTxTask();
+        static void txTaskEntry(void* param);
+        void txTaskLoop();
+        
+        // Target of the CBLE_LOG* macros inside this class
+        void log(LogLevel level, const char* format, ...);
+        
+    private:
+        Channel(const Channel&);
+        Channel& operator=(const Channel&);
+    };
+    
+    /**
+     * Session - Transfer state of one connected client
+     * 
+     * Everything a connection negotiates, receives and sends lives here or in its
+     * channels, so clients never see each other's chunks, credits or reports. Sessions
+     * are allocated by setMaxSessions() and reused; a reconnecting client gets back the
+     * one holding its interrupted transfers. Only ChunkedBLEProtocol uses it, so its
+     * state is open to the protocol.
+     */
+    class Session {
+    public:
+        ChunkedBLEProtocol& protocol;
+        const uint8_t index;                 // Position in ChunkedBLEProtocol::sessions
+        Channel* channels[MAX_CHANNELS];
+        
+        // Connection
+        bool isConnected;
+        uint16_t connId;                     // Valid while connected
+        uint32_t generation;                 // Incremented per connection
+        uint8_t peerAddress[BLE_ADDRESS_LENGTH];  // Central of the current or last connection
+        
+        TransferStats stats;
+        uint16_t negotiatedMTU;              // ATT MTU agreed with this client
+        
+        // Transport state
+        BLETransport* transport;             // Carries this client's frames, GATT until a CoC opens
+        uint16_t transportFrameSize;         // Frame size of an open CoC, 0 while on GATT
+        
+        // Flow control state
+        uint8_t peerFeatures;            // Features announced in the peer's HELLO
+        uint8_t peerExtendedFeatures;    // ExtendedFeatureFlags of that HELLO, 0 if it had none
+        uint16_t peerCreditWindow;       // Window the peer granted us in its HELLO
+        uint16_t creditsOwed;            // Chunks received since the last credit grant
+        SemaphoreHandle_t txCredits;     // Counting semaphore of credits granted by the peer
+        SemaphoreHandle_t congestionCleared;
+        volatile bool linkCongested;
+        volatile bool preparedWrite;     // Long write parts queued, the next onWrite() commits them (Bluedroid)
+        SemaphoreHandle_t txTurn;        // Given by releaseTxTurn() when it is this session's turn
+        bool waitingForTurn;             // Guarded by txMutex
+        Channel* channelTurnHolder;      // Channel notifying a data frame, guarded by txMutex
+        
+        // Large transfer state
+        uint16_t nextTransferId;         // Id for our next outbound large transfer, guarded by txMutex
+        
+        // Receive worker state
+        PacketRing* rxRing;              // Data frames from the BLE task, consumed by the RX task
+        
+        // Link tuning state
+        LinkParameters linkParameters;   // Written from the BLE and timer tasks
+        TimerHandle_t linkIdleTimer;     // One-shot, relaxes the link once frames stop
+        volatile uint32_t lastLinkActivity;
+        
+        // Instrumentation
+        TransferRecord history[TRANSFER_HISTORY_LENGTH];  // Ring of finished transfers, cleared with stats
+        uint8_t historyNext;
+        uint8_t historyCount;
+        
+        Session(ChunkedBLEProtocol& protocol, uint8_t index, size_t bufferSize);
+        ~Session();
+        
+        // Connection
+        void handleConnectionChange(bool connected);
+        void handleMTUChange(uint16_t mtu);
+        bool hasResumableState() const;
+        
+        // Receive path
+        void processReceivedChunk(const uint8_t* data, size_t length);
+        void processLargeChunk(const uint8_t* data, size_t length);
+        void processOpenFrame(const uint8_t* data, size_t length);
+        bool isReceiving() const;
+        void suspendReceive();
+        
+        // Enhanced private methods for security and reliability
+        size_t getChunkDataSize(size_t headerSize = HEADER_SIZE) const;
+        size_t getMaxFrameSize() const;
+        uint32_t calculateCRC32(const uint8_t* data, size_t length);
+        bool validateDataSize(size_t totalSize, bool streamed);
+        bool validateChunkHeader(const ChunkHeader& header);
+        
+        // Flow control
+        void processControlFrame(const uint8_t* data, size_t length);
+        bool peerUsesCredits() const;
+        bool sendFrame(const uint8_t* data, size_t length);
+        bool sendControlFrame(const uint8_t* data, size_t length);
+        void sendHello();
+        void sendTransportOffer();
+        void grantCredits(uint16_t credits);
+        void resetSendCredits(uint16_t credits);
+        void resyncSendCredits(Channel& channel);
+        bool otherChannelSending(const Channel& channel) const;
+        void releaseReceiveCredit();
+        bool waitForCredit();
+        bool waitForLinkReady();
+        void handleCongestion(bool congested);
+        
+        // Selective retransmission
+        bool peerUsesSack() const;
+        bool sendData(uint8_t channel, const uint8_t* data, size_t size, SendSource* source = nullptr,
+                      uint8_t contentType = CONTENT_TYPE_NONE);
+        bool sendJSON(uint8_t channel, const std::string& json, std::string& cbor);
+        bool transmitData(Channel& channel, const uint8_t* data, size_t dataSize, SendSource* source,
+                          uint8_t contentType);
+        bool prepareTransferCRCs(OutboundTransfer& transfer);
+        const uint8_t* readChunk(const OutboundTransfer& transfer, size_t offset, size_t length);
+        bool sendChunk(const OutboundTransfer& transfer, uint32_t chunkNum, bool probe = false);
+        bool sendDataFrame(const OutboundTransfer& transfer, uint32_t chunkNum, const uint8_t* chunkData,
+                           size_t chunkDataSize, uint32_t chunkCRC32, bool probe);
+        bool awaitDelivery(const OutboundTransfer& transfer);
+        bool waitForReport(const OutboundTransfer& transfer, ReceiveReport& report);
+        void queueReport(const uint8_t* data, size_t length);
+        void sendAck(uint32_t globalCRC32, AckStatus status, uint16_t transferId);
+        void flushReceiveCredits();
+        
+        // Large transfers
+        bool peerUsesLargeTransfers() const;
+        bool sendOpenFrame(const OutboundTransfer& transfer, uint8_t type = FRAME_OPEN);
+        bool peerUsesCompactFraming() const;
+        
+        // Resumable transfers
+        bool peerUsesResume() const;
+        void sendResumePoint(uint16_t transferId, uint32_t globalCRC32, uint32_t nextChunk);
+        uint32_t requestResume(const OutboundTransfer& transfer);
+        bool sendChunkRange(const OutboundTransfer& transfer, uint32_t firstChunk, bool useSack);
+        
+        // Compression
+        bool peerUsesCompression() const;
+        
+        // Content types
+        bool peerUsesContentTypes() const;
+        
+        // Delta transfers
+        bool peerUsesDelta() const;
+        bool keepsDeltaBases() const;
+        
+        // Forward error correction
+        bool peerUsesFec() const;
+        bool addChunkParity(const OutboundTransfer& transfer, uint32_t chunkNum, const uint8_t* chunkData);
+        bool sendParity(const OutboundTransfer& transfer, uint32_t group);
+        
+        // Channels
+        bool peerUsesMultiplex() const;
+        void acquireChannelTurn(Channel& channel);
+        void releaseChannelTurn(Channel& channel);
+        
+        // Link tuning
+        void applyLinkProfile(const LinkParameters& connected);
+        void requestConnectionParams(const ConnectionParams& params);
+        void noteLinkActivity();
+        static void linkIdleTimerEntry(TimerHandle_t timer);
+        void handleLinkIdleTimer();
+        
+        // Receive worker
+        void handleDataFrame(const uint8_t* data, size_t length);
+        void queueDataFrame(const uint8_t* data, size_t length);
+        
+        // Instrumentation
+        void recordTransfer(TransferRecord& record, bool success);
+        void clearHistory();
+        static void recordGap(uint32_t* histogram, uint32_t gapUs);
+        
+        // Target of the CBLE_LOG* macros inside this class
+        void log(LogLevel level, const char* format, ...);
+        
+    private:
+        Session(const Session&);
+        Session& operator=(const Session&);
+    };
+    
     // BLE components
     BLEServer* bleServer;
     BLEService* bleService;
     BLECharacteristic* bleCharacteristic;
+    BLECharacteristic* diagnosticsCharacteristic;
     
     // Internal callback instances
     ProtocolCharacteristicCallbacks* charCallbacks;
+    ProtocolDiagnosticsCallbacks* diagnosticsCallbacks;
     ProtocolServerCallbacks* serverCallbacks;
+    ProtocolTransportCallbacks* transportCallbacks;
+    
+    // Transports
+    GattTransport* gattTransport;    // Always available once the service is set up
+    BLETransport* l2capTransport;    // L2CAP CoC server, nullptr unless the host stack provides one
+    uint16_t l2capPsm;
+    bool l2capEnabled;               // Offer the channel after HELLO
     
-    // User callbacks
-    DataReceivedCallback dataReceivedCallback;
-    ConnectionCallback connectionCallback;
+    // User callbacks, kept in their per-channel form
+    ChannelDataReceivedCallback dataReceivedCallback;
+    SessionConnectionCallback connectionCallback;
     ProgressCallback progressCallback;
+    ChannelStreamDataCallback streamDataCallback;
+    ChannelStreamCompleteCallback streamCompleteCallback;
+    
+    // Sessions, one per connected client
+    Session* sessions[MAX_SESSIONS];
+    uint8_t sessionCount;
+    TransferStats retiredStats;          // Statistics of connections whose session was reused
+    
+    // Configuration shared by all sessions
+    uint32_t chunkTimeoutMs;         // Configurable chunk timeout
+    FlowControlMode flowControlMode;
+    uint16_t creditWindow;           // Credits we grant to each peer
+    bool retransmissionEnabled;
+    uint8_t maxRetransmitRounds;
+    uint16_t streamWindow;
+    size_t maxBufferedSize;          // Limit for transfers assembled in one buffer
+    size_t maxStreamedSize;          // Limit for transfers delivered through the stream callbacks
+    bool compactFraming;             // Announce FEATURE_COMPACT and send compact frames to such peers
+    bool compactChunkCRC;            // Keep chunk_crc32 in the compact frames we send
+    uint32_t resumeGraceMs;          // 0 disables resumption
+    bool compressionEnabled;         // Announce FEATURE_COMPRESSION and compress for such peers
+    bool cborDecoding;               // Hand buffered CBOR transfers to the data callbacks as JSON text
+    bool multiplexEnabled;           // Announce FEATURE_MULTIPLEX and interleave channels for such peers
+    uint8_t fecGroupSize;            // Data chunks per parity chunk we send, 0 disables FEC
+    size_t maxDeltaBaseSize;         // Largest payload kept as a delta base, 0 disables delta transfers
+    bool diagnosticsEnabled;         // Answer reads of the diagnostics characteristic
+    LinkProfile linkProfile;
+    
+    // Notification scheduling
+    SemaphoreHandle_t txMutex;       // Guards the turn below
+    Session* txTurnHolder;           // Session notifying a data frame, nullptr if none
+    
+    // Asynchronous send state
+    SemaphoreHandle_t asyncMutex;    // Guards TX task start-up and message ids
+    uint32_t nextMessageId;
+    
+    // Receive worker state
+    TaskHandle_t rxTask;             // Started by enableReceiveWorker()
+    
+    // Link tuning state
+    Session* volatile dataLengthSession;  // Last data length request, its completion names no peer
+    
+    LogSink logSink;                 // Serial by default, empty to drop messages unformatted
     
-    // Protocol state
-    bool isConnected;
-    std::string receiveBuffer;
-    std::vector<std::string> receivedChunks;
-    int expectedChunks;
-    int receivedChunkCount;
-    
-    // Enhanced state management with timeouts and CRC
-    TransferStats stats;
-    uint32_t lastChunkTime;
-    bool transferInProgress;
-    uint32_t crc32_table[256];  // CRC32 lookup table
-    uint32_t chunkTimeoutMs;    // Configurable chunk timeout
-    uint32_t expectedGlobalCRC32;  // Expected global CRC32 from first chunk
+    static ChunkedBLEProtocol* instance;  // Target of the static GATTS and GAP event handlers
     
     // Private methods
-    void setupBLEService(const char* serviceUUID, const char* charUUID);
-    void clearReceiveBuffers();
+    void setupBLEService(const char* serviceUUID, const char* charUUID, const char* diagnosticsUUID);
     void notifyProgress(int current, int total, bool isReceiving);
+    void initCRC32();
+    void initFlowControl();
+    static bool isControlFrame(const uint8_t* data, size_t length);
+    static size_t largeHeaderSize(uint8_t openFlags);
     
-    // Enhanced private methods for security and reliability
-    void initCRC32Table();
-    uint32_t calculateCRC32(const uint8_t* data, size_t length);
-    bool validateDataSize(size_t totalSize);
-    bool checkChunkTimeout();
-    void updateChunkTimer();
-    void cancelTransfer(const char* reason);
-    bool validateChunkHeader(const ChunkHeader& header);
-    void updateStatistics(bool success, size_t dataSize);
+    // Sessions
+    Session* findSession(uint16_t connId) const;
+    Session* findSession(const uint8_t* address) const;
+    Session* firstConnectedSession() const;
+    void openSession(uint16_t connId, const uint8_t* address, const LinkParameters& connected);
+    void closeSession(uint16_t connId);
+    void handleMTUChange(uint16_t connId, uint16_t mtu);
+    void handleWrite(uint16_t connId, const uint8_t* data, size_t length);
+    void restartAdvertising();
+    static void addStatistics(TransferStats& total, const TransferStats& stats);
+    
+    // Diagnostics
+    void updateDiagnostics(uint16_t connId);
+    static void encodeTransferRecord(DiagnosticsTransfer& out, const TransferRecord& record);
+    
+    // Transports
+    void openTransport(BLETransport* transport, uint16_t connId, uint16_t frameSize);
+    void closeTransport(BLETransport* transport, uint16_t connId);
+    
+    // Notification scheduling
+    void acquireTxTurn(Session& session);
+    void releaseTxTurn(Session& session);
+#if !CHUNKED_BLE_NIMBLE
+    static void gattsEventHandler(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf,
+                                  esp_ble_gatts_cb_param_t* param);
+#endif
+    
+    // Asynchronous send
+    uint32_t takeMessageId();
+    bool queueSend(Channel& channel, uint32_t id, std::string data, SendCompleteCallback onComplete,
+                   bool json = false);
+    
+    // Link tuning
+    static const LinkProfileSettings& profileSettings(LinkProfile profile);
+#if CHUNKED_BLE_NIMBLE
+    static int gapEventHandler(struct ble_gap_event* event, void* arg);
+    void handleGapEvent(struct ble_gap_event* event);
+#else
+    static void gapEventHandler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+    void handleGapEvent(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t* param);
+#endif
+    
+    // Receive worker
+    static void rxTaskEntry(void* param);
+    void rxTaskLoop();
+    
+    // Logging
+    void logv(LogLevel level, const char* format, va_list args, const Session* session = nullptr,
+              const Channel* channel = nullptr);
+    static void serialLogSink(LogLevel level, const char* message);
     
 public:
     /**
@@ -126,8 +985,10 @@ public:
      * @param server BLE server instance  
      * @param serviceUUID Custom service UUID
      * @param charUUID Custom characteristic UUID
+     * @param diagnosticsUUID Custom diagnostics characteristic UUID, nullptr for DEFAULT_DIAGNOSTICS_UUID
      */
-    ChunkedBLEProtocol(BLEServer* server, const char* serviceUUID, const char* charUUID);
+    ChunkedBLEProtocol(BLEServer* server, const char* serviceUUID, const char* charUUID,
+                       const char* diagnosticsUUID = nullptr);
     
     /**
      * Destructor - Clean up resources
@@ -137,7 +998,9 @@ public:
     /**
      * Set callback for complete data reception
      * 
-     * @param callback Function called when complete data is received
+     * @param callback Function called when complete data is received.
+     *                 The data refers to the internal reassembly buffer and is only
+     *                 valid during the call - copy it to keep it.
      */
     void setDataReceivedCallback(DataReceivedCallback callback);
     
@@ -156,37 +1019,361 @@ public:
      */
     void setProgressCallback(ProgressCallback callback);
     
+    /**
+     * Receive in streaming mode instead of buffering whole transfers
+     * 
+     * Data is delivered in order as soon as it is contiguous, so memory use stays at
+     * `window` chunks regardless of the transfer size, and the streamed limit of
+     * setTransferLimits() applies instead of the buffered one. The global CRC32 is checked incrementally; data already delivered
+     * cannot be taken back, so act on it only once onComplete reports success.
+     * While streaming is set, DataReceivedCallback is not called.
+     * 
+     * @param onData Called with each in-order piece: (data, length, offset in payload).
+     *               The data is only valid during the call. Pass nullptr to disable streaming.
+     * @param onComplete Called once per transfer: (success, totalLength). A failed global
+     *                   CRC32, cancellation or disconnect reports false.
+     * @param window Chunks that may arrive ahead of a missing one (1..MAX_STREAM_WINDOW)
+     */
+    void setStreamCallbacks(StreamDataCallback onData, StreamCompleteCallback onComplete,
+                            uint16_t window = DEFAULT_STREAM_WINDOW);
+    
+    /**
+     * Set callback for complete data reception, naming the client that sent it
+     * 
+     * Replaces a callback set by setDataReceivedCallback().
+     * 
+     * @param callback Function (connId, data); the data is only valid during the call
+     */
+    void setSessionDataReceivedCallback(SessionDataReceivedCallback callback);
+    
+    /**
+     * Set callback for connection changes of each client
+     * 
+     * Replaces a callback set by setConnectionCallback().
+     * 
+     * @param callback Function (connId, connected)
+     */
+    void setSessionConnectionCallback(SessionConnectionCallback callback);
+    
+    /**
+     * Receive in streaming mode, naming the client each piece comes from
+     * 
+     * Same as setStreamCallbacks(); streams of different clients interleave.
+     * 
+     * @param onData Called with (connId, data, length, offset), nullptr disables streaming
+     * @param onComplete Called once per transfer with (connId, success, totalLength)
+     * @param window Chunks that may arrive ahead of a missing one (1..MAX_STREAM_WINDOW)
+     */
+    void setSessionStreamCallbacks(SessionStreamDataCallback onData, SessionStreamCompleteCallback onComplete,
+                                   uint16_t window = DEFAULT_STREAM_WINDOW);
+    
+    /**
+     * Set callback for complete data reception, naming the client and channel
+     * 
+     * Replaces a callback set by setDataReceivedCallback() or setSessionDataReceivedCallback().
+     * Transfers of peers without FEATURE_MULTIPLEX arrive on DEFAULT_CHANNEL.
+     * 
+     * @param callback Function (connId, channel, data); the data is only valid during the call
+     */
+    void setChannelDataReceivedCallback(ChannelDataReceivedCallback callback);
+    
+    /**
+     * Receive in streaming mode, naming the client and channel of each piece
+     * 
+     * Same as setStreamCallbacks(); streams of different channels interleave, each in order.
+     * 
+     * @param onData Called with (connId, channel, data, length, offset), nullptr disables streaming
+     * @param onComplete Called once per transfer with (connId, channel, success, totalLength)
+     * @param window Chunks that may arrive ahead of a missing one (1..MAX_STREAM_WINDOW)
+     */
+    void setChannelStreamCallbacks(ChannelStreamDataCallback onData, ChannelStreamCompleteCallback onComplete,
+                                   uint16_t window = DEFAULT_STREAM_WINDOW);
+    
+    /**
+     * Enable or disable multiplexed channels
+     * 
+     * Negotiated via FRAME_HELLO and requires large transfers on both sides. With a
+     * peer that multiplexes, every channel runs its own transfer in each direction,
+     * and data frames of concurrent sends are interleaved by priority: a waiting
+     * chunk of a lower channel number always goes first, so a short message on
+     * channel 0 overtakes a bulk transfer on channel 3 instead of queueing behind it.
+     * Data frames then carry the transfer_id (compact frames with OPEN_FLAG_TAGGED).
+     * 
+     * @param enabled Announce FEATURE_MULTIPLEX to the peer (on by default)
+     */
+    void setMultiplexing(bool enabled);
+    
+    /**
+     * Allow several clients to connect at the same time
+     * 
+     * Every client gets its own session: receive buffers, MTU, credits, statistics and
+     * TX queue. Sessions are allocated here, so connecting clients allocate nothing up
+     * front; with bufferSize set, each session also keeps that much receive buffer
+     * between transfers. Data frames of concurrent sends are notified in turns, one
+     * frame per session. Advertising restarts while a session is free; further
+     * clients are disconnected. Call before enableReceiveWorker() and the first connection.
+     * Bluedroid accepts CONFIG_BT_ACL_CONNECTIONS links (4 by default in Arduino-ESP32),
+     * NimBLE CONFIG_BT_NIMBLE_MAX_CONNECTIONS (3 by default in NimBLE-Arduino).
+     * 
+     * @param count Sessions (1..MAX_SESSIONS), 1 by default
+     * @param bufferSize Receive buffer reserved per session, 0 to allocate per transfer
+     * @return false if called too late or memory ran out (previous sessions kept)
+     */
+    bool setMaxSessions(uint8_t count, size_t bufferSize = 0);
+    
+    /**
+     * Get number of connected clients
+     */
+    uint8_t getConnectedCount() const;
+    
     /**
      * Send data using chunked protocol
      * 
+     * With several clients connected, the data is sent to each of them in turn.
+     * 
+     * @param data Data to send (will be automatically chunked)
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first); peers without FEATURE_MULTIPLEX ignore it
+     * @return true if sent successfully (to every client), false otherwise
+     */
+    bool sendData(const std::string& data, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Send data to one client
+     * 
+     * Transfers to different clients, or on different channels of a multiplexing
+     * client, run concurrently when called from different tasks.
+     * 
+     * @param connId Client's conn_id, as passed to the session callbacks
      * @param data Data to send (will be automatically chunked)
-     * @return true if sent successfully, false otherwise
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return true if sent successfully, false if it failed or the client is not connected
+     */
+    bool sendData(uint16_t connId, const std::string& data, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Send a payload pulled from a source, to every connected client in turn
+     * 
+     * Only one chunk of the payload is held in RAM at a time: the source is read once
+     * for the global CRC32, then chunk by chunk while sending (again for chunks the
+     * receiver misses). Sources are not compressed. Blocks like sendData().
+     * 
+     * @param source Payload, unchanged until the call returns
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return true if sent successfully (to every client), false otherwise
+     */
+    bool sendStream(SendSource& source, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Send a payload pulled from a source to one client
+     * 
+     * @param connId Client's conn_id
+     * @param source Payload, unchanged until the call returns
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return true if sent successfully, false if reading or sending failed
+     */
+    bool sendStream(uint16_t connId, SendSource& source, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Send a file, e.g. sendFile(LittleFS, "/log.txt"), to every connected client
+     * 
+     * @param fs Mounted file system
+     * @param path File to send
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return false if the file cannot be opened or sending failed
+     */
+    bool sendFile(fs::FS& fs, const char* path, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Send a file to one client
+     * 
+     * @param connId Client's conn_id
+     * @param fs Mounted file system
+     * @param path File to send
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return false if the file cannot be opened or sending failed
+     */
+    bool sendFile(uint16_t connId, fs::FS& fs, const char* path, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Queue data for sending on the protocol's TX task and return immediately
+     * 
+     * Safe to call from BLE callbacks. Messages are sent one at a time in queue
+     * order; a disconnected link fails the message instead of blocking the queue.
+     * With several clients connected, a copy is queued for each of them under the
+     * same message id and onComplete runs once per client.
+     * 
+     * @param data Data to send (copied, or moved when passed as an rvalue)
+     * @param onComplete Optional callback (messageId, success), runs on the TX task
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first); each channel has its own queue
+     * @return Message id (never 0), or 0 if the TX queue is full or the task could not start
+     */
+    uint32_t sendDataAsync(std::string data, SendCompleteCallback onComplete = nullptr,
+                           uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Queue data for one client on its channel's TX task
+     * 
+     * Each channel of each session has its own TX task and queue. A message queued for
+     * a connection that ends before it is sent fails, even if the client reconnects.
+     * 
+     * @param connId Client's conn_id
+     * @param data Data to send (copied, or moved when passed as an rvalue)
+     * @param onComplete Optional callback (messageId, success), runs on the channel's TX task
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return Message id (never 0), or 0 if the client is not connected or its queue is full
+     */
+    uint32_t sendDataAsync(uint16_t connId, std::string data, SendCompleteCallback onComplete = nullptr,
+                           uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Send JSON text, as CBOR to peers that accept content types
+     * 
+     * The text is encoded once with CBOR::fromJSON() and sent as CONTENT_TYPE_CBOR to
+     * every client that announced FEATURE_EXT_CONTENT_TYPE; others get the text itself.
+     * Text that is not valid JSON goes out unchanged. Blocks like sendData().
+     * 
+     * @param json JSON text
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return true if sent successfully (to every client), false otherwise
+     */
+    bool sendJSON(const std::string& json, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Send JSON text to one client, as CBOR if it accepts content types
+     * 
+     * @param connId Client's conn_id
+     * @param json JSON text
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return true if sent successfully, false if it failed or the client is not connected
+     */
+    bool sendJSON(uint16_t connId, const std::string& json, uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Queue JSON text like sendDataAsync(), encoded as for sendJSON() by the TX task
+     * 
+     * @param json JSON text (copied, or moved when passed as an rvalue)
+     * @param onComplete Optional callback (messageId, success), runs on the TX task
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return Message id (never 0), or 0 if the TX queue is full or the task could not start
+     */
+    uint32_t sendJSONAsync(std::string json, SendCompleteCallback onComplete = nullptr,
+                           uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Queue JSON text for one client like sendDataAsync(), encoded as for sendJSON()
+     * 
+     * @param connId Client's conn_id
+     * @param json JSON text (copied, or moved when passed as an rvalue)
+     * @param onComplete Optional callback (messageId, success), runs on the channel's TX task
+     * @param channel Channel (0..MAX_CHANNELS - 1, 0 first)
+     * @return Message id (never 0), or 0 if the client is not connected or its queue is full
+     */
+    uint32_t sendJSONAsync(uint16_t connId, std::string json, SendCompleteCallback onComplete = nullptr,
+                           uint8_t channel = DEFAULT_CHANNEL);
+    
+    /**
+     * Get number of messages waiting for the TX tasks (excluding the ones in flight)
      */
-    bool sendData(const std::string& data);
+    size_t getPendingSendCount() const;
+    
+    /**
+     * Process received data frames on a dedicated task instead of the BLE callback
+     * 
+     * Frames are copied into a lock-free ring and parsed by the RX task, so the
+     * BLE stack is never blocked by CRC checks, reassembly or user callbacks.
+     * Data, stream and progress callbacks then run on the RX task. Call once,
+     * after setMaxSessions() and before the first connection.
+     * 
+     * @param ringSize Ring buffer size in bytes per session; must hold at least two full frames
+     * @return true if the worker is running
+     */
+    bool enableReceiveWorker(size_t ringSize = DEFAULT_RX_RING_SIZE);
+    
+    /**
+     * Set where log messages go
+     * 
+     * Levels above CHUNKED_BLE_LOG_LEVEL are compiled out; the sink sees the rest.
+     * The sink is called from the BLE, RX and TX tasks and must not block, e.g.
+     * copy into a FreeRTOS ring buffer and print from loop().
+     * 
+     * @param sink Function (level, message), or nullptr to skip formatting entirely
+     */
+    void setLogSink(LogSink sink);
     
     /**
      * Check if device is connected
      * 
-     * @return true if connected, false otherwise
+     * @return true if any client is connected, false otherwise
      */
     bool isDeviceConnected() const;
     
+    /**
+     * Check if a client is connected
+     * 
+     * @param connId Client's conn_id
+     */
+    bool isDeviceConnected(uint16_t connId) const;
+    
     /**
      * Get transfer statistics
      * 
-     * @return Current transfer statistics
+     * @return Statistics of all clients since the last reset; link describes the first connected one
      */
     TransferStats getStatistics() const;
     
     /**
-     * Reset transfer statistics
+     * Get transfer statistics of one client's current connection
+     * 
+     * @param connId Client's conn_id
+     * @return Its statistics, all 0 if the client is not connected
+     */
+    TransferStats getStatistics(uint16_t connId) const;
+    
+    /**
+     * Get the latest finished transfers of one client, newest first
+     * 
+     * @param connId Client's conn_id
+     * @param records Receives up to maxRecords records
+     * @param maxRecords Capacity of records, at most TRANSFER_HISTORY_LENGTH are kept
+     * @return Number of records written, 0 if the client is not connected
+     */
+    size_t getTransferHistory(uint16_t connId, TransferRecord* records, size_t maxRecords) const;
+    
+    /**
+     * Reset transfer statistics and the transfer history
      */
     void resetStatistics();
     
+    /**
+     * Answer reads of the diagnostics characteristic
+     * 
+     * A client reading it gets DiagnosticsValue with its own connection's statistics,
+     * so transfer performance can be checked without a serial console. Enabled by default;
+     * when disabled the value reads as empty.
+     * 
+     * @param enabled false to hide the statistics from clients
+     */
+    void setDiagnosticsEnabled(bool enabled);
+    
+    /**
+     * Get ATT MTU negotiated with the connected peer
+     * 
+     * @return Negotiated MTU of the first connected client (DEFAULT_MTU_SIZE until it exchanges MTU)
+     */
+    uint16_t getNegotiatedMTU() const;
+    
+    /**
+     * Get ATT MTU negotiated with one client
+     * 
+     * @param connId Client's conn_id
+     * @return Negotiated MTU (DEFAULT_MTU_SIZE until the client exchanges MTU or if it is not connected)
+     */
+    uint16_t getNegotiatedMTU(uint16_t connId) const;
+    
     /**
      * Check if transfer is currently in progress
      * 
-     * @return true if transfer is active, false otherwise
+     * @return true if a transfer from any client is active, false otherwise
      */
     bool isTransferInProgress() const;
     
@@ -198,26 +1385,35 @@ public:
     void cancelCurrentTransfer(const char* reason = "User requested");
     
     /**
-     * Process received chunk (called internally)
+     * Log message (internal utility, used through the CBLE_LOG* macros)
      * 
-     * @param data Raw chunk data
+     * @param level Message level
+     * @param format Printf-style format string
+     * @param ... Variable arguments
      */
-    void processReceivedChunk(const std::string& data);
+    void log(LogLevel level, const char* format, ...);
     
     /**
-     * Handle connection changes (called internally)
+     * Select flow control for outgoing and incoming chunks
+     * 
+     * Credit mode is negotiated with the peer via FRAME_HELLO; peers that do not
+     * announce FEATURE_CREDITS are served with the legacy fixed delay.
      * 
-     * @param connected Connection status
+     * @param mode Flow control mode
+     * @param window Credits granted to the peer (clamped to 1..MAX_CREDIT_WINDOW)
      */
-    void handleConnectionChange(bool connected);
+    void setFlowControl(FlowControlMode mode, uint16_t window = DEFAULT_CREDIT_WINDOW);
     
     /**
-     * Log message (internal utility)
+     * Enable or disable selective retransmission
      * 
-     * @param format Printf-style format string
-     * @param ... Variable arguments
+     * Negotiated via FRAME_HELLO. When active, the receiver keeps valid chunks on errors
+     * and reports missing ones so that only those are sent again.
+     * 
+     * @param enabled Announce FEATURE_SACK to the peer
+     * @param maxRounds Retransmission rounds before a send is abandoned
      */
-    void log(const char* format, ...);
+    void setRetransmission(bool enabled, uint8_t maxRounds = DEFAULT_MAX_RETRANSMIT_ROUNDS);
     
     /**
      * Set chunk timeout in milliseconds
@@ -225,6 +1421,150 @@ public:
      * @param timeoutMs Chunk timeout in milliseconds
      */
     void setChunkTimeout(uint32_t timeoutMs);
+    
+    /**
+     * Set the largest transfer accepted in each receive mode (and sent to such a receiver)
+     * 
+     * Peers that announce FEATURE_LARGE use 32-bit chunk numbers, so only these limits
+     * apply; older peers are additionally held to the 16-bit chunk count limits.
+     * 
+     * @param maxBufferedSize Limit for transfers assembled in RAM for DataReceivedCallback
+     * @param maxStreamedSize Limit for transfers delivered through setStreamCallbacks()
+     */
+    void setTransferLimits(size_t maxBufferedSize, size_t maxStreamedSize = DEFAULT_MAX_STREAM_SIZE);
+    
+    /**
+     * Set how long an interrupted large transfer can be resumed
+     * 
+     * A receive cut off by a disconnect keeps its buffers; when the peer reconnects and
+     * sends FRAME_RESUME for it, the transfer continues after the highest chunk held.
+     * A send that fails is offered for resumption when the same data is sent again.
+     * Expired receive state is released by the next transfer.
+     * Announced as FEATURE_RESUME in the next HELLO; needs FEATURE_LARGE and FEATURE_SACK.
+     * 
+     * @param graceMs Grace period in milliseconds, 0 disables resumption
+     */
+    void setResumeGracePeriod(uint32_t graceMs);
+    
+    /**
+     * Configure compact framing for large transfers
+     * 
+     * Compact data frames carry a 16-bit chunk number and the chunk CRC32 (6 bytes), or only
+     * the chunk number (2 bytes) when chunkCRC is false. Without chunk CRC32s a corrupted
+     * chunk is only caught by the global CRC32 and fails the whole transfer, so disable it
+     * only when the link-layer CRC is trusted. Transfers above MAX_COMPACT_CHUNKS always
+     * use LargeChunkHeader. Announced as FEATURE_COMPACT in the next HELLO.
+     * 
+     * @param enabled Accept compact frames and send them to peers that accept them
+     * @param chunkCRC Include chunk_crc32 in the compact frames we send
+     */
+    void setCompactFraming(bool enabled, bool chunkCRC = true);
+    
+    /**
+     * Enable or disable payload compression for large transfers
+     * 
+     * Payloads of MIN_COMPRESSION_SIZE bytes or more are LZSS-compressed ahead of chunking
+     * when the peer announced FEATURE_COMPRESSION and the result is smaller; received
+     * OPEN_FLAG_COMPRESSED transfers are inflated after reassembly, or through a
+     * LZSS::WINDOW_SIZE window as a stream is delivered. Callbacks always see the original
+     * data; transfer limits apply to its decompressed size. Announced in the next HELLO.
+     * 
+     * @param enabled Compress for peers that accept it and accept compressed transfers
+     */
+    void setCompression(bool enabled);
+    
+    /**
+     * Send parity chunks with large transfers so lossy links need fewer retransmissions
+     * 
+     * After every groupSize data chunks an XOR parity chunk goes out; a receiver that lost
+     * one chunk of a group rebuilds it without a NACK round trip. Costs one frame per group
+     * (groupSize 8 = 12.5% overhead); lower values protect better. Each FRAME_OPEN carries
+     * its own group size, so a change applies from the next transfer on. Only used for peers
+     * that announced FEATURE_EXT_FEC, never for streaming receivers or resumed transfers;
+     * parity from such peers is always accepted for buffered transfers.
+     * 
+     * @param groupSize Data chunks per parity chunk, 0 disables FEC (the default)
+     */
+    void setForwardErrorCorrection(uint8_t groupSize);
+    
+    /**
+     * Decode buffered CBOR transfers to JSON text before the data callbacks (on by default)
+     * 
+     * Keeps JSON handlers working when the peer sends CBOR (CONTENT_TYPE_CBOR); turn it off
+     * to get the CBOR itself and parse it with CBOR::Reader instead of a JSON parser. A
+     * transfer that does not decode is rejected with ACK_STATUS_REJECTED. Streamed transfers
+     * are never decoded - feed the pieces to a CBOR::Reader, see getReceivedContentType().
+     * 
+     * @param enabled Convert CBOR to JSON text for DataReceivedCallback and its variants
+     */
+    void setCBORDecoding(bool enabled);
+    
+    /**
+     * Get the content type of the transfer a callback is delivering
+     * 
+     * Valid in the data, stream and stream complete callbacks of that client and channel.
+     * A decoded CBOR transfer reports CONTENT_TYPE_JSON; peers without
+     * FEATURE_EXT_CONTENT_TYPE always report CONTENT_TYPE_NONE.
+     * 
+     * @param connId Client's conn_id, as passed to the session callbacks
+     * @param channel Channel of the transfer
+     * @return ContentType, CONTENT_TYPE_NONE if the client is not connected
+     */
+    ContentType getReceivedContentType(uint16_t connId, uint8_t channel = DEFAULT_CHANNEL) const;
+    
+    /**
+     * Send repeated payloads as patches against the previous one (off by default)
+     * 
+     * Each channel keeps the last payload it sent and the last one it received, per
+     * client and up to maxBaseSize bytes each. When both ends enable this (FEATURE_EXT_DELTA)
+     * and the receiver acknowledges transfers, a payload is sent as a Delta patch against
+     * the previous one whenever the patch is smaller; the receiver rebuilds it and checks its
+     * CRC32 before the data callback. A receiver without the base answers
+     * ACK_STATUS_DELTA_BASE_MISSING and gets the whole payload instead.
+     * Sources and streaming receivers always move whole payloads. Applied on next HELLO.
+     * 
+     * @param maxBaseSize Largest payload kept as a base (0 disables delta transfers and frees the bases),
+     *                    e.g. DEFAULT_MAX_DELTA_BASE_SIZE
+     */
+    void setDeltaTransfers(size_t maxBaseSize);
+    
+    /**
+     * Select the connection parameters, PHY and data length requested from the central
+     * 
+     * Applied when a client connects: the profile's active interval, LE 2M PHY and a
+     * PREFERRED_DATA_LENGTH link-layer payload are requested; after LINK_IDLE_TIMEOUT_MS
+     * without frames the link relaxes to the idle interval and the next frame in either
+     * direction speeds it up again. The central decides - the values it agreed to are
+     * reported in TransferStats::link.
+     * 
+     * @param profile LINK_PROFILE_NONE keeps the central's choices (the default)
+     */
+    void setLinkProfile(LinkProfile profile);
+    
+    /**
+     * Offer an L2CAP Connection-Oriented Channel to clients
+     * 
+     * After the HELLO exchange the device sends FRAME_TRANSPORT with the PSM. A client
+     * that opens the channel gets all further frames as L2CAP SDUs, with the channel's
+     * own credits and without ATT overhead; clients that cannot stay on GATT. The API
+     * and framing stay the same on both transports, frames stay within MAX_FRAME_SIZE.
+     * Requires a host stack with LE CoC support: NimBLE (CHUNKED_BLE_NIMBLE) built with
+     * CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM > 0. The Bluedroid host of Arduino-ESP32 has
+     * none, so enabling fails there. The PSM cannot change once the channel was enabled.
+     * 
+     * @param enabled Offer the channel to clients that connect from now on
+     * @param psm LE PSM to listen on (0x0080..0x00FF)
+     * @return false if the host stack cannot provide the channel
+     */
+    bool setL2capChannel(bool enabled, uint16_t psm = DEFAULT_L2CAP_PSM);
+    
+    /**
+     * Get the transport a client's frames currently travel over
+     * 
+     * @param connId Client's conn_id
+     * @return TRANSPORT_L2CAP_COC once the client opened the channel, TRANSPORT_GATT otherwise
+     */
+    TransportKind getTransport(uint16_t connId) const;
 };
 
 #endif // CHUNKED_BLE_PROTOCOL_H
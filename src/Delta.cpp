@@ -0,0 +1,158 @@
+#include "Delta.h"
+#include <string.h>
+#include <vector>
+
+namespace {
+
+const unsigned HASH_BITS = 12;             // 16 KB of base positions while encoding
+const size_t HASH_SIZE = (size_t)1 << HASH_BITS;
+const size_t HASH_BYTES = 4;
+const int32_t NO_POSITION = -1;
+const unsigned MAX_VARINT_BYTES = 10;
+
+// Hash of the 4 bytes starting at p
+inline size_t hash4(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void appendVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+bool readVarint(const uint8_t* data, size_t length, size_t& position, uint64_t& value) {
+    value = 0;
+    for (unsigned i = 0; i < MAX_VARINT_BYTES && position < length; i++) {
+        uint8_t byte = data[position++];
+        value |= (uint64_t)(byte & 0x7F) << (7 * i);
+        if (!(byte & 0x80)) {
+            return i < MAX_VARINT_BYTES - 1 || byte <= 1;  // The tenth byte holds bit 63 only
+        }
+    }
+    return false;
+}
+
+void appendInsert(std::string& out, const uint8_t* data, size_t length) {
+    if (length) {
+        appendVarint(out, (uint64_t)length << 1);
+        out.append((const char*)data, length);
+    }
+}
+
+// Bytes a and b have in common, at most limit
+inline size_t matchLength(const uint8_t* a, const uint8_t* b, size_t limit) {
+    size_t matched = 0;
+    while (matched < limit && a[matched] == b[matched]) {
+        matched++;
+    }
+    return matched;
+}
+
+} // namespace
+
+// Encode data as a patch against a base
+bool Delta::encode(const uint8_t* base, size_t baseLength, const uint8_t* data, size_t length, std::string& out) {
+    out.clear();
+    if (baseLength < MIN_COPY || length < MIN_COPY || (uint64_t)baseLength > 0x7FFFFFFFu) {
+        return false;
+    }
+    appendVarint(out, length);
+
+    // Latest base position per hash of its first HASH_BYTES bytes
+    std::vector<int32_t> head(HASH_SIZE, NO_POSITION);
+    for (size_t i = 0; i + HASH_BYTES <= baseLength; i++) {
+        head[hash4(base + i)] = (int32_t)i;
+    }
+
+    size_t cursor = 0;          // End of the last copy in the base
+    size_t literalStart = 0;    // First data byte not covered by an instruction yet
+    size_t position = 0;
+    while (position + MIN_COPY <= length && out.size() < length) {
+        // The stretch after the last copy (skipping as many bytes as were inserted since),
+        // then whatever the index holds for these bytes
+        size_t candidates[2] = {cursor + (position - literalStart), (size_t)head[hash4(data + position)]};
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        for (int i = 0; i < 2; i++) {
+            size_t candidate = candidates[i];
+            if (candidate == (size_t)NO_POSITION || candidate + MIN_COPY > baseLength) {
+                continue;
+            }
+            size_t limit = baseLength - candidate < length - position ? baseLength - candidate : length - position;
+            size_t matched = matchLength(base + candidate, data + position, limit);
+            if (matched > bestLength) {
+                bestLength = matched;
+                bestOffset = candidate;
+            }
+        }
+        if (bestLength < MIN_COPY) {
+            position++;
+            continue;
+        }
+
+        // The match may start a little earlier, inside the bytes still to be inserted
+        while (position > literalStart && bestOffset > 0 && base[bestOffset - 1] == data[position - 1]) {
+            position--;
+            bestOffset--;
+            bestLength++;
+        }
+        appendInsert(out, data + literalStart, position - literalStart);
+        int64_t offset = (int64_t)bestOffset - (int64_t)cursor;
+        appendVarint(out, ((uint64_t)(bestLength - MIN_COPY) << 1) | 1);
+        appendVarint(out, ((uint64_t)offset << 1) ^ (uint64_t)(offset >> 63));
+        cursor = bestOffset + bestLength;
+        position += bestLength;
+        literalStart = position;
+    }
+    appendInsert(out, data + literalStart, length - literalStart);
+    return out.size() < length;
+}
+
+// Rebuild a payload from its base and a patch
+bool Delta::apply(const uint8_t* base, size_t baseLength, const uint8_t* patch, size_t patchLength,
+                  std::string& out, size_t maxLength) {
+    out.clear();
+    size_t position = 0;
+    uint64_t resultLength;
+    if (!readVarint(patch, patchLength, position, resultLength) || resultLength > maxLength) {
+        return false;
+    }
+    out.reserve(resultLength);
+
+    size_t cursor = 0;
+    while (out.size() < resultLength) {
+        uint64_t instruction;
+        if (!readVarint(patch, patchLength, position, instruction)) {
+            return false;
+        }
+        uint64_t count = instruction >> 1;
+        uint64_t room = resultLength - out.size();
+        if (!(instruction & 1)) {
+            if (count == 0 || count > room || count > patchLength - position) {
+                return false;
+            }
+            out.append((const char*)patch + position, count);
+            position += count;
+            continue;
+        }
+
+        uint64_t zigzag;
+        if (!readVarint(patch, patchLength, position, zigzag)) {
+            return false;
+        }
+        count += MIN_COPY;
+        int64_t offset = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        int64_t start = (int64_t)cursor + offset;
+        if (count > room || start < 0 || (uint64_t)start > baseLength || count > baseLength - (uint64_t)start) {
+            return false;
+        }
+        out.append((const char*)base + start, count);
+        cursor = start + count;
+    }
+    return position == patchLength;  // Nothing may follow the last instruction
+}
@@ -0,0 +1,61 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+/**
+ * Delta - Binary patches of a payload against the one sent before it
+ *
+ * Patch format (varints are LEB128, 7 bits per byte, low bits first):
+ *   result_length, then instructions until result_length bytes are produced:
+ *   n even: insert the n >> 1 bytes that follow (n >> 1 >= 1)
+ *   n odd:  copy (n >> 1) + MIN_COPY bytes of the base, starting at cursor + offset,
+ *           where offset is a zigzag varint and cursor is where the previous copy
+ *           ended (0 before the first one)
+ *
+ * Relative offsets keep copies of an edited document at one or two bytes, so a
+ * small edit costs about its own size plus a few bytes. The encoder indexes the
+ * base in a fixed 16 KB hash table and tries the position right after the last
+ * copy first, which is where an unchanged stretch usually continues.
+ *
+ * Usage:
+ *   std::string patch;
+ *   if (Delta::encode(base, baseLength, data, length, patch)) { ... }    // false if it would not shrink
+ *
+ *   std::string result;
+ *   if (Delta::apply(base, baseLength, patch.data(), patch.size(), result, maxLength)) { ... }
+ */
+class Delta {
+public:
+    static const size_t MIN_COPY = 6;           // Shorter matches cost more than inserting them
+
+    /**
+     * Encode data as a patch against a base
+     *
+     * @param base Payload the receiver already holds
+     * @param baseLength Length of base
+     * @param data Payload to send
+     * @param length Length of data
+     * @param out Patch (contents undefined on false)
+     * @return false if the patch would not be smaller than the data
+     */
+    static bool encode(const uint8_t* base, size_t baseLength, const uint8_t* data, size_t length, std::string& out);
+
+    /**
+     * Rebuild a payload from its base and a patch
+     *
+     * @param base Payload the patch was made against
+     * @param baseLength Length of base
+     * @param patch Patch
+     * @param patchLength Length of patch
+     * @param out Rebuilt payload
+     * @param maxLength Largest result_length accepted
+     * @return false if the patch is corrupt, truncated, reaches outside the base or is too large
+     */
+    static bool apply(const uint8_t* base, size_t baseLength, const uint8_t* patch, size_t patchLength,
+                      std::string& out, size_t maxLength);
+};
+
+#endif // DELTA_H
@@ -0,0 +1,33 @@
+#include "GattTransport.h"
+#if !CHUNKED_BLE_NIMBLE
+#include <esp_gatts_api.h>
+#endif
+
+// Constructor
+GattTransport::GattTransport(BLEServer* server, BLECharacteristic* characteristic)
+    : server(server), characteristic(characteristic) {
+}
+
+// Get short name for logs
+const char* GattTransport::name() const {
+    return "GATT";
+}
+
+// Notify one client
+esp_err_t GattTransport::send(uint16_t connId, const uint8_t* data, size_t length) {
+#if CHUNKED_BLE_NIMBLE
+    // The mbuf is consumed whatever the outcome; running out of them is the stack's "busy"
+    struct os_mbuf* om = ble_hs_mbuf_from_flat(data, length);
+    if (!om) {
+        return ESP_FAIL;
+    }
+    int rc = ble_gattc_notify_custom(connId, characteristic->getHandle(), om);
+    if (rc == 0) {
+        return ESP_OK;
+    }
+    return rc == BLE_HS_ENOMEM ? ESP_FAIL : ESP_ERR_INVALID_STATE;
+#else
+    return esp_ble_gatts_send_indicate(server->getGattsIf(), connId, characteristic->getHandle(),
+                                       length, (uint8_t*)data, false);
+#endif
+}
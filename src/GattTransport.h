@@ -0,0 +1,36 @@
+#ifndef GATT_TRANSPORT_H
+#define GATT_TRANSPORT_H
+
+#include "BLETransport.h"
+#include "BLEStack.h"
+
+/**
+ * GattTransport - Frames as notifications of the protocol characteristic
+ *
+ * Frames sent by the device become notifications to one client (BLECharacteristic::notify()
+ * would reach every connected client), on Bluedroid and NimBLE alike. Frames written by clients reach the protocol
+ * through the characteristic's callbacks, so this class only covers the sending side;
+ * the frame size follows the ATT MTU of each connection and is tracked by the protocol.
+ */
+class GattTransport : public BLETransport {
+public:
+    /**
+     * Constructor
+     *
+     * @param server Server the characteristic belongs to
+     * @param characteristic Protocol characteristic, with notifications enabled
+     */
+    GattTransport(BLEServer* server, BLECharacteristic* characteristic);
+
+    const char* name() const override;
+    esp_err_t send(uint16_t connId, const uint8_t* data, size_t length) override;
+
+private:
+    BLEServer* server;
+    BLECharacteristic* characteristic;
+
+    GattTransport(const GattTransport&);
+    GattTransport& operator=(const GattTransport&);
+};
+
+#endif // GATT_TRANSPORT_H
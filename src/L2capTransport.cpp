@@ -0,0 +1,210 @@
+#include "L2capTransport.h"
+
+#if CHUNKED_BLE_L2CAP_COC
+#include <new>
+
+L2capTransport* L2capTransport::instance = nullptr;
+
+// Constructor
+L2capTransport::L2capTransport(Receiver* receiver, uint16_t frameSize)
+    : receiver(receiver), frameSize(frameSize), links(), linkMutex(nullptr),
+      rxMemory(nullptr), rxMempool(), rxPool(), frameBuffer(nullptr) {
+    linkMutex = xSemaphoreCreateMutex();
+}
+
+// Destructor - channels are closed, the server stays registered with the host
+L2capTransport::~L2capTransport() {
+    if (instance == this) {
+        instance = nullptr;
+    }
+    for (size_t i = 0; i < CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM; i++) {
+        if (links[i].chan) {
+            ble_l2cap_disconnect(links[i].chan);
+        }
+    }
+    if (linkMutex) {
+        vSemaphoreDelete(linkMutex);
+    }
+    // Closing channels return their receive buffers later, so the pool memory stays allocated
+    delete[] frameBuffer;
+}
+
+// Listen for channels
+bool L2capTransport::begin(uint16_t psm) {
+    // One block holds a whole SDU, so reassembly never chains blocks
+    const uint16_t blockSize = sizeof(struct os_mbuf) + sizeof(struct os_mbuf_pkthdr) + frameSize;
+    const uint16_t blockCount = RX_BUFFERS_PER_CHANNEL * CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM;
+
+    if (!rxMemory) {
+        rxMemory = new (std::nothrow) os_membuf_t[OS_MEMPOOL_SIZE(blockCount, blockSize)];
+        frameBuffer = new (std::nothrow) uint8_t[frameSize];
+        if (!rxMemory || !frameBuffer || !linkMutex ||
+            os_mempool_init(&rxMempool, blockCount, blockSize, rxMemory, "cble_coc") != 0 ||
+            os_mbuf_pool_init(&rxPool, &rxMempool, blockSize, blockCount) != 0) {
+            delete[] rxMemory;
+            delete[] frameBuffer;
+            rxMemory = nullptr;
+            frameBuffer = nullptr;
+            return false;
+        }
+    }
+
+    instance = this;
+    int rc = ble_l2cap_create_server(psm, frameSize, eventHandler, nullptr);
+    // Registered by an earlier instance, its events now come here
+    return rc == 0 || rc == BLE_HS_EALREADY;
+}
+
+// Get short name for logs
+const char* L2capTransport::name() const {
+    return "L2CAP";
+}
+
+// Send one frame as one SDU
+esp_err_t L2capTransport::send(uint16_t connId, const uint8_t* data, size_t length) {
+    if (length > frameSize) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    xSemaphoreTake(linkMutex, portMAX_DELAY);
+    Link* link = nullptr;
+    for (size_t i = 0; i < CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM && !link; i++) {
+        if (links[i].chan && links[i].connId == connId) {
+            link = &links[i];
+        }
+    }
+    if (!link) {
+        xSemaphoreGive(linkMutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    // The previous SDU waits for credits - the caller retries once TX_UNSTALLED arrived
+    if (link->stalled) {
+        xSemaphoreGive(linkMutex);
+        return ESP_FAIL;
+    }
+
+    esp_err_t result = ESP_FAIL;
+    struct os_mbuf* om = ble_hs_mbuf_from_flat(data, length);
+    if (om) {
+        int rc = ble_l2cap_send(link->chan, om);
+        if (rc == 0) {
+            result = ESP_OK;
+        } else if (rc == BLE_HS_ESTALLED) {
+            // Taken, but the rest of it goes out once the peer grants credits
+            link->stalled = true;
+            result = ESP_OK;
+        } else if (rc == BLE_HS_EBUSY) {
+            os_mbuf_free_chain(om);
+        } else {
+            result = ESP_ERR_INVALID_STATE;
+        }
+    }
+    xSemaphoreGive(linkMutex);
+    return result;
+}
+
+// Static L2CAP event hook
+int L2capTransport::eventHandler(struct ble_l2cap_event* event, void* arg) {
+    (void)arg;
+    if (!instance) {
+        return BLE_HS_ENOTCONN;
+    }
+    return instance->handleEvent(event);
+}
+
+// Track channels and hand their SDUs to the receiver (host task)
+int L2capTransport::handleEvent(struct ble_l2cap_event* event) {
+    Link* link;
+    switch (event->type) {
+        case BLE_L2CAP_EVENT_COC_ACCEPT:
+            // One free link and a receive buffer, or the channel is refused
+            return findLink(nullptr) && giveReceiveBuffer(event->accept.chan) ? 0 : BLE_HS_ENOMEM;
+
+        case BLE_L2CAP_EVENT_COC_CONNECTED: {
+            if (event->connect.status != 0) {
+                return 0;
+            }
+            struct ble_l2cap_chan_info info;
+            xSemaphoreTake(linkMutex, portMAX_DELAY);
+            link = findLink(nullptr);
+            if (!link || ble_l2cap_get_chan_info(event->connect.chan, &info) != 0) {
+                xSemaphoreGive(linkMutex);
+                ble_l2cap_disconnect(event->connect.chan);
+                return 0;
+            }
+            link->chan = event->connect.chan;
+            link->connId = event->connect.conn_handle;
+            link->stalled = false;
+            xSemaphoreGive(linkMutex);
+
+            uint16_t sduSize = info.peer_coc_mtu < frameSize ? info.peer_coc_mtu : frameSize;
+            receiver->onTransportOpened(this, event->connect.conn_handle, sduSize);
+            return 0;
+        }
+
+        case BLE_L2CAP_EVENT_COC_DISCONNECTED:
+            xSemaphoreTake(linkMutex, portMAX_DELAY);
+            link = findLink(event->disconnect.chan);
+            if (link) {
+                link->chan = nullptr;
+            }
+            xSemaphoreGive(linkMutex);
+            if (link) {
+                receiver->onTransportClosed(this, event->disconnect.conn_handle);
+            }
+            return 0;
+
+        case BLE_L2CAP_EVENT_COC_DATA_RECEIVED: {
+            struct os_mbuf* sdu = event->receive.sdu_rx;
+            uint16_t length = OS_MBUF_PKTLEN(sdu);
+            bool fits = length <= frameSize && os_mbuf_copydata(sdu, 0, length, frameBuffer) == 0;
+            os_mbuf_free_chain(sdu);
+
+            // The next SDU needs its buffer before the peer may send it
+            if (!giveReceiveBuffer(event->receive.chan)) {
+                ble_l2cap_disconnect(event->receive.chan);
+                return 0;
+            }
+            if (fits) {
+                receiver->onTransportFrame(this, event->receive.conn_handle, frameBuffer, length);
+            }
+            return 0;
+        }
+
+        case BLE_L2CAP_EVENT_COC_TX_UNSTALLED:
+            xSemaphoreTake(linkMutex, portMAX_DELAY);
+            link = findLink(event->tx_unstalled.chan);
+            if (link) {
+                link->stalled = false;
+            }
+            xSemaphoreGive(linkMutex);
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+// Queue an empty SDU buffer for the next frame of a channel
+bool L2capTransport::giveReceiveBuffer(struct ble_l2cap_chan* chan) {
+    struct os_mbuf* sdu = os_mbuf_get_pkthdr(&rxPool, 0);
+    if (!sdu) {
+        return false;
+    }
+    if (ble_l2cap_recv_ready(chan, sdu) != 0) {
+        os_mbuf_free_chain(sdu);
+        return false;
+    }
+    return true;
+}
+
+// Find the link of a channel, or a free one for nullptr
+L2capTransport::Link* L2capTransport::findLink(struct ble_l2cap_chan* chan) {
+    for (size_t i = 0; i < CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM; i++) {
+        if (links[i].chan == chan) {
+            return &links[i];
+        }
+    }
+    return nullptr;
+}
+
+#endif // CHUNKED_BLE_L2CAP_COC
@@ -0,0 +1,82 @@
+#ifndef L2CAP_TRANSPORT_H
+#define L2CAP_TRANSPORT_H
+
+#include "BLETransport.h"
+#include "BLEStack.h"
+
+#if CHUNKED_BLE_L2CAP_COC
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+/**
+ * L2capTransport - Frames as SDUs of LE Credit Based channels (NimBLE only)
+ *
+ * Listens on one LE PSM; every client may open one channel to it. Each frame is one SDU,
+ * so frames keep their boundaries without any extra header, and the channel's own credits
+ * pace the link instead of ATT notifications. SDUs up to the frame size passed to the
+ * constructor are accepted; larger ones are dropped.
+ *
+ * NimBLE cannot remove an L2CAP server again. Its events go to the latest instance, and
+ * a new instance for the same PSM takes over the registered server.
+ *
+ * Usage:
+ *   L2capTransport* coc = new L2capTransport(receiver, 514);
+ *   coc->begin(0x0080);     // channels are reported through the receiver
+ */
+class L2capTransport : public BLETransport {
+public:
+    static const uint16_t RX_BUFFERS_PER_CHANNEL = 2;  // SDU being received and the one handed out
+
+    /**
+     * Constructor
+     *
+     * @param receiver Gets the frames and channel changes, from the host task
+     * @param frameSize Largest SDU accepted and sent
+     */
+    L2capTransport(Receiver* receiver, uint16_t frameSize);
+    ~L2capTransport();
+
+    /**
+     * Listen for channels
+     *
+     * @param psm LE PSM (0x0080..0x00FF)
+     * @return false if the receive buffers or the server could not be set up
+     */
+    bool begin(uint16_t psm);
+
+    const char* name() const override;
+    esp_err_t send(uint16_t connId, const uint8_t* data, size_t length) override;
+
+private:
+    // Channel of one client
+    struct Link {
+        struct ble_l2cap_chan* chan = nullptr;
+        uint16_t connId = 0;
+        volatile bool stalled = false;  // Last SDU still waiting for peer credits
+    };
+
+    Receiver* receiver;
+    const uint16_t frameSize;
+    Link links[CONFIG_BT_NIMBLE_L2CAP_COC_MAX_NUM];
+    SemaphoreHandle_t linkMutex;     // Keeps a channel from closing while a TX task sends on it
+
+    // SDU receive buffers
+    os_membuf_t* rxMemory;
+    struct os_mempool rxMempool;
+    struct os_mbuf_pool rxPool;
+    uint8_t* frameBuffer;            // Flat copy of the SDU being delivered, host task only
+
+    static L2capTransport* instance;  // Target of the static L2CAP event handler
+
+    static int eventHandler(struct ble_l2cap_event* event, void* arg);
+    int handleEvent(struct ble_l2cap_event* event);
+    bool giveReceiveBuffer(struct ble_l2cap_chan* chan);
+    Link* findLink(struct ble_l2cap_chan* chan);
+
+    L2capTransport(const L2capTransport&);
+    L2capTransport& operator=(const L2capTransport&);
+};
+
+#endif // CHUNKED_BLE_L2CAP_COC
+
+#endif // L2CAP_TRANSPORT_H
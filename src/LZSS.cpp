@@ -0,0 +1,246 @@
+#include "LZSS.h"
+#include <string.h>
+#include <new>
+#include <vector>
+
+namespace {
+
+const unsigned HASH_BITS = 10;             // 4 KB of chain heads while compressing
+const size_t HASH_SIZE = (size_t)1 << HASH_BITS;
+const unsigned MAX_CHAIN = 16;             // Candidates tried per position
+const unsigned LENGTH_BITS = 5;
+const int32_t NO_POSITION = -1;
+
+// Hash of the 3 bytes starting at p
+inline size_t hash3(const uint8_t* p) {
+    uint32_t value = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+} // namespace
+
+// Compress a buffer
+bool LZSS::compress(const uint8_t* data, size_t length, std::string& out) {
+    out.clear();
+    if (length <= LENGTH_SIZE || (uint64_t)length > 0xFFFFFFFFu) {
+        return false;
+    }
+    out.reserve(length);
+    uint32_t length32 = length;
+    out.append((const char*)&length32, LENGTH_SIZE);
+
+    // Hash chains over the window: head per hash, prev per window slot, absolute positions
+    std::vector<int32_t> head(HASH_SIZE, NO_POSITION);
+    std::vector<int32_t> prev(WINDOW_SIZE, NO_POSITION);
+
+    size_t flagPosition = 0;
+    unsigned flagBit = 8;
+    size_t position = 0;
+    while (position < length) {
+        if (flagBit == 8) {
+            flagPosition = out.size();
+            out.push_back(0);
+            flagBit = 0;
+        }
+
+        // Longest match in the window, nearest first on ties
+        size_t bestLength = 0;
+        size_t bestDistance = 0;
+        size_t maxLength = length - position < MAX_MATCH ? length - position : MAX_MATCH;
+        if (maxLength >= MIN_MATCH) {
+            int32_t candidate = head[hash3(data + position)];
+            for (unsigned chain = 0; chain < MAX_CHAIN && candidate != NO_POSITION &&
+                 position - (size_t)candidate <= WINDOW_SIZE; chain++) {
+                const uint8_t* a = data + candidate;
+                const uint8_t* b = data + position;
+                size_t matched = 0;
+                while (matched < maxLength && a[matched] == b[matched]) {
+                    matched++;
+                }
+                if (matched > bestLength) {
+                    bestLength = matched;
+                    bestDistance = position - candidate;
+                    if (matched == maxLength) {
+                        break;
+                    }
+                }
+                candidate = prev[candidate & (WINDOW_SIZE - 1)];
+            }
+        }
+
+        size_t step;
+        if (bestLength >= MIN_MATCH) {
+            uint16_t token = ((bestDistance - 1) << LENGTH_BITS) | (bestLength - MIN_MATCH);
+            out[flagPosition] |= 1 << flagBit;
+            out.append((const char*)&token, sizeof(token));
+            step = bestLength;
+        } else {
+            out.push_back(data[position]);
+            step = 1;
+        }
+        flagBit++;
+
+        // Incompressible data - stop before spending more time on it
+        if (out.size() >= length) {
+            return false;
+        }
+
+        // Every position passed over becomes a match candidate
+        for (size_t end = position + step; position < end; position++) {
+            if (position + MIN_MATCH <= length) {
+                size_t h = hash3(data + position);
+                prev[position & (WINDOW_SIZE - 1)] = head[h];
+                head[h] = position;
+            }
+        }
+    }
+    return true;
+}
+
+// Decompress a complete stream
+bool LZSS::decompress(const uint8_t* data, size_t length, std::string& out, size_t maxLength) {
+    out.clear();
+    if (length < LENGTH_SIZE) {
+        return false;
+    }
+    uint32_t expected;
+    memcpy(&expected, data, LENGTH_SIZE);
+    if (expected > maxLength) {
+        return false;
+    }
+    out.reserve(expected);
+
+    Decoder decoder;
+    if (!decoder.begin(maxLength)) {
+        return false;
+    }
+    bool ok = decoder.feed(data, length, [&out](const uint8_t* piece, size_t pieceLength) {
+        out.append((const char*)piece, pieceLength);
+    });
+    return ok && decoder.isFinished();
+}
+
+// Constructor
+LZSS::Decoder::Decoder()
+    : window(nullptr), maxLength(0), expectedLength(0), produced(0), writePosition(0), flushPosition(0),
+      lengthBytes(0), flags(0), flagBits(0), referenceLow(0), haveReferenceLow(false), failed(false) {
+}
+
+// Destructor
+LZSS::Decoder::~Decoder() {
+    delete[] window;
+}
+
+// Start a new stream
+bool LZSS::Decoder::begin(size_t maxLength) {
+    if (!window) {
+        window = new (std::nothrow) uint8_t[WINDOW_SIZE];
+    }
+    this->maxLength = maxLength;
+    expectedLength = 0;
+    produced = 0;
+    writePosition = 0;
+    flushPosition = 0;
+    lengthBytes = 0;
+    flags = 0;
+    flagBits = 0;
+    haveReferenceLow = false;
+    failed = window == nullptr;
+    return !failed;
+}
+
+// Release the window
+void LZSS::Decoder::end() {
+    delete[] window;
+    window = nullptr;
+    failed = true;
+}
+
+// Decode the next piece of the stream
+bool LZSS::Decoder::feed(const uint8_t* data, size_t length, const Sink& sink) {
+    for (size_t i = 0; i < length && !failed; i++) {
+        uint8_t value = data[i];
+
+        if (lengthBytes < LENGTH_SIZE) {
+            expectedLength |= (size_t)value << (8 * lengthBytes);
+            if (++lengthBytes == LENGTH_SIZE && expectedLength > maxLength) {
+                failed = true;
+            }
+            continue;
+        }
+
+        // Nothing may follow the last token
+        if (produced == expectedLength) {
+            failed = true;
+            break;
+        }
+
+        if (flagBits == 0) {
+            flags = value;
+            flagBits = 8;
+            continue;
+        }
+
+        if (!(flags & 1)) {
+            put(value, sink);
+        } else if (!haveReferenceLow) {
+            referenceLow = value;
+            haveReferenceLow = true;
+            continue;
+        } else {
+            // Reference into the window, bytes may overlap the ones being written
+            uint16_t token = referenceLow | ((uint16_t)value << 8);
+            haveReferenceLow = false;
+            size_t distance = (token >> 5) + 1;
+            size_t matchLength = (token & 0x1F) + MIN_MATCH;
+            if (distance > produced || matchLength > expectedLength - produced) {
+                failed = true;
+                break;
+            }
+            for (size_t n = 0; n < matchLength; n++) {
+                put(window[(writePosition - distance) & (WINDOW_SIZE - 1)], sink);
+            }
+        }
+        flags >>= 1;
+        flagBits--;
+    }
+
+    if (window) {
+        flush(sink);
+    }
+    return !failed;
+}
+
+// Append one byte to the window, handing out the window whenever it wraps
+void LZSS::Decoder::put(uint8_t value, const Sink& sink) {
+    window[writePosition] = value;
+    produced++;
+    if (++writePosition == WINDOW_SIZE) {
+        flush(sink);
+        writePosition = 0;
+        flushPosition = 0;
+    }
+}
+
+// Hand the bytes written since the last flush to the sink
+void LZSS::Decoder::flush(const Sink& sink) {
+    if (writePosition > flushPosition) {
+        sink(window + flushPosition, writePosition - flushPosition);
+        flushPosition = writePosition;
+    }
+}
+
+// Check if all original_length bytes were produced
+bool LZSS::Decoder::isFinished() const {
+    return !failed && lengthBytes == LENGTH_SIZE && produced == expectedLength;
+}
+
+// Check if the stream was rejected
+bool LZSS::Decoder::hasFailed() const {
+    return failed;
+}
+
+// Get decompressed bytes produced so far
+size_t LZSS::Decoder::outputLength() const {
+    return produced;
+}
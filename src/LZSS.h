@@ -0,0 +1,129 @@
+#ifndef LZSS_H
+#define LZSS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <functional>
+
+/**
+ * LZSS - Byte-aligned LZSS compression with a small fixed window (heatshrink-style)
+ *
+ * Stream format (little-endian):
+ *   original_length(4), then groups of a flag byte and up to 8 tokens.
+ *   Flag bit i (LSB first) clear: literal byte. Set: reference(2) =
+ *   (distance - 1) << 5 | (length - MIN_MATCH), copied from the last WINDOW_SIZE bytes.
+ *   The stream ends once original_length bytes are produced.
+ *
+ * The decoder needs only WINDOW_SIZE bytes of state, so a stream can be inflated
+ * piece by piece as it arrives, whatever the chunk boundaries.
+ *
+ * Usage:
+ *   std::string packed;
+ *   if (LZSS::compress(data, length, packed)) { ... }     // false if it would not shrink
+ *
+ *   LZSS::Decoder decoder;
+ *   decoder.begin(maxLength);
+ *   decoder.feed(piece, pieceLength, [](const uint8_t* out, size_t outLength) { ... });
+ *   decoder.isFinished();
+ */
+class LZSS {
+public:
+    static const size_t WINDOW_SIZE = 2048;     // 11-bit distances
+    static const size_t MIN_MATCH = 3;          // Shorter matches cost more than literals
+    static const size_t MAX_MATCH = 34;         // 5-bit lengths
+    static const size_t LENGTH_SIZE = 4;        // original_length ahead of the tokens
+
+    // Output handed out by the decoder, valid only during the call
+    typedef std::function<void(const uint8_t* data, size_t length)> Sink;
+
+    /**
+     * Compress a buffer
+     *
+     * @param data Data to compress
+     * @param length Length of data
+     * @param out Compressed stream (contents undefined on false)
+     * @return false if the stream would not be smaller than the data
+     */
+    static bool compress(const uint8_t* data, size_t length, std::string& out);
+
+    /**
+     * Decompress a complete stream
+     *
+     * @param data Compressed stream
+     * @param length Length of the stream
+     * @param out Decompressed data
+     * @param maxLength Largest original_length accepted
+     * @return false if the stream is corrupt, truncated or too large
+     */
+    static bool decompress(const uint8_t* data, size_t length, std::string& out, size_t maxLength);
+
+    /**
+     * Decoder - Incremental decompression in a WINDOW_SIZE ring
+     */
+    class Decoder {
+    public:
+        Decoder();
+        ~Decoder();
+
+        /**
+         * Start a new stream, allocating the window on first use
+         *
+         * @param maxLength Largest original_length accepted
+         * @return false if the window could not be allocated
+         */
+        bool begin(size_t maxLength);
+
+        /**
+         * Release the window
+         */
+        void end();
+
+        /**
+         * Decode the next piece of the stream
+         *
+         * @param data Compressed bytes, any split of the stream
+         * @param length Length of data
+         * @param sink Receives the decompressed bytes, in order, in pieces of up to WINDOW_SIZE
+         * @return false once the stream turned out corrupt or too large
+         */
+        bool feed(const uint8_t* data, size_t length, const Sink& sink);
+
+        /**
+         * Check if all original_length bytes were produced
+         */
+        bool isFinished() const;
+
+        /**
+         * Check if the stream was rejected
+         */
+        bool hasFailed() const;
+
+        /**
+         * Get decompressed bytes produced so far
+         */
+        size_t outputLength() const;
+
+    private:
+        uint8_t* window;
+        size_t maxLength;
+        size_t expectedLength;    // original_length, valid once all of it was read
+        size_t produced;
+        size_t writePosition;     // Next window byte to write
+        size_t flushPosition;     // First window byte not yet handed to the sink
+        uint8_t lengthBytes;      // Bytes of original_length read so far
+        uint8_t flags;
+        uint8_t flagBits;         // Tokens left in the current group
+        uint8_t referenceLow;
+        bool haveReferenceLow;
+        bool failed;
+
+        void put(uint8_t value, const Sink& sink);
+        void flush(const Sink& sink);
+
+        Decoder(const Decoder&);
+        Decoder& operator=(const Decoder&);
+    };
+};
+
+#endif // LZSS_H
@@ -0,0 +1,99 @@
+#include "PacketRing.h"
+#include <string.h>
+#include <new>
+
+// Constructor
+PacketRing::PacketRing(size_t capacity)
+    : buffer(new (std::nothrow) uint8_t[capacity]), size(buffer ? capacity : 0),
+      head(0), tail(0), peekPosition(0), peekLength(0) {
+}
+
+// Destructor
+PacketRing::~PacketRing() {
+    delete[] buffer;
+}
+
+// Check if the buffer was allocated
+bool PacketRing::isValid() const {
+    return buffer != nullptr;
+}
+
+// Get buffer size in bytes
+size_t PacketRing::capacity() const {
+    return size;
+}
+
+// Copy a packet into the ring
+bool PacketRing::push(const uint8_t* data, size_t length) {
+    // Records never split, so only packets below half the buffer are guaranteed to fit
+    size_t need = LENGTH_SIZE + length;
+    if (length > MAX_PACKET_SIZE || 2 * need >= size) {
+        return false;
+    }
+
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+
+    // head == tail means empty, so the write position must never catch up with tail
+    size_t position;
+    if (h >= t) {
+        size_t untilEnd = size - h;
+        if (untilEnd > need || (untilEnd == need && t != 0)) {
+            position = h;
+        } else if (t > need) {
+            // Not enough room before the end - mark the wrap and start over at 0
+            if (untilEnd >= LENGTH_SIZE) {
+                uint16_t marker = WRAP_MARKER;
+                memcpy(buffer + h, &marker, LENGTH_SIZE);
+            }
+            position = 0;
+        } else {
+            return false;
+        }
+    } else if (t - h > need) {
+        position = h;
+    } else {
+        return false;
+    }
+
+    uint16_t length16 = length;
+    memcpy(buffer + position, &length16, LENGTH_SIZE);
+    if (length) {
+        memcpy(buffer + position + LENGTH_SIZE, data, length);
+    }
+
+    size_t newHead = position + need;
+    head.store(newHead == size ? 0 : newHead, std::memory_order_release);
+    return true;
+}
+
+// Look at the oldest packet
+bool PacketRing::peek(const uint8_t*& data, size_t& length) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    if (t == h) {
+        return false;
+    }
+
+    // Too little room left for a length means an implicit wrap
+    uint16_t length16 = WRAP_MARKER;
+    if (size - t >= LENGTH_SIZE) {
+        memcpy(&length16, buffer + t, LENGTH_SIZE);
+    }
+    if (length16 == WRAP_MARKER) {
+        t = 0;
+        memcpy(&length16, buffer, LENGTH_SIZE);
+    }
+
+    peekPosition = t;
+    peekLength = length16;
+    data = buffer + t + LENGTH_SIZE;
+    length = length16;
+    return true;
+}
+
+// Remove the packet returned by the last peek()
+void PacketRing::pop() {
+    size_t newTail = peekPosition + LENGTH_SIZE + peekLength;
+    tail.store(newTail == size ? 0 : newTail, std::memory_order_release);
+}
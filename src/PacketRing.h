@@ -0,0 +1,90 @@
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * PacketRing - Lock-free single-producer/single-consumer ring of variable-length packets
+ *
+ * One preallocated buffer, no allocation after construction. Each packet is stored
+ * contiguously (length prefix + data), so the consumer can process it in place.
+ * Exactly one task may push and exactly one task may peek/pop.
+ *
+ * Usage:
+ *   PacketRing ring(8192);
+ *   ring.push(data, length);                 // producer
+ *   const uint8_t* packet; size_t length;
+ *   while (ring.peek(packet, length)) {      // consumer
+ *       process(packet, length);
+ *       ring.pop();
+ *   }
+ */
+class PacketRing {
+public:
+    static const size_t MAX_PACKET_SIZE = 0xFFFE;  // 0xFFFF marks a wrap to the buffer start
+
+    /**
+     * Constructor - Allocates the ring buffer
+     *
+     * @param capacity Buffer size in bytes (each packet takes 2 bytes extra,
+     *                 packets must stay below half of it)
+     */
+    explicit PacketRing(size_t capacity);
+
+    /**
+     * Destructor - Frees the ring buffer
+     */
+    ~PacketRing();
+
+    /**
+     * Check if the buffer was allocated
+     */
+    bool isValid() const;
+
+    /**
+     * Copy a packet into the ring (producer only)
+     *
+     * @param data Packet data
+     * @param length Packet length, 0 is allowed
+     * @return false if the ring has no room for the packet, or the packet
+     *         needs half the buffer or more
+     */
+    bool push(const uint8_t* data, size_t length);
+
+    /**
+     * Look at the oldest packet without removing it (consumer only)
+     *
+     * @param data Set to the packet data, valid until pop()
+     * @param length Set to the packet length
+     * @return false if the ring is empty
+     */
+    bool peek(const uint8_t*& data, size_t& length);
+
+    /**
+     * Remove the packet returned by the last peek() (consumer only)
+     */
+    void pop();
+
+    /**
+     * Get buffer size in bytes
+     */
+    size_t capacity() const;
+
+private:
+    static const uint16_t WRAP_MARKER = 0xFFFF;
+    static const size_t LENGTH_SIZE = 2;
+
+    uint8_t* buffer;
+    size_t size;
+    std::atomic<size_t> head;   // Next write position, owned by the producer
+    std::atomic<size_t> tail;   // Next read position, owned by the consumer
+    size_t peekPosition;        // Start of the packet returned by peek()
+    size_t peekLength;
+
+    PacketRing(const PacketRing&);
+    PacketRing& operator=(const PacketRing&);
+};
+
+#endif // PACKET_RING_H
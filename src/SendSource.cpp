@@ -0,0 +1,51 @@
+#include "SendSource.h"
+#include <string.h>
+
+// Constructor
+MemorySource::MemorySource(const uint8_t* data, size_t length)
+    : data(data), length(length) {
+}
+
+// Get payload length
+size_t MemorySource::size() const {
+    return length;
+}
+
+// Copy part of the payload
+bool MemorySource::read(size_t offset, uint8_t* buffer, size_t length) {
+    memcpy(buffer, data + offset, length);
+    return true;
+}
+
+// Constructor
+FileSource::FileSource(fs::File& file)
+    : file(file), length(file ? file.size() : 0) {
+}
+
+// Get payload length
+size_t FileSource::size() const {
+    return length;
+}
+
+// Read part of the file, seeking only when the chunks are not read in order
+bool FileSource::read(size_t offset, uint8_t* buffer, size_t length) {
+    if (file.position() != offset && !file.seek(offset)) {
+        return false;
+    }
+    return file.read(buffer, length) == length;
+}
+
+// Constructor
+CallbackSource::CallbackSource(size_t length, Reader reader)
+    : length(length), reader(reader) {
+}
+
+// Get payload length
+size_t CallbackSource::size() const {
+    return length;
+}
+
+// Let the callback produce part of the payload
+bool CallbackSource::read(size_t offset, uint8_t* buffer, size_t length) {
+    return reader && reader(offset, buffer, length);
+}
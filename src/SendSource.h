@@ -0,0 +1,96 @@
+#ifndef SEND_SOURCE_H
+#define SEND_SOURCE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <FS.h>
+
+/**
+ * SendSource - Pull-style payload for ChunkedBLEProtocol::sendStream()
+ *
+ * The protocol never holds more than one chunk of a source: it reads the payload
+ * once up front for the global CRC32 and then again chunk by chunk while sending,
+ * re-reading chunks the receiver reports missing. The bytes must therefore stay
+ * the same until sendStream() returns.
+ *
+ * Usage:
+ *   File log = LittleFS.open("/log.txt");
+ *   FileSource source(log);
+ *   protocol.sendStream(connId, source);
+ *
+ *   MemorySource flash(mappedPartition, partitionSize);   // e.g. from esp_partition_mmap()
+ */
+class SendSource {
+public:
+    virtual ~SendSource() {}
+
+    /**
+     * Get payload length in bytes
+     */
+    virtual size_t size() const = 0;
+
+    /**
+     * Read part of the payload
+     *
+     * @param offset Byte offset, offset + length <= size()
+     * @param buffer Receives exactly length bytes
+     * @param length Bytes to read, at most one chunk
+     * @return false if the bytes could not be read - the transfer fails
+     */
+    virtual bool read(size_t offset, uint8_t* buffer, size_t length) = 0;
+};
+
+/**
+ * MemorySource - Payload already addressable in memory or memory-mapped flash
+ */
+class MemorySource : public SendSource {
+public:
+    MemorySource(const uint8_t* data, size_t length);
+
+    size_t size() const override;
+    bool read(size_t offset, uint8_t* buffer, size_t length) override;
+
+private:
+    const uint8_t* data;
+    size_t length;
+};
+
+/**
+ * FileSource - Payload read from an open Arduino FS file (LittleFS, SPIFFS, SD)
+ */
+class FileSource : public SendSource {
+public:
+    /**
+     * Constructor
+     *
+     * @param file Open file, kept open by the caller while sending; read from its start
+     */
+    explicit FileSource(fs::File& file);
+
+    size_t size() const override;
+    bool read(size_t offset, uint8_t* buffer, size_t length) override;
+
+private:
+    fs::File& file;
+    size_t length;
+};
+
+/**
+ * CallbackSource - Payload produced by a function for any offset
+ */
+class CallbackSource : public SendSource {
+public:
+    typedef std::function<bool(size_t offset, uint8_t* buffer, size_t length)> Reader;
+
+    CallbackSource(size_t length, Reader reader);
+
+    size_t size() const override;
+    bool read(size_t offset, uint8_t* buffer, size_t length) override;
+
+private:
+    size_t length;
+    Reader reader;
+};
+
+#endif // SEND_SOURCE_H
@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include "../ChunkedBLEProtocol.h"
+
+/**
+ * Benchmark firmware - built by env:esp32-c3-devkitm-1-bench, driven by benchmark_ble_client.py
+ *
+ * Received transfers are counted and dropped, except these text commands:
+ *   BENCH SEND <bytes> <text|random>   answer with a generated payload of that size
+ *   BENCH STATS                        answer with heap and protocol counters as JSON
+ *   BENCH RESET                        reset the counters
+ *
+ * Timings per transfer come from the client and the diagnostics characteristic; protocol
+ * logging is compiled down to errors so the serial port does not pace the link.
+ */
+
+const size_t MAX_BENCH_PAYLOAD = ChunkedBLEProtocol::MAX_TOTAL_DATA_SIZE;  // The client's default receive limit
+const size_t MAX_COMMAND_LENGTH = 64;
+
+BLEServer* pServer = nullptr;
+ChunkedBLEProtocol* protocol = nullptr;
+
+// Command of the last received transfer, handled by loop() so the receive path never sends
+char pendingCommand[MAX_COMMAND_LENGTH + 1];
+volatile bool commandPending = false;
+
+// Sink counters
+volatile uint32_t receivedTransfers = 0;
+volatile uint32_t receivedBytes = 0;
+
+// Payload of the requested size: repeated JSON records, or xorshift32 bytes that do not compress
+std::string makePayload(size_t size, bool random) {
+    std::string payload;
+    payload.reserve(size);
+    if (random) {
+        uint32_t state = 0x2545F491;
+        while (payload.size() < size) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            payload.push_back((char)state);
+        }
+        return payload;
+    }
+    char record[64];
+    for (uint32_t id = 0; payload.size() < size; id++) {
+        int length = snprintf(record, sizeof(record), "{\"id\":%u,\"temp\":%u.%u,\"status\":\"ok\"},",
+                              id, 20 + id % 10, id % 7);
+        payload.append(record, std::min((size_t)length, size - payload.size()));
+    }
+    return payload;
+}
+
+// Answer with the counters that are not in the diagnostics characteristic
+void sendStats() {
+    ChunkedBLEProtocol::TransferStats stats = protocol->getStatistics();
+    char json[320];
+    snprintf(json, sizeof(json),
+             "{\"free_heap\":%u,\"min_free_heap\":%u,\"max_alloc_heap\":%u,\"loop_stack_free\":%u,"
+             "\"received_transfers\":%u,\"received_bytes\":%u,\"send_allocations\":%u,"
+             "\"crc_time_us\":%u,\"reassembly_time_us\":%u,\"callback_time_us\":%u,\"uptime_ms\":%u}",
+             ESP.getFreeHeap(), ESP.getMinFreeHeap(), ESP.getMaxAllocHeap(),
+             (unsigned)uxTaskGetStackHighWaterMark(nullptr), receivedTransfers, receivedBytes,
+             stats.sendAllocations, stats.crcTimeUs, stats.reassemblyTimeUs, stats.callbackTimeUs, millis());
+    protocol->sendData(json);
+}
+
+// Run one command from the client
+void handleCommand(const char* command) {
+    unsigned long size = 0;
+    char kind[16] = "text";
+    if (sscanf(command, "BENCH SEND %lu %15s", &size, kind) >= 1) {
+        if (size == 0 || size > MAX_BENCH_PAYLOAD) {
+            Serial.printf("[BENCH] Payload size %lu out of range\n", size);
+            return;
+        }
+        std::string payload = makePayload(size, strcmp(kind, "random") == 0);
+        uint32_t start = micros();
+        bool sent = protocol->sendData(payload);
+        Serial.printf("[BENCH] Sent %lu %s bytes in %u us%s\n", size, kind, micros() - start, sent ? "" : " - failed");
+    } else if (strcmp(command, "BENCH STATS") == 0) {
+        sendStats();
+    } else if (strcmp(command, "BENCH RESET") == 0) {
+        protocol->resetStatistics();
+        receivedTransfers = 0;
+        receivedBytes = 0;
+        Serial.println("[BENCH] Counters reset");
+    } else {
+        Serial.printf("[BENCH] Unknown command: %s\n", command);
+    }
+}
+
+void onDataReceived(const std::string& data) {
+    receivedTransfers++;
+    receivedBytes += data.size();
+    if (data.size() <= MAX_COMMAND_LENGTH && data.compare(0, 6, "BENCH ") == 0 && !commandPending) {
+        memcpy(pendingCommand, data.data(), data.size());
+        pendingCommand[data.size()] = '\0';
+        commandPending = true;
+    }
+}
+
+void onConnectionChanged(bool connected) {
+    Serial.printf("[BENCH] Client %s\n", connected ? "connected" : "disconnected");
+    if (!connected) {
+        commandPending = false;
+        BLEDevice::startAdvertising();
+    }
+}
+
+void setup() {
+    Serial.begin(115200);
+    Serial.println("[SETUP] Starting ChunkedBLEProtocol benchmark firmware");
+
+    BLEDevice::init("BLE-Chunked-Bench");
+    pServer = BLEDevice::createServer();
+    protocol = new ChunkedBLEProtocol(pServer);
+    protocol->setDataReceivedCallback(onDataReceived);
+    protocol->setConnectionCallback(onConnectionChanged);
+    protocol->setLinkProfile(ChunkedBLEProtocol::LINK_PROFILE_THROUGHPUT);
+
+    Serial.printf("[SETUP] Ready, free heap %u bytes\n", ESP.getFreeHeap());
+}
+
+void loop() {
+    if (commandPending) {
+        handleCommand(pendingCommand);
+        commandPending = false;
+    }
+    delay(1);
+}
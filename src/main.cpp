@@ -1,26 +1,31 @@
 #include <Arduino.h>
-#include <BLEDevice.h>
-#include <BLEServer.h>
-#include "ChunkedBLEProtocol.h"
+#include "ChunkedBLEProtocol.h"  // Brings in the BLE stack selected by CHUNKED_BLE_NIMBLE
 
 // Global objects
 BLEServer* pServer = nullptr;
 ChunkedBLEProtocol* protocol = nullptr;
 
+// Pending echo response, queued from loop() once the simulated processing time is over.
+// sendJSONAsync() hands it to the protocol's TX task, so neither loop() nor the BLE task blocks;
+// clients that take CBOR get the response CBOR-encoded, and their CBOR arrives here as JSON text.
+// The BLE task fills it while loop() takes it, so both hold responseMutex around it.
+const uint32_t RESPONSE_DELAY_MS = 5000;  // Simulated processing time
+SemaphoreHandle_t responseMutex = nullptr;
+std::string pendingResponse;
+uint32_t responseReceivedAt = 0;
+bool responsePending = false;
+
 // Application callbacks
 void onDataReceived(const std::string& data) {
     Serial.println("[APP] Complete JSON data received, will respond in 5 seconds");
     
     // Process received JSON data here
     // For demo, we'll echo it back after a delay
-    
-    delay(5000); // Simulate processing time
-    
-    Serial.println("[APP] Sending response back to client...");
-    if (protocol && protocol->isDeviceConnected()) {
-        protocol->sendData(data); // Echo back the same data
-        Serial.println("[APP] Response sent successfully");
-    }
+    xSemaphoreTake(responseMutex, portMAX_DELAY);
+    pendingResponse = data;
+    responseReceivedAt = millis();
+    responsePending = true;
+    xSemaphoreGive(responseMutex);
 }
 
 void onConnectionChanged(bool connected) {
@@ -28,6 +33,10 @@ void onConnectionChanged(bool connected) {
         Serial.println("[APP] Client connected - ready for data exchange");
     } else {
         Serial.println("[APP] Client disconnected - clearing pending responses");
+        xSemaphoreTake(responseMutex, portMAX_DELAY);
+        responsePending = false;
+        pendingResponse.clear();
+        xSemaphoreGive(responseMutex);
         
         // Restart advertising for next connection
         Serial.println("[APP] Connection lost, restarting advertising");
@@ -36,6 +45,14 @@ void onConnectionChanged(bool connected) {
     }
 }
 
+void onResponseSent(uint32_t messageId, bool success) {
+    if (success) {
+        Serial.printf("[APP] Response %u sent successfully\n", messageId);
+    } else {
+        Serial.printf("[APP] Failed to send response %u\n", messageId);
+    }
+}
+
 void onProgress(int current, int total, bool isReceiving) {
     const char* direction = isReceiving ? "Receiving" : "Sending";
     Serial.printf("[PROGRESS] %s: %d/%d chunks\n", direction, current, total);
@@ -44,6 +61,7 @@ void onProgress(int current, int total, bool isReceiving) {
 void setup() {
     Serial.begin(115200);
     Serial.println("[SETUP] Starting ESP32 BLE JSON Transfer Server");
+    responseMutex = xSemaphoreCreateMutex();
     
     // Initialize BLE
     BLEDevice::init("BLE-Chunked");
@@ -61,10 +79,34 @@ void setup() {
     protocol->setConnectionCallback(onConnectionChanged);
     protocol->setProgressCallback(onProgress);
     
+    // Short connection interval, 2M PHY and DLE while JSON is moving, relaxed in between
+    protocol->setLinkProfile(ChunkedBLEProtocol::LINK_PROFILE_THROUGHPUT);
+    
     Serial.println("[SETUP] ChunkedBLEProtocol initialized with callbacks");
     Serial.println("[SETUP] Server ready for connections!");
 }
 
 void loop() {
+    // Take the response out under the mutex, a new one may arrive while this one is queued
+    std::string response;
+    bool due = false;
+    xSemaphoreTake(responseMutex, portMAX_DELAY);
+    if (responsePending && millis() - responseReceivedAt >= RESPONSE_DELAY_MS) {
+        responsePending = false;
+        response.swap(pendingResponse);
+        due = true;
+    }
+    xSemaphoreGive(responseMutex);
     
+    if (due) {
+        Serial.println("[APP] Sending response back to client...");
+        if (protocol && protocol->isDeviceConnected()) {
+            // Echo back the same data
+            uint32_t messageId = protocol->sendJSONAsync(std::move(response), onResponseSent);
+            if (messageId == 0) {
+                Serial.println("[APP] Failed to queue response");
+            }
+        }
+    }
+    delay(10);
 }
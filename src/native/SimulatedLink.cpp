@@ -0,0 +1,92 @@
+#include "SimulatedLink.h"
+
+static const size_t ATT_HEADER_SIZE = 3;
+
+// Constructor
+SimulatedLink::SimulatedLink(const Config& config)
+    : config(config), counters(), linkFreeUs(0), state(config.seed ? config.seed : 1) {
+}
+
+// Queue a frame for delivery
+bool SimulatedLink::send(const uint8_t* data, size_t length, uint64_t nowUs) {
+    if (length > maxFrameSize()) {
+        counters.refused++;
+        return false;
+    }
+    counters.sent++;
+
+    // Frames leave one after another, each taking its airtime
+    uint64_t departUs = nowUs > linkFreeUs ? nowUs : linkFreeUs;
+    linkFreeUs = departUs + config.frameTimeUs;
+
+    if (nextUnit() < config.lossRate) {
+        counters.dropped++;
+        return true;
+    }
+
+    InFlight frame;
+    frame.dueUs = departUs + config.latencyUs;
+    if (config.jitterUs) {
+        frame.dueUs += nextRandom() % (config.jitterUs + 1);
+    }
+    if (nextUnit() < config.reorderRate) {
+        // Held back long enough for the following frames to overtake it
+        frame.dueUs += config.latencyUs + config.jitterUs + 1;
+        counters.reordered++;
+    }
+    frame.data.assign(data, data + length);
+    queue.push_back(frame);
+    return true;
+}
+
+// Take the next frame due at the given time
+bool SimulatedLink::poll(uint64_t nowUs, std::vector<uint8_t>& frame) {
+    size_t earliest = queue.size();
+    for (size_t i = 0; i < queue.size(); i++) {
+        if (queue[i].dueUs <= nowUs && (earliest == queue.size() || queue[i].dueUs < queue[earliest].dueUs)) {
+            earliest = i;
+        }
+    }
+    if (earliest == queue.size()) {
+        return false;
+    }
+    frame.swap(queue[earliest].data);
+    queue[earliest] = queue.back();
+    queue.pop_back();
+    counters.delivered++;
+    return true;
+}
+
+// Get the time the next frame becomes due
+uint64_t SimulatedLink::nextDelivery() const {
+    uint64_t due = 0;
+    for (size_t i = 0; i < queue.size(); i++) {
+        if (due == 0 || queue[i].dueUs < due) {
+            due = queue[i].dueUs;
+        }
+    }
+    return due;
+}
+
+// Get the largest frame the link carries
+size_t SimulatedLink::maxFrameSize() const {
+    return config.mtu - ATT_HEADER_SIZE;
+}
+
+// Get counters
+const SimulatedLink::Stats& SimulatedLink::stats() const {
+    return counters;
+}
+
+// Next pseudo-random number (xorshift32)
+uint32_t SimulatedLink::nextRandom() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Next pseudo-random number in [0, 1)
+double SimulatedLink::nextUnit() {
+    return (nextRandom() >> 8) / 16777216.0;
+}
@@ -0,0 +1,93 @@
+#ifndef SIMULATED_LINK_H
+#define SIMULATED_LINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/**
+ * SimulatedLink - One direction of a lossy BLE link on a virtual clock, for host benchmarks
+ *
+ * Frames are delivered after a latency with jitter, may be dropped, and may overtake
+ * each other; frames longer than the MTU allows are refused like the stack would.
+ * Nothing sleeps: the caller advances the clock with poll(), so a simulated second
+ * costs no wall-clock time. The random sequence depends only on the seed.
+ *
+ * Usage:
+ *   SimulatedLink::Config config;
+ *   config.lossRate = 0.02;
+ *   SimulatedLink link(config);
+ *   link.send(frame, length, nowUs);
+ *   while (link.poll(nowUs, frame)) process(frame);
+ */
+class SimulatedLink {
+public:
+    struct Config {
+        double lossRate = 0.0;        // Probability that a frame is dropped
+        double reorderRate = 0.0;     // Probability that a frame is held back by an extra latency
+        uint32_t latencyUs = 7500;    // One connection interval
+        uint32_t jitterUs = 0;        // Up to this much extra latency per frame
+        uint16_t mtu = 247;           // ATT MTU; frames carry at most mtu - 3 bytes
+        uint32_t frameTimeUs = 0;     // Airtime per frame, 0 for an unlimited link
+        uint32_t seed = 1;
+    };
+
+    // Counters since construction
+    struct Stats {
+        uint32_t sent = 0;
+        uint32_t dropped = 0;
+        uint32_t reordered = 0;
+        uint32_t refused = 0;         // Longer than the MTU allows
+        uint32_t delivered = 0;
+    };
+
+    explicit SimulatedLink(const Config& config);
+
+    /**
+     * Queue a frame for delivery
+     *
+     * @param data Frame data
+     * @param length Frame length
+     * @param nowUs Current virtual time
+     * @return false if the frame does not fit the MTU (a dropped frame still returns true)
+     */
+    bool send(const uint8_t* data, size_t length, uint64_t nowUs);
+
+    /**
+     * Take the next frame due at the given time
+     *
+     * @param nowUs Current virtual time
+     * @param frame Receives the frame data
+     * @return false if no frame is due yet
+     */
+    bool poll(uint64_t nowUs, std::vector<uint8_t>& frame);
+
+    /**
+     * Get the time the next frame becomes due, 0 if none is queued
+     */
+    uint64_t nextDelivery() const;
+
+    /**
+     * Get the largest frame the link carries
+     */
+    size_t maxFrameSize() const;
+
+    const Stats& stats() const;
+
+private:
+    struct InFlight {
+        uint64_t dueUs;
+        std::vector<uint8_t> data;
+    };
+
+    Config config;
+    Stats counters;
+    std::vector<InFlight> queue;    // Unordered, poll() picks the earliest due frame
+    uint64_t linkFreeUs;            // End of the airtime of the last frame sent
+    uint32_t state;                 // xorshift32
+
+    uint32_t nextRandom();
+    double nextUnit();
+};
+
+#endif // SIMULATED_LINK_H
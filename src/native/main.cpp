@@ -0,0 +1,807 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "../CRC32.h"
+#include "../ChunkAssembler.h"
+#include "../CBOR.h"
+#include "../Delta.h"
+#include "SimulatedLink.h"
+
+/**
+ * Host benchmarks of the protocol core - built by env:native-bench, no ESP32 needed
+ *
+ *   pio run -e native-bench && .pio/build/native-bench/program [fuzz-frames] [seed]
+ *
+ * Runs CRC32, chunking, reassembly, CBOR and delta micro-benchmarks, then whole transfers with
+ * selective retransmission and optional FEC parity over a SimulatedLink (loss,
+ * reordering, jitter, MTU), then
+ * feeds random and corrupt data frames to the receive path. The receive path mirrors
+ * Channel::processLargeChunk() on top of the same ChunkAssembler the firmware uses.
+ * Exits with 1 if any transfer, CBOR or delta round trip or fuzz check fails.
+ */
+
+// Data frame header of a large transfer, laid out like ChunkedBLEProtocol::LargeChunkHeader
+struct FrameHeader {
+    uint16_t transfer_id;
+    uint32_t chunk_num;
+    uint32_t chunk_crc32;
+} __attribute__((packed));
+
+// Receive report of the simulation: type, base chunk, then the NACK bitmap
+struct ReportHeader {
+    uint8_t type;
+    uint32_t base;
+} __attribute__((packed));
+
+const uint8_t REPORT_ACK = 0x03;          // FRAME_ACK
+const uint8_t REPORT_NACK = 0x04;         // FRAME_NACK
+const uint16_t TRANSFER_ID = 1;
+const size_t PAYLOAD_SIZE = 64 * 1024;
+const size_t MAX_NACK_BITMAP_BYTES = 64;
+const size_t STREAM_WINDOW = 16;
+const uint64_t REPORT_TIMEOUT_US = 100000;  // Sender probes again when no report arrives
+const double MIN_BENCH_SECONDS = 0.2;
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Next xorshift32 number (state must not be 0)
+uint32_t rng(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Deterministic payload, xorshift32 bytes
+std::vector<uint8_t> makePayload(size_t size, uint32_t seed) {
+    std::vector<uint8_t> payload(size);
+    uint32_t state = seed ? seed : 1;
+    for (size_t i = 0; i < size; i++) {
+        payload[i] = (uint8_t)rng(state);
+    }
+    return payload;
+}
+
+// Data bytes per frame for an ATT MTU
+size_t chunkSizeFor(size_t mtu) {
+    return mtu - 3 - sizeof(FrameHeader);
+}
+
+// Chunk count of a payload
+uint32_t chunkCount(size_t size, size_t chunkSize) {
+    return (uint32_t)((size + chunkSize - 1) / chunkSize);
+}
+
+// Build one data frame into a reused buffer, like Session::sendChunk()
+size_t buildFrame(uint8_t* frame, const uint8_t* payload, size_t size, size_t chunkSize,
+                  uint32_t chunkNum, uint32_t chunkCRC32) {
+    size_t offset = (size_t)(chunkNum - 1) * chunkSize;
+    size_t length = std::min(chunkSize, size - offset);
+    FrameHeader header;
+    header.transfer_id = TRANSFER_ID;
+    header.chunk_num = chunkNum;
+    header.chunk_crc32 = chunkCRC32;
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), payload + offset, length);
+    return sizeof(header) + length;
+}
+
+// Build a parity frame: numbered after the data chunks, always a full chunk long
+size_t buildParityFrame(uint8_t* frame, const std::vector<uint8_t>& parity, uint32_t chunkNum) {
+    FrameHeader header;
+    header.transfer_id = TRANSFER_ID;
+    header.chunk_num = chunkNum;
+    header.chunk_crc32 = CRC32::calculate(parity.data(), parity.size());
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), parity.data(), parity.size());
+    return sizeof(header) + parity.size();
+}
+
+// XOR parity of every group of fecGroup chunks
+std::vector<std::vector<uint8_t> > parityChunks(const std::vector<uint8_t>& payload, size_t chunkSize, uint32_t fecGroup) {
+    uint32_t chunks = chunkCount(payload.size(), chunkSize);
+    std::vector<std::vector<uint8_t> > parity((chunks + fecGroup - 1) / fecGroup, std::vector<uint8_t>(chunkSize));
+    for (uint32_t i = 0; i < chunks; i++) {
+        size_t offset = (size_t)i * chunkSize;
+        ChunkAssembler::addParity(parity[i / fecGroup].data(), &payload[offset], std::min(chunkSize, payload.size() - offset));
+    }
+    return parity;
+}
+
+// First round of a transfer in the order Session::sendChunkRange() sends it: each group's
+// parity after the group, the last group's ahead of the last chunk (none if that is alone)
+std::vector<uint32_t> firstRound(uint32_t chunks, uint32_t fecGroup) {
+    std::vector<uint32_t> round;
+    for (uint32_t chunkNum = 1; chunkNum <= chunks; chunkNum++) {
+        uint32_t parityNum = chunks + (chunkNum - 1) / (fecGroup ? fecGroup : 1) + 1;
+        if (fecGroup && chunkNum == chunks && (chunkNum - 1) % fecGroup != 0) {
+            round.push_back(parityNum);
+        }
+        round.push_back(chunkNum);
+        if (fecGroup && chunkNum != chunks && chunkNum % fecGroup == 0) {
+            round.push_back(parityNum);
+        }
+    }
+    return round;
+}
+
+// CRC32 of every chunk, computed once per transfer like Session::sendData()
+std::vector<uint32_t> chunkCRCs(const std::vector<uint8_t>& payload, size_t chunkSize) {
+    uint32_t chunks = chunkCount(payload.size(), chunkSize);
+    std::vector<uint32_t> crcs(chunks);
+    for (uint32_t i = 0; i < chunks; i++) {
+        size_t offset = (size_t)i * chunkSize;
+        crcs[i] = CRC32::calculate(&payload[offset], std::min(chunkSize, payload.size() - offset));
+    }
+    return crcs;
+}
+
+/**
+ * Receiver - Receive path of one channel: frame validation and reassembly
+ */
+class Receiver {
+public:
+    uint32_t expectedGlobalCRC32;
+    uint32_t reportPoint;         // Chunk number that triggers the next report
+    uint32_t parityFrames;        // Parity chunk numbers after the data chunks, 0 without FEC
+    uint32_t rejected;            // Short, foreign or corrupt frames
+    uint32_t stored;
+    uint32_t duplicates;
+    uint32_t streamCRC32;         // CRC32 of the delivered data, computed the slow way
+    size_t streamBytes;
+    ChunkAssembler assembler;
+
+    Receiver() : expectedGlobalCRC32(0), reportPoint(0), parityFrames(0), rejected(0), stored(0), duplicates(0),
+                 streamCRC32(0), streamBytes(0) {
+    }
+
+    void begin(uint32_t chunks, uint32_t globalCRC32, size_t totalLength, size_t chunkSize, bool streaming,
+               uint32_t fecGroup = 0) {
+        expectedGlobalCRC32 = globalCRC32;
+        reportPoint = chunks;
+        // Streaming receivers drop the parity, like Channel::processOpenFrame()
+        if (streaming) {
+            fecGroup = 0;
+        }
+        parityFrames = fecGroup ? (chunks + fecGroup - 1) / fecGroup : 0;
+        streamCRC32 = 0;
+        streamBytes = 0;
+        assembler.clear(0);
+        if (streaming) {
+            assembler.begin(chunks, STREAM_WINDOW, STREAM_WINDOW * chunkSize, [this](const uint8_t* data, size_t length) {
+                streamCRC32 = CRC32::update(streamCRC32, data, length);
+                streamBytes += length;
+            });
+        } else {
+            assembler.begin(chunks, 0, totalLength);
+        }
+        if (chunkSize) {
+            assembler.setStride(chunkSize, totalLength);
+        }
+        if (fecGroup) {
+            assembler.setParity(fecGroup);
+        }
+    }
+
+    // Validate and store a data frame, true if a report is due
+    bool processFrame(const uint8_t* data, size_t length) {
+        if (length <= sizeof(FrameHeader)) {
+            rejected++;
+            return false;
+        }
+        FrameHeader header;
+        memcpy(&header, data, sizeof(header));
+        const uint8_t* chunkData = data + sizeof(header);
+        size_t dataSize = length - sizeof(header);
+        if (header.transfer_id != TRANSFER_ID || CRC32::calculate(chunkData, dataSize) != header.chunk_crc32) {
+            rejected++;
+            return false;
+        }
+        uint32_t chunks = assembler.totalChunks();
+        if (header.chunk_num == 0 || header.chunk_num > chunks + parityFrames) {
+            rejected++;
+            return false;
+        }
+        bool parity = header.chunk_num > chunks;
+        ChunkAssembler::StoreResult result = parity
+            ? assembler.storeParity(header.chunk_num - chunks - 1, chunkData, dataSize)
+            : assembler.store(header.chunk_num, chunkData, dataSize, header.chunk_crc32);
+        if (result == ChunkAssembler::STORE_OK) {
+            stored++;
+        } else if (result == ChunkAssembler::STORE_DUPLICATE) {
+            duplicates++;
+        } else {
+            rejected++;
+        }
+        return assembler.isComplete() || (!parity && header.chunk_num >= reportPoint);
+    }
+
+    // ACK or NACK of the current state, like Channel::sendNack()
+    size_t buildReport(uint8_t* frame, size_t maxLength) {
+        ReportHeader header;
+        size_t bitmapLength = 0;
+        if (assembler.isComplete()) {
+            header.type = REPORT_ACK;
+            header.base = 0;
+        } else {
+            int base;
+            int highest;
+            size_t capacity = std::min(maxLength - sizeof(header), MAX_NACK_BITMAP_BYTES);
+            assembler.missingChunks(frame + sizeof(header), capacity, base, highest, bitmapLength);
+            header.type = REPORT_NACK;
+            header.base = base;
+            reportPoint = highest;
+        }
+        memcpy(frame, &header, sizeof(header));
+        return sizeof(header) + bitmapLength;
+    }
+
+    // Check the assembled data the slow way
+    bool verify(const std::vector<uint8_t>& payload) {
+        if (!assembler.isComplete() || assembler.globalCRC32() != expectedGlobalCRC32) {
+            return false;
+        }
+        if (assembler.windowed()) {
+            return streamBytes == payload.size() && streamCRC32 == expectedGlobalCRC32;
+        }
+        const std::string& data = assembler.data();
+        return data.size() == payload.size() && memcmp(data.data(), payload.data(), data.size()) == 0;
+    }
+};
+
+// CRC32 throughput and combine cost
+void benchCRC32() {
+    printf("=== CRC32 (%s) ===\n", CRC32::backendName());
+    if (!CRC32::selfTest()) {
+        printf("[ERROR] CRC32 self-test failed\n");
+        exit(1);
+    }
+    std::vector<uint8_t> payload = makePayload(PAYLOAD_SIZE, 1);
+    const size_t sizes[] = {20, 244, 4096, PAYLOAD_SIZE};
+    for (size_t size : sizes) {
+        uint32_t crc = 0;
+        size_t bytes = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed;
+        do {
+            for (int i = 0; i < 64; i++) {
+                crc += CRC32::calculate(payload.data(), size);
+                bytes += size;
+            }
+        } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+        printf("calculate %6u B: %8.1f MB/s (0x%08X)\n", (unsigned)size, bytes / elapsed / 1e6, crc);
+    }
+
+    uint32_t op = CRC32::combineOperator(244);
+    uint32_t crc = 0;
+    size_t combines = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed;
+    do {
+        for (int i = 0; i < 1024; i++) {
+            crc = CRC32::combine(crc, (uint32_t)i, 244);
+        }
+        combines += 1024;
+    } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+    printf("combine:              %8.2f M/s (0x%08X)\n", combines / elapsed / 1e6, crc);
+
+    combines = 0;
+    start = Clock::now();
+    do {
+        for (int i = 0; i < 1024; i++) {
+            crc = CRC32::combineWithOperator(crc, (uint32_t)i, op);
+        }
+        combines += 1024;
+    } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+    printf("combineWithOperator:  %8.2f M/s (0x%08X)\n", combines / elapsed / 1e6, crc);
+}
+
+// Framing cost of the sender: chunk CRC32s up front, then one frame per chunk
+void benchChunking() {
+    printf("\n=== Chunking %u B ===\n", (unsigned)PAYLOAD_SIZE);
+    std::vector<uint8_t> payload = makePayload(PAYLOAD_SIZE, 2);
+    const size_t mtus[] = {23, 247, 517};
+    std::vector<uint8_t> frame(517);
+    for (size_t mtu : mtus) {
+        size_t chunkSize = chunkSizeFor(mtu);
+        uint32_t chunks = chunkCount(payload.size(), chunkSize);
+        size_t frames = 0;
+        size_t checksum = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed;
+        do {
+            std::vector<uint32_t> crcs = chunkCRCs(payload, chunkSize);
+            for (uint32_t chunkNum = 1; chunkNum <= chunks; chunkNum++) {
+                checksum += buildFrame(frame.data(), payload.data(), payload.size(), chunkSize, chunkNum, crcs[chunkNum - 1]);
+            }
+            frames += chunks;
+        } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+        printf("MTU %3u: %9.0f frames/s, %8.1f MB/s (%u)\n", (unsigned)mtu, frames / elapsed,
+               frames * (double)chunkSize / elapsed / 1e6, (unsigned)(checksum & 0xFFFF));
+    }
+}
+
+// Receive cost per frame: validation, copy to the offset, global CRC32 from the chunk CRC32s
+bool benchReassembly() {
+    printf("\n=== Reassembly %u B, MTU 247 ===\n", (unsigned)PAYLOAD_SIZE);
+    std::vector<uint8_t> payload = makePayload(PAYLOAD_SIZE, 3);
+    size_t chunkSize = chunkSizeFor(247);
+    uint32_t chunks = chunkCount(payload.size(), chunkSize);
+    std::vector<uint32_t> crcs = chunkCRCs(payload, chunkSize);
+    uint32_t globalCRC32 = CRC32::calculate(payload.data(), payload.size());
+
+    // Every frame built once, the loop measures only the receive side
+    std::vector<std::vector<uint8_t> > frames(chunks, std::vector<uint8_t>(chunkSize + sizeof(FrameHeader)));
+    for (uint32_t i = 0; i < chunks; i++) {
+        frames[i].resize(buildFrame(frames[i].data(), payload.data(), payload.size(), chunkSize, i + 1, crcs[i]));
+    }
+    std::vector<uint32_t> inOrder(chunks);
+    for (uint32_t i = 0; i < chunks; i++) {
+        inOrder[i] = i;
+    }
+    std::vector<uint32_t> shuffled(inOrder);
+    uint32_t state = 7;
+    for (uint32_t i = chunks - 1; i > 0; i--) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        std::swap(shuffled[i], shuffled[state % (i + 1)]);
+    }
+
+    struct Case {
+        const char* name;
+        const std::vector<uint32_t>* order;
+        bool streaming;
+    };
+    const Case cases[] = {
+        {"buffered, in order", &inOrder, false},
+        {"buffered, shuffled", &shuffled, false},
+        {"windowed, in order", &inOrder, true},
+    };
+
+    bool ok = true;
+    Receiver receiver;
+    for (const Case& c : cases) {
+        size_t received = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed;
+        do {
+            receiver.begin(chunks, globalCRC32, 0, 0, c.streaming);
+            for (uint32_t index : *c.order) {
+                receiver.processFrame(frames[index].data(), frames[index].size());
+            }
+            ok = ok && receiver.verify(payload);
+            received += chunks;
+        } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+        printf("%-20s %9.0f frames/s, %8.1f MB/s%s\n", c.name, received / elapsed,
+               received * (double)chunkSize / elapsed / 1e6, ok ? "" : " - FAILED");
+    }
+    return ok;
+}
+
+/**
+ * Transfer - One payload sent over a pair of SimulatedLinks with selective retransmission
+ *
+ * The sender sends every chunk, the receiver reports (ACK or NACK) when a round reaches its
+ * report point, and the sender retransmits what the NACK lists. A lost report is recovered
+ * by resending the round's last chunk after REPORT_TIMEOUT_US, which triggers it again.
+ */
+struct TransferResult {
+    bool ok;
+    uint32_t frames;
+    uint32_t rounds;
+    uint32_t recovered;       // Chunks the receiver rebuilt from parity
+    uint64_t durationUs;
+};
+
+TransferResult runTransfer(const std::vector<uint8_t>& payload, const SimulatedLink::Config& config, bool streaming,
+                           uint32_t fecGroup) {
+    SimulatedLink::Config reverseConfig = config;
+    reverseConfig.seed = config.seed * 2654435761u;
+    SimulatedLink downlink(config);
+    SimulatedLink uplink(reverseConfig);
+
+    size_t chunkSize = chunkSizeFor(config.mtu);
+    uint32_t chunks = chunkCount(payload.size(), chunkSize);
+    std::vector<uint32_t> crcs = chunkCRCs(payload, chunkSize);
+    uint32_t globalCRC32 = CRC32::calculate(payload.data(), payload.size());
+    std::vector<std::vector<uint8_t> > parity;
+    if (fecGroup) {
+        parity = parityChunks(payload, chunkSize, fecGroup);
+    }
+
+    // FRAME_OPEN is not simulated, its chunk size, length and FEC group are known up front
+    Receiver receiver;
+    receiver.begin(chunks, globalCRC32, payload.size(), chunkSize, streaming, fecGroup);
+
+    TransferResult result = {false, 0, 0, 0, 0};
+    std::vector<uint8_t> frame(downlink.maxFrameSize());
+    std::vector<uint8_t> incoming;
+    std::vector<uint32_t> round = firstRound(chunks, fecGroup);
+
+    uint64_t now = 0;
+    uint64_t lastActivity = 0;
+    const uint64_t giveUpUs = 600ull * 1000000;
+    while (now < giveUpUs) {
+        // Send the round
+        for (uint32_t chunkNum : round) {
+            size_t length = chunkNum > chunks
+                ? buildParityFrame(frame.data(), parity[chunkNum - chunks - 1], chunkNum)
+                : buildFrame(frame.data(), payload.data(), payload.size(), chunkSize, chunkNum, crcs[chunkNum - 1]);
+            downlink.send(frame.data(), length, now);
+            result.frames++;
+        }
+        result.rounds++;
+        uint32_t lastSent = round.back();
+        round.clear();
+        lastActivity = now;
+
+        // Run the clock until a report tells the sender what to do
+        bool reported = false;
+        while (!reported) {
+            uint64_t next = std::min(downlink.nextDelivery() ? downlink.nextDelivery() : UINT64_MAX,
+                                     uplink.nextDelivery() ? uplink.nextDelivery() : UINT64_MAX);
+            if (next == UINT64_MAX) {
+                // Nothing in flight, the report was lost
+                now = std::max(now, lastActivity + REPORT_TIMEOUT_US);
+                round.push_back(lastSent);
+                break;
+            }
+            now = std::max(now, next);
+            while (downlink.poll(now, incoming)) {
+                if (receiver.processFrame(incoming.data(), incoming.size())) {
+                    size_t length = receiver.buildReport(frame.data(), uplink.maxFrameSize());
+                    uplink.send(frame.data(), length, now);
+                }
+                lastActivity = now;
+            }
+            while (uplink.poll(now, incoming)) {
+                ReportHeader header;
+                memcpy(&header, incoming.data(), sizeof(header));
+                if (header.type == REPORT_ACK) {
+                    result.ok = receiver.verify(payload);
+                    result.recovered = receiver.assembler.recoveredChunks();
+                    result.durationUs = now;
+                    return result;
+                }
+                // Bit i of the bitmap is chunk base + i
+                for (size_t bit = 0; bit < (incoming.size() - sizeof(header)) * 8; bit++) {
+                    if ((incoming[sizeof(header) + bit / 8] >> (bit % 8)) & 1) {
+                        round.push_back(header.base + (uint32_t)bit);
+                    }
+                }
+                reported = !round.empty();
+                lastActivity = now;
+            }
+        }
+    }
+    result.durationUs = now;
+    return result;
+}
+
+// Whole transfers over lossy links
+bool simulateTransfers() {
+    printf("\n=== Simulated transfers %u B ===\n", (unsigned)PAYLOAD_SIZE);
+    struct Scenario {
+        const char* name;
+        double loss;
+        double reorder;
+        uint32_t jitterUs;
+        uint16_t mtu;
+        bool streaming;
+        uint32_t fecGroup;
+    };
+    const Scenario scenarios[] = {
+        {"clean, MTU 23", 0.0, 0.0, 0, 23, false, 0},
+        {"clean, MTU 247", 0.0, 0.0, 0, 247, false, 0},
+        {"clean, MTU 517", 0.0, 0.0, 0, 517, false, 0},
+        {"1% loss", 0.01, 0.0, 2000, 247, false, 0},
+        {"1% loss, FEC 16", 0.01, 0.0, 2000, 247, false, 16},
+        {"5% loss, 5% reorder", 0.05, 0.05, 5000, 247, false, 0},
+        {"5% loss, FEC 8", 0.05, 0.05, 5000, 247, false, 8},
+        {"20% loss", 0.20, 0.02, 5000, 247, false, 0},
+        {"20% loss, FEC 4", 0.20, 0.02, 5000, 247, false, 4},
+        {"5% loss, streaming", 0.05, 0.05, 5000, 247, true, 0},
+    };
+
+    std::vector<uint8_t> payload = makePayload(PAYLOAD_SIZE, 4);
+    bool ok = true;
+    for (const Scenario& scenario : scenarios) {
+        SimulatedLink::Config config;
+        config.lossRate = scenario.loss;
+        config.reorderRate = scenario.reorder;
+        config.jitterUs = scenario.jitterUs;
+        config.mtu = scenario.mtu;
+        // Roughly one frame on LE 2M: 4 us per byte with link-layer overhead, plus the inter-frame space
+        config.frameTimeUs = (scenario.mtu + 14) * 4 + 150;
+        config.seed = 0x9E3779B9u ^ scenario.mtu;
+
+        Clock::time_point start = Clock::now();
+        TransferResult result = runTransfer(payload, config, scenario.streaming, scenario.fecGroup);
+        double wall = secondsSince(start);
+        ok = ok && result.ok;
+        printf("%-24s %5u frames, %3u rounds, %4u rebuilt, %8.1f ms simulated, %7.1f KB/s, %6.2f ms wall%s\n",
+               scenario.name, result.frames, result.rounds, result.recovered, result.durationUs / 1000.0,
+               result.durationUs ? payload.size() / (result.durationUs / 1e6) / 1024.0 : 0.0,
+               wall * 1000.0, result.ok ? "" : " - FAILED");
+    }
+    return ok;
+}
+
+// Random, corrupt and conflicting frames against the receive path
+bool fuzz(uint64_t frames, uint32_t seed) {
+    printf("\n=== Fuzz, %llu frames ===\n", (unsigned long long)frames);
+    uint32_t state = seed ? seed : 1;
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    };
+
+    std::vector<uint8_t> payload = makePayload(PAYLOAD_SIZE, seed);
+    std::vector<uint8_t> frame(517);
+    Receiver receiver;
+    size_t chunkSize = 0;
+    uint32_t chunks = 0;
+    uint32_t transfers = 0;
+    uint32_t completed = 0;
+    uint32_t failures = 0;
+
+    Clock::time_point start = Clock::now();
+    for (uint64_t n = 0; n < frames; n++) {
+        // A new transfer now and then, sized and framed at random
+        if (chunks == 0 || next() % 4096 == 0) {
+            chunkSize = 1 + next() % 500;
+            size_t size = 1 + next() % PAYLOAD_SIZE;
+            chunks = chunkCount(size, chunkSize);
+            bool announced = next() & 1;
+            uint32_t fecGroup = announced && next() % 2 ? 1 + next() % 16 : 0;
+            receiver.begin(chunks, next(), announced ? size : 0, announced ? chunkSize : 0, next() & 1, fecGroup);
+            transfers++;
+        }
+
+        // Parity chunks carry arbitrary data, whatever they rebuild must still match its CRC32
+        uint32_t chunkNum = 1 + next() % (chunks + receiver.parityFrames + 1);
+        if (next() % 64 == 0) {
+            chunkNum = next();
+        }
+        size_t offset = (size_t)(chunkNum - 1) * chunkSize % PAYLOAD_SIZE;
+        size_t length = chunkSize;
+        if (next() % 8 == 0) {
+            length = next() % (frame.size() - sizeof(FrameHeader));
+        }
+        length = std::min(length, PAYLOAD_SIZE - offset);
+
+        FrameHeader header;
+        header.transfer_id = next() % 32 ? TRANSFER_ID : (uint16_t)next();
+        header.chunk_num = chunkNum;
+        header.chunk_crc32 = CRC32::calculate(payload.data() + offset, length);
+        memcpy(frame.data(), &header, sizeof(header));
+        memcpy(frame.data() + sizeof(header), payload.data() + offset, length);
+        size_t frameLength = sizeof(header) + length;
+        switch (next() % 16) {
+            case 0:
+                frame[next() % frameLength] ^= 1 << (next() % 8);   // Bit error
+                break;
+            case 1:
+                frameLength = next() % (sizeof(header) + 1);        // Truncated
+                break;
+            default:
+                break;
+        }
+        receiver.processFrame(frame.data(), frameLength);
+
+        if (receiver.assembler.isComplete()) {
+            // The combined CRC32 must match the data actually assembled or delivered
+            uint32_t combined = receiver.assembler.globalCRC32();
+            uint32_t actual = receiver.assembler.windowed()
+                ? receiver.streamCRC32
+                : CRC32::calculate((const uint8_t*)receiver.assembler.data().data(), receiver.assembler.data().size());
+            size_t bytes = receiver.assembler.windowed() ? receiver.streamBytes : receiver.assembler.data().size();
+            if (combined != actual || bytes != receiver.assembler.length()) {
+                failures++;
+                printf("[ERROR] Transfer %u: combined CRC32 0x%08X, data 0x%08X (%u/%u bytes)\n", transfers,
+                       combined, actual, (unsigned)bytes, (unsigned)receiver.assembler.length());
+            }
+            completed++;
+            chunks = 0;
+        }
+    }
+    double elapsed = secondsSince(start);
+    printf("%.2f M frames/s, %u transfers, %u completed, %u rejected, %u duplicates, %u failures\n",
+           frames / elapsed / 1e6, transfers, completed, receiver.rejected, receiver.duplicates, failures);
+    return failures == 0;
+}
+
+// JSON document like the ones apps send: an array of sensor records
+std::string makeJSON(size_t records) {
+    std::string json = "{\"device\":\"BLE-Chunked\",\"firmware\":\"1.4.2\",\"readings\":[";
+    char record[160];
+    uint32_t state = 7;
+    for (size_t i = 0; i < records; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        snprintf(record, sizeof(record),
+                 "%s{\"id\":%u,\"timestamp\":%u,\"temperature\":%.1f,\"humidity\":%u,\"ok\":%s,\"label\":\"sensor-%u\"}",
+                 i ? "," : "", (unsigned)i, 1700000000u + (unsigned)i * 60, (int)(state % 600) / 10.0 - 10.0,
+                 (unsigned)(state >> 8) % 100, state & 1 ? "true" : "false", (unsigned)(state >> 16) % 16);
+        json += record;
+    }
+    json += "]}";
+    return json;
+}
+
+// JSON to CBOR and back: encode and decode rates, size, and a round trip through the Reader
+bool benchCBOR() {
+    std::string json = makeJSON(500);
+    printf("\n=== CBOR %u B of JSON ===\n", (unsigned)json.size());
+    std::string cbor;
+    if (!CBOR::fromJSON(json.data(), json.size(), cbor)) {
+        printf("[ERROR] JSON not encoded\n");
+        return false;
+    }
+
+    size_t bytes = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed;
+    do {
+        std::string out;
+        CBOR::fromJSON(json.data(), json.size(), out);
+        bytes += json.size();
+    } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+    printf("fromJSON: %8.1f MB/s of JSON, %u B of CBOR (%.0f%%)\n", bytes / elapsed / 1e6,
+           (unsigned)cbor.size(), 100.0 * cbor.size() / json.size());
+
+    std::string decoded;
+    bytes = 0;
+    start = Clock::now();
+    do {
+        CBOR::toJSON((const uint8_t*)cbor.data(), cbor.size(), decoded);
+        bytes += cbor.size();
+    } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+    printf("toJSON:   %8.1f MB/s of CBOR\n", bytes / elapsed / 1e6);
+
+    // The decoded text encodes to the same CBOR, and the Reader takes it one byte at a time
+    std::string again;
+    bool ok = CBOR::toJSON((const uint8_t*)cbor.data(), cbor.size(), decoded) &&
+        CBOR::fromJSON(decoded.data(), decoded.size(), again) && again == cbor;
+    CBOR::Reader reader;
+    reader.begin();
+    size_t items = 0;
+    for (size_t i = 0; i < cbor.size() && ok; i++) {
+        ok = reader.feed((const uint8_t*)cbor.data() + i, 1, [&items](const CBOR::Item&) { items++; });
+    }
+    ok = ok && reader.isFinished();
+    printf("Round trip %s, %u items read byte by byte\n", ok ? "passed" : "FAILED", (unsigned)items);
+    return ok;
+}
+
+// Nesting at and beyond CBOR::MAX_DEPTH, then corrupted encodings: refused or decoded, never out of bounds
+bool fuzzCBOR(uint64_t rounds, uint32_t seed) {
+    printf("\n=== CBOR limits and %llu corrupted encodings ===\n", (unsigned long long)rounds);
+    const uint8_t containers[][2] = {{0x81, 0}, {0x9F, 0}, {0xA1, 0x01}, {0xBF, 0x01}};  // Head and key per level
+    bool ok = true;
+    for (size_t c = 0; c < sizeof(containers) / sizeof(containers[0]); c++) {
+        for (size_t levels = CBOR::MAX_DEPTH; levels <= CBOR::MAX_DEPTH + 1; levels++) {
+            std::string cbor;
+            for (size_t i = 0; i < levels; i++) {
+                cbor.push_back((char)containers[c][0]);
+                if (containers[c][1]) {
+                    cbor.push_back((char)containers[c][1]);
+                }
+            }
+            cbor.push_back(0x01);
+            for (size_t i = 0; i < levels; i++) {
+                if (containers[c][0] == 0x9F || containers[c][0] == 0xBF) {
+                    cbor.push_back((char)0xFF);
+                }
+            }
+            std::string json;
+            bool decoded = CBOR::toJSON((const uint8_t*)cbor.data(), cbor.size(), json);
+            if (decoded != (levels == CBOR::MAX_DEPTH)) {
+                printf("[ERROR] %u levels of 0x%02X %s\n", (unsigned)levels, containers[c][0],
+                       decoded ? "decoded" : "refused");
+                ok = false;
+            }
+        }
+    }
+
+    // Mutations of a valid document: flipped, inserted and deleted bytes, cut at random points
+    std::string valid;
+    std::string json = makeJSON(20);
+    CBOR::fromJSON(json.data(), json.size(), valid);
+    uint32_t state = seed ? seed : 1;
+    uint64_t decoded = 0;
+    for (uint64_t round = 0; round < rounds; round++) {
+        std::string cbor = valid;
+        for (int edits = 1 + rng(state) % 8; edits > 0; edits--) {
+            size_t at = rng(state) % cbor.size();
+            switch (rng(state) % 4) {
+                case 0: cbor[at] = (char)rng(state); break;
+                case 1: cbor.insert(at, 1, (char)(0x80 + rng(state) % 0x80)); break;
+                case 2: cbor.erase(at, 1 + rng(state) % 4); break;
+                default: cbor.resize(at); break;
+            }
+            if (cbor.empty()) {
+                cbor.push_back((char)rng(state));
+            }
+        }
+        std::string out;
+        decoded += CBOR::toJSON((const uint8_t*)cbor.data(), cbor.size(), out);
+    }
+    printf("%llu decoded, %llu refused\n", (unsigned long long)decoded, (unsigned long long)(rounds - decoded));
+    printf("Limits %s\n", ok ? "passed" : "FAILED");
+    return ok;
+}
+
+// Patches of a synced document after a few edits: size, encode and apply rates, round trip
+bool benchDelta() {
+    std::string base = makeJSON(200);
+    std::string edited = base;
+    edited.replace(edited.find("\"temperature\":") + 14, 4, "21.5");   // Same length
+    edited.insert(edited.size() / 2, ",\"note\":\"calibrated\"");       // Insertion
+    edited.erase(edited.size() * 3 / 4, 40);                              // Deletion
+    printf("\n=== Delta %u B document, 3 edits ===\n", (unsigned)edited.size());
+
+    std::string patch;
+    if (!Delta::encode((const uint8_t*)base.data(), base.size(), (const uint8_t*)edited.data(), edited.size(), patch)) {
+        printf("[ERROR] Edited document not encoded\n");
+        return false;
+    }
+    size_t bytes = 0;
+    Clock::time_point start = Clock::now();
+    double elapsed;
+    do {
+        std::string out;
+        Delta::encode((const uint8_t*)base.data(), base.size(), (const uint8_t*)edited.data(), edited.size(), out);
+        bytes += edited.size();
+    } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+    printf("encode: %8.1f MB/s, %u B patch (%.1fx smaller)\n", bytes / elapsed / 1e6, (unsigned)patch.size(),
+           (double)edited.size() / patch.size());
+
+    std::string result;
+    bytes = 0;
+    start = Clock::now();
+    do {
+        Delta::apply((const uint8_t*)base.data(), base.size(), (const uint8_t*)patch.data(), patch.size(),
+                     result, edited.size());
+        bytes += result.size();
+    } while ((elapsed = secondsSince(start)) < MIN_BENCH_SECONDS);
+    printf("apply:  %8.1f MB/s\n", bytes / elapsed / 1e6);
+
+    // The patch rebuilds the document and nothing else, truncated patches are refused
+    bool ok = Delta::apply((const uint8_t*)base.data(), base.size(), (const uint8_t*)patch.data(), patch.size(),
+                           result, edited.size()) && result == edited;
+    for (size_t length = 0; length < patch.size() && ok; length++) {
+        ok = !Delta::apply((const uint8_t*)base.data(), base.size(), (const uint8_t*)patch.data(), length,
+                           result, edited.size());
+    }
+    printf("Round trip %s\n", ok ? "passed" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint64_t fuzzFrames = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000000;
+    uint32_t seed = argc > 2 ? (uint32_t)strtoul(argv[2], nullptr, 10) : 1;
+
+    benchCRC32();
+    benchChunking();
+    bool ok = benchReassembly();
+    ok = benchCBOR() && ok;
+    ok = fuzzCBOR(fuzzFrames / 100 + 1, seed) && ok;
+    ok = benchDelta() && ok;
+    ok = simulateTransfers() && ok;
+    ok = fuzz(fuzzFrames, seed) && ok;
+    printf("\n%s\n", ok ? "All checks passed" : "FAILED");
+    return ok ? 0 : 1;
+}